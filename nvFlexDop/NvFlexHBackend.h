@@ -0,0 +1,297 @@
+#pragma once
+#include <NvFlex.h>
+#include <../core/maths.h>
+
+#include <string>
+
+
+class NvFlexHCollisionData; //fwd decl
+class NvFlexHProfiler; //fwd decl
+class NvFlexHBackend; //fwd decl
+
+/// particles a new container has buffers for. small scenes should not pay for the whole maxParticles
+const int NVFLEXH_INITIAL_CAPACITY = 4096;
+
+/// capacity a container grows to so it holds count particles: doubling, clamped to maxParticles
+inline int nvFlexHGrownCapacity(int capacity, int count, int maxParticles) {
+	int newcap = capacity > 0 ? capacity : 1;
+	while (newcap < count && newcap < maxParticles)newcap = newcap > maxParticles / 2 ? maxParticles : newcap * 2;
+	return newcap;
+}
+
+
+/// Particle buffers of a container while they are mapped on host. Same layout as NvFlexExtParticleData.
+struct NvFlexHParticleData {
+	float* particles;     //x, y, z, inverse mass
+	float* restParticles; //x, y, z, 1
+	float* velocities;    //x, y, z
+	int* phases;
+	float* normals;       //x, y, z, w
+
+	NvFlexHParticleData() :particles(NULL), restParticles(NULL), velocities(NULL), phases(NULL), normals(NULL) {}
+};
+
+/// Diffuse (foam, spray, bubble) particles flex spawns from fluid by itself. Read only, they live on device.
+struct NvFlexHDiffuseData {
+	float* positions;  //x, y, z, remaining lifetime
+	float* velocities; //x, y, z, w
+	int count;
+
+	NvFlexHDiffuseData() :positions(NULL), velocities(NULL), count(0) {}
+};
+
+/// Surfacing channels of fluid particles, by particle index like NvFlexHParticleData. NULL if not pulled.
+struct NvFlexHSurfaceData {
+	float* smoothParticles; //x, y, z, w, positions after laplacian smoothing
+	float* anisotropy[3];   //x, y, z unit axis of particle's ellipsoid, w scale along it
+
+	NvFlexHSurfaceData() :smoothParticles(NULL) { anisotropy[0] = anisotropy[1] = anisotropy[2] = NULL; }
+};
+
+/// Neighbour density and particle-shape contacts of the last tick, by particle index. NULL if not pulled.
+/// Contacts of particle i are planes/velocities [indices[i] * maxContactsPerParticle, + counts[indices[i]])
+struct NvFlexHContactData {
+	float* densities;
+	float* planes;         //x, y, z contact normal, w plane distance
+	float* velocities;     //x, y, z velocity of the shape, w shape index
+	int* indices;
+	unsigned int* counts;
+	int maxContactsPerParticle;
+
+	NvFlexHContactData() :densities(NULL), planes(NULL), velocities(NULL), indices(NULL), counts(NULL), maxContactsPerParticle(0) {}
+};
+
+/// Shape matching clusters (rigid and soft bodies), same layout flex takes. particles of cluster r are
+/// indices[offsets[r], offsets[r + 1]), restPositions are theirs relative to the cluster center at rest
+struct NvFlexHRigidData {
+	int* offsets;          //rigid count + 1
+	int* indices;
+	float* restPositions;  //x, y, z
+	float* restNormals;    //x, y, z direction out of the cluster, w signed distance to its surface
+	float* stiffness;      //0..1, 1 is rigid
+	float* thresholds;     //plastic deformation threshold, 0 never deforms for good
+	float* creeps;         //part of the deformation over threshold that goes into rest positions
+	float* rotations;      //x, y, z, w
+	float* translations;   //x, y, z, cluster center
+
+	NvFlexHRigidData() :offsets(NULL), indices(NULL), restPositions(NULL), restNormals(NULL), stiffness(NULL), thresholds(NULL), creeps(NULL), rotations(NULL), translations(NULL) {}
+};
+
+/// Cluster transforms solved in the last tick, by rigid index. rest positions rotated and moved by them give the goal shape
+struct NvFlexHRigidTransforms {
+	float* rotations;    //x, y, z, w
+	float* translations; //x, y, z
+	int count;
+
+	NvFlexHRigidTransforms() :rotations(NULL), translations(NULL), count(0) {}
+};
+
+/// Closed triangle meshes that keep their volume. inflatable i is dynamic triangles [startTris[i], startTris[i] + numTris[i])
+struct NvFlexHInflatableData {
+	int* startTris;
+	int* numTris;
+	float* restVolumes;
+	float* overPressures;    //volume the mesh is pushed to, times rest volume
+	float* constraintScales; //0..1 stiffness of the volume constraint
+
+	NvFlexHInflatableData() :startTris(NULL), numTris(NULL), restVolumes(NULL), overPressures(NULL), constraintScales(NULL) {}
+};
+
+typedef struct NvFlexHSpringData {
+	int* const springIds;
+	float* const springRls;
+	float* const springSts;
+
+	NvFlexHSpringData(int*sid, float*srl, float*sts) :springIds(sid), springRls(srl), springSts(sts) {}
+} NvFlexHSpringData;
+
+typedef struct NvFlexHTriangleData {
+	int* const triangleIds;
+	float* const triangleNms;
+
+	NvFlexHTriangleData(int*tid, float*tnm) :triangleIds(tid), triangleNms(tnm) {}
+} NvFlexHTriangleData;
+
+
+/// Buffers of a collision triangle mesh while they are mapped on host. triangles is NULL when the mesh keeps the ones it had
+struct NvFlexHTriangleMeshData {
+	Vec3* vertices;
+	int* triangles; //3 per triangle
+
+	NvFlexHTriangleMeshData() :vertices(NULL), triangles(NULL) {}
+};
+
+
+/// Solver + particle container of some backend. Everything SIM_NvFlexSolver does with the simulation goes through here.
+/// Data is mapped on host, filled, unmapped and then pushed, same as with NvFlexExt containers.
+/// Containers start with room for NVFLEXH_INITIAL_CAPACITY particles and grow on reserve, up to maxParticles.
+class NvFlexHContainer {
+public:
+	virtual ~NvFlexHContainer() {}
+
+	virtual NvFlexHBackend* backend()const = 0;
+
+	/// hard limit, what capacity may grow to
+	virtual int maxParticles()const = 0;
+	/// particles there are buffers for right now. indices are always below this
+	virtual int capacity()const = 0;
+	virtual int activeCount()const = 0;
+	/// makes room for count particles in total, capacity at least doubles so growing point counts reallocate rarely.
+	/// particles keep their indices and state, so do springs, triangles, rigids, inflatables, shapes and params.
+	/// all data must be unmapped, pointers from before are invalid after. false if count is over maxParticles
+	/// or the bigger container could not be created, then capacity stays as it was
+	virtual bool reserve(int count) = 0;
+
+	//particles
+	/// returns number of particles actually allocated, their indices go to indices. never grows capacity, reserve first
+	virtual int allocParticles(int n, int* indices) = 0;
+	virtual void freeParticles(int n, const int* indices) = 0;
+	virtual int getActiveList(int* indices) = 0;
+	virtual NvFlexHParticleData mapParticleData() = 0;
+	virtual void unmapParticleData() = 0;
+	/// whole particle data and active list go to the solver. data must be unmapped
+	virtual void pushParticlesToDevice() = 0;
+	virtual void pullParticlesFromDevice() = 0;
+
+	//springs
+	virtual int getSpringsCount()const = 0;
+	/// be sure data is NOT MAPPED before here, cuz all previous pointers will be invalidated
+	virtual void resizeSpringData(int newSize) = 0;
+	virtual NvFlexHSpringData mapSpringData() = 0;
+	virtual void unmapSpringData() = 0;
+	virtual void pushSpringsToDevice() = 0;
+
+	//triangles
+	virtual int getTrianglesCount()const = 0;
+	/// be sure data is NOT MAPPED before here, cuz all previous pointers will be invalidated
+	virtual void resizeTriangleData(int newSize) = 0;
+	virtual NvFlexHTriangleData mapTriangleData() = 0;
+	virtual void unmapTriangleData() = 0;
+	virtual void pushTrianglesToDevice(bool pushNormals = true) = 0;
+	/// if the last pushTrianglesToDevice had normals
+	virtual bool hasTriangleNormals()const = 0;
+
+	//rigids
+	virtual int getRigidsCount()const = 0;
+	virtual int getRigidIndicesCount()const = 0;
+	/// be sure data is NOT MAPPED before here, cuz all previous pointers will be invalidated
+	virtual void resizeRigidData(int numRigids, int numIndices) = 0;
+	virtual NvFlexHRigidData mapRigidData() = 0;
+	virtual void unmapRigidData() = 0;
+	/// rotations and translations of rigid data are only where clusters start, the solver keeps its own after that
+	virtual void pushRigidsToDevice() = 0;
+	/// transforms as of the last pullParticlesFromDevice or pullAndSpeculate
+	virtual NvFlexHRigidTransforms mapRigidTransforms() = 0;
+	virtual void unmapRigidTransforms() = 0;
+
+	//inflatables, they address dynamic triangles so push them after triangles
+	virtual int getInflatablesCount()const = 0;
+	/// be sure data is NOT MAPPED before here, cuz all previous pointers will be invalidated
+	virtual void resizeInflatableData(int newSize) = 0;
+	virtual NvFlexHInflatableData mapInflatableData() = 0;
+	virtual void unmapInflatableData() = 0;
+	virtual void pushInflatablesToDevice() = 0;
+
+	//diffuse. backends without them have 0 capacity and never give out any
+	virtual int maxDiffuseParticles()const { return 0; }
+	/// diffuse particles as of the last pullParticlesFromDevice or pullAndSpeculate
+	virtual NvFlexHDiffuseData mapDiffuseData() { return NvFlexHDiffuseData(); }
+	virtual void unmapDiffuseData() {}
+
+	//surfacing. tick computes them only when params have smoothing / anisotropyScale, pulling them is separate,
+	//so nobody pays for copies no one reads. backends without them never give out any
+	/// pulls from now on go for these channels too
+	virtual void setSurfacePull(bool /*smoothParticles*/, bool /*anisotropy*/) {}
+	/// channels of the last pullParticlesFromDevice or pullAndSpeculate
+	virtual NvFlexHSurfaceData mapSurfaceData() { return NvFlexHSurfaceData(); }
+	virtual void unmapSurfaceData() {}
+
+	//densities and contacts, pulled on request same as surfacing channels
+	virtual void setContactPull(bool /*densities*/, bool /*contacts*/) {}
+	virtual NvFlexHContactData mapContactData() { return NvFlexHContactData(); }
+	virtual void unmapContactData() {}
+
+	//shapes
+	virtual NvFlexHCollisionData* collisionData() = 0;
+	/// sends current state of collisionData() to the solver
+	virtual void pushShapesToDevice() = 0;
+
+	//simulation
+	virtual void setParams(const NvFlexParams& params) = 0;
+	/// enableTimers asks the backend to time its internals, that may cost a sync, so keep it off unless someone looks
+	virtual void tick(float dt, int substeps, bool enableTimers = false) = 0;
+	/// adds device timers of the last tick with enableTimers to prof. backends without any add nothing
+	virtual void readTimers(NvFlexHProfiler& /*prof*/) {}
+
+	//pipelining: results of a tick are copied to a host staging buffer and the next tick is started right away,
+	//betting the inputs won't change, so the device works while host exports. backends that can't do it run serial
+	virtual bool supportsPipelining()const { return false; }
+	/// queues copy of particles into the next of two staging buffers, then queues a speculative tick with the params set last.
+	/// backends may only stage and not tick when they could not discard the tick, hasSpeculativeTick() tells.
+	/// host particle buffers then hold the staged state too, as after pullParticlesFromDevice
+	virtual void pullAndSpeculate(float /*dt*/, int /*substeps*/) {}
+	/// later pullAndSpeculate calls stage rest particles too, so the cache can be written without mapping host buffers
+	virtual void setStagedRestPull(bool /*restParticles*/) {}
+	/// particles, velocities and phases of the last pullAndSpeculate, valid until the next one.
+	/// rest particles only if they were asked for with setStagedRestPull, normals are NULL
+	virtual NvFlexHParticleData mapStagedParticleData() { return NvFlexHParticleData(); }
+	virtual void unmapStagedParticleData() {}
+	virtual bool hasSpeculativeTick()const { return false; }
+	/// true if the queued tick used the same dt, substeps and params, so it is the tick we would do now
+	virtual bool speculationMatches(float /*dt*/, int /*substeps*/, const NvFlexParams& /*params*/)const { return false; }
+	/// the speculative tick is consumed, as if we just ticked
+	virtual void acceptSpeculativeTick() {}
+	/// throws away the speculative tick: staged particles go back into host buffers and are pushed, so device is at the staged state
+	virtual void discardSpeculativeTick() {}
+};
+
+
+/// Library level part of a backend: creates containers and owns collision mesh resources, that are shared between solvers.
+/// Resource ids go straight into NvFlexCollisionGeometry, so they are the backend's own ids.
+class NvFlexHBackend {
+public:
+	virtual ~NvFlexHBackend() {}
+
+	virtual const char* name()const = 0;
+
+	/// backend context becomes current on this thread, and only on this one until releaseContext. calls nest.
+	/// use NvFlexHContextGuard instead of calling these directly
+	virtual void acquireContext() {}
+	virtual void releaseContext() {}
+	/// last error the library reported since the previous call, empty if none. backends that throw have nothing here
+	virtual std::string takeError() { return std::string(); }
+
+	/// throws std::runtime_error if container cannot be created
+	virtual NvFlexHContainer* createContainer(int maxParticles, int maxDiffuseParticles, int maxNeighbours = 96) = 0;
+
+	virtual NvFlexTriangleMeshId createTriangleMesh() = 0;
+	/// mesh buffers sized for vertcount vertices and tricount triangles, caller writes them and unmaps. with keepTriangles only vertices
+	/// are mapped, triangles stay as they were (deforming collider, same topology and point count) and tricount is ignored
+	virtual NvFlexHTriangleMeshData mapTriangleMesh(NvFlexTriangleMeshId id, int vertcount, int tricount, bool keepTriangles) = 0;
+	/// mesh takes what was written since mapTriangleMesh
+	virtual void unmapTriangleMesh(NvFlexTriangleMeshId id, const float* lower, const float* upper) = 0;
+	virtual void destroyTriangleMesh(NvFlexTriangleMeshId id) = 0;
+
+	virtual NvFlexConvexMeshId createConvexMesh() = 0;
+	/// planes are normal and -dot(normal, point on plane)
+	virtual void updateConvexMesh(NvFlexConvexMeshId id, const Vec4* planes, int planecount, const float* lower, const float* upper) = 0;
+	virtual void destroyConvexMesh(NvFlexConvexMeshId id) = 0;
+
+	virtual NvFlexDistanceFieldId createDistanceField() = 0;
+	/// dim^3 values, x fastest
+	virtual void updateDistanceField(NvFlexDistanceFieldId id, int dim, const float* values) = 0;
+	virtual void destroyDistanceField(NvFlexDistanceFieldId id) = 0;
+};
+
+
+/// Holds the backend context for a scope. Everything touching containers or resources of one backend goes under one,
+/// so several dop networks cooking on different threads never use the same context at once
+class NvFlexHContextGuard {
+public:
+	explicit NvFlexHContextGuard(NvFlexHBackend* backend) :_backend(backend) { if (_backend != NULL)_backend->acquireContext(); }
+	~NvFlexHContextGuard() { if (_backend != NULL)_backend->releaseContext(); }
+	NvFlexHContextGuard(const NvFlexHContextGuard&) = delete;
+	NvFlexHContextGuard& operator=(const NvFlexHContextGuard&) = delete;
+private:
+	NvFlexHBackend* _backend;
+};
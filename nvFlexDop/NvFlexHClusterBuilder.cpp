@@ -0,0 +1,267 @@
+#include "NvFlexHClusterBuilder.h"
+
+#include <GA/GA_PageIterator.h>
+#include <GA/GA_PageHandle.h>
+#include <GU/GU_PrimPacked.h>
+#include <UT/UT_ParallelUtil.h>
+#include <UT/UT_Quaternion.h>
+
+#include <algorithm>
+#include <cmath>
+#include <map>
+
+#include "NvFlexHGeoUtils.h"
+#include "NvFlexHShapeMatching.h"
+
+
+static inline Vec3 toVec3(const UT_Vector3F& v) { return Vec3(v.x(), v.y(), v.z()); }
+
+
+NvFlexHClusterBuilder::NvFlexHClusterBuilder(const GU_Detail* gdp, const int* indices, int nactives) :_gdp(gdp), _indices(indices), _nactives(nactives),
+	_phnd(gdp->getP()),
+	_rhnd(gdp->findPointAttribute("restP")),
+	_mhnd(gdp->findPointAttribute("imass")),
+	_sthnd(gdp->findPointAttribute("clusterstiffness")),
+	_clhnd(gdp->findPointAttribute("cluster")),
+	_primclhnd(gdp->findPrimitiveAttribute("cluster")),
+	_start(1, 0) {}
+
+void NvFlexHClusterBuilder::count() {
+	_members.clear();
+	_start.assign(1, 0);
+	_packed.clear();
+	if (!isValid())return;
+
+	//only runs when clusters change, so serial is fine
+	std::vector<int> cluster(_nactives, -1);
+	if (_clhnd.isValid()) {
+		for (GA_Index i = 0; i < _nactives; ++i)cluster[i] = _clhnd.get(_gdp->pointOffset(i));
+	}
+	//packed point goes with its primitive, whatever cluster it has itself
+	if (_primclhnd.isValid()) {
+		for (GA_Iterator it(_gdp->getPrimitiveRange()); !it.atEnd(); ++it) {
+			const GU_PrimPacked* packed = dynamic_cast<const GU_PrimPacked*>(_gdp->getPrimitive(*it));
+			if (packed == NULL)continue;
+			int c = _primclhnd.get(*it);
+			GA_Index pt = _gdp->pointIndex(packed->getPointOffset(0));
+			if (c < 0 || pt >= _nactives)continue;
+			cluster[pt] = c;
+			_packed.push_back(std::make_pair(_gdp->primitiveIndex(*it), c));
+		}
+	}
+
+	//cluster values can be anything. slots go by value, so rigid order does not depend on point order
+	std::map<int, int> slots;
+	for (GA_Index i = 0; i < _nactives; ++i) {
+		if (cluster[i] >= 0)slots[cluster[i]] = 0;
+	}
+	int nslots = 0;
+	for (std::map<int, int>::iterator it = slots.begin(); it != slots.end(); ++it)it->second = nslots++;
+
+	//counting sort of points into their slots
+	_start.assign(nslots + 1, 0);
+	for (GA_Index i = 0; i < _nactives; ++i) {
+		if (cluster[i] >= 0)++_start[slots[cluster[i]] + 1];
+	}
+	for (int c = 0; c < nslots; ++c)_start[c + 1] += _start[c];
+	_members.resize(_start[nslots]);
+	std::vector<int> fill(_start.begin(), _start.end() - 1);
+	for (GA_Index i = 0; i < _nactives; ++i) {
+		if (cluster[i] >= 0)_members[fill[slots[cluster[i]]]++] = i;
+	}
+	for (size_t i = 0; i < _packed.size(); ++i)_packed[i].second = slots[_packed[i].second];
+}
+
+
+void NvFlexHClusterBuilder::build(NvFlexHRigidData& rdat, int rigidOffset, int indexOffset, float stiffness, float threshold, float creep, NvFlexHClusterLayout& layout)const {
+	const int nrigids = rigidCount();
+	layout.pointRigids.assign(_nactives, -1);
+	layout.packed.clear();
+	layout.rigidCount = nrigids;
+	layout.stiffness = stiffness;
+	layout.threshold = threshold;
+	layout.creep = creep;
+	if (nrigids == 0)return;
+
+	std::vector<Quat> rotations(nrigids);
+	std::vector<Vec3> centers(nrigids);
+	for (int c = 0; c < nrigids; ++c) {
+		const int r = rigidOffset + c;
+		const int begin = _start[c], end = _start[c + 1];
+
+		//mass weighted like the solver's center, so rest positions are around the point clusters rotate about.
+		//clusters of static particles only have no mass, those get plain average
+		float mass = 0.0f;
+		for (int k = begin; k < end; ++k) {
+			float imass = _mhnd.isValid() ? _mhnd.get(_gdp->pointOffset(_members[k])) : 1.0f;
+			if (imass > 0.0f)mass += 1.0f / imass;
+		}
+		const bool uniform = mass == 0.0f;
+		std::vector<float> weights(end - begin);
+		Vec3 restcenter(0.0f), center(0.0f);
+		float wsum = 0.0f;
+		for (int k = begin; k < end; ++k) {
+			GA_Offset off = _gdp->pointOffset(_members[k]);
+			float imass = _mhnd.isValid() ? _mhnd.get(off) : 1.0f;
+			float w = uniform ? 1.0f : (imass > 0.0f ? 1.0f / imass : 0.0f);
+			weights[k - begin] = w;
+			center += toVec3(_phnd.get(off)) * w;
+			restcenter += toVec3(_rhnd.isValid() ? _rhnd.get(off) : _phnd.get(off)) * w;
+			wsum += w;
+		}
+		center = center * (1.0f / wsum);
+		restcenter = restcenter * (1.0f / wsum);
+
+		//rest positions, and how P is rotated against them
+		Vec3 A[3] = { Vec3(0.0f), Vec3(0.0f), Vec3(0.0f) };
+		float maxr = 0.0f;
+		for (int k = begin; k < end; ++k) {
+			GA_Offset off = _gdp->pointOffset(_members[k]);
+			Vec3 local = toVec3(_rhnd.isValid() ? _rhnd.get(off) : _phnd.get(off)) - restcenter;
+			float* rp = rdat.restPositions + 3 * (indexOffset + k);
+			rp[0] = local.x; rp[1] = local.y; rp[2] = local.z;
+			maxr = std::max(maxr, Length(local));
+			Vec3 d = (toVec3(_phnd.get(off)) - center) * weights[k - begin];
+			A[0] += d * local.x;
+			A[1] += d * local.y;
+			A[2] += d * local.z;
+			rdat.indices[indexOffset + k] = _indices[_members[k]];
+			layout.pointRigids[_members[k]] = r;
+		}
+		Quat q;
+		if (_rhnd.isValid())nvFlexHExtractRotation(A, q);
+		rotations[c] = q;
+		centers[c] = center;
+
+		//no surface to take normals from, so it's a sphere around the center. good enough to push overlapping clusters apart
+		for (int k = begin; k < end; ++k) {
+			const float* rp = rdat.restPositions + 3 * (indexOffset + k);
+			float* np = rdat.restNormals + 4 * (indexOffset + k);
+			Vec3 local(rp[0], rp[1], rp[2]);
+			float len = Length(local);
+			Vec3 dir = len > 1e-6f ? local * (1.0f / len) : Vec3(0.0f, 1.0f, 0.0f);
+			np[0] = dir.x; np[1] = dir.y; np[2] = dir.z; np[3] = len - maxr;
+		}
+
+		float clusterstiffness = stiffness;
+		if (_sthnd.isValid()) {
+			clusterstiffness = 0.0f;
+			for (int k = begin; k < end; ++k)clusterstiffness += _sthnd.get(_gdp->pointOffset(_members[k]));
+			clusterstiffness /= float(end - begin);
+		}
+		rdat.offsets[r] = indexOffset + begin;
+		rdat.stiffness[r] = clusterstiffness;
+		rdat.thresholds[r] = threshold;
+		rdat.creeps[r] = creep;
+		rdat.rotations[4 * r + 0] = q.x; rdat.rotations[4 * r + 1] = q.y; rdat.rotations[4 * r + 2] = q.z; rdat.rotations[4 * r + 3] = q.w;
+		rdat.translations[3 * r + 0] = center.x; rdat.translations[3 * r + 1] = center.y; rdat.translations[3 * r + 2] = center.z;
+	}
+	rdat.offsets[rigidOffset + nrigids] = indexOffset + _start[nrigids];
+
+	//packed transforms are taken back to where the cluster has no rotation yet
+	layout.packed.reserve(_packed.size());
+	for (size_t i = 0; i < _packed.size(); ++i) {
+		const GU_PrimPacked* packed = dynamic_cast<const GU_PrimPacked*>(_gdp->getPrimitive(_gdp->primitiveOffset(_packed[i].first)));
+		const int c = _packed[i].second;
+		NvFlexHPackedRest rest;
+		rest.prim = _packed[i].first;
+		rest.rigid = rigidOffset + c;
+		Vec3 offset = nvFlexHRotateInv(rotations[c], toVec3(_gdp->getPos3(packed->getPointOffset(0))) - centers[c]);
+		rest.offset = UT_Vector3D(offset.x, offset.y, offset.z);
+		packed->getLocalTransform(rest.transform);
+		UT_Matrix3D unrotate;
+		UT_QuaternionD(rotations[c].x, rotations[c].y, rotations[c].z, rotations[c].w).getRotationMatrix(unrotate);
+		unrotate.transpose();
+		rest.transform *= unrotate;
+		layout.packed.push_back(rest);
+	}
+}
+
+
+
+NvFlexHClusterExport::NvFlexHClusterExport(GU_Detail* gdp, const NvFlexHClusterLayout& layout, const NvFlexHRigidTransforms& tdat) :_gdp(gdp), _layout(layout), _tdat(tdat) {
+	_orientatt = gdp->findFloatTuple(GA_ATTRIB_POINT, "orient", 4, 4);
+	if (!_orientatt.isValid()) {
+		const float identity[4] = { 0.0f, 0.0f, 0.0f, 1.0f };
+		_orientatt = gdp->addFloatTuple(GA_ATTRIB_POINT, "orient", 4, GA_Defaults(identity, 4));
+		_orientatt.setTypeInfo(GA_TYPE_QUATERNION);
+	}
+	_centeratt = gdp->findFloatTuple(GA_ATTRIB_POINT, "clustercenter", 3, 3);
+	if (!_centeratt.isValid()) {
+		_centeratt = gdp->addFloatTuple(GA_ATTRIB_POINT, "clustercenter", 3, GA_Defaults(0));
+		_centeratt.setTypeInfo(GA_TYPE_POINT);
+	}
+}
+
+/// functor for UTparallelFor, same page walk as the particle export
+class NvFlexHClusterExport::ThreadedTransfer {
+public:
+	ThreadedTransfer(const NvFlexHClusterExport& exp) :_exp(exp) {}
+
+	void operator()(const GA_SplittableRange& r)const {
+		GU_Detail* gdp = _exp._gdp;
+		const std::vector<int>& rigids = _exp._layout.pointRigids;
+		const NvFlexHRigidTransforms& tdat = _exp._tdat;
+		const GA_Index nactives = GA_Index(rigids.size());
+		GA_RWPageHandleV4 orienthnd(_exp._orientatt.get());
+		GA_RWPageHandleV3 centerhnd(_exp._centeratt.get());
+
+		for (GA_PageIterator pit = r.beginPages(); !pit.atEnd(); ++pit) {
+			GA_Offset bst, bed;
+			for (GA_Iterator it(pit.begin()); it.blockAdvance(bst, bed);) {
+				orienthnd.setPage(bst);
+				centerhnd.setPage(bst);
+
+				GA_Index idx = contiguousBlockIndex(gdp->getPointMap(), bst);
+				const bool contiguous = idx >= 0;
+				for (GA_Offset off = bst; off < bed; ++off, ++idx) {
+					if (!contiguous)idx = gdp->pointIndex(off);
+					if (idx >= nactives) {
+						if (contiguous)break;
+						continue;
+					}
+					int rigid = rigids[idx];
+					if (rigid < 0 || rigid >= tdat.count)continue;
+					const float* q = tdat.rotations + rigid * 4;
+					const float* t = tdat.translations + rigid * 3;
+					orienthnd.value(off).assign(q[0], q[1], q[2], q[3]);
+					centerhnd.value(off).assign(t[0], t[1], t[2]);
+				}
+			}
+		}
+	}
+
+private:
+	const NvFlexHClusterExport& _exp;
+};
+
+void NvFlexHClusterExport::transfer()const {
+	UTparallelFor(GA_SplittableRange(_gdp->getPointRange()), ThreadedTransfer(*this));
+
+	//one per piece, serial is fine
+	for (size_t i = 0; i < _layout.packed.size(); ++i) {
+		const NvFlexHPackedRest& rest = _layout.packed[i];
+		if (rest.rigid >= _tdat.count || rest.prim >= _gdp->getNumPrimitives())continue;
+		GU_PrimPacked* packed = dynamic_cast<GU_PrimPacked*>(_gdp->getPrimitive(_gdp->primitiveOffset(rest.prim)));
+		if (packed == NULL)continue;
+		const float* q = _tdat.rotations + rest.rigid * 4;
+		const float* t = _tdat.translations + rest.rigid * 3;
+		UT_QuaternionD orient(q[0], q[1], q[2], q[3]);
+		UT_Matrix3D rotation;
+		orient.getRotationMatrix(rotation);
+		UT_Matrix3D xform = rest.transform;
+		xform *= rotation;
+		packed->setLocalTransform(xform);
+		UT_Vector3D pos = orient.rotate(rest.offset);
+		_gdp->setPos3(packed->getPointOffset(0), UT_Vector3(float(pos.x() + t[0]), float(pos.y() + t[1]), float(pos.z() + t[2])));
+	}
+}
+
+void NvFlexHClusterExport::bumpDataIds() {
+	_orientatt.get()->bumpDataId();
+	_centeratt.get()->bumpDataId();
+	if (_layout.packed.empty())return;
+	_gdp->getP()->bumpDataId();
+	//packed transforms live in the primitive list
+	_gdp->getPrimitiveList().bumpDataId();
+}
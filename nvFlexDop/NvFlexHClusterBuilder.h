@@ -0,0 +1,98 @@
+#pragma once
+#include <GU/GU_Detail.h>
+#include <GA/GA_Handle.h>
+#include <UT/UT_Matrix3.h>
+#include <UT/UT_Vector3.h>
+
+#include <utility>
+#include <vector>
+
+#include "NvFlexHBackend.h"
+
+
+/// Packed primitive that follows a cluster. Its transform and point are kept as they would be with the cluster
+/// at rest, so export only rotates and moves them by the cluster transform
+struct NvFlexHPackedRest {
+	GA_Index prim;
+	int rigid;             //rigid index in the container
+	UT_Vector3D offset;    //packed point relative to the cluster center
+	UT_Matrix3D transform; //local transform of the packed primitive
+};
+
+/// What export needs to know about the clusters of one object, made along with their rigid data
+struct NvFlexHClusterLayout {
+	std::vector<int> pointRigids; //rigid index in the container by point GA_Index, -1 for points in no cluster
+	std::vector<NvFlexHPackedRest> packed;
+	int rigidCount;
+	//solver params the rigid data was built with, so changing them rebuilds it
+	float stiffness, threshold, creep;
+
+	NvFlexHClusterLayout() :rigidCount(0), stiffness(-1.0f), threshold(-1.0f), creep(-1.0f) {}
+};
+
+
+/// Turns points with int attribute "cluster" >= 0 into shape matching clusters, one per cluster value.
+/// Packed primitives with primitive "cluster" put their own point into that cluster and follow it on export,
+/// so fractured pieces can be packed prims with particles scattered inside. Optional point "clusterstiffness" averaged
+/// over the cluster overrides the stiffness given to build(). Rest shape is restP if there is one, P otherwise, and
+/// clusters start at P rotated by what matches rest shape to P best.
+/// Points that did not get a particle (GA_Index >= nactives) are skipped. count() must be called before build().
+class NvFlexHClusterBuilder {
+public:
+	NvFlexHClusterBuilder(const GU_Detail* gdp, const int* indices, int nactives);
+	NvFlexHClusterBuilder(const NvFlexHClusterBuilder&) = delete;
+	NvFlexHClusterBuilder& operator=(const NvFlexHClusterBuilder&) = delete;
+
+	/// there is a cluster attribute on points or primitives
+	bool isValid()const { return _clhnd.isValid() || _primclhnd.isValid(); }
+
+	/// groups points by cluster
+	void count();
+	int rigidCount()const { return int(_start.size()) - 1; }
+	int indexCount()const { return int(_members.size()); }
+
+	/// writes rigids [rigidOffset, rigidOffset + rigidCount()) and indices [indexOffset, indexOffset + indexCount()) of rdat,
+	/// offsets[rigidOffset + rigidCount()] too. layout gets everything export needs
+	void build(NvFlexHRigidData& rdat, int rigidOffset, int indexOffset, float stiffness, float threshold, float creep, NvFlexHClusterLayout& layout)const;
+
+private:
+	const GU_Detail* _gdp;
+	const int* _indices;
+	int _nactives;
+
+	GA_ROHandleV3 _phnd;
+	GA_ROHandleV3 _rhnd;
+	GA_ROHandleF _mhnd;
+	GA_ROHandleF _sthnd;
+	GA_ROHandleI _clhnd;
+	GA_ROHandleI _primclhnd;
+
+	/// point indices grouped by cluster, cluster c has [_start[c], _start[c + 1])
+	std::vector<GA_Index> _members;
+	std::vector<int> _start;
+	/// packed primitives and their clusters
+	std::vector<std::pair<GA_Index, int> > _packed;
+};
+
+
+/// Writes cluster transforms into the detail the clusters were built from: point orient and clustercenter
+/// for points in clusters, and for packed primitives following a cluster their transform and point position.
+/// Particle P is not touched, the particle export writes that
+class NvFlexHClusterExport {
+public:
+	NvFlexHClusterExport(GU_Detail* gdp, const NvFlexHClusterLayout& layout, const NvFlexHRigidTransforms& tdat);
+	NvFlexHClusterExport(const NvFlexHClusterExport&) = delete;
+	NvFlexHClusterExport& operator=(const NvFlexHClusterExport&) = delete;
+
+	void transfer()const;
+	void bumpDataIds();
+
+private:
+	class ThreadedTransfer;
+
+	GU_Detail* _gdp;
+	const NvFlexHClusterLayout& _layout;
+	const NvFlexHRigidTransforms& _tdat;
+	GA_RWAttributeRef _orientatt;
+	GA_RWAttributeRef _centeratt;
+};
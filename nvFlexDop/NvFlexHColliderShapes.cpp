@@ -0,0 +1,228 @@
+#include "NvFlexHColliderShapes.h"
+
+#include <GA/GA_Handle.h>
+#include <GEO/GEO_PrimVolume.h>
+#include <GEO/GEO_PrimVDB.h>
+#include <UT/UT_BoundingBox.h>
+#include <UT/UT_ParallelUtil.h>
+
+#include <algorithm>
+
+#include "NvFlexHGeoUtils.h"
+
+
+NvFlexHColliderShapes::Type NvFlexHColliderShapes::readType(const GU_Detail* gdp) {
+	GA_ROHandleS typehnd(gdp->findAttribute(GA_ATTRIB_DETAIL, "collshape"));
+	if (!typehnd.isValid())return eTypeMesh;
+	UT_StringRef name(typehnd.get(GA_Offset(0)));
+	if (name == "sphere")return eTypeSphere;
+	if (name == "capsule")return eTypeCapsule;
+	if (name == "box")return eTypeBox;
+	if (name == "convex")return eTypeConvex;
+	if (name == "sdf")return eTypeSDF;
+	return eTypeMesh;
+}
+
+NvFlexHColliderShapes::NvFlexHColliderShapes(const GU_Detail* gdp, Type type) :_gdp(gdp), _type(type), _sdfPrim(NULL), _sdfEdge(1.0f), _sdfDim(0) {
+	switch (type) {
+	case eTypeSphere:
+		readSpheres();
+		break;
+	case eTypeCapsule:
+		readCapsules();
+		break;
+	case eTypeBox:
+		readBox();
+		break;
+	case eTypeConvex: {
+		//planes are in local space already
+		Shape shp;
+		shp.center.assign(0, 0, 0);
+		shp.rotation.identity();
+		shp.params[0] = shp.params[1] = shp.params[2] = 0.0f;
+		if (gdp->getNumPrimitives() > 0)_shapes.push_back(shp);
+		break;
+	}
+	case eTypeSDF:
+		readSDF();
+		break;
+	default:
+		break;
+	}
+}
+
+NvFlexCollisionShapeType NvFlexHColliderShapes::flexType()const {
+	switch (_type) {
+	case eTypeSphere: return eNvFlexShapeSphere;
+	case eTypeCapsule: return eNvFlexShapeCapsule;
+	case eTypeBox: return eNvFlexShapeBox;
+	case eTypeConvex: return eNvFlexShapeConvexMesh;
+	case eTypeSDF: return eNvFlexShapeSDF;
+	default: return eNvFlexShapeTriangleMesh;
+	}
+}
+
+int64 NvFlexHColliderShapes::contentHash()const {
+	if (_type == eTypeSDF) {
+		//voxels have no data id, so any change of the detail counts
+		return (_gdp->getUniqueId() << 32) ^ (_gdp->getMetaCacheCount() << 8) ^ _sdfDim;
+	}
+	return (_gdp->getUniqueId() << 32) ^ topologyDataId(_gdp) ^ (_gdp->getP()->getDataId() << 16);
+}
+
+
+void NvFlexHColliderShapes::readSpheres() {
+	GA_ROHandleF pschnd(_gdp->findPointAttribute("pscale"));
+	_shapes.reserve(_gdp->getNumPoints());
+	GA_Offset off;
+	GA_FOR_ALL_PTOFF(_gdp, off) {
+		Shape shp;
+		shp.center = UT_Vector3D(_gdp->getPos3(off));
+		shp.rotation.identity();
+		shp.params[0] = pschnd.isValid() ? pschnd.get(off) : 1.0f;
+		shp.params[1] = shp.params[2] = 0.0f;
+		_shapes.push_back(shp);
+	}
+}
+
+void NvFlexHColliderShapes::readCapsules() {
+	GA_ROHandleF pschnd(_gdp->findPointAttribute("pscale"));
+	for (GA_Iterator it(_gdp->getPrimitiveRange()); !it.atEnd(); ++it) {
+		if (_gdp->getPrimitiveVertexCount(*it) != 2)continue;
+		GA_Offset pt0 = _gdp->vertexPoint(_gdp->getPrimitiveVertexOffset(*it, 0));
+		GA_Offset pt1 = _gdp->vertexPoint(_gdp->getPrimitiveVertexOffset(*it, 1));
+		UT_Vector3D p0(_gdp->getPos3(pt0));
+		UT_Vector3D p1(_gdp->getPos3(pt1));
+		UT_Vector3D dir = p1 - p0;
+		double len = dir.normalize();
+
+		Shape shp;
+		shp.center = (p0 + p1) * 0.5;
+		shp.rotation.identity();
+		if (len > 0.0)shp.rotation.updateFromVectors(UT_Vector3D(1, 0, 0), dir); //flex capsules lie along x
+		shp.params[0] = pschnd.isValid() ? 0.5f * (pschnd.get(pt0) + pschnd.get(pt1)) : 1.0f;
+		shp.params[1] = float(len * 0.5);
+		shp.params[2] = 0.0f;
+		_shapes.push_back(shp);
+	}
+}
+
+void NvFlexHColliderShapes::readBox() {
+	UT_BoundingBox bbox;
+	if (_gdp->getNumPoints() == 0 || !_gdp->getBBox(&bbox))return;
+	Shape shp;
+	shp.center = UT_Vector3D(bbox.center());
+	shp.rotation.identity();
+	shp.params[0] = 0.5f * bbox.xsize();
+	shp.params[1] = 0.5f * bbox.ysize();
+	shp.params[2] = 0.5f * bbox.zsize();
+	_shapes.push_back(shp);
+}
+
+void NvFlexHColliderShapes::readSDF() {
+	int resx = 0, resy = 0, resz = 0;
+	for (GA_Iterator it(_gdp->getPrimitiveRange()); !it.atEnd(); ++it) {
+		const GA_Primitive* prim = _gdp->getPrimitive(*it);
+		if (const GEO_PrimVolume* vol = dynamic_cast<const GEO_PrimVolume*>(prim)) {
+			vol->getRes(resx, resy, resz);
+		}
+		else if (const GEO_PrimVDB* vdb = dynamic_cast<const GEO_PrimVDB*>(prim)) {
+			vdb->getRes(resx, resy, resz);
+		}
+		else continue;
+		_sdfPrim = prim;
+		break;
+	}
+	if (_sdfPrim == NULL)return;
+
+	UT_BoundingBox bbox;
+	_sdfPrim->getBBox(&bbox);
+	_sdfEdge = std::max(bbox.xsize(), std::max(bbox.ysize(), bbox.zsize()));
+	if (_sdfEdge <= 0.0f)return;
+
+	//flex fields are cubic, so sample bounding cube with the finest axis resolution
+	GA_ROHandleI reshnd(_gdp->findAttribute(GA_ATTRIB_DETAIL, "sdfres"));
+	_sdfDim = reshnd.isValid() ? reshnd.get(GA_Offset(0)) : std::max(resx, std::max(resy, resz));
+	_sdfDim = std::min(std::max(_sdfDim, 8), 256);
+
+	Shape shp;
+	shp.center = UT_Vector3D(bbox.minvec());
+	shp.rotation.identity();
+	shp.params[0] = shp.params[1] = shp.params[2] = 0.0f;
+	_shapes.push_back(shp);
+}
+
+
+void NvFlexHColliderShapes::buildConvex(NvFlexHConvexMesh& mesh)const {
+	NvFlexHConvexMeshAutoMapper lock(mesh);
+	float* lw = lock.lower();
+	float* up = lock.upper();
+	lw[0] = lw[1] = lw[2] = FLT_MAX;
+	up[0] = up[1] = up[2] = -FLT_MAX;
+	UT_Vector3D centroid(0, 0, 0);
+	GA_Offset off;
+	GA_FOR_ALL_PTOFF(_gdp, off) {
+		UT_Vector3 p = _gdp->getPos3(off);
+		centroid += UT_Vector3D(p);
+		for (int i = 0; i < 3; ++i) {
+			lw[i] = std::min(p(i), lw[i]);
+			up[i] = std::max(p(i), up[i]);
+		}
+	}
+	if (_gdp->getNumPoints() > 0)centroid /= double(_gdp->getNumPoints());
+
+	lock.setPlanesCount(int(_gdp->getNumPrimitives()));
+	Vec4* planes = lock.planes();
+	int count = 0;
+	for (GA_Iterator it(_gdp->getPrimitiveRange()); !it.atEnd(); ++it) {
+		if (_gdp->getPrimitiveVertexCount(*it) < 3)continue;
+		UT_Vector3D p0(_gdp->getPos3(_gdp->vertexPoint(_gdp->getPrimitiveVertexOffset(*it, 0))));
+		UT_Vector3D p1(_gdp->getPos3(_gdp->vertexPoint(_gdp->getPrimitiveVertexOffset(*it, 1))));
+		UT_Vector3D p2(_gdp->getPos3(_gdp->vertexPoint(_gdp->getPrimitiveVertexOffset(*it, 2))));
+		UT_Vector3D n = cross(p1 - p0, p2 - p0);
+		if (n.normalize() == 0.0)continue;
+		//don't trust winding, just look away from the centroid
+		if (dot(n, centroid - p0) > 0.0)n = -n;
+		planes[count++] = Vec4(float(n.x()), float(n.y()), float(n.z()), float(-dot(n, p0)));
+	}
+	lock.setPlanesCount(count);
+}
+
+
+/// fills z slices of the field, every slice is written by one thread
+class NvFlexHColliderShapes::SDFSampler {
+public:
+	SDFSampler(const GA_Primitive* prim, const UT_Vector3& lower, float edge, int dim, float* values) :_prim(prim), _lower(lower), _edge(edge), _dim(dim), _values(values) {}
+
+	void operator()(const UT_BlockedRange<int>& r)const {
+		const GEO_PrimVolume* vol = dynamic_cast<const GEO_PrimVolume*>(_prim);
+		const GEO_PrimVDB* vdb = vol == NULL ? dynamic_cast<const GEO_PrimVDB*>(_prim) : NULL;
+		const float step = _edge / _dim;
+		for (int z = r.begin(); z < r.end(); ++z) {
+			float* slice = _values + size_t(z) * _dim * _dim;
+			for (int y = 0; y < _dim; ++y) {
+				for (int x = 0; x < _dim; ++x) {
+					UT_Vector3 pos(_lower.x() + (x + 0.5f) * step, _lower.y() + (y + 0.5f) * step, _lower.z() + (z + 0.5f) * step);
+					float dist = vol != NULL ? vol->getValue(pos) : vdb->getValueF(pos);
+					slice[y * _dim + x] = dist / _edge; //field lives in unit cube
+				}
+			}
+		}
+	}
+
+private:
+	const GA_Primitive* _prim;
+	UT_Vector3 _lower;
+	float _edge;
+	int _dim;
+	float* _values;
+};
+
+void NvFlexHColliderShapes::buildSDF(NvFlexHDistanceField& field)const {
+	if (_sdfPrim == NULL || _sdfDim == 0)return;
+	NvFlexHDistanceFieldAutoMapper lock(field);
+	lock.setDimension(_sdfDim);
+	const Shape& shp = _shapes[0];
+	UT_Vector3 lower(float(shp.center.x()), float(shp.center.y()), float(shp.center.z()));
+	UTparallelFor(UT_BlockedRange<int>(0, _sdfDim), SDFSampler(_sdfPrim, lower, _sdfEdge, _sdfDim, lock.values()));
+}
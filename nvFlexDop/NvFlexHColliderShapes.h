@@ -0,0 +1,64 @@
+#pragma once
+#include <GU/GU_Detail.h>
+#include <UT/UT_Quaternion.h>
+
+#include <NvFlex.h>
+
+#include <vector>
+
+#include "NvFlexHConvexMesh.h"
+#include "NvFlexHDistanceField.h"
+
+
+/// Turns collider detail into flex analytic shapes instead of a triangle mesh.
+/// Type comes from "collshape" detail string attribute:
+///  mesh    - triangle mesh, default
+///  sphere  - sphere per point, radius from pscale
+///  capsule - capsule per 2-point primitive, radius from pscale
+///  box     - bounding box
+///  convex  - convex mesh, every polygon is a plane, so geometry must already be convex
+///  sdf     - first volume or vdb primitive sampled into a distance field, "sdfres" detail int overrides resolution
+/// Shapes are in detail's local space, NvFlexHColliderSource places them in world.
+class NvFlexHColliderShapes {
+public:
+	enum Type { eTypeMesh, eTypeSphere, eTypeCapsule, eTypeBox, eTypeConvex, eTypeSDF };
+
+	struct Shape {
+		UT_Vector3D center; //for sdf it's the lower corner of field's cube
+		UT_QuaternionD rotation;
+		float params[3]; //sphere: radius. capsule: radius, half height along x. box: half extents
+	};
+
+	static Type readType(const GU_Detail* gdp);
+
+	NvFlexHColliderShapes(const GU_Detail* gdp, Type type);
+	NvFlexHColliderShapes(const NvFlexHColliderShapes&) = delete;
+	NvFlexHColliderShapes& operator=(const NvFlexHColliderShapes&) = delete;
+
+	Type type()const { return _type; }
+	NvFlexCollisionShapeType flexType()const;
+	const std::vector<Shape>& shapes()const { return _shapes; }
+
+	/// changes when buildConvex/buildSDF have to be redone
+	int64 contentHash()const;
+	void buildConvex(NvFlexHConvexMesh& mesh)const;
+	void buildSDF(NvFlexHDistanceField& field)const;
+	/// edge of sdf cube in local units, goes into sdf shape scale
+	float sdfEdge()const { return _sdfEdge; }
+
+private:
+	class SDFSampler;
+
+	void readSpheres();
+	void readCapsules();
+	void readBox();
+	void readSDF();
+
+	const GU_Detail* _gdp;
+	Type _type;
+	std::vector<Shape> _shapes;
+
+	const GA_Primitive* _sdfPrim;
+	float _sdfEdge;
+	int _sdfDim;
+};
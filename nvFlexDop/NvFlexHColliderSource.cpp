@@ -0,0 +1,84 @@
+#include "NvFlexHColliderSource.h"
+
+#include <SIM/SIM_Geometry.h>
+#include <SIM/SIM_Position.h>
+#include <GU/GU_PrimPacked.h>
+#include <UT/UT_Matrix3.h>
+#include <UT/UT_Quaternion.h>
+
+#include "NvFlexHGeoUtils.h"
+
+
+NvFlexHColliderSource::NvFlexHColliderSource(const SIM_Object* obj) :_gdp(NULL) {
+	_xform.identity();
+	const SIM_Geometry* geo = SIM_DATA_GETCONST(*obj, SIM_GEOMETRY_DATANAME, SIM_Geometry);
+	if (geo == NULL)return;
+
+	_lock.reset(new GU_DetailHandleAutoReadLock(geo->getGeometry()));
+	_gdp = _lock->getGdp();
+	if (_gdp == NULL)return;
+
+	//same as dops do it: geometry transform, then position
+	geo->getTransform(_xform);
+	const SIM_Position* pos = SIM_DATA_GETCONST(*obj, SIM_POSITION_DATANAME, SIM_Position);
+	if (pos != NULL) {
+		UT_DMatrix4 posxform;
+		pos->getTransform(posxform);
+		_xform = _xform * posxform;
+	}
+
+	//single packed primitive - use packed geometry as is and it's transform
+	if (_gdp->getNumPrimitives() != 1)return;
+	const GU_PrimPacked* packed = dynamic_cast<const GU_PrimPacked*>(_gdp->getPrimitive(_gdp->primitiveOffset(0)));
+	if (packed == NULL || packed->implementation() == NULL)return;
+	GU_ConstDetailHandle packedhnd = packed->implementation()->getPackedDetail();
+	if (!packedhnd.isValid())return; //procedurals that can't give us a detail are treated as ordinary geometry
+	_packedLock.reset(new GU_DetailHandleAutoReadLock(packedhnd));
+	if (_packedLock->getGdp() == NULL) {
+		_packedLock.reset();
+		return;
+	}
+	UT_DMatrix4 packedxform;
+	packed->getFullTransform4(packedxform);
+	_xform = packedxform * _xform;
+	_gdp = _packedLock->getGdp();
+}
+
+int64 NvFlexHColliderSource::pointsDataId()const {
+	return _gdp->getP()->getDataId();
+}
+
+int64 NvFlexHColliderSource::topologyDataId()const {
+	//data ids are per detail, so mix detail in, otherwise switching packed geo may look like nothing changed
+	return ::topologyDataId(_gdp) ^ (_gdp->getUniqueId() << 32);
+}
+
+void NvFlexHColliderSource::shapeTransform(Vec4& position, Quat& rotation, float* scale)const {
+	decompose(_xform, position, rotation, scale);
+}
+
+void NvFlexHColliderSource::shapeTransform(const UT_Vector3D& center, const UT_QuaternionD& orient, Vec4& position, Quat& rotation, float* scale)const {
+	UT_Matrix3D orientmat;
+	orient.getRotationMatrix(orientmat);
+	UT_DMatrix4 local(orientmat);
+	local.setTranslates(center);
+	decompose(local * _xform, position, rotation, scale);
+}
+
+void NvFlexHColliderSource::decompose(const UT_DMatrix4& xform, Vec4& position, Quat& rotation, float* scale) {
+	UT_Vector3D t;
+	xform.getTranslates(t);
+	position = Vec4(float(t.x()), float(t.y()), float(t.z()), 0.0f);
+
+	UT_Matrix3D rot(xform);
+	UT_Vector3D scl, shr;
+	rot.extractScales(scl, &shr);
+	scale[0] = float(scl.x());
+	scale[1] = float(scl.y());
+	scale[2] = float(scl.z());
+
+	UT_QuaternionD q;
+	q.updateFromRotationMatrix(rot);
+	q.normalize();
+	rotation = Quat(float(q.x()), float(q.y()), float(q.z()), float(q.w()));
+}
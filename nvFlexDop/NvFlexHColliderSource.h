@@ -0,0 +1,42 @@
+#pragma once
+#include <GU/GU_Detail.h>
+#include <GU/GU_DetailHandle.h>
+#include <SIM/SIM_Object.h>
+#include <UT/UT_Quaternion.h>
+
+#include <../core/maths.h>
+
+#include <memory>
+
+
+/// Resolves what a collision object looks like to flex: the detail holding its mesh in local space
+/// and the rigid transform placing that mesh in world.
+/// Local space is SIM_Geometry's space, or the packed geometry if collider is a single packed primitive,
+/// so objects moved by SIM_Position/geometry transform or packed transforms never touch their vertices.
+class NvFlexHColliderSource {
+public:
+	NvFlexHColliderSource(const SIM_Object* obj);
+	NvFlexHColliderSource(const NvFlexHColliderSource&) = delete;
+	NvFlexHColliderSource& operator=(const NvFlexHColliderSource&) = delete;
+
+	bool isValid()const { return _gdp != NULL; }
+	/// local space mesh detail
+	const GU_Detail* detail()const { return _gdp; }
+	/// changes when local space points move
+	int64 pointsDataId()const;
+	/// changes when local mesh topology changes or it becomes a different detail
+	int64 topologyDataId()const;
+
+	/// world transform split into flex shape parts. scale goes into triMesh.scale, shear is dropped
+	void shapeTransform(Vec4& position, Quat& rotation, float* scale)const;
+	/// same for a shape placed at center/orientation in local space
+	void shapeTransform(const UT_Vector3D& center, const UT_QuaternionD& orient, Vec4& position, Quat& rotation, float* scale)const;
+
+private:
+	static void decompose(const UT_DMatrix4& xform, Vec4& position, Quat& rotation, float* scale);
+
+	std::unique_ptr<GU_DetailHandleAutoReadLock> _lock;
+	std::unique_ptr<GU_DetailHandleAutoReadLock> _packedLock;
+	const GU_Detail* _gdp;
+	UT_DMatrix4 _xform;
+};
@@ -1,124 +1,268 @@
 #include "NvFlexHCollisionData.h"
 #include "NvFlexHTriangleMesh.h"
 
+#include <cstring>
 
-bool NvFlexHCollisionData::hasKey(std::string key) {
-	return collmap.find(key) != collmap.end();
+
+int NvFlexHCollisionData::find(NvFlexHCollisionKey key)const {
+	return collmap.find(key);
 }
 
-bool NvFlexHCollisionData::removeItem(std::string key) {
-	// buffers must be mapped!
-	if (!hasKey(key))return false;
-	int id = collmap.at(key);
-	collmap.erase(key);
-	hashmap.erase(key);
-	for (auto it = collmap.begin(); it != collmap.end(); ++it) {
-		int cid = it->second;
-		if (cid > id) collmap[it->first] -= 1;
+int NvFlexHCollisionData::acquire(NvFlexHCollisionKey key, NvFlexCollisionShapeType type, bool& isnew) {
+	int handle = collmap.find(key);
+	if (handle >= 0 && (flagvec[slots[handle].offset] & eNvFlexShapeFlagTypeMask) != type) {
+		removeItemByHandle(handle);
+		handle = -1;
 	}
-	if (flagvec[id] & eNvFlexShapeFlagTypeMask == eNvFlexShapeTriangleMesh) {
-		NvFlexTriangleMeshId mid = colgeovec[id].triMesh.mesh;
-		delete meshmap[mid];
-		meshmap.erase(mid);
+	isnew = handle < 0;
+	if (isnew)handle = addItem(key, type);
+	slots[handle].alive = true;
+	return handle;
+}
+
+bool NvFlexHCollisionData::removeItem(NvFlexHCollisionKey key) {
+	int handle = collmap.find(key);
+	if (handle < 0)return false;
+	removeItemByHandle(handle);
+	return true;
+}
+
+void NvFlexHCollisionData::removeItemByHandle(int handle) {
+	Slot& slt = slots[handle];
+	int id = slt.offset;
+	collmap.erase(slt.key);
+	releaseResources(id);
+
+	//swap-and-pop: flex only cares that shapes are packed, not about their order
+	int last = int(colgeovec.size()) - 1;
+	if (id != last) {
+		colgeovec[id] = colgeovec[last];
+		positionvec[id] = positionvec[last];
+		rotationvec[id] = rotationvec[last];
+		prevpositionvec[id] = prevpositionvec[last];
+		prevrotationvec[id] = prevrotationvec[last];
+		flagvec[id] = flagvec[last];
+		int movedslot = offsetslots[last];
+		slots[movedslot].offset = id;
+		offsetslots[id] = movedslot;
 	}
-	for (int i = id; i < colgeovec.size() - 1; ++i) {
-		//shift down all (we assume there's not that much of them, so it's okay
-		colgeovec[i] = colgeovec[i + 1];
-		positionvec[i] = positionvec[i + 1];
-		rotationvec[i] = rotationvec[i + 1];
-		prevpositionvec[i] = prevpositionvec[i + 1];
-		prevrotationvec[i] = prevrotationvec[i + 1];
-		flagvec[i] = flagvec[i + 1];
+	resizeall(last);
+	offsetslots.pop_back();
+
+	slt.offset = -1;
+	freeslots.push_back(handle);
+}
+
+int NvFlexHCollisionData::removeIndexedItems(int objectid, int from) {
+	int removed = 0;
+	while (removeItem(makeKey(objectid, from + removed)))++removed;
+	return removed;
+}
+
+int NvFlexHCollisionData::getShapeType(int handle) {
+	return flagvec[slots[handle].offset] & eNvFlexShapeFlagTypeMask;
+}
+
+void NvFlexHCollisionData::markAllStale() {
+	for (auto it = slots.begin(); it != slots.end(); ++it)it->alive = false;
+}
+
+int NvFlexHCollisionData::removeStale() {
+	int removed = 0;
+	for (size_t i = 0; i < slots.size(); ++i) {
+		if (slots[i].offset < 0 || slots[i].alive)continue;
+		removeItemByHandle(int(i));
+		++removed;
 	}
-	resizeall(colgeovec.size() - 1);
-	return true;
+	return removed;
 }
 
-bool NvFlexHCollisionData::addSphere(std::string key) {
-	// buffers must be mapped!
-	if (hasKey(key))return false;
-	int oldsize = colgeovec.size();
-	collmap[key] = oldsize;
-	hashmap[key] = -2;
-	resizeall(oldsize + 1);
-	int nid = colgeovec.size() - 1;
-	flagvec[nid] = NvFlexMakeShapeFlags(eNvFlexShapeSphere, true);
+int NvFlexHCollisionData::addItem(NvFlexHCollisionKey key, NvFlexCollisionShapeType type) {
+	int nid = int(colgeovec.size());
+	int slot;
+	if (freeslots.empty()) {
+		slot = int(slots.size());
+		slots.push_back(Slot());
+	}
+	else {
+		slot = freeslots.back();
+		freeslots.pop_back();
+	}
+	Slot& slt = slots[slot];
+	slt.offset = nid;
+	slt.alive = true;
+	slt.hash = -2;
+	slt.topohash = -2;
+	slt.key = key;
+	collmap.insert(key, slot);
+	offsetslots.push_back(slot);
+
+	resizeall(nid + 1);
+	flagvec[nid] = NvFlexMakeShapeFlags(type, true);
+	positionvec[nid] = Vec4(0.0f, 0.0f, 0.0f, 0.0f);
+	prevpositionvec[nid] = Vec4(0.0f, 0.0f, 0.0f, 0.0f);
 	rotationvec[nid] = Quat();
 	prevrotationvec[nid] = Quat();
-	return true;
+	createResources(nid);
+	return slot;
 }
 
-NvfSphereGeo NvFlexHCollisionData::getSphere(std::string key) {
-	// buffers must be mapped!
-	if (!hasKey(key))return NvfSphereGeo();
-	int offset = collmap.at(key);
-	return NvfSphereGeo((NvFlexSphereGeometry*)(colgeovec.mappedPtr + offset), positionvec.mappedPtr + offset, rotationvec.mappedPtr + offset, prevpositionvec.mappedPtr + offset, prevrotationvec.mappedPtr + offset);
-}
-
-bool NvFlexHCollisionData::addTriangleMesh(std::string key) {
-	// buffers must be mapped!
-	if (hasKey(key))return false;
-	int oldsize = colgeovec.size();
-	collmap[key] = oldsize;
-	hashmap[key] = -2;
-	resizeall(oldsize + 1);
-	int nid = colgeovec.size() - 1;
-	flagvec[nid] = NvFlexMakeShapeFlags(eNvFlexShapeTriangleMesh, true);
-	colgeovec[nid].triMesh.scale[0] = 1.0f;
-	colgeovec[nid].triMesh.scale[1] = 1.0f;
-	colgeovec[nid].triMesh.scale[2] = 1.0f;
-	rotationvec[nid] = Quat();
-	prevrotationvec[nid] = Quat();
-	NvFlexHTriangleMesh* newmesh = new NvFlexHTriangleMesh(colgeovec.lib);
-	NvFlexTriangleMeshId meshid = newmesh->getId();
-	meshmap[meshid] = newmesh;
-	colgeovec[nid].triMesh.mesh = meshid;
-	return true;
+void NvFlexHCollisionData::createResources(int offset) {
+	NvFlexCollisionGeometry& geo = colgeovec[offset];
+	switch (flagvec[offset] & eNvFlexShapeFlagTypeMask) {
+	case eNvFlexShapeConvexMesh: {
+		geo.convexMesh.scale[0] = geo.convexMesh.scale[1] = geo.convexMesh.scale[2] = 1.0f;
+		NvFlexHConvexMesh* newmesh = new NvFlexHConvexMesh(backend);
+		geo.convexMesh.mesh = newmesh->getId();
+		convexmap[geo.convexMesh.mesh] = newmesh;
+		break;
+	}
+	case eNvFlexShapeTriangleMesh: {
+		geo.triMesh.scale[0] = geo.triMesh.scale[1] = geo.triMesh.scale[2] = 1.0f;
+		NvFlexHTriangleMesh* newmesh = new NvFlexHTriangleMesh(backend);
+		geo.triMesh.mesh = newmesh->getId();
+		meshmap[geo.triMesh.mesh] = newmesh;
+		break;
+	}
+	case eNvFlexShapeSDF: {
+		geo.sdf.scale = 1.0f;
+		NvFlexHDistanceField* newfield = new NvFlexHDistanceField(backend);
+		geo.sdf.field = newfield->getId();
+		sdfmap[geo.sdf.field] = newfield;
+		break;
+	}
+	default:
+		break;
+	}
 }
 
-NvfTrimeshGeo NvFlexHCollisionData::getTriangleMesh(std::string key) {
-	// buffers must be mapped!
-	if (!hasKey(key))return NvfTrimeshGeo();
-	int offset = collmap.at(key);
-	NvFlexTriangleMeshId mid = colgeovec[offset].triMesh.mesh;
-	return NvfTrimeshGeo(meshmap.at(mid), positionvec.mappedPtr + offset, rotationvec.mappedPtr + offset, prevpositionvec.mappedPtr + offset, prevrotationvec.mappedPtr + offset);
+void NvFlexHCollisionData::releaseResources(int offset) {
+	const NvFlexCollisionGeometry& geo = colgeovec[offset];
+	switch (flagvec[offset] & eNvFlexShapeFlagTypeMask) {
+	case eNvFlexShapeTriangleMesh:
+		delete meshmap[geo.triMesh.mesh];
+		meshmap.erase(geo.triMesh.mesh);
+		break;
+	case eNvFlexShapeConvexMesh:
+		delete convexmap[geo.convexMesh.mesh];
+		convexmap.erase(geo.convexMesh.mesh);
+		break;
+	case eNvFlexShapeSDF:
+		delete sdfmap[geo.sdf.field];
+		sdfmap.erase(geo.sdf.field);
+		break;
+	default:
+		break;
+	}
+}
+
+template<class T>
+NvFlexHCollisionGeometryWrapper<T> NvFlexHCollisionData::wrap(T* cg, int offset) {
+	return NvFlexHCollisionGeometryWrapper<T>(cg, positionvec.data() + offset, rotationvec.data() + offset, prevpositionvec.data() + offset, prevrotationvec.data() + offset);
+}
+
+NvfSphereGeo NvFlexHCollisionData::getSphere(int handle) {
+	int offset = slots[handle].offset;
+	return wrap(&colgeovec[offset].sphere, offset);
+}
+
+NvfCapsuleGeo NvFlexHCollisionData::getCapsule(int handle) {
+	int offset = slots[handle].offset;
+	return wrap(&colgeovec[offset].capsule, offset);
+}
+
+NvfBoxGeo NvFlexHCollisionData::getBox(int handle) {
+	int offset = slots[handle].offset;
+	return wrap(&colgeovec[offset].box, offset);
+}
+
+NvfConvexGeo NvFlexHCollisionData::getConvexMesh(int handle) {
+	int offset = slots[handle].offset;
+	return wrap(convexmap.at(colgeovec[offset].convexMesh.mesh), offset);
+}
+
+NvfTrimeshGeo NvFlexHCollisionData::getTriangleMesh(int handle) {
+	int offset = slots[handle].offset;
+	return wrap(meshmap.at(colgeovec[offset].triMesh.mesh), offset);
+}
+
+NvfSdfGeo NvFlexHCollisionData::getSDF(int handle) {
+	int offset = slots[handle].offset;
+	return wrap(sdfmap.at(colgeovec[offset].sdf.field), offset);
+}
+
+void NvFlexHCollisionData::setMeshScale(int handle, const float* scale) {
+	int offset = slots[handle].offset;
+	NvFlexCollisionGeometry& geo = colgeovec[offset];
+	switch (flagvec[offset] & eNvFlexShapeFlagTypeMask) {
+	case eNvFlexShapeTriangleMesh:
+		geo.triMesh.scale[0] = scale[0];
+		geo.triMesh.scale[1] = scale[1];
+		geo.triMesh.scale[2] = scale[2];
+		break;
+	case eNvFlexShapeConvexMesh:
+		geo.convexMesh.scale[0] = scale[0];
+		geo.convexMesh.scale[1] = scale[1];
+		geo.convexMesh.scale[2] = scale[2];
+		break;
+	case eNvFlexShapeSDF:
+		geo.sdf.scale = scale[0];
+		break;
+	default:
+		break;
+	}
 }
 
 
 int NvFlexHCollisionData::size()const {
-	return colgeovec.size();
+	return int(colgeovec.size());
 }
 
-int64 NvFlexHCollisionData::getStoredHash(std::string key) {
-	if (!hasKey(key))return -2;
-	return hashmap.at(key);
+long long NvFlexHCollisionData::getStoredHash(int handle)const {
+	return slots[handle].hash;
 }
 
-bool NvFlexHCollisionData::setStoredHash(std::string key, int64 hash) {
-	if (!hasKey(key))return false;
-	hashmap[key] = hash;
-	return true;
+void NvFlexHCollisionData::setStoredHash(int handle, long long hash) {
+	//hash changes when mesh contents were rebuilt, buffers alone won't show that
+	if (slots[handle].hash != hash)contentchanged = true;
+	slots[handle].hash = hash;
+}
+
+long long NvFlexHCollisionData::getStoredTopologyHash(int handle)const {
+	return slots[handle].topohash;
+}
+
+void NvFlexHCollisionData::setStoredTopologyHash(int handle, long long hash) {
+	if (slots[handle].topohash != hash)contentchanged = true;
+	slots[handle].topohash = hash;
+}
+
+template<typename T>
+static bool sameContents(const std::vector<T>& a, const std::vector<T>& b) {
+	return a.size() == b.size() && (a.empty() || memcmp(a.data(), b.data(), a.size() * sizeof(T)) == 0);
 }
 
-void NvFlexHCollisionData::mapall() {
-	colgeovec.map();
-	positionvec.map();
-	rotationvec.map();
-	prevpositionvec.map();
-	prevrotationvec.map();
-	flagvec.map();
+void NvFlexHCollisionData::setTransform(int handle, const Vec4& position, const Quat& rotation) {
+	int offset = slots[handle].offset;
+	positionvec[offset] = position;
+	prevpositionvec[offset] = position;
+	rotationvec[offset] = rotation;
+	prevrotationvec[offset] = rotation;
 }
-void NvFlexHCollisionData::unmapall() {
-	colgeovec.unmap();
-	positionvec.unmap();
-	rotationvec.unmap();
-	prevpositionvec.unmap();
-	prevrotationvec.unmap();
-	flagvec.unmap();
+
+bool NvFlexHCollisionData::changedSincePush()const {
+	return contentchanged || !sameContents(colgeovec, pushedcolgeovec) || !sameContents(positionvec, pushedpositionvec) || !sameContents(rotationvec, pushedrotationvec)
+		|| !sameContents(prevpositionvec, pushedprevpositionvec) || !sameContents(prevrotationvec, pushedprevrotationvec) || !sameContents(flagvec, pushedflagvec);
 }
 
-void NvFlexHCollisionData::setCollisionData(NvFlexSolver * solv){
-	NvFlexSetShapes(solv, colgeovec.buffer, positionvec.buffer, rotationvec.buffer, prevpositionvec.buffer, prevrotationvec.buffer, flagvec.buffer, flagvec.size());
+void NvFlexHCollisionData::markPushed() {
+	pushedcolgeovec = colgeovec;
+	pushedpositionvec = positionvec;
+	pushedrotationvec = rotationvec;
+	pushedprevpositionvec = prevpositionvec;
+	pushedprevrotationvec = prevrotationvec;
+	pushedflagvec = flagvec;
+	contentchanged = false;
 }
 
 void NvFlexHCollisionData::resizeall(int newsize) {
@@ -130,15 +274,8 @@ void NvFlexHCollisionData::resizeall(int newsize) {
 	flagvec.resize(newsize);
 }
 
-NvFlexHCollisionData::NvFlexHCollisionData(NvFlexLibrary *lib):colgeovec(lib), positionvec(lib), rotationvec(lib), prevpositionvec(lib), prevrotationvec(lib), flagvec(lib)
+NvFlexHCollisionData::NvFlexHCollisionData(NvFlexHBackend *be):backend(be), contentchanged(true)
 {
-	colgeovec.resize(0);
-	positionvec.resize(0);
-	rotationvec.resize(0);
-	prevpositionvec.resize(0);
-	prevrotationvec.resize(0);
-	flagvec.resize(0);
-	unmapall();
 }
 
 
@@ -147,11 +284,10 @@ NvFlexHCollisionData::~NvFlexHCollisionData()
 	for (auto it = meshmap.begin(); it != meshmap.end(); ++it) {
 		delete it->second;
 	}
-
-	colgeovec.destroy(); //dont need to destroy them - destructor does that!
-	positionvec.destroy();
-	rotationvec.destroy();
-	prevpositionvec.destroy();
-	prevrotationvec.destroy();
-	flagvec.destroy();
+	for (auto it = convexmap.begin(); it != convexmap.end(); ++it) {
+		delete it->second;
+	}
+	for (auto it = sdfmap.begin(); it != sdfmap.end(); ++it) {
+		delete it->second;
+	}
 }
@@ -1,12 +1,15 @@
 #pragma once
 #include <NvFlex.h>
-#include <NvFlexExt.h>
 #include <../core/maths.h>
 
-#include <string>
 #include <unordered_map>
+#include <vector>
 
+#include "NvFlexHBackend.h"
 #include "NvFlexHTriangleMesh.h"
+#include "NvFlexHConvexMesh.h"
+#include "NvFlexHDistanceField.h"
+#include "NvFlexHFlatMap.h"
 
 
 
@@ -31,51 +34,119 @@ public:
 };
 
 typedef NvFlexHCollisionGeometryWrapper<NvFlexSphereGeometry> NvfSphereGeo;
+typedef NvFlexHCollisionGeometryWrapper<NvFlexCapsuleGeometry> NvfCapsuleGeo;
+typedef NvFlexHCollisionGeometryWrapper<NvFlexBoxGeometry> NvfBoxGeo;
+typedef NvFlexHCollisionGeometryWrapper<NvFlexHConvexMesh> NvfConvexGeo;
 typedef NvFlexHCollisionGeometryWrapper<NvFlexHTriangleMesh> NvfTrimeshGeo;
+typedef NvFlexHCollisionGeometryWrapper<NvFlexHDistanceField> NvfSdfGeo;
 
-typedef long long int64;
+/// collider key: dop object id and index of shape within that object.
+/// plain long long, not HDK's int64 - this header has to build without HDK
+typedef long long NvFlexHCollisionKey;
 
 class NvFlexHCollisionData
 {
 public:
-	NvFlexHCollisionData(NvFlexLibrary*lib);
+	NvFlexHCollisionData(NvFlexHBackend* backend);
 	NvFlexHCollisionData(const NvFlexHCollisionData&) = delete;
 	NvFlexHCollisionData& operator=(const NvFlexHCollisionData&) = delete;
 	~NvFlexHCollisionData();
 
-
-	bool hasKey(std::string key);
-	int64 getStoredHash(std::string key);
-	bool setStoredHash(std::string key, int64 hash);
-	//add-remove shit
-	bool removeItem(std::string key);
-
-	bool addSphere(std::string key);
-	NvfSphereGeo getSphere(std::string key);
-
-	bool addTriangleMesh(std::string key);
-	NvfTrimeshGeo getTriangleMesh(std::string key);
+	static inline NvFlexHCollisionKey makeKey(int objectid, int subindex) { return (NvFlexHCollisionKey(objectid) << 32) | (unsigned int)subindex; }
+
+	/// items are addressed by handles. handle stays the same until item is removed, and is reused after that
+	/// handle of the item, -1 if there's none
+	int find(NvFlexHCollisionKey key)const;
+	/// handle of the item of given type, created if missing. item of other type under same key is replaced
+	/// isnew is true if item was created. marks item alive
+	int acquire(NvFlexHCollisionKey key, NvFlexCollisionShapeType type, bool& isnew);
+
+	long long getStoredHash(int handle)const;
+	void setStoredHash(int handle, long long hash);
+	//separate hash for topology, so deforming meshes can keep their triangles
+	long long getStoredTopologyHash(int handle)const;
+	void setStoredTopologyHash(int handle, long long hash);
+	//add-remove shit. removal swaps last item into the hole, so offsets of other items may change, handles stay valid
+	bool removeItem(NvFlexHCollisionKey key);
+	void removeItemByHandle(int handle);
+	/// removes items of the object with subindex from, from+1 ... up to the first missing one
+	int removeIndexedItems(int objectid, int from);
+
+	// pointers in returned wrappers are valid until next add or remove
+	NvfSphereGeo getSphere(int handle);
+	NvfCapsuleGeo getCapsule(int handle);
+	NvfBoxGeo getBox(int handle);
+	NvfConvexGeo getConvexMesh(int handle);
+	NvfTrimeshGeo getTriangleMesh(int handle);
+	NvfSdfGeo getSDF(int handle);
+
+	/// scale of mesh-like shapes: triangle and convex meshes take 3 components, sdf only the first one
+	void setMeshScale(int handle, const float* scale);
+	/// sets current and previous transform at once, for items that come back from a cache
+	void setTransform(int handle, const Vec4& position, const Quat& rotation);
+	/// NvFlexCollisionShapeType of the item
+	int getShapeType(int handle);
+
+	/// collider liveness: mark everything stale, acquire marks items alive again,
+	/// then removeStale drops the ones nobody asked for (objects that left collision relationships)
+	void markAllStale();
+	int removeStale();
 	//
 	int size() const;
 
-	void mapall();
-	void unmapall();
-
-	void setCollisionData(NvFlexSolver* solv);
+	/// shape buffers in the layout NvFlexSetShapes wants, for backends
+	const NvFlexCollisionGeometry* geometry()const { return colgeovec.data(); }
+	const Vec4* positions()const { return positionvec.data(); }
+	const Quat* rotations()const { return rotationvec.data(); }
+	const Vec4* prevPositions()const { return prevpositionvec.data(); }
+	const Quat* prevRotations()const { return prevrotationvec.data(); }
+	const int* flags()const { return flagvec.data(); }
+	/// key of the item at offset into the buffers above
+	NvFlexHCollisionKey keyAt(int offset)const { return slots[offsetslots[offset]].key; }
+
+	/// true if shape buffers or mesh contents changed since last markPushed, so unchanged colliders need not be sent again
+	bool changedSincePush()const;
+	/// remembers current shape buffers as what the solver has
+	void markPushed();
 
 private:
-	std::unordered_map<std::string, int> collmap; //offset into colgeovec
+	struct Slot {
+		int offset; //into colgeovec, -1 if slot is free
+		bool alive;
+		long long hash;
+		long long topohash;
+		NvFlexHCollisionKey key;
+	};
+
+	NvFlexHFlatMap collmap; //key -> slot index
+	std::vector<Slot> slots;
+	std::vector<int> offsetslots; //offset -> slot, to patch the item moved by swap-and-pop
+	std::vector<int> freeslots;
 	std::unordered_map<NvFlexTriangleMeshId, NvFlexHTriangleMesh*> meshmap;
-	std::unordered_map<std::string, int64> hashmap;
+	std::unordered_map<NvFlexConvexMeshId, NvFlexHConvexMesh*> convexmap;
+	std::unordered_map<NvFlexDistanceFieldId, NvFlexHDistanceField*> sdfmap;
 
 	void resizeall(int newsize);
+	int addItem(NvFlexHCollisionKey key, NvFlexCollisionShapeType type); //returns handle
+	void createResources(int offset);
+	void releaseResources(int offset);
+	template<class T> NvFlexHCollisionGeometryWrapper<T> wrap(T* cg, int offset);
 
 private:
-	NvFlexVector<NvFlexCollisionGeometry> colgeovec;
-	NvFlexVector<Vec4> positionvec;
-	NvFlexVector<Quat> rotationvec;
-	NvFlexVector<Vec4> prevpositionvec;
-	NvFlexVector<Quat> prevrotationvec;
-	NvFlexVector<int>  flagvec;
-
-};
+	NvFlexHBackend* backend;
+	std::vector<NvFlexCollisionGeometry> colgeovec;
+	std::vector<Vec4> positionvec;
+	std::vector<Quat> rotationvec;
+	std::vector<Vec4> prevpositionvec;
+	std::vector<Quat> prevrotationvec;
+	std::vector<int>  flagvec;
+
+	//what was pushed last, for changedSincePush. mesh contents are not compared, stored hash changes set contentchanged instead
+	std::vector<NvFlexCollisionGeometry> pushedcolgeovec;
+	std::vector<Vec4> pushedpositionvec;
+	std::vector<Quat> pushedrotationvec;
+	std::vector<Vec4> pushedprevpositionvec;
+	std::vector<Quat> pushedprevrotationvec;
+	std::vector<int> pushedflagvec;
+	bool contentchanged;
+};
\ No newline at end of file
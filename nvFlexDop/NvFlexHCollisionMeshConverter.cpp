@@ -0,0 +1,155 @@
+#include "NvFlexHCollisionMeshConverter.h"
+
+#include <GA/GA_PageIterator.h>
+#include <GA/GA_PageHandle.h>
+#include <UT/UT_ParallelUtil.h>
+
+#include "NvFlexHGeoUtils.h"
+
+
+NvFlexHCollisionMeshConverter::NvFlexHCollisionMeshConverter(const GU_Detail* gdp) :_gdp(gdp) {}
+
+
+/// UTparallelReduce body: copies positions and reduces bounds on the way
+class NvFlexHCollisionMeshConverter::PointWriter {
+public:
+	PointWriter(const GU_Detail* gdp, Vec3* vertices) :_gdp(gdp), _vertices(vertices) { reset(); }
+	PointWriter(PointWriter& src, UT_Split) :_gdp(src._gdp), _vertices(src._vertices) { reset(); }
+
+	void operator()(const GA_SplittableRange& r) {
+		GA_ROPageHandleV3 phnd(_gdp->getP());
+		for (GA_PageIterator pit = r.beginPages(); !pit.atEnd(); ++pit) {
+			GA_Offset bst, bed;
+			for (GA_Iterator it(pit.begin()); it.blockAdvance(bst, bed);) {
+				phnd.setPage(bst);
+				GA_Index idx = contiguousBlockIndex(_gdp->getPointMap(), bst);
+				const bool contiguous = idx >= 0;
+				for (GA_Offset off = bst; off < bed; ++off, ++idx) {
+					if (!contiguous)idx = _gdp->pointIndex(off);
+					const UT_Vector3F& p = phnd.value(off);
+					Vec3* currtgp = _vertices + idx;
+					currtgp->x = p.x();
+					currtgp->y = p.y();
+					currtgp->z = p.z();
+					lower[0] = std::min(p.x(), lower[0]);
+					lower[1] = std::min(p.y(), lower[1]);
+					lower[2] = std::min(p.z(), lower[2]);
+					upper[0] = std::max(p.x(), upper[0]);
+					upper[1] = std::max(p.y(), upper[1]);
+					upper[2] = std::max(p.z(), upper[2]);
+				}
+			}
+		}
+	}
+	void join(const PointWriter& other) {
+		for (int i = 0; i < 3; ++i) {
+			lower[i] = std::min(lower[i], other.lower[i]);
+			upper[i] = std::max(upper[i], other.upper[i]);
+		}
+	}
+
+	float lower[3];
+	float upper[3];
+
+private:
+	void reset() {
+		lower[0] = lower[1] = lower[2] = FLT_MAX;
+		upper[0] = upper[1] = upper[2] = -FLT_MAX;
+	}
+
+	const GU_Detail* _gdp;
+	Vec3* _vertices;
+};
+
+
+void NvFlexHCollisionMeshConverter::convertPoints(Vec3* vertices, float* lower, float* upper)const {
+	PointWriter writer(_gdp, vertices);
+	UTparallelReduce(GA_SplittableRange(_gdp->getPointRange()), writer);
+	for (int i = 0; i < 3; ++i) {
+		lower[i] = writer.lower[i];
+		upper[i] = writer.upper[i];
+	}
+}
+
+
+/// counts fan triangles of every primitive page
+class NvFlexHCollisionMeshConverter::TriangleCounter {
+public:
+	TriangleCounter(const GU_Detail* gdp, GA_Size* counts) :_gdp(gdp), _counts(counts) {}
+
+	void operator()(const GA_SplittableRange& r)const {
+		for (GA_PageIterator pit = r.beginPages(); !pit.atEnd(); ++pit) {
+			GA_Size tricount = 0;
+			GA_PageNum page = -1;
+			GA_Offset bst, bed;
+			for (GA_Iterator it(pit.begin()); it.blockAdvance(bst, bed);) {
+				page = GAgetPageNum(bst);
+				for (GA_Offset off = bst; off < bed; ++off) {
+					tricount += std::max(_gdp->getPrimitiveVertexCount(off) - 2, GA_Size(0));
+				}
+			}
+			if (page >= 0)_counts[page] = tricount;
+		}
+	}
+
+private:
+	const GU_Detail* _gdp;
+	GA_Size* _counts;
+};
+
+GA_Size NvFlexHCollisionMeshConverter::countTriangles() {
+	const GA_Size npages = (GA_Size(_gdp->getNumPrimitiveOffsets()) + GA_PAGE_SIZE - 1) >> GA_PAGE_BITS;
+	_triangleStart.assign(npages + 1, 0);
+	UTparallelFor(GA_SplittableRange(_gdp->getPrimitiveRange()), TriangleCounter(_gdp, _triangleStart.data()));
+
+	GA_Size sum = 0;
+	for (GA_Size i = 0; i <= npages; ++i) {
+		GA_Size c = _triangleStart[i];
+		_triangleStart[i] = sum;
+		sum += c;
+	}
+	return sum;
+}
+
+
+/// every page fan-triangulates its polygons into its own slots
+class NvFlexHCollisionMeshConverter::TriangleWriter {
+public:
+	TriangleWriter(const GU_Detail* gdp, const GA_Size* starts, int* triangles) :_gdp(gdp), _starts(starts), _triangles(triangles) {}
+
+	void operator()(const GA_SplittableRange& r)const {
+		for (GA_PageIterator pit = r.beginPages(); !pit.atEnd(); ++pit) {
+			GA_Size i = -1;
+			GA_Offset bst, bed;
+			for (GA_Iterator it(pit.begin()); it.blockAdvance(bst, bed);) {
+				if (i < 0)i = _starts[GAgetPageNum(bst)] * 3;
+				for (GA_Offset off = bst; off < bed; ++off) {
+					GA_OffsetListRef pvlr = _gdp->getPrimitiveVertexList(off);
+					GA_Index sttidx = -1;
+					GA_Index prvidx = -1;
+					for (int vi = 0; vi < pvlr.entries(); ++vi) {
+						GA_Index idx = _gdp->pointIndex(_gdp->vertexPoint(pvlr(vi)));
+						if (vi == 0)sttidx = idx;
+						else if (vi > 1) {
+							//invert order cuz houdini goes clockwise
+							_triangles[i++] = (int)sttidx;
+							_triangles[i++] = (int)idx;
+							_triangles[i++] = (int)prvidx;
+						}
+						prvidx = idx;
+					}
+				}
+			}
+		}
+	}
+
+private:
+	const GU_Detail* _gdp;
+	const GA_Size* _starts;
+	int* _triangles;
+};
+
+void NvFlexHCollisionMeshConverter::convertTriangles(int* triangles)const {
+	if (_triangleStart.empty() || _triangleStart.back() == 0)return;
+	UTparallelFor(GA_SplittableRange(_gdp->getPrimitiveRange()), TriangleWriter(_gdp, _triangleStart.data(), triangles));
+}
@@ -0,0 +1,34 @@
+#pragma once
+#include <GU/GU_Detail.h>
+#include <GA/GA_SplittableRange.h>
+
+#include <../core/maths.h>
+
+#include <vector>
+
+
+/// Converts detail into flex collision triangle mesh data: points become vertices (in GA_Index order),
+/// polygons are fan-triangulated. Both parts are threaded, so they can be redone separately:
+/// deforming colliders only need convertPoints(), triangles stay valid as long as topology does.
+class NvFlexHCollisionMeshConverter {
+public:
+	NvFlexHCollisionMeshConverter(const GU_Detail* gdp);
+	NvFlexHCollisionMeshConverter(const NvFlexHCollisionMeshConverter&) = delete;
+	NvFlexHCollisionMeshConverter& operator=(const NvFlexHCollisionMeshConverter&) = delete;
+
+	/// vertices must have room for getNumPoints() entries. lower/upper get the bounds
+	void convertPoints(Vec3* vertices, float* lower, float* upper)const;
+
+	/// counts fan triangles, per page, so that convertTriangles knows where to write
+	GA_Size countTriangles();
+	/// triangles must have room for 3*countTriangles() entries
+	void convertTriangles(int* triangles)const;
+
+private:
+	class PointWriter;
+	class TriangleCounter;
+	class TriangleWriter;
+
+	const GU_Detail* _gdp;
+	std::vector<GA_Size> _triangleStart;
+};
@@ -0,0 +1,23 @@
+#include "NvFlexHConvexMesh.h"
+
+
+
+NvFlexHConvexMesh::NvFlexHConvexMesh(NvFlexHBackend* be) :backend(be)
+{
+	id = backend->createConvexMesh();
+	lower[0] = lower[1] = lower[2] = 0.0f;
+	upper[0] = upper[1] = upper[2] = 0.0f;
+}
+
+NvFlexHConvexMesh::~NvFlexHConvexMesh()
+{
+	backend->destroyConvexMesh(id);
+}
+
+NvFlexConvexMeshId NvFlexHConvexMesh::getId() const {
+	return id;
+}
+
+void NvFlexHConvexMesh::updateNvBuffers() {
+	backend->updateConvexMesh(id, planevec.data(), int(planevec.size()), lower, upper);
+}
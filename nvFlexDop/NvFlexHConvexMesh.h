@@ -0,0 +1,49 @@
+#pragma once
+#include <NvFlex.h>
+#include <../core/maths.h>
+
+#include <vector>
+
+#include "NvFlexHBackend.h"
+
+
+/// host side convex mesh, backend gets a copy on updateNvBuffers
+class NvFlexHConvexMesh
+{
+public:
+	NvFlexHConvexMesh(NvFlexHBackend* backend);
+	NvFlexHConvexMesh(const NvFlexHConvexMesh&) = delete;
+	NvFlexHConvexMesh& operator=(const NvFlexHConvexMesh&) = delete;
+	~NvFlexHConvexMesh();
+
+	NvFlexConvexMeshId getId()const;
+
+	void updateNvBuffers();
+
+private:
+	friend class NvFlexHConvexMeshAutoMapper;
+
+	NvFlexHBackend* backend;
+	NvFlexConvexMeshId id;
+	std::vector<Vec4> planevec; //plane equations: normal and -dot(normal, point on plane)
+	float lower[3];
+	float upper[3];
+};
+
+
+class NvFlexHConvexMeshAutoMapper {
+public:
+	NvFlexHConvexMeshAutoMapper(NvFlexHConvexMesh* m) :mesh(*m) {}
+	NvFlexHConvexMeshAutoMapper(NvFlexHConvexMesh& m) :mesh(m) {}
+	NvFlexHConvexMeshAutoMapper(const NvFlexHConvexMeshAutoMapper&) = delete;
+	NvFlexHConvexMeshAutoMapper& operator=(const NvFlexHConvexMeshAutoMapper&) = delete;
+	~NvFlexHConvexMeshAutoMapper() { mesh.updateNvBuffers(); }
+
+	inline void setPlanesCount(int count) { mesh.planevec.resize(count); }
+	inline Vec4* planes()const { return mesh.planevec.data(); }
+	inline float* lower()const { return mesh.lower; }
+	inline float* upper()const { return mesh.upper; }
+
+private:
+	NvFlexHConvexMesh& mesh;
+};
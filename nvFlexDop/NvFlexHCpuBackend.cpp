@@ -0,0 +1,1214 @@
+#include "NvFlexHCpuBackend.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+#include <utility>
+
+#include "NvFlexHCollisionData.h"
+#include "NvFlexHShapeMatching.h"
+#include "NvFlexHThreadPool.h"
+
+
+static const int kGrain = 1024;
+static const float kPi = 3.14159265358979f;
+
+
+// small vector helpers, so we only need the basics from maths.h
+static inline Vec3 mulv(const Vec3& a, const Vec3& b) { return Vec3(a.x*b.x, a.y*b.y, a.z*b.z); }
+static inline Vec3 divv(const Vec3& a, const Vec3& b) {
+	return Vec3(b.x != 0.0f ? a.x / b.x : 0.0f, b.y != 0.0f ? a.y / b.y : 0.0f, b.z != 0.0f ? a.z / b.z : 0.0f);
+}
+static inline float lengthSq(const Vec3& a) { return Dot(a, a); }
+static inline Vec3 xyz(const Vec4& a) { return Vec3(a.x, a.y, a.z); }
+static inline float clampf(float v, float lo, float hi) { return v < lo ? lo : (v > hi ? hi : v); }
+
+static inline Vec3 rotate(const Quat& q, const Vec3& v) {
+	Vec3 u(q.x, q.y, q.z);
+	return u*(2.0f*Dot(u, v)) + v*(q.w*q.w - Dot(u, u)) + Cross(u, v)*(2.0f*q.w);
+}
+static inline Vec3 rotateInv(const Quat& q, const Vec3& v) {
+	return rotate(Quat(-q.x, -q.y, -q.z, q.w), v);
+}
+static inline Quat nlerp(const Quat& a, const Quat& b, float t) {
+	float s = (a.x*b.x + a.y*b.y + a.z*b.z + a.w*b.w) < 0.0f ? -1.0f : 1.0f; //shortest way
+	Quat q(a.x + (s*b.x - a.x)*t, a.y + (s*b.y - a.y)*t, a.z + (s*b.z - a.z)*t, a.w + (s*b.w - a.w)*t);
+	float l = std::sqrt(q.x*q.x + q.y*q.y + q.z*q.z + q.w*q.w);
+	if (l > 0.0f) { q.x /= l; q.y /= l; q.z /= l; q.w /= l; }
+	return q;
+}
+
+/// Ericson's closest point on triangle
+static Vec3 closestOnTriangle(const Vec3& p, const Vec3& a, const Vec3& b, const Vec3& c) {
+	Vec3 ab = b - a, ac = c - a, ap = p - a;
+	float d1 = Dot(ab, ap), d2 = Dot(ac, ap);
+	if (d1 <= 0.0f && d2 <= 0.0f)return a;
+	Vec3 bp = p - b;
+	float d3 = Dot(ab, bp), d4 = Dot(ac, bp);
+	if (d3 >= 0.0f && d4 <= d3)return b;
+	float vc = d1*d4 - d3*d2;
+	if (vc <= 0.0f && d1 >= 0.0f && d3 <= 0.0f)return a + ab*(d1 / (d1 - d3));
+	Vec3 cp = p - c;
+	float d5 = Dot(ab, cp), d6 = Dot(ac, cp);
+	if (d6 >= 0.0f && d5 <= d6)return c;
+	float vb = d5*d2 - d1*d6;
+	if (vb <= 0.0f && d2 >= 0.0f && d6 <= 0.0f)return a + ac*(d2 / (d2 - d6));
+	float va = d3*d6 - d5*d4;
+	if (va <= 0.0f && (d4 - d3) >= 0.0f && (d5 - d6) >= 0.0f)return b + (c - b)*((d4 - d3) / ((d4 - d3) + (d5 - d6)));
+	float denom = 1.0f / (va + vb + vc);
+	return a + ab*(vb*denom) + ac*(vc*denom);
+}
+
+static inline unsigned cellHash(int x, int y, int z) {
+	return unsigned(x) * 73856093u ^ unsigned(y) * 19349663u ^ unsigned(z) * 83492791u;
+}
+
+
+
+/// Shape as the solver sees it during one substep: world transform, bounding sphere for culling and resolved mesh data
+struct NvFlexHCpuShape {
+	int type;
+	NvFlexCollisionGeometry geo;
+	Vec3 prevposition, position;
+	Quat prevrotation, rotation;
+	Vec3 center;
+	Quat rot;
+	float boundr;
+	const NvFlexHCpuBackend::TriangleMesh* mesh;
+	const NvFlexHCpuBackend::ConvexMesh* convex;
+	const NvFlexHCpuBackend::DistanceField* field;
+};
+
+
+class NvFlexHCpuContainer :public NvFlexHContainer {
+public:
+	NvFlexHCpuContainer(NvFlexHCpuBackend* backend, int maxParticles, int maxNeighbours);
+	~NvFlexHCpuContainer();
+
+	NvFlexHBackend* backend()const { return _backend; }
+
+	int maxParticles()const { return _maxParticles; }
+	int capacity()const { return _capacity; }
+	int activeCount()const { return int(_active.size()); }
+	bool reserve(int count);
+
+	//particles
+	int allocParticles(int n, int* indices);
+	void freeParticles(int n, const int* indices);
+	int getActiveList(int* indices);
+	NvFlexHParticleData mapParticleData();
+	void unmapParticleData() {}
+	void pushParticlesToDevice();
+	void pullParticlesFromDevice();
+
+	//springs
+	int getSpringsCount()const { return int(_springRestLengths.size()); }
+	void resizeSpringData(int newSize) {
+		_springIndices.resize(2 * newSize);
+		_springRestLengths.resize(newSize);
+		_springStrenghts.resize(newSize);
+	}
+	NvFlexHSpringData mapSpringData() { return NvFlexHSpringData(_springIndices.data(), _springRestLengths.data(), _springStrenghts.data()); }
+	void unmapSpringData() {}
+	void pushSpringsToDevice() {
+		_simSpringIndices = _springIndices;
+		_simSpringRestLengths = _springRestLengths;
+		_simSpringStrenghts = _springStrenghts;
+	}
+
+	//triangles
+	int getTrianglesCount()const { return int(_triangleIndices.size() / 3); }
+	void resizeTriangleData(int newSize) {
+		_triangleIndices.resize(3 * newSize);
+		_triangleNormals.resize(3 * newSize);
+	}
+	NvFlexHTriangleData mapTriangleData() { return NvFlexHTriangleData(_triangleIndices.data(), _triangleNormals.data()); }
+	void unmapTriangleData() {}
+	void pushTrianglesToDevice(bool pushNormals) {
+		//kept only so the data flow is the same as with flex. they do not collide here
+		_simTriangleIndices = _triangleIndices;
+		_triangleNormalsPushed = pushNormals;
+	}
+	bool hasTriangleNormals()const { return _triangleNormalsPushed; }
+
+	//rigids
+	int getRigidsCount()const { return int(_rigidStiffness.size()); }
+	int getRigidIndicesCount()const { return int(_rigidIndices.size()); }
+	void resizeRigidData(int numRigids, int numIndices) {
+		_rigidOffsets.resize(numRigids > 0 ? numRigids + 1 : 0);
+		_rigidIndices.resize(numIndices);
+		_rigidRestPositions.resize(3 * size_t(numIndices));
+		_rigidRestNormals.resize(4 * size_t(numIndices));
+		_rigidStiffness.resize(numRigids);
+		_rigidThresholds.resize(numRigids);
+		_rigidCreeps.resize(numRigids);
+		_rigidRotations.resize(4 * size_t(numRigids));
+		_rigidTranslations.resize(3 * size_t(numRigids));
+	}
+	NvFlexHRigidData mapRigidData();
+	void unmapRigidData() {}
+	void pushRigidsToDevice();
+	NvFlexHRigidTransforms mapRigidTransforms();
+	void unmapRigidTransforms() {}
+
+	//inflatables
+	int getInflatablesCount()const { return int(_inflatableStarts.size()); }
+	void resizeInflatableData(int newSize) {
+		_inflatableStarts.resize(newSize);
+		_inflatableCounts.resize(newSize);
+		_inflatableVolumes.resize(newSize);
+		_inflatablePressures.resize(newSize);
+		_inflatableStiffness.resize(newSize);
+	}
+	NvFlexHInflatableData mapInflatableData();
+	void unmapInflatableData() {}
+	void pushInflatablesToDevice() {
+		_simInflatableStarts = _inflatableStarts;
+		_simInflatableCounts = _inflatableCounts;
+		_simInflatableVolumes = _inflatableVolumes;
+		_simInflatablePressures = _inflatablePressures;
+		_simInflatableStiffness = _inflatableStiffness;
+	}
+
+	//shapes
+	NvFlexHCollisionData* collisionData() { return _colld.get(); }
+	void pushShapesToDevice();
+
+	//simulation
+	void setParams(const NvFlexParams& params) { _params = params; }
+	/// no device here, tick wall time measured outside is all there is, so enableTimers changes nothing
+	void tick(float dt, int substeps, bool enableTimers);
+
+private:
+	void grow(int newcap);
+	void buildGrid(float cellsize);
+	void findNeighbours(float radius);
+	void placeShapes(float t);
+	void solveParticles(float h, float restdensity);
+	void solveSprings();
+	void solveRigids();
+	void solveInflatables();
+	void solveShapes();
+	void updateVelocities(float dt, float h, float restdensity);
+	bool shapeDistance(const NvFlexHCpuShape& shp, const Vec3& p, const Vec3& x0, float maxdist, float& dist, Vec3& normal)const;
+	void collide(Vec3& p, const Vec3& x0, const Vec3& normal, float penetration)const;
+
+	NvFlexHCpuBackend* _backend;
+	NvFlexHThreadPool* _pool;
+	int _maxParticles;
+	int _capacity;
+	int _maxNeighbours;
+	bool _triangleNormalsPushed;
+	NvFlexParams _params;
+
+	//host side, what map gives out
+	std::vector<float> _particles;
+	std::vector<float> _restParticles;
+	std::vector<float> _velocities;
+	std::vector<int> _phases;
+	std::vector<float> _normals;
+	std::vector<int> _active;
+	std::vector<int> _activePos; //where particle sits in _active, -1 if free
+	std::vector<int> _freeList;
+
+	std::vector<int> _springIndices;
+	std::vector<float> _springRestLengths;
+	std::vector<float> _springStrenghts;
+	std::vector<int> _triangleIndices;
+	std::vector<float> _triangleNormals;
+	std::vector<int> _rigidOffsets;
+	std::vector<int> _rigidIndices;
+	std::vector<float> _rigidRestPositions;
+	std::vector<float> _rigidRestNormals; //kept for the data flow, particles don't collide with rigid surfaces here
+	std::vector<float> _rigidStiffness;
+	std::vector<float> _rigidThresholds;
+	std::vector<float> _rigidCreeps;
+	std::vector<float> _rigidRotations;
+	std::vector<float> _rigidTranslations;
+	std::vector<int> _inflatableStarts;
+	std::vector<int> _inflatableCounts;
+	std::vector<float> _inflatableVolumes;
+	std::vector<float> _inflatablePressures;
+	std::vector<float> _inflatableStiffness;
+	std::vector<Quat> _pulledRigidRotations;
+	std::vector<Vec3> _pulledRigidTranslations;
+	std::unique_ptr<NvFlexHCollisionData> _colld;
+
+	//"device" side, compact arrays of active particles as of last push
+	std::vector<int> _simActive;
+	std::vector<int> _compactIndex; //flex index -> index in _simActive, -1 if not simulated
+	std::vector<Vec4> _x;
+	std::vector<Vec3> _v;
+	std::vector<int> _phase;
+	std::vector<int> _simSpringIndices;
+	std::vector<float> _simSpringRestLengths;
+	std::vector<float> _simSpringStrenghts;
+	std::vector<int> _simTriangleIndices;
+	std::vector<int> _simRigidOffsets;
+	std::vector<int> _simRigidIndices;
+	std::vector<Vec3> _simRigidRest; //plastic deformation goes in here, host rest positions stay as uploaded
+	std::vector<float> _simRigidStiffness;
+	std::vector<float> _simRigidThresholds;
+	std::vector<float> _simRigidCreeps;
+	std::vector<Quat> _simRigidRotations;
+	std::vector<Vec3> _simRigidTranslations;
+	std::vector<int> _simInflatableStarts;
+	std::vector<int> _simInflatableCounts;
+	std::vector<float> _simInflatableVolumes;
+	std::vector<float> _simInflatablePressures;
+	std::vector<float> _simInflatableStiffness;
+	std::vector<NvFlexHCpuShape> _shapes;
+
+	//scratch
+	std::vector<Vec3> _p, _x0, _delta, _vnew;
+	std::vector<Vec3> _volumeGrad;
+	std::vector<std::pair<int, Vec3> > _inflatableVerts;
+	std::vector<float> _lambda;
+	std::vector<int> _neighbours, _neighbourCount;
+	std::vector<unsigned> _cellOf;
+	std::vector<int> _cellStart, _sorted;
+	unsigned _cellMask;
+	float _cellSize;
+};
+
+
+NvFlexHCpuContainer::NvFlexHCpuContainer(NvFlexHCpuBackend* backend, int maxParticles, int maxNeighbours) :_backend(backend), _pool(backend->threadPool()),
+	_maxParticles(maxParticles), _capacity(0), _maxNeighbours(maxNeighbours), _triangleNormalsPushed(false), _cellMask(0), _cellSize(1.0f) {
+	if (maxParticles <= 0)throw std::runtime_error("CPU CONTAINER NEEDS PARTICLES!");
+	memset(&_params, 0, sizeof(_params));
+	grow(std::min(maxParticles, NVFLEXH_INITIAL_CAPACITY));
+	_colld.reset(new NvFlexHCollisionData(backend));
+}
+
+NvFlexHCpuContainer::~NvFlexHCpuContainer() {
+	//sim data dies whenever houdini decides, maybe while another network is solving and using the backend's meshes
+	NvFlexHContextGuard guard(_backend);
+	_colld.reset();
+}
+
+void NvFlexHCpuContainer::grow(int newcap) {
+	//vectors keep contents, new particles are zero and free
+	_particles.resize(4 * size_t(newcap), 0.0f);
+	_restParticles.resize(4 * size_t(newcap), 0.0f);
+	_velocities.resize(3 * size_t(newcap), 0.0f);
+	_phases.resize(newcap, 0);
+	_normals.resize(4 * size_t(newcap), 0.0f);
+	_activePos.resize(newcap, -1);
+	_compactIndex.resize(newcap, -1);
+	//free list is a stack, new indices go under the old free ones, so lowest indices still go out first
+	std::vector<int> freelist;
+	freelist.reserve(_freeList.size() + size_t(newcap - _capacity));
+	for (int i = newcap - 1; i >= _capacity; --i)freelist.push_back(i);
+	freelist.insert(freelist.end(), _freeList.begin(), _freeList.end());
+	_freeList.swap(freelist);
+	_capacity = newcap;
+}
+
+bool NvFlexHCpuContainer::reserve(int count) {
+	if (count <= _capacity)return true;
+	if (count > _maxParticles)return false;
+	//no device copy to migrate here, simulated arrays are compact and index through _compactIndex
+	grow(nvFlexHGrownCapacity(_capacity, count, _maxParticles));
+	return true;
+}
+
+int NvFlexHCpuContainer::allocParticles(int n, int* indices) {
+	int count = std::min(n, int(_freeList.size()));
+	for (int i = 0; i < count; ++i) {
+		int id = _freeList.back();
+		_freeList.pop_back();
+		_activePos[id] = int(_active.size());
+		_active.push_back(id);
+		indices[i] = id;
+	}
+	return count;
+}
+
+void NvFlexHCpuContainer::freeParticles(int n, const int* indices) {
+	for (int i = 0; i < n; ++i) {
+		int id = indices[i];
+		int pos = _activePos[id];
+		if (pos < 0)continue;
+		int last = _active.back();
+		_active[pos] = last;
+		_activePos[last] = pos;
+		_active.pop_back();
+		_activePos[id] = -1;
+		_freeList.push_back(id);
+	}
+}
+
+int NvFlexHCpuContainer::getActiveList(int* indices) {
+	if (!_active.empty())memcpy(indices, _active.data(), _active.size() * sizeof(int));
+	return int(_active.size());
+}
+
+NvFlexHParticleData NvFlexHCpuContainer::mapParticleData() {
+	NvFlexHParticleData pdat;
+	pdat.particles = _particles.data();
+	pdat.restParticles = _restParticles.data();
+	pdat.velocities = _velocities.data();
+	pdat.phases = _phases.data();
+	pdat.normals = _normals.data();
+	return pdat;
+}
+
+void NvFlexHCpuContainer::pushParticlesToDevice() {
+	for (size_t i = 0; i < _simActive.size(); ++i)_compactIndex[_simActive[i]] = -1;
+	_simActive = _active;
+	int n = int(_simActive.size());
+	for (int i = 0; i < n; ++i)_compactIndex[_simActive[i]] = i;
+	_x.resize(n);
+	_v.resize(n);
+	_phase.resize(n);
+	_pool->parallelFor(n, kGrain, [this](int begin, int end) {
+		for (int i = begin; i < end; ++i) {
+			int id = _simActive[i];
+			const float* pp = &_particles[4 * size_t(id)];
+			const float* vp = &_velocities[3 * size_t(id)];
+			_x[i] = Vec4(pp[0], pp[1], pp[2], pp[3]);
+			_v[i] = Vec3(vp[0], vp[1], vp[2]);
+			_phase[i] = _phases[id];
+		}
+	});
+}
+
+void NvFlexHCpuContainer::pullParticlesFromDevice() {
+	int n = int(_simActive.size());
+	_pool->parallelFor(n, kGrain, [this](int begin, int end) {
+		for (int i = begin; i < end; ++i) {
+			int id = _simActive[i];
+			float* pp = &_particles[4 * size_t(id)];
+			float* vp = &_velocities[3 * size_t(id)];
+			pp[0] = _x[i].x; pp[1] = _x[i].y; pp[2] = _x[i].z; pp[3] = _x[i].w;
+			vp[0] = _v[i].x; vp[1] = _v[i].y; vp[2] = _v[i].z;
+		}
+	});
+	_pulledRigidRotations = _simRigidRotations;
+	_pulledRigidTranslations = _simRigidTranslations;
+}
+
+NvFlexHRigidData NvFlexHCpuContainer::mapRigidData() {
+	NvFlexHRigidData rdat;
+	rdat.offsets = _rigidOffsets.data();
+	rdat.indices = _rigidIndices.data();
+	rdat.restPositions = _rigidRestPositions.data();
+	rdat.restNormals = _rigidRestNormals.data();
+	rdat.stiffness = _rigidStiffness.data();
+	rdat.thresholds = _rigidThresholds.data();
+	rdat.creeps = _rigidCreeps.data();
+	rdat.rotations = _rigidRotations.data();
+	rdat.translations = _rigidTranslations.data();
+	return rdat;
+}
+
+void NvFlexHCpuContainer::pushRigidsToDevice() {
+	const int nrigids = getRigidsCount();
+	const int nindices = getRigidIndicesCount();
+	_simRigidOffsets = _rigidOffsets;
+	_simRigidIndices = _rigidIndices;
+	_simRigidStiffness = _rigidStiffness;
+	_simRigidThresholds = _rigidThresholds;
+	_simRigidCreeps = _rigidCreeps;
+	_simRigidRest.resize(nindices);
+	for (int i = 0; i < nindices; ++i)_simRigidRest[i] = Vec3(_rigidRestPositions[3 * i], _rigidRestPositions[3 * i + 1], _rigidRestPositions[3 * i + 2]);
+	_simRigidRotations.resize(nrigids);
+	_simRigidTranslations.resize(nrigids);
+	for (int r = 0; r < nrigids; ++r) {
+		const float* q = &_rigidRotations[4 * r];
+		_simRigidRotations[r] = Quat(q[0], q[1], q[2], q[3]);
+		_simRigidTranslations[r] = Vec3(_rigidTranslations[3 * r], _rigidTranslations[3 * r + 1], _rigidTranslations[3 * r + 2]);
+	}
+}
+
+NvFlexHInflatableData NvFlexHCpuContainer::mapInflatableData() {
+	NvFlexHInflatableData idat;
+	idat.startTris = _inflatableStarts.data();
+	idat.numTris = _inflatableCounts.data();
+	idat.restVolumes = _inflatableVolumes.data();
+	idat.overPressures = _inflatablePressures.data();
+	idat.constraintScales = _inflatableStiffness.data();
+	return idat;
+}
+
+NvFlexHRigidTransforms NvFlexHCpuContainer::mapRigidTransforms() {
+	NvFlexHRigidTransforms tdat;
+	tdat.count = int(_pulledRigidRotations.size());
+	if (tdat.count == 0)return tdat;
+	tdat.rotations = &_pulledRigidRotations[0].x;
+	tdat.translations = &_pulledRigidTranslations[0].x;
+	return tdat;
+}
+
+void NvFlexHCpuContainer::pushShapesToDevice() {
+	const NvFlexHCollisionData* cd = _colld.get();
+	int count = cd->size();
+	_shapes.resize(count);
+	for (int i = 0; i < count; ++i) {
+		NvFlexHCpuShape& shp = _shapes[i];
+		shp.type = cd->flags()[i] & eNvFlexShapeFlagTypeMask;
+		shp.geo = cd->geometry()[i];
+		shp.position = xyz(cd->positions()[i]);
+		shp.rotation = cd->rotations()[i];
+		shp.prevposition = xyz(cd->prevPositions()[i]);
+		shp.prevrotation = cd->prevRotations()[i];
+		//mesh ids are resolved here, so the solver loops never touch backend maps
+		shp.mesh = shp.type == eNvFlexShapeTriangleMesh ? _backend->triangleMesh(shp.geo.triMesh.mesh) : NULL;
+		shp.convex = shp.type == eNvFlexShapeConvexMesh ? _backend->convexMesh(shp.geo.convexMesh.mesh) : NULL;
+		shp.field = shp.type == eNvFlexShapeSDF ? _backend->distanceField(shp.geo.sdf.field) : NULL;
+
+		//bounding sphere around shape origin
+		switch (shp.type) {
+		case eNvFlexShapeSphere:
+			shp.boundr = shp.geo.sphere.radius; break;
+		case eNvFlexShapeCapsule:
+			shp.boundr = shp.geo.capsule.radius + shp.geo.capsule.halfHeight; break;
+		case eNvFlexShapeBox:
+			shp.boundr = Length(Vec3(shp.geo.box.halfExtents[0], shp.geo.box.halfExtents[1], shp.geo.box.halfExtents[2])); break;
+		case eNvFlexShapeConvexMesh:
+		case eNvFlexShapeTriangleMesh: {
+			const float* scl = shp.type == eNvFlexShapeConvexMesh ? shp.geo.convexMesh.scale : shp.geo.triMesh.scale;
+			Vec3 lo = shp.mesh != NULL ? shp.mesh->lower : (shp.convex != NULL ? shp.convex->lower : Vec3(0.0f));
+			Vec3 up = shp.mesh != NULL ? shp.mesh->upper : (shp.convex != NULL ? shp.convex->upper : Vec3(0.0f));
+			Vec3 far(std::max(std::fabs(lo.x), std::fabs(up.x)), std::max(std::fabs(lo.y), std::fabs(up.y)), std::max(std::fabs(lo.z), std::fabs(up.z)));
+			shp.boundr = Length(mulv(far, Vec3(std::fabs(scl[0]), std::fabs(scl[1]), std::fabs(scl[2]))));
+			break;
+		}
+		case eNvFlexShapeSDF:
+			shp.boundr = std::fabs(shp.geo.sdf.scale) * 1.7320508f; break;
+		default:
+			shp.boundr = 0.0f;
+		}
+		shp.center = shp.position;
+		shp.rot = shp.rotation;
+	}
+	_colld->markPushed();
+}
+
+
+void NvFlexHCpuContainer::tick(float dt, int substeps, bool /*enableTimers*/) {
+	const int n = int(_simActive.size());
+	if (n == 0 || dt <= 0.0f)return;
+	if (substeps < 1)substeps = 1;
+	const float sdt = dt / substeps;
+	const float h = _params.radius > 0.0f ? _params.radius : 0.1f;
+
+	//rest density is what a particle sees with neighbours on a lattice of rest distance
+	float restdensity = 0.0f;
+	{
+		float d = _params.fluidRestDistance > 0.0f ? _params.fluidRestDistance : h * 0.5f;
+		int k = int(std::ceil(h / d));
+		for (int ix = -k; ix <= k; ++ix)for (int iy = -k; iy <= k; ++iy)for (int iz = -k; iz <= k; ++iz) {
+			float r2 = d*d*float(ix*ix + iy*iy + iz*iz);
+			if (r2 < h*h) { float w = h*h - r2; restdensity += w*w*w; }
+		}
+		restdensity *= 315.0f / (64.0f * kPi * std::pow(h, 9.0f));
+	}
+
+	_p.resize(n);
+	_x0.resize(n);
+	_delta.resize(n);
+	_vnew.resize(n);
+	_lambda.resize(n);
+
+	for (int step = 0; step < substeps; ++step) {
+		placeShapes(float(step + 1) / substeps);
+
+		//predict
+		const Vec3 gravity(_params.gravity[0], _params.gravity[1], _params.gravity[2]);
+		_pool->parallelFor(n, kGrain, [&](int begin, int end) {
+			for (int i = begin; i < end; ++i) {
+				_x0[i] = xyz(_x[i]);
+				if (_x[i].w > 0.0f) {
+					bool fluid = (_phase[i] & eNvFlexPhaseFluid) != 0;
+					_v[i] += gravity * (fluid ? _params.buoyancy * sdt : sdt);
+					_p[i] = _x0[i] + _v[i] * sdt;
+				}
+				else _p[i] = _x0[i];
+			}
+		});
+
+		buildGrid(h);
+		findNeighbours(h);
+
+		int iterations = std::max(_params.numIterations, 1);
+		for (int it = 0; it < iterations; ++it) {
+			solveParticles(h, restdensity);
+			solveSprings();
+			solveRigids();
+			solveInflatables();
+			solveShapes();
+		}
+
+		updateVelocities(sdt, h, restdensity);
+	}
+}
+
+
+void NvFlexHCpuContainer::placeShapes(float t) {
+	//flex moves shapes from prev to current transform over the substeps, so fast colliders don't jump
+	for (size_t i = 0; i < _shapes.size(); ++i) {
+		NvFlexHCpuShape& shp = _shapes[i];
+		shp.center = shp.prevposition + (shp.position - shp.prevposition) * t;
+		shp.rot = nlerp(shp.prevrotation, shp.rotation, t);
+	}
+}
+
+
+void NvFlexHCpuContainer::buildGrid(float cellsize) {
+	const int n = int(_p.size());
+	unsigned tablesize = 64;
+	while (tablesize < unsigned(2 * n))tablesize <<= 1;
+	_cellMask = tablesize - 1;
+	_cellSize = cellsize;
+	const float inv = 1.0f / cellsize;
+
+	_cellOf.resize(n);
+	_pool->parallelFor(n, kGrain, [&](int begin, int end) {
+		for (int i = begin; i < end; ++i) {
+			const Vec3& p = _p[i];
+			_cellOf[i] = cellHash(int(std::floor(p.x*inv)), int(std::floor(p.y*inv)), int(std::floor(p.z*inv))) & _cellMask;
+		}
+	});
+
+	//counting sort by cell, serial but it's just two passes over ints
+	_cellStart.assign(tablesize + 1, 0);
+	for (int i = 0; i < n; ++i)++_cellStart[_cellOf[i] + 1];
+	for (unsigned c = 0; c < tablesize; ++c)_cellStart[c + 1] += _cellStart[c];
+	_sorted.resize(n);
+	std::vector<int> fill(_cellStart.begin(), _cellStart.end() - 1);
+	for (int i = 0; i < n; ++i)_sorted[fill[_cellOf[i]]++] = i;
+}
+
+void NvFlexHCpuContainer::findNeighbours(float radius) {
+	const int n = int(_p.size());
+	const int maxn = _maxNeighbours;
+	_neighbours.resize(size_t(n) * maxn);
+	_neighbourCount.resize(n);
+	const float r2 = radius*radius;
+	const float inv = 1.0f / _cellSize;
+
+	_pool->parallelFor(n, kGrain / 4, [&](int begin, int end) {
+		unsigned buckets[27];
+		for (int i = begin; i < end; ++i) {
+			const Vec3 p = _p[i];
+			int cx = int(std::floor(p.x*inv)), cy = int(std::floor(p.y*inv)), cz = int(std::floor(p.z*inv));
+			//different cells may hash into one bucket, so buckets are deduplicated not to count neighbours twice
+			int nb = 0;
+			for (int dx = -1; dx <= 1; ++dx)for (int dy = -1; dy <= 1; ++dy)for (int dz = -1; dz <= 1; ++dz) {
+				buckets[nb++] = cellHash(cx + dx, cy + dy, cz + dz) & _cellMask;
+			}
+			std::sort(buckets, buckets + nb);
+			nb = int(std::unique(buckets, buckets + nb) - buckets);
+
+			int* nbrs = &_neighbours[size_t(i) * maxn];
+			int count = 0;
+			for (int b = 0; b < nb && count < maxn; ++b) {
+				for (int s = _cellStart[buckets[b]]; s < _cellStart[buckets[b] + 1]; ++s) {
+					int j = _sorted[s];
+					if (j == i)continue;
+					if (lengthSq(_p[j] - p) >= r2)continue;
+					nbrs[count++] = j;
+					if (count == maxn)break;
+				}
+			}
+			_neighbourCount[i] = count;
+		}
+	});
+}
+
+
+void NvFlexHCpuContainer::solveParticles(float h, float restdensity) {
+	const int n = int(_p.size());
+	const int maxn = _maxNeighbours;
+	const float h2 = h*h;
+	const float poly6 = 315.0f / (64.0f * kPi * std::pow(h, 9.0f)) / restdensity;
+	const float spiky = -45.0f / (kPi * std::pow(h, 6.0f)) / restdensity;
+	const float restd = _params.fluidRestDistance > 0.0f ? _params.fluidRestDistance : h * 0.5f;
+	const float eps = 1e-4f / (restd*restd);
+	const float solidrest = _params.solidRestDistance > 0.0f ? _params.solidRestDistance : restd;
+	const bool dofluid = _params.fluid;
+	const float relax = _params.relaxationFactor > 0.0f ? _params.relaxationFactor : 1.0f;
+
+	//density constraints, kernels are already divided by rest density so C = rho - 1
+	_pool->parallelFor(n, kGrain, [&](int begin, int end) {
+		for (int i = begin; i < end; ++i) {
+			_lambda[i] = 0.0f;
+			if (!dofluid || (_phase[i] & eNvFlexPhaseFluid) == 0 || _x[i].w == 0.0f)continue;
+			const Vec3 pi = _p[i];
+			float w0 = h2*h2*h2;
+			float density = poly6 * w0;
+			Vec3 gradi(0.0f);
+			float sumgrad2 = 0.0f;
+			const int* nbrs = &_neighbours[size_t(i) * maxn];
+			for (int k = 0; k < _neighbourCount[i]; ++k) {
+				int j = nbrs[k];
+				Vec3 d = pi - _p[j];
+				float r2 = lengthSq(d);
+				float w = h2 - r2;
+				float scale = (_phase[j] & eNvFlexPhaseFluid) != 0 ? 1.0f : _params.solidPressure;
+				density += poly6 * w*w*w * scale;
+				float r = std::sqrt(r2);
+				if (r > 1e-9f) {
+					Vec3 g = d * (spiky * (h - r)*(h - r) / r * scale);
+					gradi += g * -1.0f;
+					sumgrad2 += lengthSq(g);
+				}
+			}
+			float c = density - 1.0f;
+			if (c <= 0.0f)continue; //no tension, free surface particles only get pushed, never pulled
+			sumgrad2 += lengthSq(gradi);
+			_lambda[i] = -c / (sumgrad2 + eps);
+		}
+	});
+
+	//position deltas from density and contacts with solid particles. every particle only writes itself
+	_pool->parallelFor(n, kGrain, [&](int begin, int end) {
+		for (int i = begin; i < end; ++i) {
+			_delta[i] = Vec3(0.0f);
+			const float wi = _x[i].w;
+			if (wi == 0.0f)continue;
+			const Vec3 pi = _p[i];
+			const int phi = _phase[i];
+			const bool fluidi = dofluid && (phi & eNvFlexPhaseFluid) != 0;
+			Vec3 fluiddelta(0.0f), contactdelta(0.0f);
+			int contacts = 0;
+			const int* nbrs = &_neighbours[size_t(i) * maxn];
+			for (int k = 0; k < _neighbourCount[i]; ++k) {
+				int j = nbrs[k];
+				const int phj = _phase[j];
+				const bool fluidj = dofluid && (phj & eNvFlexPhaseFluid) != 0;
+				Vec3 d = pi - _p[j];
+				float r = Length(d);
+				if (fluidi && fluidj) {
+					if (r > 1e-9f)fluiddelta += d * (spiky * (h - r)*(h - r) / r * (_lambda[i] + _lambda[j]));
+					continue;
+				}
+				//same group only collides with the self collide flag
+				if ((phi & eNvFlexPhaseGroupMask) == (phj & eNvFlexPhaseGroupMask) && (phi & eNvFlexPhaseSelfCollide) == 0)continue;
+				if (r >= solidrest || r <= 1e-9f)continue;
+				float wj = _x[j].w;
+				contactdelta += d * ((solidrest - r) / r * wi / (wi + wj));
+				++contacts;
+			}
+			_delta[i] = fluiddelta * relax;
+			if (contacts > 0)_delta[i] += contactdelta * (relax / contacts);
+		}
+	});
+
+	_pool->parallelFor(n, kGrain, [&](int begin, int end) {
+		for (int i = begin; i < end; ++i)_p[i] += _delta[i];
+	});
+}
+
+void NvFlexHCpuContainer::solveSprings() {
+	//serial gauss-seidel, springs share particles so they cannot just go in parallel
+	const int count = int(_simSpringRestLengths.size());
+	if (count == 0)return;
+
+	//springs address flex indices, solver works on compact ones
+	const std::vector<int>& compact = _compactIndex;
+	for (int s = 0; s < count; ++s) {
+		int a = _simSpringIndices[2 * s], b = _simSpringIndices[2 * s + 1];
+		if (a < 0 || b < 0 || a >= _capacity || b >= _capacity)continue;
+		a = compact[a]; b = compact[b];
+		if (a < 0 || b < 0)continue;
+		float wa = _x[a].w, wb = _x[b].w;
+		if (wa + wb == 0.0f)continue;
+		Vec3 d = _p[a] - _p[b];
+		float r = Length(d);
+		if (r <= 1e-9f)continue;
+		float stiffness = clampf(_simSpringStrenghts[s], 0.0f, 1.0f);
+		Vec3 corr = d * ((r - _simSpringRestLengths[s]) / (r * (wa + wb)) * stiffness);
+		_p[a] += corr * -wa;
+		_p[b] += corr * wb;
+	}
+}
+
+void NvFlexHCpuContainer::solveRigids() {
+	//serial gauss-seidel like springs, soft bodies are usually made of clusters that overlap
+	const int count = int(_simRigidStiffness.size());
+	const std::vector<int>& compact = _compactIndex;
+	for (int r = 0; r < count; ++r) {
+		const int begin = _simRigidOffsets[r], end = _simRigidOffsets[r + 1];
+		//mass weighted center. clusters of static particles only keep the pose they have
+		Vec3 center(0.0f);
+		float mass = 0.0f;
+		for (int k = begin; k < end; ++k) {
+			int id = _simRigidIndices[k];
+			int i = id >= 0 && id < _capacity ? compact[id] : -1;
+			if (i < 0 || _x[i].w == 0.0f)continue;
+			float m = 1.0f / _x[i].w;
+			center += _p[i] * m;
+			mass += m;
+		}
+		if (mass == 0.0f)continue;
+		center = center * (1.0f / mass);
+
+		Vec3 A[3] = { Vec3(0.0f), Vec3(0.0f), Vec3(0.0f) };
+		for (int k = begin; k < end; ++k) {
+			int id = _simRigidIndices[k];
+			int i = id >= 0 && id < _capacity ? compact[id] : -1;
+			if (i < 0 || _x[i].w == 0.0f)continue;
+			Vec3 d = (_p[i] - center) * (1.0f / _x[i].w);
+			const Vec3& rest = _simRigidRest[k];
+			A[0] += d * rest.x;
+			A[1] += d * rest.y;
+			A[2] += d * rest.z;
+		}
+		Quat& q = _simRigidRotations[r];
+		nvFlexHExtractRotation(A, q, 8);
+		_simRigidTranslations[r] = center;
+
+		const float stiffness = clampf(_simRigidStiffness[r], 0.0f, 1.0f);
+		const float threshold = _simRigidThresholds[r];
+		const float creep = clampf(_simRigidCreeps[r], 0.0f, 1.0f);
+		for (int k = begin; k < end; ++k) {
+			int id = _simRigidIndices[k];
+			int i = id >= 0 && id < _capacity ? compact[id] : -1;
+			if (i < 0 || _x[i].w == 0.0f)continue;
+			Vec3& rest = _simRigidRest[k];
+			//deformation over threshold stays for good, in rest space so it rotates with the cluster
+			if (threshold > 0.0f && creep > 0.0f) {
+				Vec3 deform = nvFlexHRotateInv(q, _p[i] - center) - rest;
+				if (lengthSq(deform) > threshold*threshold)rest += deform * creep;
+			}
+			Vec3 goal = nvFlexHRotate(q, rest) + center;
+			_p[i] += (goal - _p[i]) * stiffness;
+		}
+	}
+}
+
+void NvFlexHCpuContainer::solveInflatables() {
+	//one volume constraint per mesh: C = volume - overPressure * restVolume,
+	//gradient at a vertex is the sum of cross products of the other two corners over its triangles
+	const int count = int(_simInflatableStarts.size());
+	if (count == 0)return;
+	const int ntris = int(_simTriangleIndices.size() / 3);
+	const std::vector<int>& compact = _compactIndex;
+	_volumeGrad.resize(_p.size(), Vec3(0.0f));
+	for (int f = 0; f < count; ++f) {
+		const int begin = std::max(_simInflatableStarts[f], 0);
+		const int end = std::min(_simInflatableStarts[f] + _simInflatableCounts[f], ntris);
+		float volume = 0.0f;
+		for (int t = begin; t < end; ++t) {
+			int v[3];
+			bool valid = true;
+			for (int k = 0; k < 3; ++k) {
+				int id = _simTriangleIndices[3 * t + k];
+				v[k] = id >= 0 && id < _capacity ? compact[id] : -1;
+				valid = valid && v[k] >= 0;
+			}
+			if (!valid)continue;
+			const Vec3 &a = _p[v[0]], &b = _p[v[1]], &c = _p[v[2]];
+			volume += Dot(a, Cross(b, c));
+			_volumeGrad[v[0]] += Cross(b, c);
+			_volumeGrad[v[1]] += Cross(c, a);
+			_volumeGrad[v[2]] += Cross(a, b);
+		}
+
+		//vertices are shared by triangles, each is taken once and its slot cleared for the next mesh
+		_inflatableVerts.clear();
+		float denom = 0.0f;
+		for (int t = begin; t < end; ++t) {
+			for (int k = 0; k < 3; ++k) {
+				int id = _simTriangleIndices[3 * t + k];
+				int i = id >= 0 && id < _capacity ? compact[id] : -1;
+				if (i < 0)continue;
+				Vec3 g = _volumeGrad[i] * (1.0f / 6.0f);
+				if (lengthSq(g) == 0.0f)continue;
+				_volumeGrad[i] = Vec3(0.0f);
+				_inflatableVerts.push_back(std::make_pair(i, g));
+				denom += _x[i].w * lengthSq(g);
+			}
+		}
+		if (denom <= 1e-12f)continue;
+
+		const float c = volume / 6.0f - _simInflatablePressures[f] * _simInflatableVolumes[f];
+		const float lambda = -c / denom * clampf(_simInflatableStiffness[f], 0.0f, 1.0f);
+		for (size_t k = 0; k < _inflatableVerts.size(); ++k) {
+			const int i = _inflatableVerts[k].first;
+			_p[i] += _inflatableVerts[k].second * (lambda * _x[i].w);
+		}
+	}
+}
+
+
+/// x0 is where particle started the substep, thin triangle meshes need it to know which side particle came from
+bool NvFlexHCpuContainer::shapeDistance(const NvFlexHCpuShape& shp, const Vec3& p, const Vec3& x0, float maxdist, float& dist, Vec3& normal)const {
+	//everything is done in shape space, only the normal goes back to world
+	const Vec3 q = rotateInv(shp.rot, p - shp.center);
+	Vec3 n(0.0f);
+	float d = FLT_MAX;
+
+	switch (shp.type) {
+	case eNvFlexShapeSphere: {
+		float l = Length(q);
+		d = l - shp.geo.sphere.radius;
+		n = l > 1e-9f ? q * (1.0f / l) : Vec3(0.0f, 1.0f, 0.0f);
+		break;
+	}
+	case eNvFlexShapeCapsule: {
+		//capsule goes along local x
+		Vec3 c(clampf(q.x, -shp.geo.capsule.halfHeight, shp.geo.capsule.halfHeight), 0.0f, 0.0f);
+		Vec3 dq = q - c;
+		float l = Length(dq);
+		d = l - shp.geo.capsule.radius;
+		n = l > 1e-9f ? dq * (1.0f / l) : Vec3(0.0f, 1.0f, 0.0f);
+		break;
+	}
+	case eNvFlexShapeBox: {
+		const float* he = shp.geo.box.halfExtents;
+		Vec3 e(std::fabs(q.x) - he[0], std::fabs(q.y) - he[1], std::fabs(q.z) - he[2]);
+		Vec3 sgn(q.x < 0.0f ? -1.0f : 1.0f, q.y < 0.0f ? -1.0f : 1.0f, q.z < 0.0f ? -1.0f : 1.0f);
+		if (e.x > 0.0f || e.y > 0.0f || e.z > 0.0f) {
+			Vec3 out(std::max(e.x, 0.0f), std::max(e.y, 0.0f), std::max(e.z, 0.0f));
+			d = Length(out);
+			n = mulv(out, sgn) * (1.0f / d);
+		}
+		else {
+			int axis = e.x > e.y ? (e.x > e.z ? 0 : 2) : (e.y > e.z ? 1 : 2);
+			d = e[axis];
+			n[axis] = sgn[axis];
+		}
+		break;
+	}
+	case eNvFlexShapeConvexMesh: {
+		if (shp.convex == NULL)return false;
+		//planes are in mesh space, scaling them into shape space keeps them exact
+		const Vec3 scl(shp.geo.convexMesh.scale[0], shp.geo.convexMesh.scale[1], shp.geo.convexMesh.scale[2]);
+		for (size_t i = 0; i < shp.convex->planes.size(); ++i) {
+			const Vec4& pl = shp.convex->planes[i];
+			Vec3 pn = divv(xyz(pl), scl);
+			float l = Length(pn);
+			if (l <= 1e-9f)continue;
+			float pd = (Dot(pn, q) + pl.w) / l;
+			if (pd > d || i == 0) { d = pd; n = pn * (1.0f / l); }
+		}
+		break;
+	}
+	case eNvFlexShapeTriangleMesh: {
+		const NvFlexHCpuBackend::TriangleMesh* mesh = shp.mesh;
+		if (mesh == NULL || mesh->triangles.empty())return false;
+		const Vec3 scl(shp.geo.triMesh.scale[0], shp.geo.triMesh.scale[1], shp.geo.triMesh.scale[2]);
+		//query box in mesh space covers the whole way of the particle during this substep
+		const Vec3 q0 = rotateInv(shp.rot, x0 - shp.center);
+		Vec3 m = divv(q, scl), m0 = divv(q0, scl);
+		Vec3 ext = divv(Vec3(maxdist), Vec3(std::fabs(scl.x), std::fabs(scl.y), std::fabs(scl.z)));
+		int lo[3], hi[3];
+		for (int a = 0; a < 3; ++a) {
+			lo[a] = int(std::floor((std::min(m[a], m0[a]) - ext[a] - mesh->lower[a]) / mesh->cellsize[a]));
+			hi[a] = int(std::floor((std::max(m[a], m0[a]) + ext[a] - mesh->lower[a]) / mesh->cellsize[a]));
+			if (hi[a] < 0 || lo[a] >= mesh->res[a])return false;
+			lo[a] = std::max(lo[a], 0);
+			hi[a] = std::min(hi[a], mesh->res[a] - 1);
+		}
+		float best = FLT_MAX;
+		Vec3 bestc(0.0f);
+		int besttri = -1;
+		//triangles sitting in several cells get tested several times, cheaper than remembering them
+		for (int z = lo[2]; z <= hi[2]; ++z)for (int y = lo[1]; y <= hi[1]; ++y)for (int x = lo[0]; x <= hi[0]; ++x) {
+			int cell = x + mesh->res[0] * (y + mesh->res[1] * z);
+			for (int k = mesh->cellstart[cell]; k < mesh->cellstart[cell + 1]; ++k) {
+				int t = mesh->celltris[k];
+				const int* tri = &mesh->triangles[3 * size_t(t)];
+				Vec3 c = closestOnTriangle(q, mulv(mesh->vertices[tri[0]], scl), mulv(mesh->vertices[tri[1]], scl), mulv(mesh->vertices[tri[2]], scl));
+				float l2 = lengthSq(q - c);
+				if (l2 < best) { best = l2; bestc = c; besttri = t; }
+			}
+		}
+		if (besttri < 0)return false;
+		//meshes are thin shells, particle stays on the side of the closest triangle it started the substep on
+		const int* tri = &mesh->triangles[3 * size_t(besttri)];
+		Vec3 a = mulv(mesh->vertices[tri[0]], scl);
+		Vec3 fn = Cross(mulv(mesh->vertices[tri[1]], scl) - a, mulv(mesh->vertices[tri[2]], scl) - a);
+		float fl = Length(fn);
+		fn = fl > 0.0f ? fn * (1.0f / fl) : Vec3(0.0f, 1.0f, 0.0f);
+		if (Dot(q0 - a, fn) < 0.0f)fn = fn * -1.0f;
+		d = std::sqrt(best);
+		if (Dot(q - bestc, fn) < 0.0f) { d = -d; n = fn; } //went through
+		else n = d > 1e-6f ? (q - bestc) * (1.0f / d) : fn;
+		break;
+	}
+	case eNvFlexShapeSDF: {
+		const NvFlexHCpuBackend::DistanceField* field = shp.field;
+		const float scale = shp.geo.sdf.scale;
+		if (field == NULL || field->dim < 2 || scale <= 0.0f)return false;
+		//field covers [0, scale]^3 of shape space, outside of it we add the distance to the field box
+		Vec3 u = q * (1.0f / scale);
+		Vec3 uc(clampf(u.x, 0.0f, 1.0f), clampf(u.y, 0.0f, 1.0f), clampf(u.z, 0.0f, 1.0f));
+		const int dim = field->dim;
+		//voxel i holds the distance at its center, u = (i + 0.5) / dim, same as flex and buildSDF. next to the box faces
+		//the outermost voxels are held, not extrapolated
+		auto sample = [field, dim](const Vec3& at) {
+			Vec3 g = at * float(dim) - Vec3(0.5f);
+			int i0[3];
+			float f[3];
+			for (int a = 0; a < 3; ++a) {
+				g[a] = clampf(g[a], 0.0f, float(dim - 1));
+				i0[a] = std::min(std::max(int(std::floor(g[a])), 0), dim - 2);
+				f[a] = clampf(g[a] - i0[a], 0.0f, 1.0f);
+			}
+			const float* v = field->values.data();
+			auto at3 = [v, dim](int x, int y, int z) { return v[x + dim*(y + dim*z)]; };
+			float c00 = at3(i0[0], i0[1], i0[2])*(1 - f[0]) + at3(i0[0] + 1, i0[1], i0[2])*f[0];
+			float c10 = at3(i0[0], i0[1] + 1, i0[2])*(1 - f[0]) + at3(i0[0] + 1, i0[1] + 1, i0[2])*f[0];
+			float c01 = at3(i0[0], i0[1], i0[2] + 1)*(1 - f[0]) + at3(i0[0] + 1, i0[1], i0[2] + 1)*f[0];
+			float c11 = at3(i0[0], i0[1] + 1, i0[2] + 1)*(1 - f[0]) + at3(i0[0] + 1, i0[1] + 1, i0[2] + 1)*f[0];
+			return (c00*(1 - f[1]) + c10*f[1])*(1 - f[2]) + (c01*(1 - f[1]) + c11*f[1])*f[2];
+		};
+		float outside = Length(u - uc) * scale;
+		d = sample(uc) * scale + outside;
+		if (d >= maxdist)return false;
+		const float step = 0.5f / dim;
+		Vec3 grad;
+		for (int a = 0; a < 3; ++a) {
+			Vec3 lo = uc, hi = uc;
+			lo[a] = std::max(lo[a] - step, 0.0f);
+			hi[a] = std::min(hi[a] + step, 1.0f);
+			grad[a] = sample(hi) - sample(lo);
+		}
+		float l = Length(grad);
+		if (l <= 1e-12f)return false;
+		n = grad * (1.0f / l);
+		break;
+	}
+	default:
+		return false;
+	}
+
+	if (d >= maxdist)return false;
+	dist = d;
+	normal = rotate(shp.rot, n);
+	return true;
+}
+
+void NvFlexHCpuContainer::collide(Vec3& p, const Vec3& x0, const Vec3& normal, float penetration)const {
+	p += normal * penetration;
+	//position based friction: tangential travel of this substep is cancelled fully (static) or partially (dynamic)
+	Vec3 dp = p - x0;
+	Vec3 tang = dp - normal * Dot(dp, normal);
+	float lt = Length(tang);
+	if (lt <= 1e-9f)return;
+	if (lt < _params.staticFriction * penetration)p += tang * -1.0f;
+	else p += tang * -std::min(_params.dynamicFriction * penetration / lt, 1.0f);
+}
+
+void NvFlexHCpuContainer::solveShapes() {
+	const int n = int(_p.size());
+	const int nshapes = int(_shapes.size());
+	const int nplanes = std::min(std::max(_params.numPlanes, 0), 8);
+	if (nshapes == 0 && nplanes == 0)return;
+	const float cd = _params.collisionDistance > 0.0f ? _params.collisionDistance : _params.radius * 0.5f;
+	const float margin = cd + std::max(_params.shapeCollisionMargin, 0.0f);
+
+	_pool->parallelFor(n, kGrain / 4, [&](int begin, int end) {
+		for (int i = begin; i < end; ++i) {
+			if (_x[i].w == 0.0f)continue;
+			Vec3& p = _p[i];
+			for (int s = 0; s < nshapes; ++s) {
+				const NvFlexHCpuShape& shp = _shapes[s];
+				float reach = shp.boundr + margin;
+				if (lengthSq(p - shp.center) > reach*reach)continue;
+				float d;
+				Vec3 normal;
+				if (shapeDistance(shp, p, _x0[i], cd, d, normal))collide(p, _x0[i], normal, cd - d);
+			}
+			for (int k = 0; k < nplanes; ++k) {
+				const float* pl = _params.planes[k];
+				Vec3 normal(pl[0], pl[1], pl[2]);
+				float d = Dot(normal, p) + pl[3];
+				if (d < cd)collide(p, _x0[i], normal, cd - d);
+			}
+		}
+	});
+}
+
+
+void NvFlexHCpuContainer::updateVelocities(float dt, float h, float restdensity) {
+	const int n = int(_p.size());
+	const int maxn = _maxNeighbours;
+	const float invdt = 1.0f / dt;
+	const float maxspeed = _params.maxSpeed > 0.0f ? _params.maxSpeed : FLT_MAX;
+	const float h2 = h*h;
+	const float poly6 = 315.0f / (64.0f * kPi * std::pow(h, 9.0f)) / restdensity;
+	const float visc = _params.fluid ? std::max(_params.viscosity, 0.0f) : 0.0f;
+
+	_pool->parallelFor(n, kGrain, [&](int begin, int end) {
+		for (int i = begin; i < end; ++i)_v[i] = (_p[i] - _x0[i]) * invdt;
+	});
+
+	//xsph viscosity, fluid velocities are smoothed towards their fluid neighbours
+	_pool->parallelFor(n, kGrain, [&](int begin, int end) {
+		for (int i = begin; i < end; ++i) {
+			Vec3 v = _v[i];
+			if (visc > 0.0f && (_phase[i] & eNvFlexPhaseFluid) != 0) {
+				Vec3 dv(0.0f);
+				const int* nbrs = &_neighbours[size_t(i) * maxn];
+				for (int k = 0; k < _neighbourCount[i]; ++k) {
+					int j = nbrs[k];
+					if ((_phase[j] & eNvFlexPhaseFluid) == 0)continue;
+					float w = h2 - lengthSq(_p[i] - _p[j]);
+					if (w <= 0.0f)continue;
+					dv += (_v[j] - v) * (poly6 * w*w*w);
+				}
+				v += dv * std::min(visc, 1.0f);
+			}
+			float speed = Length(v);
+			if (speed > maxspeed)v = v * (maxspeed / speed);
+			_vnew[i] = v;
+			_x[i] = Vec4(_p[i], _x[i].w);
+		}
+	});
+	_v.swap(_vnew);
+}
+
+
+
+NvFlexHCpuBackend* NvFlexHCpuBackend::instance() {
+	static NvFlexHCpuBackend backend;
+	return &backend;
+}
+
+NvFlexHCpuBackend::NvFlexHCpuBackend() :nextid(1), pool(new NvFlexHThreadPool()) {}
+
+NvFlexHCpuBackend::~NvFlexHCpuBackend() {}
+
+void NvFlexHCpuBackend::acquireContext() {
+	_contextMutex.lock();
+}
+
+void NvFlexHCpuBackend::releaseContext() {
+	_contextMutex.unlock();
+}
+
+NvFlexHContainer* NvFlexHCpuBackend::createContainer(int maxParticles, int /*maxDiffuseParticles*/, int maxNeighbours) {
+	return new NvFlexHCpuContainer(this, maxParticles, maxNeighbours);
+}
+
+
+NvFlexTriangleMeshId NvFlexHCpuBackend::createTriangleMesh() {
+	NvFlexTriangleMeshId id = nextid++;
+	TriangleMesh& mesh = meshes[id];
+	mesh.res[0] = mesh.res[1] = mesh.res[2] = 1;
+	mesh.cellsize = Vec3(1.0f);
+	mesh.cellstart.assign(2, 0);
+	return id;
+}
+
+NvFlexHTriangleMeshData NvFlexHCpuBackend::mapTriangleMesh(NvFlexTriangleMeshId id, int vertcount, int tricount, bool keepTriangles) {
+	NvFlexHTriangleMeshData mdat;
+	auto it = meshes.find(id);
+	if (it == meshes.end())return mdat;
+	TriangleMesh& mesh = it->second;
+	mesh.vertices.resize(vertcount);
+	mdat.vertices = mesh.vertices.data();
+	if (!keepTriangles) {
+		mesh.triangles.resize(3 * size_t(tricount));
+		mdat.triangles = mesh.triangles.data();
+	}
+	return mdat;
+}
+
+void NvFlexHCpuBackend::unmapTriangleMesh(NvFlexTriangleMeshId id, const float* lower, const float* upper) {
+	auto it = meshes.find(id);
+	if (it == meshes.end())return;
+	TriangleMesh& mesh = it->second;
+	const int tricount = int(mesh.triangles.size() / 3);
+	mesh.lower = Vec3(lower[0], lower[1], lower[2]);
+	mesh.upper = Vec3(upper[0], upper[1], upper[2]);
+
+	//grid with about one triangle per cell
+	Vec3 size = mesh.upper - mesh.lower;
+	float maxedge = std::max(size.x, std::max(size.y, size.z));
+	if (maxedge <= 0.0f)maxedge = 1.0f;
+	for (int a = 0; a < 3; ++a)size[a] = std::max(size[a], maxedge * 1e-3f);
+	float edge = std::cbrt(size.x*size.y*size.z / std::max(tricount, 1));
+	for (int a = 0; a < 3; ++a) {
+		mesh.res[a] = std::min(std::max(int(std::ceil(size[a] / edge)), 1), 128);
+		mesh.cellsize[a] = size[a] / mesh.res[a];
+	}
+	const int ncells = mesh.res[0] * mesh.res[1] * mesh.res[2];
+
+	auto cellRange = [&mesh](int t, int* lo, int* hi) {
+		const int* tri = &mesh.triangles[3 * size_t(t)];
+		for (int a = 0; a < 3; ++a) {
+			float tmin = std::min(mesh.vertices[tri[0]][a], std::min(mesh.vertices[tri[1]][a], mesh.vertices[tri[2]][a]));
+			float tmax = std::max(mesh.vertices[tri[0]][a], std::max(mesh.vertices[tri[1]][a], mesh.vertices[tri[2]][a]));
+			lo[a] = std::min(std::max(int(std::floor((tmin - mesh.lower[a]) / mesh.cellsize[a])), 0), mesh.res[a] - 1);
+			hi[a] = std::min(std::max(int(std::floor((tmax - mesh.lower[a]) / mesh.cellsize[a])), 0), mesh.res[a] - 1);
+		}
+	};
+
+	//count, prefix sum, fill
+	mesh.cellstart.assign(ncells + 1, 0);
+	int lo[3], hi[3];
+	for (int t = 0; t < tricount; ++t) {
+		cellRange(t, lo, hi);
+		for (int z = lo[2]; z <= hi[2]; ++z)for (int y = lo[1]; y <= hi[1]; ++y)for (int x = lo[0]; x <= hi[0]; ++x)++mesh.cellstart[x + mesh.res[0] * (y + mesh.res[1] * z) + 1];
+	}
+	for (int c = 0; c < ncells; ++c)mesh.cellstart[c + 1] += mesh.cellstart[c];
+	mesh.celltris.resize(mesh.cellstart[ncells]);
+	std::vector<int> fill(mesh.cellstart.begin(), mesh.cellstart.end() - 1);
+	for (int t = 0; t < tricount; ++t) {
+		cellRange(t, lo, hi);
+		for (int z = lo[2]; z <= hi[2]; ++z)for (int y = lo[1]; y <= hi[1]; ++y)for (int x = lo[0]; x <= hi[0]; ++x)mesh.celltris[fill[x + mesh.res[0] * (y + mesh.res[1] * z)]++] = t;
+	}
+}
+
+void NvFlexHCpuBackend::destroyTriangleMesh(NvFlexTriangleMeshId id) {
+	meshes.erase(id);
+}
+
+const NvFlexHCpuBackend::TriangleMesh* NvFlexHCpuBackend::triangleMesh(NvFlexTriangleMeshId id)const {
+	auto it = meshes.find(id);
+	return it == meshes.end() ? NULL : &it->second;
+}
+
+
+NvFlexConvexMeshId NvFlexHCpuBackend::createConvexMesh() {
+	NvFlexConvexMeshId id = nextid++;
+	convexes[id];
+	return id;
+}
+
+void NvFlexHCpuBackend::updateConvexMesh(NvFlexConvexMeshId id, const Vec4* planes, int planecount, const float* lower, const float* upper) {
+	auto it = convexes.find(id);
+	if (it == convexes.end())return;
+	it->second.planes.assign(planes, planes + planecount);
+	it->second.lower = Vec3(lower[0], lower[1], lower[2]);
+	it->second.upper = Vec3(upper[0], upper[1], upper[2]);
+}
+
+void NvFlexHCpuBackend::destroyConvexMesh(NvFlexConvexMeshId id) {
+	convexes.erase(id);
+}
+
+const NvFlexHCpuBackend::ConvexMesh* NvFlexHCpuBackend::convexMesh(NvFlexConvexMeshId id)const {
+	auto it = convexes.find(id);
+	return it == convexes.end() ? NULL : &it->second;
+}
+
+
+NvFlexDistanceFieldId NvFlexHCpuBackend::createDistanceField() {
+	NvFlexDistanceFieldId id = nextid++;
+	fields[id].dim = 0;
+	return id;
+}
+
+void NvFlexHCpuBackend::updateDistanceField(NvFlexDistanceFieldId id, int dim, const float* values) {
+	auto it = fields.find(id);
+	if (it == fields.end())return;
+	it->second.dim = dim;
+	it->second.values.assign(values, values + size_t(dim) * dim * dim);
+}
+
+void NvFlexHCpuBackend::destroyDistanceField(NvFlexDistanceFieldId id) {
+	fields.erase(id);
+}
+
+const NvFlexHCpuBackend::DistanceField* NvFlexHCpuBackend::distanceField(NvFlexDistanceFieldId id)const {
+	auto it = fields.find(id);
+	return it == fields.end() ? NULL : &it->second;
+}
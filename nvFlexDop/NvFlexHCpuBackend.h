@@ -0,0 +1,82 @@
+#pragma once
+#include <NvFlex.h>
+#include <../core/maths.h>
+
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "NvFlexHBackend.h"
+
+
+class NvFlexHThreadPool; //fwd decl
+
+
+/// Reference backend that runs on CPU threads, for machines without cuda and for testing.
+/// Position based fluids + particle contacts, springs, shape matching clusters, inflatables, shapes and planes. No diffuse
+/// particles, cloth drag/lift, cohesion, surface tension or vorticity. Dynamic triangles and rigid rest normals are
+/// stored but do not collide.
+/// Meant to be predictable rather than fast, so don't expect same looking results as on gpu.
+class NvFlexHCpuBackend :public NvFlexHBackend {
+public:
+	static NvFlexHCpuBackend* instance();
+
+	const char* name()const { return "CPU"; }
+	NvFlexHContainer* createContainer(int maxParticles, int maxDiffuseParticles, int maxNeighbours = 96);
+	/// serializes threads on a mutex: all containers share the mesh, convex and field maps below
+	void acquireContext();
+	void releaseContext();
+
+	NvFlexTriangleMeshId createTriangleMesh();
+	NvFlexHTriangleMeshData mapTriangleMesh(NvFlexTriangleMeshId id, int vertcount, int tricount, bool keepTriangles);
+	void unmapTriangleMesh(NvFlexTriangleMeshId id, const float* lower, const float* upper);
+	void destroyTriangleMesh(NvFlexTriangleMeshId id);
+
+	NvFlexConvexMeshId createConvexMesh();
+	void updateConvexMesh(NvFlexConvexMeshId id, const Vec4* planes, int planecount, const float* lower, const float* upper);
+	void destroyConvexMesh(NvFlexConvexMeshId id);
+
+	NvFlexDistanceFieldId createDistanceField();
+	void updateDistanceField(NvFlexDistanceFieldId id, int dim, const float* values);
+	void destroyDistanceField(NvFlexDistanceFieldId id);
+
+	/// triangles are binned into a grid over mesh bounds on update, so particles only test triangles near them
+	struct TriangleMesh {
+		std::vector<Vec3> vertices;
+		std::vector<int> triangles;
+		Vec3 lower, upper;
+		int res[3];
+		Vec3 cellsize;
+		std::vector<int> cellstart; //res[0]*res[1]*res[2]+1 entries
+		std::vector<int> celltris;
+	};
+	struct ConvexMesh {
+		std::vector<Vec4> planes;
+		Vec3 lower, upper;
+	};
+	struct DistanceField {
+		int dim;
+		std::vector<float> values;
+	};
+
+	/// NULL if there is no such id
+	const TriangleMesh* triangleMesh(NvFlexTriangleMeshId id)const;
+	const ConvexMesh* convexMesh(NvFlexConvexMeshId id)const;
+	const DistanceField* distanceField(NvFlexDistanceFieldId id)const;
+
+	NvFlexHThreadPool* threadPool() { return pool.get(); }
+
+private:
+	NvFlexHCpuBackend();
+	~NvFlexHCpuBackend();
+	NvFlexHCpuBackend(const NvFlexHCpuBackend&) = delete;
+	NvFlexHCpuBackend& operator=(const NvFlexHCpuBackend&) = delete;
+
+	unsigned long long nextid;
+	std::map<NvFlexTriangleMeshId, TriangleMesh> meshes;
+	std::map<NvFlexConvexMeshId, ConvexMesh> convexes;
+	std::map<NvFlexDistanceFieldId, DistanceField> fields;
+	std::unique_ptr<NvFlexHThreadPool> pool;
+	std::recursive_mutex _contextMutex;
+};
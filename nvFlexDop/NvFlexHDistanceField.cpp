@@ -0,0 +1,21 @@
+#include "NvFlexHDistanceField.h"
+
+
+
+NvFlexHDistanceField::NvFlexHDistanceField(NvFlexHBackend* be) :backend(be), dim(0)
+{
+	id = backend->createDistanceField();
+}
+
+NvFlexHDistanceField::~NvFlexHDistanceField()
+{
+	backend->destroyDistanceField(id);
+}
+
+NvFlexDistanceFieldId NvFlexHDistanceField::getId() const {
+	return id;
+}
+
+void NvFlexHDistanceField::updateNvBuffers() {
+	backend->updateDistanceField(id, dim, fieldvec.data());
+}
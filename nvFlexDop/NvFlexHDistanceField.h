@@ -0,0 +1,47 @@
+#pragma once
+#include <NvFlex.h>
+
+#include <vector>
+
+#include "NvFlexHBackend.h"
+
+
+/// dim^3 grid of signed distances covering local [0,1]^3, distances in the same units (so divided by edge length)
+/// host side, backend gets a copy on updateNvBuffers
+class NvFlexHDistanceField
+{
+public:
+	NvFlexHDistanceField(NvFlexHBackend* backend);
+	NvFlexHDistanceField(const NvFlexHDistanceField&) = delete;
+	NvFlexHDistanceField& operator=(const NvFlexHDistanceField&) = delete;
+	~NvFlexHDistanceField();
+
+	NvFlexDistanceFieldId getId()const;
+	int dimension()const { return dim; }
+
+	void updateNvBuffers();
+
+private:
+	friend class NvFlexHDistanceFieldAutoMapper;
+
+	NvFlexHBackend* backend;
+	NvFlexDistanceFieldId id;
+	std::vector<float> fieldvec;
+	int dim;
+};
+
+
+class NvFlexHDistanceFieldAutoMapper {
+public:
+	NvFlexHDistanceFieldAutoMapper(NvFlexHDistanceField* f) :field(*f) {}
+	NvFlexHDistanceFieldAutoMapper(NvFlexHDistanceField& f) :field(f) {}
+	NvFlexHDistanceFieldAutoMapper(const NvFlexHDistanceFieldAutoMapper&) = delete;
+	NvFlexHDistanceFieldAutoMapper& operator=(const NvFlexHDistanceFieldAutoMapper&) = delete;
+	~NvFlexHDistanceFieldAutoMapper() { field.updateNvBuffers(); }
+
+	inline void setDimension(int dim) { field.dim = dim; field.fieldvec.resize(size_t(dim) * dim * dim); }
+	inline float* values()const { return field.fieldvec.data(); }
+
+private:
+	NvFlexHDistanceField& field;
+};
@@ -0,0 +1,94 @@
+#pragma once
+#include <cstddef>
+#include <vector>
+
+
+/// Open addressing long long -> int table with linear probing, values must be >= 0.
+/// Erase shifts following entries back instead of leaving tombstones, so probes stay short.
+/// Memory is only allocated when the table grows.
+class NvFlexHFlatMap {
+public:
+	NvFlexHFlatMap() :_count(0) {}
+
+	/// value of the key, -1 if not found
+	int find(long long key)const {
+		if (_count == 0)return -1;
+		const size_t mask = _entries.size() - 1;
+		for (size_t i = bucket(key);; i = (i + 1) & mask) {
+			const Entry& e = _entries[i];
+			if (e.value < 0)return -1;
+			if (e.key == key)return e.value;
+		}
+	}
+
+	/// inserts or overwrites
+	void insert(long long key, int value) {
+		if ((_count + 1) * 2 > _entries.size())grow();
+		const size_t mask = _entries.size() - 1;
+		for (size_t i = bucket(key);; i = (i + 1) & mask) {
+			Entry& e = _entries[i];
+			if (e.value < 0) {
+				e.key = key;
+				e.value = value;
+				++_count;
+				return;
+			}
+			if (e.key == key) {
+				e.value = value;
+				return;
+			}
+		}
+	}
+
+	bool erase(long long key) {
+		if (_count == 0)return false;
+		const size_t mask = _entries.size() - 1;
+		size_t i = bucket(key);
+		for (;; i = (i + 1) & mask) {
+			if (_entries[i].value < 0)return false;
+			if (_entries[i].key == key)break;
+		}
+		//pull back entries of the cluster that would not be found past the hole
+		for (size_t j = (i + 1) & mask; _entries[j].value >= 0; j = (j + 1) & mask) {
+			size_t home = bucket(_entries[j].key);
+			if (((j - home) & mask) >= ((j - i) & mask)) {
+				_entries[i] = _entries[j];
+				i = j;
+			}
+		}
+		_entries[i].value = -1;
+		--_count;
+		return true;
+	}
+
+	size_t size()const { return _count; }
+
+private:
+	struct Entry {
+		long long key;
+		int value; //-1 marks empty entry
+	};
+
+	size_t bucket(long long key)const {
+		//splitmix64 finalizer, object ids are small and sequential
+		unsigned long long h = (unsigned long long)key;
+		h ^= h >> 30; h *= 0xbf58476d1ce4e5b9ULL;
+		h ^= h >> 27; h *= 0x94d049bb133111ebULL;
+		h ^= h >> 31;
+		return size_t(h) & (_entries.size() - 1);
+	}
+
+	void grow() {
+		std::vector<Entry> old;
+		old.swap(_entries);
+		Entry empty = { 0, -1 };
+		_entries.assign(old.empty() ? 64 : old.size() * 2, empty);
+		_count = 0;
+		for (auto it = old.begin(); it != old.end(); ++it) {
+			if (it->value >= 0)insert(it->key, it->value);
+		}
+	}
+
+	std::vector<Entry> _entries;
+	size_t _count;
+};
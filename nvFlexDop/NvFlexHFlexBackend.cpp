@@ -0,0 +1,926 @@
+#include "NvFlexHFlexBackend.h"
+
+#include <algorithm>
+#include <climits>
+#include <cstring>
+#include <map>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "NvFlexHCollisionData.h"
+#include "NvFlexHProfiler.h"
+
+
+//flex does not tell which library calls back, so errors go to the device whose context this thread holds
+static const int kNoDevice = INT_MIN;
+static thread_local int callbackDevice = kNoDevice;
+static std::mutex errorsMutex;
+static std::map<int, std::string> lastErrors; //kNoDevice for errors outside of any context
+
+static void nvFlexErrorCallback(NvFlexErrorSeverity type, const char *msg, const char *file, int line) {
+	if (type != eNvFlexLogError && type != eNvFlexLogWarning)return;
+	std::string text = type == eNvFlexLogError ? "NvFlex error: " : "NvFlex warning: ";
+	if (msg != NULL)text += msg;
+	if (file != NULL)text += std::string(" (") + file + ":" + std::to_string(line) + ")";
+	std::lock_guard<std::mutex> lock(errorsMutex);
+	lastErrors[callbackDevice] = text;
+}
+
+
+/// fixed in flex 1.1, contact buffers are this many slots per particle
+static const int kMaxContactsPerParticle = 6;
+
+/// resizes and leaves vec mapped, returns the mapped pointer
+template<typename T>
+static T* mapResized(NvFlexVector<T>& vec, int newSize) {
+	//NvFlexVector never lowers capacity, so we drop the buffer if less than half of it would be used
+	//contents are lost then, but we always refill after resize anyway
+	if (newSize < vec.capacity / 2)vec.destroy();
+	vec.map();
+	vec.resize(newSize);
+	return vec.mappedPtr;
+}
+
+template<typename T>
+static void resizeVector(NvFlexVector<T>& vec, int newSize) {
+	mapResized(vec, newSize);
+	vec.unmap();
+}
+
+template<typename T>
+static void assignVector(NvFlexVector<T>& vec, const T* data, int count) {
+	if (count < vec.capacity / 2)vec.destroy();
+	vec.map();
+	vec.assign(data, count);
+	vec.unmap();
+}
+
+
+/// NvFlexExt container + solver, springs and triangles are set on the solver directly, next to the container
+class NvFlexHFlexContainer :public NvFlexHContainer {
+public:
+	NvFlexHFlexContainer(NvFlexHFlexBackend* backend, int maxParticles, int maxDiffuseParticles, int maxNeighbours) :_backend(backend), _lib(backend->library()),
+		_maxParticles(maxParticles), _capacity(std::min(maxParticles, NVFLEXH_INITIAL_CAPACITY)), _activeCount(0), _maxDiffuseParticles(maxDiffuseParticles), _maxNeighbours(maxNeighbours),
+		_timersEnabled(false), _triangleNormalsPushed(false),
+		_springIndices(backend->library()), _springRestLengths(backend->library()), _springStrenghts(backend->library()),
+		_triangleIndices(backend->library()), _triangleNormals(backend->library()),
+		_rigidOffsets(backend->library()), _rigidIndices(backend->library()), _rigidRestPositions(backend->library()), _rigidRestNormals(backend->library()),
+		_rigidStiffness(backend->library()), _rigidThresholds(backend->library()), _rigidCreeps(backend->library()), _rigidRotations(backend->library()), _rigidTranslations(backend->library()),
+		_inflatableStarts(backend->library()), _inflatableCounts(backend->library()), _inflatableVolumes(backend->library()), _inflatablePressures(backend->library()), _inflatableStiffness(backend->library()),
+		_geometry(backend->library()), _positions(backend->library()), _rotations(backend->library()), _prevPositions(backend->library()), _prevRotations(backend->library()), _flags(backend->library()),
+		_lastRigids(NULL), _lastDiffuse(NULL), _pullSmooth(false), _pullAnisotropy(false), _lastSurface(NULL), _pullDensities(false), _pullContacts(false), _lastContacts(NULL), _staged(-1), _pullStagedRest(false), _speculating(false), _specDt(0.0f), _specSubsteps(0) {
+		memset(&_params, 0, sizeof(_params));
+		if (!createSolver(_capacity, _slv, _cont))throw std::runtime_error("NULL NVFLEX SOLVER OR CONTAINER!");
+		_colld.reset(new NvFlexHCollisionData(backend));
+		_staging[0].reset(new StagingBuffers(backend->library()));
+		_staging[1].reset(new StagingBuffers(backend->library()));
+		_rigidPose.reset(new RigidBuffers(backend->library()));
+		_diffuse.reset(new DiffuseBuffers(backend->library()));
+		_surface.reset(new SurfaceBuffers(backend->library()));
+		_contacts.reset(new ContactBuffers(backend->library()));
+	}
+	~NvFlexHFlexContainer() {
+		{
+			//sim data dies whenever houdini decides, maybe while another network is solving on this device
+			NvFlexHContextGuard guard(_backend);
+			_colld.reset();
+			_staging[0].reset();
+			_staging[1].reset();
+			_rigidPose.reset();
+			_diffuse.reset();
+			_surface.reset();
+			_contacts.reset();
+			destroyBuffers();
+			NvFlexExtDestroyContainer(_cont);
+			NvFlexDestroySolver(_slv);
+		}
+		_backend->containerDestroyed();
+	}
+
+	NvFlexHBackend* backend()const { return _backend; }
+
+	int maxParticles()const { return _maxParticles; }
+	int capacity()const { return _capacity; }
+	int activeCount()const { return _activeCount; }
+	bool reserve(int count);
+
+	//particles
+	int allocParticles(int n, int* indices) {
+		int count = NvFlexExtAllocParticles(_cont, n, indices);
+		_activeCount += count;
+		return count;
+	}
+	void freeParticles(int n, const int* indices) {
+		NvFlexExtFreeParticles(_cont, n, indices);
+		_activeCount -= n;
+	}
+	int getActiveList(int* indices) { return NvFlexExtGetActiveList(_cont, indices); }
+	NvFlexHParticleData mapParticleData() {
+		NvFlexExtParticleData extdat = NvFlexExtMapParticleData(_cont);
+		NvFlexHParticleData pdat;
+		pdat.particles = extdat.particles;
+		pdat.restParticles = extdat.restParticles;
+		pdat.velocities = extdat.velocities;
+		pdat.phases = extdat.phases;
+		pdat.normals = extdat.normals;
+		return pdat;
+	}
+	void unmapParticleData() { NvFlexExtUnmapParticleData(_cont); }
+	//This pushes all from particle data returned by map (NvFlexExt cannot push single channels). so collisions, springs and triangles we push separately.
+	void pushParticlesToDevice() { NvFlexExtPushToDevice(_cont); }
+	void pullParticlesFromDevice() {
+		NvFlexExtPullFromDevice(_cont);
+		pullRigids(*_rigidPose);
+		pullDiffuse(*_diffuse);
+		pullSurface(*_surface);
+		pullContacts(*_contacts);
+	}
+
+	//springs
+	int getSpringsCount()const { return _springRestLengths.size(); }
+	void resizeSpringData(int newSize) {
+		resizeVector(_springIndices, 2 * newSize);
+		resizeVector(_springRestLengths, newSize);
+		resizeVector(_springStrenghts, newSize);
+	}
+	NvFlexHSpringData mapSpringData() {
+		_springIndices.map();
+		_springRestLengths.map();
+		_springStrenghts.map();
+		return NvFlexHSpringData(_springIndices.mappedPtr, _springRestLengths.mappedPtr, _springStrenghts.mappedPtr);
+	}
+	void unmapSpringData() {
+		_springIndices.unmap();
+		_springRestLengths.unmap();
+		_springStrenghts.unmap();
+	}
+	void pushSpringsToDevice() {
+		NvFlexSetSprings(_slv, _springIndices.buffer, _springRestLengths.buffer, _springStrenghts.buffer, _springRestLengths.size());
+	}
+
+	//triangles
+	int getTrianglesCount()const { return _triangleIndices.size() / 3; }
+	void resizeTriangleData(int newSize) {
+		resizeVector(_triangleIndices, 3 * newSize);
+		resizeVector(_triangleNormals, 3 * newSize);
+	}
+	NvFlexHTriangleData mapTriangleData() {
+		_triangleIndices.map();
+		_triangleNormals.map();
+		return NvFlexHTriangleData(_triangleIndices.mappedPtr, _triangleNormals.mappedPtr);
+	}
+	void unmapTriangleData() {
+		_triangleIndices.unmap();
+		_triangleNormals.unmap();
+	}
+	void pushTrianglesToDevice(bool pushNormals) {
+		NvFlexSetDynamicTriangles(_slv, _triangleIndices.buffer, pushNormals ? _triangleNormals.buffer : NULL, _triangleIndices.size() / 3);
+		_triangleNormalsPushed = pushNormals;
+	}
+	bool hasTriangleNormals()const { return _triangleNormalsPushed; }
+
+	//rigids
+	int getRigidsCount()const { return std::max(_rigidOffsets.size() - 1, 0); }
+	int getRigidIndicesCount()const { return _rigidIndices.size(); }
+	void resizeRigidData(int numRigids, int numIndices) {
+		resizeVector(_rigidOffsets, numRigids > 0 ? numRigids + 1 : 0);
+		resizeVector(_rigidIndices, numIndices);
+		resizeVector(_rigidRestPositions, numIndices);
+		resizeVector(_rigidRestNormals, numIndices);
+		resizeVector(_rigidStiffness, numRigids);
+		resizeVector(_rigidThresholds, numRigids);
+		resizeVector(_rigidCreeps, numRigids);
+		resizeVector(_rigidRotations, numRigids);
+		resizeVector(_rigidTranslations, numRigids);
+	}
+	NvFlexHRigidData mapRigidData() {
+		_rigidOffsets.map(); _rigidIndices.map(); _rigidRestPositions.map(); _rigidRestNormals.map();
+		_rigidStiffness.map(); _rigidThresholds.map(); _rigidCreeps.map(); _rigidRotations.map(); _rigidTranslations.map();
+		NvFlexHRigidData rdat;
+		rdat.offsets = _rigidOffsets.mappedPtr;
+		rdat.indices = _rigidIndices.mappedPtr;
+		rdat.restPositions = (float*)_rigidRestPositions.mappedPtr;
+		rdat.restNormals = (float*)_rigidRestNormals.mappedPtr;
+		rdat.stiffness = _rigidStiffness.mappedPtr;
+		rdat.thresholds = _rigidThresholds.mappedPtr;
+		rdat.creeps = _rigidCreeps.mappedPtr;
+		rdat.rotations = (float*)_rigidRotations.mappedPtr;
+		rdat.translations = (float*)_rigidTranslations.mappedPtr;
+		return rdat;
+	}
+	void unmapRigidData() {
+		_rigidOffsets.unmap(); _rigidIndices.unmap(); _rigidRestPositions.unmap(); _rigidRestNormals.unmap();
+		_rigidStiffness.unmap(); _rigidThresholds.unmap(); _rigidCreeps.unmap(); _rigidRotations.unmap(); _rigidTranslations.unmap();
+	}
+	void pushRigidsToDevice() {
+		NvFlexSetRigids(_slv, _rigidOffsets.buffer, _rigidIndices.buffer, _rigidRestPositions.buffer, _rigidRestNormals.buffer, _rigidStiffness.buffer,
+			_rigidThresholds.buffer, _rigidCreeps.buffer, _rigidRotations.buffer, _rigidTranslations.buffer, getRigidsCount(), _rigidIndices.size());
+	}
+	NvFlexHRigidTransforms mapRigidTransforms() {
+		NvFlexHRigidTransforms tdat;
+		if (_lastRigids == NULL || _lastRigids->count == 0)return tdat;
+		_lastRigids->rotations.map();
+		_lastRigids->translations.map();
+		tdat.rotations = (float*)_lastRigids->rotations.mappedPtr;
+		tdat.translations = (float*)_lastRigids->translations.mappedPtr;
+		tdat.count = _lastRigids->count;
+		return tdat;
+	}
+	void unmapRigidTransforms() {
+		if (_lastRigids == NULL || _lastRigids->count == 0)return;
+		_lastRigids->rotations.unmap();
+		_lastRigids->translations.unmap();
+	}
+
+	//inflatables
+	int getInflatablesCount()const { return _inflatableStarts.size(); }
+	void resizeInflatableData(int newSize) {
+		resizeVector(_inflatableStarts, newSize);
+		resizeVector(_inflatableCounts, newSize);
+		resizeVector(_inflatableVolumes, newSize);
+		resizeVector(_inflatablePressures, newSize);
+		resizeVector(_inflatableStiffness, newSize);
+	}
+	NvFlexHInflatableData mapInflatableData() {
+		_inflatableStarts.map(); _inflatableCounts.map(); _inflatableVolumes.map(); _inflatablePressures.map(); _inflatableStiffness.map();
+		NvFlexHInflatableData idat;
+		idat.startTris = _inflatableStarts.mappedPtr;
+		idat.numTris = _inflatableCounts.mappedPtr;
+		idat.restVolumes = _inflatableVolumes.mappedPtr;
+		idat.overPressures = _inflatablePressures.mappedPtr;
+		idat.constraintScales = _inflatableStiffness.mappedPtr;
+		return idat;
+	}
+	void unmapInflatableData() {
+		_inflatableStarts.unmap(); _inflatableCounts.unmap(); _inflatableVolumes.unmap(); _inflatablePressures.unmap(); _inflatableStiffness.unmap();
+	}
+	void pushInflatablesToDevice() {
+		NvFlexSetInflatables(_slv, _inflatableStarts.buffer, _inflatableCounts.buffer, _inflatableVolumes.buffer, _inflatablePressures.buffer, _inflatableStiffness.buffer, getInflatablesCount());
+	}
+
+	//diffuse
+	int maxDiffuseParticles()const { return _maxDiffuseParticles; }
+	NvFlexHDiffuseData mapDiffuseData() {
+		NvFlexHDiffuseData ddat;
+		if (_lastDiffuse == NULL || _lastDiffuse->count == 0)return ddat;
+		_lastDiffuse->positions.map();
+		_lastDiffuse->velocities.map();
+		ddat.positions = (float*)_lastDiffuse->positions.mappedPtr;
+		ddat.velocities = (float*)_lastDiffuse->velocities.mappedPtr;
+		ddat.count = _lastDiffuse->count;
+		return ddat;
+	}
+	void unmapDiffuseData() {
+		if (_lastDiffuse == NULL || _lastDiffuse->count == 0)return;
+		_lastDiffuse->positions.unmap();
+		_lastDiffuse->velocities.unmap();
+	}
+
+	//surfacing
+	void setSurfacePull(bool smoothParticles, bool anisotropy) {
+		_pullSmooth = smoothParticles;
+		_pullAnisotropy = anisotropy;
+	}
+	NvFlexHSurfaceData mapSurfaceData() {
+		NvFlexHSurfaceData sdat;
+		if (_lastSurface == NULL)return sdat;
+		if (_lastSurface->hasSmooth) {
+			_lastSurface->smooth.map();
+			sdat.smoothParticles = (float*)_lastSurface->smooth.mappedPtr;
+		}
+		if (_lastSurface->hasAnisotropy) {
+			for (int i = 0; i < 3; ++i) {
+				_lastSurface->anisotropy(i).map();
+				sdat.anisotropy[i] = (float*)_lastSurface->anisotropy(i).mappedPtr;
+			}
+		}
+		return sdat;
+	}
+	void unmapSurfaceData() {
+		if (_lastSurface == NULL)return;
+		if (_lastSurface->hasSmooth)_lastSurface->smooth.unmap();
+		if (_lastSurface->hasAnisotropy) {
+			for (int i = 0; i < 3; ++i)_lastSurface->anisotropy(i).unmap();
+		}
+	}
+
+	//densities and contacts
+	void setContactPull(bool densities, bool contacts) {
+		_pullDensities = densities;
+		_pullContacts = contacts;
+	}
+	NvFlexHContactData mapContactData() {
+		NvFlexHContactData cdat;
+		if (_lastContacts == NULL)return cdat;
+		if (_lastContacts->hasDensities) {
+			_lastContacts->densities.map();
+			cdat.densities = _lastContacts->densities.mappedPtr;
+		}
+		if (_lastContacts->hasContacts) {
+			_lastContacts->planes.map();
+			_lastContacts->velocities.map();
+			_lastContacts->indices.map();
+			_lastContacts->counts.map();
+			cdat.planes = (float*)_lastContacts->planes.mappedPtr;
+			cdat.velocities = (float*)_lastContacts->velocities.mappedPtr;
+			cdat.indices = _lastContacts->indices.mappedPtr;
+			cdat.counts = _lastContacts->counts.mappedPtr;
+			cdat.maxContactsPerParticle = kMaxContactsPerParticle;
+		}
+		return cdat;
+	}
+	void unmapContactData() {
+		if (_lastContacts == NULL)return;
+		if (_lastContacts->hasDensities)_lastContacts->densities.unmap();
+		if (_lastContacts->hasContacts) {
+			_lastContacts->planes.unmap();
+			_lastContacts->velocities.unmap();
+			_lastContacts->indices.unmap();
+			_lastContacts->counts.unmap();
+		}
+	}
+
+	//shapes
+	NvFlexHCollisionData* collisionData() { return _colld.get(); }
+	void pushShapesToDevice() {
+		//collision data lives on host, so it's one extra copy into flex buffers here
+		const NvFlexHCollisionData* cd = _colld.get();
+		int count = cd->size();
+		assignVector(_geometry, cd->geometry(), count);
+		assignVector(_positions, cd->positions(), count);
+		assignVector(_rotations, cd->rotations(), count);
+		assignVector(_prevPositions, cd->prevPositions(), count);
+		assignVector(_prevRotations, cd->prevRotations(), count);
+		assignVector(_flags, cd->flags(), count);
+		NvFlexSetShapes(_slv, _geometry.buffer, _positions.buffer, _rotations.buffer, _prevPositions.buffer, _prevRotations.buffer, _flags.buffer, count);
+		_colld->markPushed();
+	}
+
+	//simulation
+	void setParams(const NvFlexParams& params) {
+		_params = params;
+		NvFlexSetParams(_slv, &params);
+	}
+	void tick(float dt, int substeps, bool enableTimers) {
+		_timersEnabled = enableTimers;
+		NvFlexExtTickContainer(_cont, dt, substeps, enableTimers);
+	}
+	void readTimers(NvFlexHProfiler& prof) {
+		//timers are only filled by a tick that had them enabled, otherwise we'd report zeros or stale values
+		if (!_timersEnabled)return;
+		NvFlexTimers timers;
+		NvFlexGetTimers(_slv, &timers);
+		static const struct { const char* name; float NvFlexTimers::*field; } stages[] = {
+			{ "predict", &NvFlexTimers::predict }, { "createCellIndices", &NvFlexTimers::createCellIndices },
+			{ "sortCellIndices", &NvFlexTimers::sortCellIndices }, { "createGrid", &NvFlexTimers::createGrid },
+			{ "reorder", &NvFlexTimers::reorder }, { "collideParticles", &NvFlexTimers::collideParticles },
+			{ "collideShapes", &NvFlexTimers::collideShapes }, { "collideTriangles", &NvFlexTimers::collideTriangles },
+			{ "collideFields", &NvFlexTimers::collideFields }, { "calculateDensity", &NvFlexTimers::calculateDensity },
+			{ "solveDensities", &NvFlexTimers::solveDensities }, { "solveVelocities", &NvFlexTimers::solveVelocities },
+			{ "solveShapes", &NvFlexTimers::solveShapes }, { "solveSprings", &NvFlexTimers::solveSprings },
+			{ "solveContacts", &NvFlexTimers::solveContacts }, { "solveInflatables", &NvFlexTimers::solveInflatables },
+			{ "applyDeltas", &NvFlexTimers::applyDeltas }, { "calculateAnisotropy", &NvFlexTimers::calculateAnisotropy },
+			{ "updateDiffuse", &NvFlexTimers::updateDiffuse }, { "updateTriangles", &NvFlexTimers::updateTriangles },
+			{ "updateNormals", &NvFlexTimers::updateNormals }, { "finalize", &NvFlexTimers::finalize },
+			{ "updateBounds", &NvFlexTimers::updateBounds }, { "total", &NvFlexTimers::total }
+		};
+		for (size_t i = 0; i < sizeof(stages) / sizeof(stages[0]); ++i)prof.addDeviceTimer(stages[i].name, timers.*stages[i].field);
+
+		//detail timers are per kernel, names can repeat, so they are summed by name
+		NvFlexDetailTimer* details = NULL;
+		int ndetails = NvFlexGetDetailTimers(_slv, &details);
+		std::map<std::string, float> summed;
+		for (int i = 0; i < ndetails; ++i) {
+			if (details[i].name != NULL)summed[details[i].name] += details[i].time;
+		}
+		for (std::map<std::string, float>::const_iterator it = summed.begin(); it != summed.end(); ++it)prof.addDeviceTimer(("detail_" + it->first).c_str(), it->second);
+	}
+
+	//pipelining
+	bool supportsPipelining()const { return true; }
+	void pullAndSpeculate(float dt, int substeps) {
+		//alternate buffers, so the copy queued now never lands in the one host may still read from the last step
+		_staged = _staged == 0 ? 1 : 0;
+		StagingBuffers& st = *_staging[_staged];
+		if (st.particles.size() != _capacity) {
+			resizeVector(st.particles, _capacity);
+			resizeVector(st.velocities, _capacity);
+			resizeVector(st.phases, _capacity);
+		}
+		NvFlexGetParticles(_slv, st.particles.buffer, _capacity);
+		NvFlexGetVelocities(_slv, st.velocities.buffer, _capacity);
+		NvFlexGetPhases(_slv, st.phases.buffer, _capacity);
+		st.hasRest = _pullStagedRest;
+		if (st.hasRest) {
+			if (st.restParticles.size() != _capacity)resizeVector(st.restParticles, _capacity);
+			NvFlexGetRestParticles(_slv, st.restParticles.buffer, _capacity);
+		}
+		pullRigids(st.rigids);
+		pullDiffuse(st.diffuse);
+		pullSurface(st.surface);
+		pullContacts(st.contacts);
+
+		//NvFlex docs only promise that map waits until gets into the buffer are done, not that it skips the tick queued after them.
+		//if it waits for the whole stream there is no overlap; the solver counts the staged map into the pull phase, so it shows in the profile.
+		//rigid rotations and translations live on device only, discard could not take them back a tick, so no speculation with rigids.
+		//nothing would copy the staged state into host buffers then, so it's done right away, next ingest writes there and pushes all channels
+		if (getRigidsCount() > 0) {
+			stagedToHost();
+			return;
+		}
+		NvFlexExtTickContainer(_cont, dt, substeps, false);
+		_speculating = true;
+		_specDt = dt;
+		_specSubsteps = substeps;
+		_specParams = _params;
+	}
+	void setStagedRestPull(bool restParticles) { _pullStagedRest = restParticles; }
+	NvFlexHParticleData mapStagedParticleData() {
+		StagingBuffers& st = *_staging[_staged];
+		st.particles.map();
+		st.velocities.map();
+		st.phases.map();
+		NvFlexHParticleData pdat;
+		pdat.particles = (float*)st.particles.mappedPtr;
+		pdat.velocities = (float*)st.velocities.mappedPtr;
+		pdat.phases = st.phases.mappedPtr;
+		if (st.hasRest) {
+			st.restParticles.map();
+			pdat.restParticles = (float*)st.restParticles.mappedPtr;
+		}
+		return pdat;
+	}
+	void unmapStagedParticleData() {
+		StagingBuffers& st = *_staging[_staged];
+		st.particles.unmap();
+		st.velocities.unmap();
+		st.phases.unmap();
+		if (st.hasRest)st.restParticles.unmap();
+	}
+	bool hasSpeculativeTick()const { return _speculating; }
+	bool speculationMatches(float dt, int substeps, const NvFlexParams& params)const {
+		return _speculating && dt == _specDt && substeps == _specSubsteps && memcmp(&params, &_specParams, sizeof(NvFlexParams)) == 0;
+	}
+	void acceptSpeculativeTick() { _speculating = false; }
+	void discardSpeculativeTick() {
+		if (!_speculating)return;
+		_speculating = false;
+		//particles and diffuse are all the tick changed, pullAndSpeculate does not tick while there are rigids
+		stagedToHost();
+		pushParticlesToDevice();
+		pushDiffuse(_slv);
+	}
+
+private:
+	/// ext host buffers are not pulled into while pipelining, staged data is the last state we exported
+	void stagedToHost() {
+		NvFlexHParticleData pdat = mapParticleData();
+		NvFlexHParticleData staged = mapStagedParticleData();
+		memcpy(pdat.particles, staged.particles, sizeof(float) * 4 * _capacity);
+		memcpy(pdat.velocities, staged.velocities, sizeof(float) * 3 * _capacity);
+		memcpy(pdat.phases, staged.phases, sizeof(int) * _capacity);
+		unmapStagedParticleData();
+		unmapParticleData();
+	}
+
+	bool createSolver(int capacity, NvFlexSolver*& slv, NvFlexExtContainer*& cont) {
+		slv = NvFlexCreateSolver(_lib, capacity, _maxDiffuseParticles, _maxNeighbours);
+		if (slv == NULL)return false;
+		cont = NvFlexExtCreateContainer(_lib, slv, capacity);
+		if (cont == NULL) {
+			NvFlexDestroySolver(slv);
+			slv = NULL;
+			return false;
+		}
+		return true;
+	}
+
+	/// only transforms are pulled, the rest of rigid data is ours and flex does not change it (except plastic rest positions)
+	struct RigidBuffers;
+	void pullRigids(RigidBuffers& rb) {
+		_lastRigids = &rb;
+		rb.count = getRigidsCount();
+		if (rb.count == 0)return;
+		if (rb.rotations.size() != rb.count) {
+			resizeVector(rb.rotations, rb.count);
+			resizeVector(rb.translations, rb.count);
+		}
+		NvFlexGetRigids(_slv, NULL, NULL, NULL, NULL, NULL, NULL, NULL, rb.rotations.buffer, rb.translations.buffer);
+	}
+	/// diffuse count comes back right away, the copy itself is queued like the particle one
+	struct DiffuseBuffers;
+	void pullDiffuse(DiffuseBuffers& db) {
+		_lastDiffuse = &db;
+		db.count = 0;
+		if (_maxDiffuseParticles <= 0)return;
+		if (db.positions.size() != _maxDiffuseParticles) {
+			resizeVector(db.positions, _maxDiffuseParticles);
+			resizeVector(db.velocities, _maxDiffuseParticles);
+			resizeVector(db.indices, _maxDiffuseParticles);
+		}
+		db.count = NvFlexGetDiffuseParticles(_slv, db.positions.buffer, db.velocities.buffer, db.indices.buffer);
+	}
+	/// surfacing channels are by particle index, so they are as big as particle buffers
+	struct SurfaceBuffers;
+	void pullSurface(SurfaceBuffers& sb) {
+		_lastSurface = &sb;
+		sb.hasSmooth = _pullSmooth;
+		sb.hasAnisotropy = _pullAnisotropy;
+		if (_pullSmooth) {
+			if (sb.smooth.size() != _capacity)resizeVector(sb.smooth, _capacity);
+			NvFlexGetSmoothParticles(_slv, sb.smooth.buffer, _capacity);
+		}
+		if (_pullAnisotropy) {
+			for (int i = 0; i < 3; ++i) {
+				if (sb.anisotropy(i).size() != _capacity)resizeVector(sb.anisotropy(i), _capacity);
+			}
+			NvFlexGetAnisotropy(_slv, sb.anisotropy1.buffer, sb.anisotropy2.buffer, sb.anisotropy3.buffer);
+		}
+	}
+	struct ContactBuffers;
+	void pullContacts(ContactBuffers& cb) {
+		_lastContacts = &cb;
+		cb.hasDensities = _pullDensities;
+		cb.hasContacts = _pullContacts;
+		if (_pullDensities) {
+			if (cb.densities.size() != _capacity)resizeVector(cb.densities, _capacity);
+			NvFlexGetDensities(_slv, cb.densities.buffer, _capacity);
+		}
+		if (_pullContacts) {
+			if (cb.indices.size() != _capacity) {
+				resizeVector(cb.planes, _capacity * kMaxContactsPerParticle);
+				resizeVector(cb.velocities, _capacity * kMaxContactsPerParticle);
+				resizeVector(cb.indices, _capacity);
+				resizeVector(cb.counts, _capacity);
+			}
+			NvFlexGetContacts(_slv, cb.planes.buffer, cb.velocities.buffer, cb.indices.buffer, cb.counts.buffer);
+		}
+	}
+	/// last pulled diffuse particles go to slv, for solvers that lost them (new one after reserve, discarded tick)
+	void pushDiffuse(NvFlexSolver* slv) {
+		if (_lastDiffuse == NULL || _lastDiffuse->count == 0)return;
+		NvFlexSetDiffuseParticles(slv, _lastDiffuse->positions.buffer, _lastDiffuse->velocities.buffer, _lastDiffuse->count);
+	}
+
+	/// our NvFlexVectors must go before the library can, their destructors would run too late
+	void destroyBuffers() {
+		_springIndices.destroy(); _springRestLengths.destroy(); _springStrenghts.destroy();
+		_triangleIndices.destroy(); _triangleNormals.destroy();
+		_rigidOffsets.destroy(); _rigidIndices.destroy(); _rigidRestPositions.destroy(); _rigidRestNormals.destroy();
+		_rigidStiffness.destroy(); _rigidThresholds.destroy(); _rigidCreeps.destroy(); _rigidRotations.destroy(); _rigidTranslations.destroy();
+		_inflatableStarts.destroy(); _inflatableCounts.destroy(); _inflatableVolumes.destroy(); _inflatablePressures.destroy(); _inflatableStiffness.destroy();
+		_geometry.destroy(); _positions.destroy(); _rotations.destroy(); _prevPositions.destroy(); _prevRotations.destroy(); _flags.destroy();
+	}
+
+	NvFlexHFlexBackend* _backend;
+	NvFlexLibrary* _lib;
+	int _maxParticles;
+	int _capacity;
+	int _activeCount;
+	int _maxDiffuseParticles;
+	int _maxNeighbours;
+	bool _timersEnabled;
+	bool _triangleNormalsPushed;
+	std::unique_ptr<NvFlexHCollisionData> _colld;
+	NvFlexSolver* _slv;
+	NvFlexExtContainer* _cont;
+
+	//springs
+	NvFlexVector<int> _springIndices;
+	NvFlexVector<float> _springRestLengths;
+	NvFlexVector<float> _springStrenghts;
+	//triangles
+	NvFlexVector<int> _triangleIndices;
+	NvFlexVector<float> _triangleNormals;
+	//rigids
+	NvFlexVector<int> _rigidOffsets;
+	NvFlexVector<int> _rigidIndices;
+	NvFlexVector<Vec3> _rigidRestPositions;
+	NvFlexVector<Vec4> _rigidRestNormals;
+	NvFlexVector<float> _rigidStiffness;
+	NvFlexVector<float> _rigidThresholds;
+	NvFlexVector<float> _rigidCreeps;
+	NvFlexVector<Quat> _rigidRotations;
+	NvFlexVector<Vec3> _rigidTranslations;
+	//inflatables
+	NvFlexVector<int> _inflatableStarts;
+	NvFlexVector<int> _inflatableCounts;
+	NvFlexVector<float> _inflatableVolumes;
+	NvFlexVector<float> _inflatablePressures;
+	NvFlexVector<float> _inflatableStiffness;
+	//shapes
+	NvFlexVector<NvFlexCollisionGeometry> _geometry;
+	NvFlexVector<Vec4> _positions;
+	NvFlexVector<Quat> _rotations;
+	NvFlexVector<Vec4> _prevPositions;
+	NvFlexVector<Quat> _prevRotations;
+	NvFlexVector<int> _flags;
+
+	//rigid transforms of a pull
+	struct RigidBuffers {
+		NvFlexVector<Quat> rotations;
+		NvFlexVector<Vec3> translations;
+		int count;
+		explicit RigidBuffers(NvFlexLibrary* lib) :rotations(lib), translations(lib), count(0) {}
+	};
+	std::unique_ptr<RigidBuffers> _rigidPose;
+	RigidBuffers* _lastRigids; //same as _lastDiffuse
+
+	//diffuse
+	struct DiffuseBuffers {
+		NvFlexVector<Vec4> positions;
+		NvFlexVector<Vec4> velocities;
+		NvFlexVector<int> indices; //render sort order, we don't use it
+		int count;
+		explicit DiffuseBuffers(NvFlexLibrary* lib) :positions(lib), velocities(lib), indices(lib), count(0) {}
+	};
+	std::unique_ptr<DiffuseBuffers> _diffuse;
+	DiffuseBuffers* _lastDiffuse; //_diffuse or the one of a staging buffer, whichever was pulled last
+
+	//surfacing
+	struct SurfaceBuffers {
+		NvFlexVector<Vec4> smooth;
+		NvFlexVector<Vec4> anisotropy1;
+		NvFlexVector<Vec4> anisotropy2;
+		NvFlexVector<Vec4> anisotropy3;
+		bool hasSmooth;
+		bool hasAnisotropy;
+		explicit SurfaceBuffers(NvFlexLibrary* lib) :smooth(lib), anisotropy1(lib), anisotropy2(lib), anisotropy3(lib), hasSmooth(false), hasAnisotropy(false) {}
+		NvFlexVector<Vec4>& anisotropy(int i) { return i == 0 ? anisotropy1 : i == 1 ? anisotropy2 : anisotropy3; }
+	};
+	bool _pullSmooth;
+	bool _pullAnisotropy;
+	std::unique_ptr<SurfaceBuffers> _surface;
+	SurfaceBuffers* _lastSurface; //same as _lastDiffuse
+
+	//densities and contacts
+	struct ContactBuffers {
+		NvFlexVector<float> densities;
+		NvFlexVector<Vec4> planes;
+		NvFlexVector<Vec4> velocities;
+		NvFlexVector<int> indices;
+		NvFlexVector<unsigned int> counts;
+		bool hasDensities;
+		bool hasContacts;
+		explicit ContactBuffers(NvFlexLibrary* lib) :densities(lib), planes(lib), velocities(lib), indices(lib), counts(lib), hasDensities(false), hasContacts(false) {}
+	};
+	bool _pullDensities;
+	bool _pullContacts;
+	std::unique_ptr<ContactBuffers> _contacts;
+	ContactBuffers* _lastContacts; //same as _lastDiffuse
+
+	//pipelining
+	struct StagingBuffers {
+		NvFlexVector<Vec4> particles;
+		NvFlexVector<Vec3> velocities;
+		NvFlexVector<int> phases;
+		NvFlexVector<Vec4> restParticles;
+		RigidBuffers rigids;
+		DiffuseBuffers diffuse;
+		SurfaceBuffers surface;
+		ContactBuffers contacts;
+		bool hasRest;
+		explicit StagingBuffers(NvFlexLibrary* lib) :particles(lib), velocities(lib), phases(lib), restParticles(lib), rigids(lib), diffuse(lib), surface(lib), contacts(lib), hasRest(false) {}
+	};
+	std::unique_ptr<StagingBuffers> _staging[2];
+	int _staged; //staging buffer of the last pullAndSpeculate, -1 before the first
+	bool _pullStagedRest;
+	bool _speculating;
+	float _specDt;
+	int _specSubsteps;
+	NvFlexParams _params;
+	NvFlexParams _specParams;
+};
+
+
+
+bool NvFlexHFlexContainer::reserve(int count) {
+	if (count <= _capacity)return true;
+	if (count > _maxParticles)return false;
+	const int newcap = nvFlexHGrownCapacity(_capacity, count, _maxParticles);
+
+	//host buffers must be the current state, a queued tick would be lost with the old solver anyway
+	discardSpeculativeTick();
+
+	NvFlexSolver* slv = NULL;
+	NvFlexExtContainer* cont = NULL;
+	if (!createSolver(newcap, slv, cont))return false;
+
+	//new container has its own free list. taking everything and giving back what was not active in the old one
+	//leaves the old indices allocated, whatever order ext hands them out in
+	std::vector<int> active(_capacity);
+	active.resize(NvFlexExtGetActiveList(_cont, active.data()));
+	std::vector<char> isactive(newcap, 0);
+	for (size_t i = 0; i < active.size(); ++i)isactive[active[i]] = 1;
+	std::vector<int> all(newcap);
+	const int nall = NvFlexExtAllocParticles(cont, newcap, all.data());
+	std::vector<int> unused;
+	unused.reserve(nall);
+	for (int i = 0; i < nall; ++i) {
+		if (!isactive[all[i]])unused.push_back(all[i]);
+	}
+	if (!unused.empty())NvFlexExtFreeParticles(cont, int(unused.size()), unused.data());
+
+	NvFlexExtParticleData olddat = NvFlexExtMapParticleData(_cont);
+	NvFlexExtParticleData newdat = NvFlexExtMapParticleData(cont);
+	memcpy(newdat.particles, olddat.particles, sizeof(float) * 4 * _capacity);
+	memcpy(newdat.restParticles, olddat.restParticles, sizeof(float) * 4 * _capacity);
+	memcpy(newdat.velocities, olddat.velocities, sizeof(float) * 3 * _capacity);
+	memcpy(newdat.phases, olddat.phases, sizeof(int) * _capacity);
+	memcpy(newdat.normals, olddat.normals, sizeof(float) * 4 * _capacity);
+	NvFlexExtUnmapParticleData(cont);
+	NvFlexExtUnmapParticleData(_cont);
+
+	NvFlexExtDestroyContainer(_cont);
+	NvFlexDestroySolver(_slv);
+	_slv = slv;
+	_cont = cont;
+	_capacity = newcap;
+
+	//the new solver knows nothing yet. our buffers outlive solvers, so everything is just set again
+	NvFlexExtPushToDevice(_cont);
+	NvFlexSetParams(_slv, &_params);
+	if (_springRestLengths.size() > 0)pushSpringsToDevice();
+	if (_triangleIndices.size() > 0)pushTrianglesToDevice(_triangleNormalsPushed);
+	//clusters start over from the rotations they were uploaded with, flex only uses those as the first guess anyway.
+	//plastic changes of rest positions happened on device and are lost
+	if (_rigidIndices.size() > 0)pushRigidsToDevice();
+	if (_inflatableStarts.size() > 0)pushInflatablesToDevice();
+	if (_geometry.size() > 0)NvFlexSetShapes(_slv, _geometry.buffer, _positions.buffer, _rotations.buffer, _prevPositions.buffer, _prevRotations.buffer, _flags.buffer, _geometry.size());
+	pushDiffuse(_slv);
+	return true;
+}
+
+
+//backends live till the process ends, even shut down ones, containers may still point at them
+static std::mutex instancesMutex;
+static std::map<int, NvFlexHFlexBackend*> instances; //NULL for devices that failed
+static bool instancesShutdown = false;
+
+NvFlexHFlexBackend* NvFlexHFlexBackend::instance(int device) {
+	std::lock_guard<std::mutex> lock(instancesMutex);
+	if (instancesShutdown)return NULL;
+	//we only try once per device, failed init won't get better by retrying every frame
+	std::map<int, NvFlexHFlexBackend*>::iterator it = instances.find(device);
+	if (it != instances.end())return it->second;
+
+	NvFlexLibrary* lib = NULL;
+	callbackDevice = device;
+	if (device < 0)lib = NvFlexInit(110, &nvFlexErrorCallback);
+	else {
+		NvFlexInitDesc desc;
+		memset(&desc, 0, sizeof(desc));
+		desc.deviceIndex = device;
+		desc.enableExtensions = true;
+		desc.computeType = eNvFlexCUDA;
+		lib = NvFlexInit(110, &nvFlexErrorCallback, &desc);
+	}
+	callbackDevice = kNoDevice;
+	NvFlexHFlexBackend* backend = lib != NULL ? new NvFlexHFlexBackend(lib, device) : NULL;
+	instances[device] = backend;
+	return backend;
+}
+
+void NvFlexHFlexBackend::shutdown() {
+	std::lock_guard<std::mutex> lock(instancesMutex);
+	instancesShutdown = true;
+	for (std::map<int, NvFlexHFlexBackend*>::iterator it = instances.begin(); it != instances.end(); ++it) {
+		NvFlexHFlexBackend* backend = it->second;
+		if (backend == NULL)continue;
+		backend->_shutdown = true;
+		if (backend->_containers == 0)backend->shutdownLibrary();
+	}
+}
+
+NvFlexHFlexBackend::NvFlexHFlexBackend(NvFlexLibrary* l, int device) :lib(l), _device(device), _contextDepth(0), _containers(0), _shutdown(false) {}
+
+void NvFlexHFlexBackend::shutdownLibrary() {
+	if (lib == NULL)return;
+	std::lock_guard<std::recursive_mutex> lock(_contextMutex);
+	meshbuffers.clear();
+	convexbuffers.clear();
+	sdfbuffers.clear();
+	NvFlexShutdown(lib);
+	lib = NULL;
+}
+
+void NvFlexHFlexBackend::acquireContext() {
+	_contextMutex.lock();
+	if (_contextDepth++ == 0) {
+		callbackDevice = _device;
+		if (lib != NULL)NvFlexAcquireContext(lib);
+	}
+}
+
+void NvFlexHFlexBackend::releaseContext() {
+	if (--_contextDepth == 0) {
+		if (lib != NULL)NvFlexRestoreContext(lib);
+		callbackDevice = kNoDevice;
+	}
+	_contextMutex.unlock();
+}
+
+std::string NvFlexHFlexBackend::takeDeviceError(int device) {
+	std::lock_guard<std::mutex> lock(errorsMutex);
+	std::string error;
+	//errors from outside a context belong to nobody, whoever asks first reports them
+	const int keys[2] = { device, kNoDevice };
+	for (int k = 0; k < 2; ++k) {
+		std::map<int, std::string>::iterator it = lastErrors.find(keys[k]);
+		if (it == lastErrors.end())continue;
+		if (!error.empty())error += "; ";
+		error += it->second;
+		lastErrors.erase(it);
+	}
+	return error;
+}
+
+void NvFlexHFlexBackend::containerCreated() {
+	std::lock_guard<std::mutex> lock(instancesMutex);
+	++_containers;
+}
+
+void NvFlexHFlexBackend::containerDestroyed() {
+	std::lock_guard<std::mutex> lock(instancesMutex);
+	if (--_containers == 0 && _shutdown)shutdownLibrary();
+}
+
+NvFlexHContainer* NvFlexHFlexBackend::createContainer(int maxParticles, int maxDiffuseParticles, int maxNeighbours) {
+	//counted before the context is taken, shutdown locks in the other order
+	containerCreated();
+	try {
+		NvFlexHContextGuard guard(this);
+		return new NvFlexHFlexContainer(this, maxParticles, maxDiffuseParticles, maxNeighbours);
+	}
+	catch (...) {
+		containerDestroyed();
+		throw;
+	}
+}
+
+
+NvFlexTriangleMeshId NvFlexHFlexBackend::createTriangleMesh() {
+	NvFlexTriangleMeshId id = NvFlexCreateTriangleMesh(lib);
+	meshbuffers[id].reset(new TriangleMeshBuffers(lib));
+	return id;
+}
+
+NvFlexHTriangleMeshData NvFlexHFlexBackend::mapTriangleMesh(NvFlexTriangleMeshId id, int vertcount, int tricount, bool keepTriangles) {
+	TriangleMeshBuffers* bufs = meshbuffers[id].get();
+	//caller writes straight into pinned memory, kept triangles are not touched at all
+	NvFlexHTriangleMeshData mdat;
+	mdat.vertices = mapResized(bufs->vertices, vertcount);
+	bufs->trianglesMapped = !keepTriangles;
+	if (!keepTriangles)mdat.triangles = mapResized(bufs->triangles, tricount * 3);
+	return mdat;
+}
+
+void NvFlexHFlexBackend::unmapTriangleMesh(NvFlexTriangleMeshId id, const float* lower, const float* upper) {
+	TriangleMeshBuffers* bufs = meshbuffers[id].get();
+	bufs->vertices.unmap();
+	if (bufs->trianglesMapped)bufs->triangles.unmap();
+	bufs->trianglesMapped = false;
+	NvFlexUpdateTriangleMesh(lib, id, bufs->vertices.buffer, bufs->triangles.buffer, bufs->vertices.size(), bufs->triangles.size() / 3, lower, upper);
+}
+
+void NvFlexHFlexBackend::destroyTriangleMesh(NvFlexTriangleMeshId id) {
+	NvFlexDestroyTriangleMesh(lib, id);
+	meshbuffers.erase(id);
+}
+
+
+NvFlexConvexMeshId NvFlexHFlexBackend::createConvexMesh() {
+	NvFlexConvexMeshId id = NvFlexCreateConvexMesh(lib);
+	convexbuffers[id].reset(new NvFlexVector<Vec4>(lib));
+	return id;
+}
+
+void NvFlexHFlexBackend::updateConvexMesh(NvFlexConvexMeshId id, const Vec4* planes, int planecount, const float* lower, const float* upper) {
+	NvFlexVector<Vec4>* planevec = convexbuffers[id].get();
+	assignVector(*planevec, planes, planecount);
+	NvFlexUpdateConvexMesh(lib, id, planevec->buffer, planecount, lower, upper);
+}
+
+void NvFlexHFlexBackend::destroyConvexMesh(NvFlexConvexMeshId id) {
+	NvFlexDestroyConvexMesh(lib, id);
+	convexbuffers.erase(id);
+}
+
+
+NvFlexDistanceFieldId NvFlexHFlexBackend::createDistanceField() {
+	NvFlexDistanceFieldId id = NvFlexCreateDistanceField(lib);
+	sdfbuffers[id].reset(new NvFlexVector<float>(lib));
+	return id;
+}
+
+void NvFlexHFlexBackend::updateDistanceField(NvFlexDistanceFieldId id, int dim, const float* values) {
+	NvFlexVector<float>* fieldvec = sdfbuffers[id].get();
+	assignVector(*fieldvec, values, dim * dim * dim);
+	NvFlexUpdateDistanceField(lib, id, dim, dim, dim, fieldvec->buffer);
+}
+
+void NvFlexHFlexBackend::destroyDistanceField(NvFlexDistanceFieldId id) {
+	NvFlexDestroyDistanceField(lib, id);
+	sdfbuffers.erase(id);
+}
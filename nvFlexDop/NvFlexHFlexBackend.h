@@ -0,0 +1,74 @@
+#pragma once
+#include <NvFlex.h>
+#include <NvFlexExt.h>
+
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+
+#include "NvFlexHBackend.h"
+
+
+/// Backend on top of the NvFlex library itself. There is one per cuda device, each with its own library,
+/// initialized on first use and shared by all sims on that device.
+class NvFlexHFlexBackend :public NvFlexHBackend {
+public:
+	/// device -1 lets flex pick one. NULL if NvFlexInit failed for it (no cuda device, wrong driver...) or after shutdown
+	static NvFlexHFlexBackend* instance(int device = -1);
+	/// for exit: no more instances after this, libraries go down as soon as their last container is destroyed
+	static void shutdown();
+
+	NvFlexLibrary* library() { return lib; }
+	int device()const { return _device; }
+
+	const char* name()const { return "NvFlex"; }
+	/// serializes threads on a mutex, the flex context is pushed by the outermost acquire only
+	void acquireContext();
+	void releaseContext();
+	std::string takeError() { return takeDeviceError(_device); }
+	/// errors flex reported for a device, also works for devices whose init failed and that have no backend
+	static std::string takeDeviceError(int device);
+	/// containers keep the library alive, so shutdown with sims still around is delayed till they are gone
+	void containerCreated();
+	void containerDestroyed();
+	NvFlexHContainer* createContainer(int maxParticles, int maxDiffuseParticles, int maxNeighbours = 96);
+
+	NvFlexTriangleMeshId createTriangleMesh();
+	NvFlexHTriangleMeshData mapTriangleMesh(NvFlexTriangleMeshId id, int vertcount, int tricount, bool keepTriangles);
+	void unmapTriangleMesh(NvFlexTriangleMeshId id, const float* lower, const float* upper);
+	void destroyTriangleMesh(NvFlexTriangleMeshId id);
+
+	NvFlexConvexMeshId createConvexMesh();
+	void updateConvexMesh(NvFlexConvexMeshId id, const Vec4* planes, int planecount, const float* lower, const float* upper);
+	void destroyConvexMesh(NvFlexConvexMeshId id);
+
+	NvFlexDistanceFieldId createDistanceField();
+	void updateDistanceField(NvFlexDistanceFieldId id, int dim, const float* values);
+	void destroyDistanceField(NvFlexDistanceFieldId id);
+
+private:
+	NvFlexHFlexBackend(NvFlexLibrary* lib, int device);
+	/// frees buffers we hold in the library, then the library. only once nothing uses it
+	void shutdownLibrary();
+	NvFlexHFlexBackend(const NvFlexHFlexBackend&) = delete;
+	NvFlexHFlexBackend& operator=(const NvFlexHFlexBackend&) = delete;
+
+	/// flex reads mesh data from buffers on update, so we keep them per mesh
+	struct TriangleMeshBuffers {
+		NvFlexVector<Vec3> vertices;
+		NvFlexVector<int> triangles;
+		bool trianglesMapped;
+		TriangleMeshBuffers(NvFlexLibrary* lib) :vertices(lib), triangles(lib), trianglesMapped(false) {}
+	};
+
+	NvFlexLibrary* lib;
+	int _device;
+	std::recursive_mutex _contextMutex;
+	int _contextDepth;
+	int _containers; //guarded by the static instances mutex, same as _shutdown
+	bool _shutdown;
+	std::map<NvFlexTriangleMeshId, std::unique_ptr<TriangleMeshBuffers>> meshbuffers;
+	std::map<NvFlexConvexMeshId, std::unique_ptr<NvFlexVector<Vec4>>> convexbuffers;
+	std::map<NvFlexDistanceFieldId, std::unique_ptr<NvFlexVector<float>>> sdfbuffers;
+};
@@ -0,0 +1,19 @@
+#pragma once
+#include <GA/GA_Detail.h>
+#include <GA/GA_IndexMap.h>
+#include <GA/GA_Types.h>
+
+
+/// returns GA_Index of bst if all the offsets of the block [bst, bed) returned by blockAdvance have consecutive indices, -1 otherwise
+/// so that per-element index lookups can be skipped
+inline GA_Index contiguousBlockIndex(const GA_IndexMap& map, GA_Offset bst) {
+	if (map.isTrivialMap())return GA_Index(bst);
+	if (map.isMonotonicMap())return map.indexFromOffset(bst); //active offsets in a block have no holes, so indices go one by one
+	return -1;
+}
+
+/// changes whenever primitives are added/removed or rewired to other points
+/// primitive list and point ref ids only grow, so their sum changes if any of them does
+inline int64 topologyDataId(const GA_Detail* gdp) {
+	return gdp->getPrimitiveList().getDataId() + gdp->getTopology().getPointRef()->getDataId();
+}
@@ -0,0 +1,50 @@
+#include "NvFlexHIndexMap.h"
+
+
+NvFlexHIndexMap::NvFlexHIndexMap(int capacity):_size(0), _requested(0), _capacity(capacity){}
+
+int NvFlexHIndexMap::resize(NvFlexHContainer* cont, int count) {
+	_requested = count < 0 ? 0 : count;
+	if (count > _capacity)count = _capacity;
+	if (count < 0)count = 0;
+
+	if (count > _size) {
+		//new indices are appended right after existing ones, so old points keep their particles
+		if (int(_indices.size()) < count)_indices.resize(count);
+		_size += cont->allocParticles(count - _size, _indices.data() + _size);
+	}
+	else if (count < _size) {
+		//free the tail
+		cont->freeParticles(_size - count, _indices.data() + count);
+		_size = count;
+	}
+	return _size;
+}
+
+void NvFlexHIndexMap::resync(NvFlexHContainer* cont) {
+	if (int(_indices.size()) < cont->capacity())_indices.resize(cont->capacity());
+	_size = cont->getActiveList(_indices.data());
+	_requested = _size;
+}
+
+void NvFlexHIndexMap::assign(const int* indices, int count) {
+	_size = count < _capacity ? count : _capacity;
+	_requested = _size;
+	if (int(_indices.size()) < _size)_indices.resize(_size);
+	for (int i = 0; i < _size; ++i)_indices[i] = indices[i];
+}
+
+
+void NvFlexHMemberMaps::update(const std::vector<int>& ids, const std::vector<std::shared_ptr<NvFlexHIndexMap> >& maps, std::vector<std::shared_ptr<NvFlexHIndexMap> >& released) {
+	std::map<int, std::shared_ptr<NvFlexHIndexMap> > members;
+	for (size_t i = 0; i < ids.size(); ++i)members[ids[i]] = maps[i];
+	for (auto it = _maps.begin(); it != _maps.end(); ++it) {
+		auto found = members.find(it->first);
+		if (found == members.end() || found->second != it->second)released.push_back(it->second);
+	}
+	_maps.swap(members);
+}
+
+void NvFlexHMemberMaps::add(int id, const std::shared_ptr<NvFlexHIndexMap>& map) {
+	_maps[id] = map;
+}
@@ -0,0 +1,63 @@
+#pragma once
+#include "NvFlexHBackend.h"
+
+#include <map>
+#include <memory>
+#include <vector>
+
+
+/// Mirror of container's active particles list, kept in sync as we alloc/free particles,
+/// so that getActiveList does not have to be called every step.
+/// Entry i is the flex particle index of the point with GA_Index i.
+/// Storage grows with size, capacity is only the upper limit.
+class NvFlexHIndexMap
+{
+public:
+	explicit NvFlexHIndexMap(int capacity);
+	NvFlexHIndexMap(const NvFlexHIndexMap&) = delete;
+	NvFlexHIndexMap& operator=(const NvFlexHIndexMap&) = delete;
+
+	inline int size()const { return _size; }
+	inline int capacity()const { return _capacity; }
+	/// count the last resize asked for, more than size() when container ran out of room
+	inline int requested()const { return _requested; }
+	inline const int* indices()const { return _indices.data(); }
+	inline int operator[](int i)const { return _indices[i]; }
+
+	/// allocates or frees particles at the end of the map so it holds count entries (or as much as container allows)
+	/// returns new size. does not grow the container, reserve there first
+	int resize(NvFlexHContainer* cont, int count);
+
+	/// rereads active list from the container. only needed if someone allocated particles behind our back
+	void resync(NvFlexHContainer* cont);
+
+	/// takes indices of particles someone else already allocated, like a cache restore. count is clamped to capacity
+	void assign(const int* indices, int count);
+
+private:
+	std::vector<int> _indices;
+	int _size;
+	int _requested;
+	int _capacity;
+};
+
+
+/// Index maps of the objects sharing one container, by dop object id.
+/// An object that is gone can't free its particles itself, this remembers them so the solver can.
+class NvFlexHMemberMaps
+{
+public:
+	/// makes ids/maps the members. maps of objects not among them, or replaced by another map of the same object,
+	/// go to released. their particles are still allocated, the caller frees them
+	void update(const std::vector<int>& ids, const std::vector<std::shared_ptr<NvFlexHIndexMap> >& maps, std::vector<std::shared_ptr<NvFlexHIndexMap> >& released);
+
+	/// adds a member as is, like particles of a cache restore that no object claimed
+	void add(int id, const std::shared_ptr<NvFlexHIndexMap>& map);
+
+	/// forgets all members without freeing, for when the container was refilled from elsewhere
+	inline void clear() { _maps.clear(); }
+	inline size_t size()const { return _maps.size(); }
+
+private:
+	std::map<int, std::shared_ptr<NvFlexHIndexMap> > _maps;
+};
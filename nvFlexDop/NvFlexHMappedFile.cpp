@@ -0,0 +1,82 @@
+#include "NvFlexHMappedFile.h"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+
+#ifdef _WIN32
+NvFlexHMappedFile::NvFlexHMappedFile() :_data(NULL), _size(0), _file(INVALID_HANDLE_VALUE), _mapping(NULL) {}
+#else
+NvFlexHMappedFile::NvFlexHMappedFile() :_data(NULL), _size(0) {}
+#endif
+
+NvFlexHMappedFile::~NvFlexHMappedFile() {
+	close();
+}
+
+#ifdef _WIN32
+bool NvFlexHMappedFile::open(const char* path) {
+	close();
+	_file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+	if (_file == INVALID_HANDLE_VALUE)return false;
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(_file, &size) || size.QuadPart == 0) {
+		close();
+		return false;
+	}
+	_mapping = CreateFileMappingA(_file, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (_mapping == NULL) {
+		close();
+		return false;
+	}
+	_data = (const unsigned char*)MapViewOfFile(_mapping, FILE_MAP_READ, 0, 0, 0);
+	if (_data == NULL) {
+		close();
+		return false;
+	}
+	_size = size_t(size.QuadPart);
+	return true;
+}
+
+void NvFlexHMappedFile::close() {
+	if (_data != NULL)UnmapViewOfFile(_data);
+	if (_mapping != NULL)CloseHandle(_mapping);
+	if (_file != INVALID_HANDLE_VALUE)CloseHandle(_file);
+	_data = NULL;
+	_size = 0;
+	_mapping = NULL;
+	_file = INVALID_HANDLE_VALUE;
+}
+#else
+bool NvFlexHMappedFile::open(const char* path) {
+	close();
+	int fd = ::open(path, O_RDONLY);
+	if (fd < 0)return false;
+	struct stat st;
+	if (fstat(fd, &st) != 0 || st.st_size == 0) {
+		::close(fd);
+		return false;
+	}
+	//mapping keeps the file referenced, descriptor is not needed after this
+	void* ptr = mmap(NULL, size_t(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+	::close(fd);
+	if (ptr == MAP_FAILED)return false;
+	_data = (const unsigned char*)ptr;
+	_size = size_t(st.st_size);
+	return true;
+}
+
+void NvFlexHMappedFile::close() {
+	if (_data != NULL)munmap((void*)_data, _size);
+	_data = NULL;
+	_size = 0;
+}
+#endif
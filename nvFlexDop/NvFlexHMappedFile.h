@@ -0,0 +1,29 @@
+#pragma once
+#include <cstddef>
+
+
+/// Read only memory mapping of a whole file. Pages are loaded by the OS on first touch,
+/// so opening a big file is cheap and only what is read costs io.
+class NvFlexHMappedFile {
+public:
+	NvFlexHMappedFile();
+	NvFlexHMappedFile(const NvFlexHMappedFile&) = delete;
+	NvFlexHMappedFile& operator=(const NvFlexHMappedFile&) = delete;
+	~NvFlexHMappedFile();
+
+	/// false if file can't be opened or is empty
+	bool open(const char* path);
+	void close();
+
+	bool isOpen()const { return _data != NULL; }
+	const unsigned char* data()const { return _data; }
+	size_t size()const { return _size; }
+
+private:
+	const unsigned char* _data;
+	size_t _size;
+#ifdef _WIN32
+	void* _file;
+	void* _mapping;
+#endif
+};
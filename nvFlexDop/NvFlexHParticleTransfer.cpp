@@ -0,0 +1,542 @@
+#include "NvFlexHParticleTransfer.h"
+
+#include <GA/GA_PageIterator.h>
+#include <GA/GA_PageHandle.h>
+#include <GA/GA_OffsetList.h>
+#include <GA/GA_Range.h>
+#include <UT/UT_ParallelUtil.h>
+
+#include "NvFlexHGeoUtils.h"
+
+
+void NvFlexHDataIds::invalidate() {
+	P = v = phs = imass = restP = -1;
+	topology = restlength = strength = N = -1;
+	cluster = primcluster = clusterstiffness = -1;
+	inflatable = pressure = -1;
+}
+
+static inline int64 attribDataId(const GA_Attribute* att) {
+	return att == NULL ? -1 : att->getDataId();
+}
+
+void NvFlexHDataIds::read(const GU_Detail* gdp) {
+	P = attribDataId(gdp->getP());
+	v = attribDataId(gdp->findPointAttribute("v").get());
+	phs = attribDataId(gdp->findPointAttribute("phs").get());
+	imass = attribDataId(gdp->findPointAttribute("imass").get());
+	restP = attribDataId(gdp->findPointAttribute("restP").get());
+
+	topology = topologyDataId(gdp);
+	restlength = attribDataId(gdp->findPrimitiveAttribute("restlength").get());
+	strength = attribDataId(gdp->findPrimitiveAttribute("strength").get());
+	//same priority as in triangle normals: primitive, vertex, point
+	N = attribDataId(gdp->findPrimitiveAttribute("N").get());
+	if (N < 0)N = attribDataId(gdp->findVertexAttribute("N").get());
+	if (N < 0)N = attribDataId(gdp->findPointAttribute("N").get());
+
+	cluster = attribDataId(gdp->findPointAttribute("cluster").get());
+	primcluster = attribDataId(gdp->findPrimitiveAttribute("cluster").get());
+	clusterstiffness = attribDataId(gdp->findPointAttribute("clusterstiffness").get());
+
+	inflatable = attribDataId(gdp->findPrimitiveAttribute("inflatable").get());
+	pressure = attribDataId(gdp->findPrimitiveAttribute("pressure").get());
+}
+
+
+NvFlexHParticleIngest::NvFlexHParticleIngest(const GU_Detail* gdp):_gdp(gdp),
+	_phnd(gdp->getP()),
+	_vhnd(gdp->findPointAttribute("v")),
+	_ihnd(gdp->findPointAttribute("iid")),
+	_phshnd(gdp->findPointAttribute("phs")),
+	_mhnd(gdp->findPointAttribute("imass")),
+	_rhnd(gdp->findPointAttribute("restP")){}
+
+bool NvFlexHParticleIngest::isValid()const {
+	return _phnd.isValid() && _vhnd.isValid() && _ihnd.isValid() && _phshnd.isValid() && _mhnd.isValid();
+}
+
+/// functor for UTparallelFor. every thread gets it's own set of page handles
+class NvFlexHParticleIngest::ThreadedTransfer {
+public:
+	ThreadedTransfer(const NvFlexHParticleIngest& ingest, NvFlexHParticleData& pdat, const int* indices, int nactives, int channels) :_ing(ingest), _pdat(pdat), _indices(indices), _nactives(nactives), _channels(channels) {}
+
+	void operator()(const GA_SplittableRange& r)const {
+		const GU_Detail* gdp = _ing._gdp;
+		const bool doP = (_channels & eChannelPosition) != 0;
+		const bool doV = (_channels & eChannelVelocity) != 0;
+		const bool doPhs = (_channels & eChannelPhase) != 0;
+		const bool doM = (_channels & eChannelMass) != 0;
+		const bool doRest = (_channels & eChannelRest) != 0 && _ing.hasRest();
+		GA_ROPageHandleV3 phnd, vhnd, rhnd;
+		GA_ROPageHandleI phshnd;
+		GA_ROPageHandleF mhnd;
+		if (doP)phnd.bind(_ing._phnd.getAttribute());
+		if (doV)vhnd.bind(_ing._vhnd.getAttribute());
+		if (doPhs)phshnd.bind(_ing._phshnd.getAttribute());
+		if (doM)mhnd.bind(_ing._mhnd.getAttribute());
+		if (doRest)rhnd.bind(_ing._rhnd.getAttribute());
+
+		for (GA_PageIterator pit = r.beginPages(); !pit.atEnd(); ++pit) {
+			GA_Offset bst, bed;
+			for (GA_Iterator it(pit.begin()); it.blockAdvance(bst, bed);) {
+				if (doP)phnd.setPage(bst);
+				if (doV)vhnd.setPage(bst);
+				if (doPhs)phshnd.setPage(bst);
+				if (doM)mhnd.setPage(bst);
+				if (doRest)rhnd.setPage(bst);
+
+				GA_Index idx = contiguousBlockIndex(gdp->getPointMap(), bst);
+				const bool contiguous = idx >= 0;
+				for (GA_Offset off = bst; off < bed; ++off, ++idx) {
+					if (!contiguous)idx = gdp->pointIndex(off);
+					if (idx >= _nactives) {
+						if (contiguous)break; //rest of the block is out too
+						continue;
+					}
+					int iid = _indices[idx];
+					int iid4 = iid * 4;
+					int iid3 = iid * 3;
+
+					if (doP) {
+						const UT_Vector3F& p = phnd.value(off);
+						_pdat.particles[iid4 + 0] = p.x();
+						_pdat.particles[iid4 + 1] = p.y();
+						_pdat.particles[iid4 + 2] = p.z();
+					}
+					if (doM)_pdat.particles[iid4 + 3] = mhnd.value(off);
+					if (doRest) {
+						const UT_Vector3F& rst = rhnd.value(off);
+						_pdat.restParticles[iid4 + 0] = rst.x();
+						_pdat.restParticles[iid4 + 1] = rst.y();
+						_pdat.restParticles[iid4 + 2] = rst.z();
+						_pdat.restParticles[iid4 + 3] = 1.0f;
+					}
+					if (doV) {
+						const UT_Vector3F& v = vhnd.value(off);
+						_pdat.velocities[iid3 + 0] = v.x();
+						_pdat.velocities[iid3 + 1] = v.y();
+						_pdat.velocities[iid3 + 2] = v.z();
+					}
+					if (doPhs)_pdat.phases[iid] = phshnd.value(off);
+				}
+			}
+		}
+	}
+
+private:
+	const NvFlexHParticleIngest& _ing;
+	NvFlexHParticleData& _pdat;
+	const int* _indices;
+	int _nactives;
+	int _channels;
+};
+
+
+void NvFlexHParticleIngest::transfer(NvFlexHParticleData& pdat, const int* indices, int nactives, int channels, bool threaded)const {
+	if (channels == 0)return;
+	if (!threaded) {
+		transferSerial(pdat, indices, nactives, channels);
+		return;
+	}
+	UTparallelFor(GA_SplittableRange(_gdp->getPointRange()), ThreadedTransfer(*this, pdat, indices, nactives, channels));
+}
+
+
+void NvFlexHParticleIngest::transferSerial(NvFlexHParticleData& pdat, const int* indices, int nactives, int channels)const {
+	const bool doP = (channels & eChannelPosition) != 0;
+	const bool doV = (channels & eChannelVelocity) != 0;
+	const bool doPhs = (channels & eChannelPhase) != 0;
+	const bool doM = (channels & eChannelMass) != 0;
+	const bool doRest = (channels & eChannelRest) != 0 && hasRest();
+	GA_Offset bst, bed;
+	for (GA_Iterator it(_gdp->getPointRange()); it.blockAdvance(bst, bed);) {
+		for (GA_Offset off = bst; off < bed; ++off) {
+			GA_Index idx = _gdp->pointIndex(off);
+			if (idx >= nactives)continue; //index map may be not monotonic, so we cannot just stop here
+
+			int iid = indices[idx];
+			int iid4 = iid * 4;
+			int iid3 = iid * 3;
+			if (doP) {
+				UT_Vector3F p = _phnd.get(off);
+				pdat.particles[iid4 + 0] = p.x();
+				pdat.particles[iid4 + 1] = p.y();
+				pdat.particles[iid4 + 2] = p.z();
+			}
+			if (doM)pdat.particles[iid4 + 3] = _mhnd.get(off);
+			if (doRest) {
+				UT_Vector3F rst = _rhnd.get(off);
+				pdat.restParticles[iid4 + 0] = rst.x();
+				pdat.restParticles[iid4 + 1] = rst.y();
+				pdat.restParticles[iid4 + 2] = rst.z();
+				pdat.restParticles[iid4 + 3] = 1.0f; //cannot find in manual what it expects here
+			}
+			if (doV) {
+				UT_Vector3F v = _vhnd.get(off);
+				pdat.velocities[iid3 + 0] = v.x();
+				pdat.velocities[iid3 + 1] = v.y();
+				pdat.velocities[iid3 + 2] = v.z();
+			}
+			if (doPhs)pdat.phases[iid] = _phshnd.get(off);
+		}
+	}
+}
+
+
+
+NvFlexHParticleExport::NvFlexHParticleExport(GU_Detail* gdp):_gdp(gdp) {
+	_vatt = gdp->findFloatTuple(GA_ATTRIB_POINT, "v", 3, 3);
+	if (!_vatt.isValid()) {
+		_vatt = gdp->addFloatTuple(GA_ATTRIB_POINT, "v", 3, GA_Defaults(0));
+		_vatt.setTypeInfo(GA_TYPE_VECTOR);
+	}
+	_iidatt = gdp->findIntTuple(GA_ATTRIB_POINT, "iid", 1, 1);
+	if (!_iidatt.isValid()) {
+		_iidatt = gdp->addIntTuple(GA_ATTRIB_POINT, "iid", 1, GA_Defaults(-1));
+	}
+	_phsatt = gdp->findIntTuple(GA_ATTRIB_POINT, "phs", 1, 1);
+	if (!_phsatt.isValid()) {
+		_phsatt = gdp->addIntTuple(GA_ATTRIB_POINT, "phs", 1, GA_Defaults(0));
+	}
+}
+
+/// functor for UTparallelFor. pages are written by one thread only, so no locking needed
+class NvFlexHParticleExport::ThreadedTransfer {
+public:
+	ThreadedTransfer(const NvFlexHParticleExport& exp, const NvFlexHParticleData& pdat, const int* indices, int nactives) :_exp(exp), _pdat(pdat), _indices(indices), _nactives(nactives) {}
+
+	void operator()(const GA_SplittableRange& r)const {
+		GU_Detail* gdp = _exp._gdp;
+		GA_RWPageHandleV3 phnd(gdp->getP());
+		GA_RWPageHandleV3 vhnd(_exp._vatt.get());
+		GA_RWPageHandleI iidhnd(_exp._iidatt.get());
+		GA_RWPageHandleI phshnd(_exp._phsatt.get());
+
+		for (GA_PageIterator pit = r.beginPages(); !pit.atEnd(); ++pit) {
+			GA_Offset bst, bed;
+			for (GA_Iterator it(pit.begin()); it.blockAdvance(bst, bed);) {
+				phnd.setPage(bst);
+				vhnd.setPage(bst);
+				iidhnd.setPage(bst);
+				phshnd.setPage(bst);
+
+				GA_Index idx = contiguousBlockIndex(gdp->getPointMap(), bst);
+				const bool contiguous = idx >= 0;
+				for (GA_Offset off = bst; off < bed; ++off, ++idx) {
+					if (!contiguous)idx = gdp->pointIndex(off);
+					if (idx >= _nactives) {
+						if (contiguous)break;
+						continue;
+					}
+					int ii = _indices[idx];
+					const float* pp = _pdat.particles + ii * 4;
+					const float* vp = _pdat.velocities + ii * 3;
+					phnd.value(off).assign(pp[0], pp[1], pp[2]);
+					vhnd.value(off).assign(vp[0], vp[1], vp[2]);
+					iidhnd.value(off) = ii;
+					phshnd.value(off) = _pdat.phases[ii];
+				}
+			}
+		}
+	}
+
+private:
+	const NvFlexHParticleExport& _exp;
+	const NvFlexHParticleData& _pdat;
+	const int* _indices;
+	int _nactives;
+};
+
+
+bool NvFlexHParticleExport::fitPointCount(int nactives) {
+	const GA_Size npts = _gdp->getNumPoints();
+	if (nactives == npts)return false;
+	if (nactives > npts) {
+		_gdp->appendPointBlock(nactives - npts);
+		return true;
+	}
+	//index order is not offset order, so the tail is collected by index
+	GA_OffsetList tail;
+	tail.reserve(npts - nactives);
+	for (GA_Index idx = nactives; idx < npts; ++idx)tail.append(_gdp->pointOffset(idx));
+	_gdp->destroyPointOffsets(GA_Range(_gdp->getPointMap(), tail), GA_Detail::GA_DESTROY_DEGENERATE);
+	return true;
+}
+
+void NvFlexHParticleExport::transfer(const NvFlexHParticleData& pdat, const int* indices, int nactives)const {
+	UTparallelFor(GA_SplittableRange(_gdp->getPointRange()), ThreadedTransfer(*this, pdat, indices, nactives));
+}
+
+void NvFlexHParticleExport::bumpDataIds() {
+	_gdp->getP()->bumpDataId();
+	_vatt.get()->bumpDataId();
+	_iidatt.get()->bumpDataId();
+	_phsatt.get()->bumpDataId();
+}
+
+
+
+NvFlexHDiffuseExport::NvFlexHDiffuseExport(GU_Detail* gdp) :_gdp(gdp) {
+	_vatt = gdp->findFloatTuple(GA_ATTRIB_POINT, "v", 3, 3);
+	if (!_vatt.isValid()) {
+		_vatt = gdp->addFloatTuple(GA_ATTRIB_POINT, "v", 3, GA_Defaults(0));
+		_vatt.setTypeInfo(GA_TYPE_VECTOR);
+	}
+	_lifeatt = gdp->findFloatTuple(GA_ATTRIB_POINT, "life", 1, 1);
+	if (!_lifeatt.isValid()) {
+		_lifeatt = gdp->addFloatTuple(GA_ATTRIB_POINT, "life", 1, GA_Defaults(0));
+	}
+}
+
+/// functor for UTparallelFor, same page walk as the particle export
+class NvFlexHDiffuseExport::ThreadedTransfer {
+public:
+	ThreadedTransfer(const NvFlexHDiffuseExport& exp, const NvFlexHDiffuseData& ddat) :_exp(exp), _ddat(ddat) {}
+
+	void operator()(const GA_SplittableRange& r)const {
+		GU_Detail* gdp = _exp._gdp;
+		GA_RWPageHandleV3 phnd(gdp->getP());
+		GA_RWPageHandleV3 vhnd(_exp._vatt.get());
+		GA_RWPageHandleF lifehnd(_exp._lifeatt.get());
+
+		for (GA_PageIterator pit = r.beginPages(); !pit.atEnd(); ++pit) {
+			GA_Offset bst, bed;
+			for (GA_Iterator it(pit.begin()); it.blockAdvance(bst, bed);) {
+				phnd.setPage(bst);
+				vhnd.setPage(bst);
+				lifehnd.setPage(bst);
+
+				GA_Index idx = contiguousBlockIndex(gdp->getPointMap(), bst);
+				const bool contiguous = idx >= 0;
+				for (GA_Offset off = bst; off < bed; ++off, ++idx) {
+					if (!contiguous)idx = gdp->pointIndex(off);
+					if (idx >= _ddat.count) {
+						if (contiguous)break;
+						continue;
+					}
+					const float* pp = _ddat.positions + idx * 4;
+					const float* vp = _ddat.velocities + idx * 4;
+					phnd.value(off).assign(pp[0], pp[1], pp[2]);
+					vhnd.value(off).assign(vp[0], vp[1], vp[2]);
+					lifehnd.value(off) = pp[3];
+				}
+			}
+		}
+	}
+
+private:
+	const NvFlexHDiffuseExport& _exp;
+	const NvFlexHDiffuseData& _ddat;
+};
+
+
+void NvFlexHDiffuseExport::transfer(const NvFlexHDiffuseData& ddat) {
+	//diffuse particles have no identity between steps, so a changed count just rebuilds the points
+	if (ddat.count != _gdp->getNumPoints()) {
+		_gdp->stashAll();
+		if (ddat.count > 0)_gdp->appendPointBlock(ddat.count);
+		_gdp->destroyStashed();
+	}
+	if (ddat.count > 0)UTparallelFor(GA_SplittableRange(_gdp->getPointRange()), ThreadedTransfer(*this, ddat));
+	_gdp->getAttributes().bumpAllDataIds(GA_ATTRIB_POINT);
+}
+
+
+
+NvFlexHSurfaceExport::NvFlexHSurfaceExport(GU_Detail* gdp, const NvFlexHSurfaceData& sdat) :_gdp(gdp), _sdat(sdat) {
+	if (sdat.smoothParticles != NULL) {
+		_smoothatt = gdp->findFloatTuple(GA_ATTRIB_POINT, "smoothP", 3, 3);
+		if (!_smoothatt.isValid()) {
+			_smoothatt = gdp->addFloatTuple(GA_ATTRIB_POINT, "smoothP", 3, GA_Defaults(0));
+			_smoothatt.setTypeInfo(GA_TYPE_POINT);
+		}
+	}
+	static const char* anisonames[3] = { "aniso1", "aniso2", "aniso3" };
+	for (int i = 0; i < 3; ++i) {
+		if (sdat.anisotropy[i] == NULL)continue;
+		_anisoatt[i] = gdp->findFloatTuple(GA_ATTRIB_POINT, anisonames[i], 3, 3);
+		if (!_anisoatt[i].isValid()) {
+			_anisoatt[i] = gdp->addFloatTuple(GA_ATTRIB_POINT, anisonames[i], 3, GA_Defaults(0));
+			_anisoatt[i].setTypeInfo(GA_TYPE_VECTOR);
+		}
+	}
+}
+
+/// functor for UTparallelFor, same page walk as the particle export
+class NvFlexHSurfaceExport::ThreadedTransfer {
+public:
+	ThreadedTransfer(const NvFlexHSurfaceExport& exp, const int* indices, int nactives) :_exp(exp), _indices(indices), _nactives(nactives) {}
+
+	void operator()(const GA_SplittableRange& r)const {
+		GU_Detail* gdp = _exp._gdp;
+		const NvFlexHSurfaceData& sdat = _exp._sdat;
+		GA_RWPageHandleV3 smoothhnd;
+		GA_RWPageHandleV3 anisohnd[3];
+		if (sdat.smoothParticles != NULL)smoothhnd.bind(_exp._smoothatt.get());
+		for (int i = 0; i < 3; ++i) {
+			if (sdat.anisotropy[i] != NULL)anisohnd[i].bind(_exp._anisoatt[i].get());
+		}
+
+		for (GA_PageIterator pit = r.beginPages(); !pit.atEnd(); ++pit) {
+			GA_Offset bst, bed;
+			for (GA_Iterator it(pit.begin()); it.blockAdvance(bst, bed);) {
+				if (sdat.smoothParticles != NULL)smoothhnd.setPage(bst);
+				for (int i = 0; i < 3; ++i) {
+					if (sdat.anisotropy[i] != NULL)anisohnd[i].setPage(bst);
+				}
+
+				GA_Index idx = contiguousBlockIndex(gdp->getPointMap(), bst);
+				const bool contiguous = idx >= 0;
+				for (GA_Offset off = bst; off < bed; ++off, ++idx) {
+					if (!contiguous)idx = gdp->pointIndex(off);
+					if (idx >= _nactives) {
+						if (contiguous)break;
+						continue;
+					}
+					const size_t ii4 = size_t(_indices[idx]) * 4;
+					if (sdat.smoothParticles != NULL) {
+						const float* sp = sdat.smoothParticles + ii4;
+						smoothhnd.value(off).assign(sp[0], sp[1], sp[2]);
+					}
+					for (int i = 0; i < 3; ++i) {
+						if (sdat.anisotropy[i] == NULL)continue;
+						const float* q = sdat.anisotropy[i] + ii4;
+						anisohnd[i].value(off).assign(q[0] * q[3], q[1] * q[3], q[2] * q[3]);
+					}
+				}
+			}
+		}
+	}
+
+private:
+	const NvFlexHSurfaceExport& _exp;
+	const int* _indices;
+	int _nactives;
+};
+
+
+void NvFlexHSurfaceExport::transfer(const int* indices, int nactives)const {
+	UTparallelFor(GA_SplittableRange(_gdp->getPointRange()), ThreadedTransfer(*this, indices, nactives));
+}
+
+void NvFlexHSurfaceExport::bumpDataIds() {
+	if (_smoothatt.isValid())_smoothatt.get()->bumpDataId();
+	for (int i = 0; i < 3; ++i) {
+		if (_anisoatt[i].isValid())_anisoatt[i].get()->bumpDataId();
+	}
+}
+
+
+
+static GA_RWAttributeRef findOrAddFloat(GU_Detail* gdp, const char* name, int size, GA_TypeInfo typeinfo) {
+	GA_RWAttributeRef att = gdp->findFloatTuple(GA_ATTRIB_POINT, name, size, size);
+	if (!att.isValid()) {
+		att = gdp->addFloatTuple(GA_ATTRIB_POINT, name, size, GA_Defaults(0));
+		att.setTypeInfo(typeinfo);
+	}
+	return att;
+}
+
+static GA_RWAttributeRef findOrAddInt(GU_Detail* gdp, const char* name, int def) {
+	GA_RWAttributeRef att = gdp->findIntTuple(GA_ATTRIB_POINT, name, 1, 1);
+	if (!att.isValid())att = gdp->addIntTuple(GA_ATTRIB_POINT, name, 1, GA_Defaults(def));
+	return att;
+}
+
+NvFlexHContactExport::NvFlexHContactExport(GU_Detail* gdp, const NvFlexHContactData& cdat) :_gdp(gdp), _cdat(cdat) {
+	if (cdat.densities != NULL)_densityatt = findOrAddFloat(gdp, "density", 1, GA_TYPE_VOID);
+	if (cdat.planes != NULL) {
+		_countatt = findOrAddInt(gdp, "contactcount", 0);
+		_normalatt = findOrAddFloat(gdp, "contactN", 3, GA_TYPE_NORMAL);
+		_distatt = findOrAddFloat(gdp, "contactdist", 1, GA_TYPE_VOID);
+		_velatt = findOrAddFloat(gdp, "contactv", 3, GA_TYPE_VECTOR);
+		_shapeatt = findOrAddInt(gdp, "contactshape", -1);
+	}
+}
+
+/// functor for UTparallelFor, same page walk as the particle export
+class NvFlexHContactExport::ThreadedTransfer {
+public:
+	ThreadedTransfer(const NvFlexHContactExport& exp, const int* indices, int nactives) :_exp(exp), _indices(indices), _nactives(nactives) {}
+
+	void operator()(const GA_SplittableRange& r)const {
+		GU_Detail* gdp = _exp._gdp;
+		const NvFlexHContactData& cdat = _exp._cdat;
+		const bool doDensity = cdat.densities != NULL;
+		const bool doContacts = cdat.planes != NULL;
+		GA_RWPageHandleF densityhnd;
+		GA_RWPageHandleI counthnd, shapehnd;
+		GA_RWPageHandleV3 normalhnd, velhnd;
+		GA_RWPageHandleF disthnd;
+		if (doDensity)densityhnd.bind(_exp._densityatt.get());
+		if (doContacts) {
+			counthnd.bind(_exp._countatt.get());
+			normalhnd.bind(_exp._normalatt.get());
+			disthnd.bind(_exp._distatt.get());
+			velhnd.bind(_exp._velatt.get());
+			shapehnd.bind(_exp._shapeatt.get());
+		}
+
+		for (GA_PageIterator pit = r.beginPages(); !pit.atEnd(); ++pit) {
+			GA_Offset bst, bed;
+			for (GA_Iterator it(pit.begin()); it.blockAdvance(bst, bed);) {
+				if (doDensity)densityhnd.setPage(bst);
+				if (doContacts) {
+					counthnd.setPage(bst);
+					normalhnd.setPage(bst);
+					disthnd.setPage(bst);
+					velhnd.setPage(bst);
+					shapehnd.setPage(bst);
+				}
+
+				GA_Index idx = contiguousBlockIndex(gdp->getPointMap(), bst);
+				const bool contiguous = idx >= 0;
+				for (GA_Offset off = bst; off < bed; ++off, ++idx) {
+					if (!contiguous)idx = gdp->pointIndex(off);
+					if (idx >= _nactives) {
+						if (contiguous)break;
+						continue;
+					}
+					const int ii = _indices[idx];
+					if (doDensity)densityhnd.value(off) = cdat.densities[ii];
+					if (!doContacts)continue;
+					const int slot = cdat.indices[ii];
+					const int count = int(cdat.counts[slot]);
+					counthnd.value(off) = count;
+					if (count == 0) {
+						normalhnd.value(off).assign(0, 0, 0);
+						disthnd.value(off) = 0.0f;
+						velhnd.value(off).assign(0, 0, 0);
+						shapehnd.value(off) = -1;
+						continue;
+					}
+					const size_t c4 = size_t(slot) * cdat.maxContactsPerParticle * 4;
+					const float* pl = cdat.planes + c4;
+					const float* cv = cdat.velocities + c4;
+					normalhnd.value(off).assign(pl[0], pl[1], pl[2]);
+					disthnd.value(off) = pl[3];
+					velhnd.value(off).assign(cv[0], cv[1], cv[2]);
+					shapehnd.value(off) = int(cv[3]);
+				}
+			}
+		}
+	}
+
+private:
+	const NvFlexHContactExport& _exp;
+	const int* _indices;
+	int _nactives;
+};
+
+
+void NvFlexHContactExport::transfer(const int* indices, int nactives)const {
+	UTparallelFor(GA_SplittableRange(_gdp->getPointRange()), ThreadedTransfer(*this, indices, nactives));
+}
+
+void NvFlexHContactExport::bumpDataIds() {
+	GA_RWAttributeRef* atts[] = { &_densityatt, &_countatt, &_normalatt, &_distatt, &_velatt, &_shapeatt };
+	for (size_t i = 0; i < sizeof(atts) / sizeof(atts[0]); ++i) {
+		if (atts[i]->isValid())atts[i]->get()->bumpDataId();
+	}
+}
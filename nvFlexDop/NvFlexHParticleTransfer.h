@@ -0,0 +1,152 @@
+#pragma once
+#include <GU/GU_Detail.h>
+#include <GA/GA_Handle.h>
+#include <GA/GA_SplittableRange.h>
+
+#include <NvFlex.h>
+#include "NvFlexHBackend.h"
+
+
+/// Data ids of the detail attributes that feed the container, -1 if attribute is missing or never uploaded.
+/// Comparing them to ids stored on the last upload tells what needs to be uploaded again.
+struct NvFlexHDataIds {
+	int64 P, v, phs, imass, restP;
+	int64 topology, restlength, strength, N;
+	int64 cluster, primcluster, clusterstiffness;
+	int64 inflatable, pressure;
+
+	NvFlexHDataIds() { invalidate(); }
+	void invalidate();
+	void read(const GU_Detail* gdp);
+};
+
+
+/// Copies P/v/imass/restP/phs of detail's points into mapped container particle data.
+/// Point with GA_Index i goes into flex particle indices[i], points with i >= nactives are skipped.
+/// Serial path is the reference one, threaded path must produce exactly the same buffers.
+class NvFlexHParticleIngest {
+public:
+	enum Channel {
+		eChannelPosition = 1 << 0,
+		eChannelVelocity = 1 << 1,
+		eChannelPhase = 1 << 2,
+		eChannelMass = 1 << 3,
+		eChannelRest = 1 << 4,
+		eChannelAll = eChannelPosition | eChannelVelocity | eChannelPhase | eChannelMass | eChannelRest
+	};
+
+	NvFlexHParticleIngest(const GU_Detail* gdp);
+	NvFlexHParticleIngest(const NvFlexHParticleIngest&) = delete;
+	NvFlexHParticleIngest& operator=(const NvFlexHParticleIngest&) = delete;
+
+	/// all required attributes are there
+	bool isValid()const;
+	bool hasRest()const { return _rhnd.isValid(); }
+
+	/// channels is a combination of Channel flags, only those are written
+	void transfer(NvFlexHParticleData& pdat, const int* indices, int nactives, int channels, bool threaded)const;
+
+private:
+	class ThreadedTransfer;
+
+	void transferSerial(NvFlexHParticleData& pdat, const int* indices, int nactives, int channels)const;
+
+	const GU_Detail* _gdp;
+	GA_ROHandleV3 _phnd;
+	GA_ROHandleV3 _vhnd;
+	GA_ROHandleI _ihnd;
+	GA_ROHandleI _phshnd;
+	GA_ROHandleF _mhnd;
+	GA_ROHandleV3 _rhnd;
+};
+
+
+/// Writes flex particles back into detail's points: P, v, iid and phs.
+/// Point with GA_Index i gets flex particle indices[i]. Missing v/iid/phs attributes are created.
+class NvFlexHParticleExport {
+public:
+	NvFlexHParticleExport(GU_Detail* gdp);
+	NvFlexHParticleExport(const NvFlexHParticleExport&) = delete;
+	NvFlexHParticleExport& operator=(const NvFlexHParticleExport&) = delete;
+
+	/// makes point count nactives without touching the points that stay. points past nactives are destroyed
+	/// with the primitives they leave degenerate, missing ones are appended. returns true if the count changed
+	bool fitPointCount(int nactives);
+	void transfer(const NvFlexHParticleData& pdat, const int* indices, int nactives)const;
+	/// bumps data ids of the attributes written by transfer
+	void bumpDataIds();
+
+private:
+	class ThreadedTransfer;
+
+	GU_Detail* _gdp;
+	GA_RWAttributeRef _vatt;
+	GA_RWAttributeRef _iidatt;
+	GA_RWAttributeRef _phsatt;
+};
+
+
+/// Writes diffuse particles into points of their own detail: P, v and life (remaining lifetime).
+/// Point count follows the diffuse count, point with GA_Index i gets diffuse particle i.
+class NvFlexHDiffuseExport {
+public:
+	NvFlexHDiffuseExport(GU_Detail* gdp);
+	NvFlexHDiffuseExport(const NvFlexHDiffuseExport&) = delete;
+	NvFlexHDiffuseExport& operator=(const NvFlexHDiffuseExport&) = delete;
+
+	/// also bumps data ids, everything changes every step anyway
+	void transfer(const NvFlexHDiffuseData& ddat);
+
+private:
+	class ThreadedTransfer;
+
+	GU_Detail* _gdp;
+	GA_RWAttributeRef _vatt;
+	GA_RWAttributeRef _lifeatt;
+};
+
+
+/// Writes surfacing channels of flex particles into detail's points, same indexing as NvFlexHParticleExport:
+/// smoothP (smoothed position) and aniso1..3 (ellipsoid axes scaled by their length), only channels sdat has.
+class NvFlexHSurfaceExport {
+public:
+	NvFlexHSurfaceExport(GU_Detail* gdp, const NvFlexHSurfaceData& sdat);
+	NvFlexHSurfaceExport(const NvFlexHSurfaceExport&) = delete;
+	NvFlexHSurfaceExport& operator=(const NvFlexHSurfaceExport&) = delete;
+
+	void transfer(const int* indices, int nactives)const;
+	void bumpDataIds();
+
+private:
+	class ThreadedTransfer;
+
+	GU_Detail* _gdp;
+	const NvFlexHSurfaceData& _sdat;
+	GA_RWAttributeRef _smoothatt;
+	GA_RWAttributeRef _anisoatt[3];
+};
+
+
+/// Writes densities and contacts of flex particles into detail's points, same indexing as NvFlexHParticleExport:
+/// density, and contactcount, contactN, contactdist, contactv, contactshape of the first contact. only channels cdat has.
+class NvFlexHContactExport {
+public:
+	NvFlexHContactExport(GU_Detail* gdp, const NvFlexHContactData& cdat);
+	NvFlexHContactExport(const NvFlexHContactExport&) = delete;
+	NvFlexHContactExport& operator=(const NvFlexHContactExport&) = delete;
+
+	void transfer(const int* indices, int nactives)const;
+	void bumpDataIds();
+
+private:
+	class ThreadedTransfer;
+
+	GU_Detail* _gdp;
+	const NvFlexHContactData& _cdat;
+	GA_RWAttributeRef _densityatt;
+	GA_RWAttributeRef _countatt;
+	GA_RWAttributeRef _normalatt;
+	GA_RWAttributeRef _distatt;
+	GA_RWAttributeRef _velatt;
+	GA_RWAttributeRef _shapeatt;
+};
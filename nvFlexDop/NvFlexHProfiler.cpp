@@ -0,0 +1,25 @@
+#include "NvFlexHProfiler.h"
+
+
+const char* NvFlexHProfiler::phaseName(int phase) {
+	static const char* names[ePhaseCount] = { "ingest", "push", "collision", "tick", "pull", "export" };
+	return phase >= 0 && phase < ePhaseCount ? names[phase] : "unknown";
+}
+
+void NvFlexHProfiler::reset() {
+	for (int i = 0; i < ePhaseCount; ++i)_times[i] = 0.0;
+	_device.clear();
+}
+
+double NvFlexHProfiler::total()const {
+	double t = 0.0;
+	for (int i = 0; i < ePhaseCount; ++i)t += _times[i];
+	return t;
+}
+
+void NvFlexHProfiler::addDeviceTimer(const char* name, float ms) {
+	DeviceTimer timer;
+	timer.name = name;
+	timer.ms = ms;
+	_device.push_back(timer);
+}
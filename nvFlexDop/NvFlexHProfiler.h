@@ -0,0 +1,55 @@
+#pragma once
+#include <chrono>
+#include <string>
+#include <vector>
+
+
+/// Wall time of the solver step phases, in milliseconds. Reset at the start of the step, filled by Scope objects.
+/// Device timers are whatever the backend reports for its last tick, if it reports anything.
+class NvFlexHProfiler {
+public:
+	enum Phase {
+		ePhaseIngest,		//geometry -> host buffers, particles, springs and triangles
+		ePhasePush,			//host -> device
+		ePhaseCollision,	//collider conversion and collision data update
+		ePhaseTick,
+		ePhasePull,			//device -> host
+		ePhaseExport,		//host buffers -> geometry
+		ePhaseCount
+	};
+
+	struct DeviceTimer {
+		std::string name;
+		float ms;
+	};
+
+	/// short lowercase name, used in attribute and option names
+	static const char* phaseName(int phase);
+
+	NvFlexHProfiler() { reset(); }
+
+	void reset();
+	void add(Phase phase, double ms) { _times[phase] += ms; }
+	double time(Phase phase)const { return _times[phase]; }
+	double total()const;
+
+	void addDeviceTimer(const char* name, float ms);
+	const std::vector<DeviceTimer>& deviceTimers()const { return _device; }
+
+	/// adds time from construction to destruction to the phase. don't nest scopes of the same profiler, time would be counted twice
+	class Scope {
+	public:
+		Scope(NvFlexHProfiler& prof, Phase phase) :_prof(prof), _phase(phase), _start(std::chrono::steady_clock::now()) {}
+		~Scope() { _prof.add(_phase, std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - _start).count()); }
+		Scope(const Scope&) = delete;
+		Scope& operator=(const Scope&) = delete;
+	private:
+		NvFlexHProfiler& _prof;
+		Phase _phase;
+		std::chrono::steady_clock::time_point _start;
+	};
+
+private:
+	double _times[ePhaseCount];
+	std::vector<DeviceTimer> _device;
+};
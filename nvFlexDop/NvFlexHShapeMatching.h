@@ -0,0 +1,40 @@
+#pragma once
+#include <../core/maths.h>
+
+#include <cmath>
+
+
+/// Shape matching bits shared by the CPU backend and cluster building.
+/// A is the sum of outer products (p - center) * rest^T over particles of a cluster, given by its three columns.
+
+/// v rotated by unit quaternion q
+inline Vec3 nvFlexHRotate(const Quat& q, const Vec3& v) {
+	Vec3 u(q.x, q.y, q.z);
+	return u*(2.0f*Dot(u, v)) + v*(q.w*q.w - Dot(u, u)) + Cross(u, v)*(2.0f*q.w);
+}
+
+/// v rotated back by unit quaternion q
+inline Vec3 nvFlexHRotateInv(const Quat& q, const Vec3& v) {
+	return nvFlexHRotate(Quat(-q.x, -q.y, -q.z, q.w), v);
+}
+
+/// rotational part of A, as in Mueller et al. "A Robust Method to Extract the Rotational Part of Deformations".
+/// q is the starting guess and the result. last tick's rotation is a good guess, then it takes an iteration or two
+inline void nvFlexHExtractRotation(const Vec3 A[3], Quat& q, int maxIterations = 16) {
+	for (int it = 0; it < maxIterations; ++it) {
+		Vec3 r[3] = { nvFlexHRotate(q, Vec3(1.0f, 0.0f, 0.0f)), nvFlexHRotate(q, Vec3(0.0f, 1.0f, 0.0f)), nvFlexHRotate(q, Vec3(0.0f, 0.0f, 1.0f)) };
+		Vec3 omega = Cross(r[0], A[0]) + Cross(r[1], A[1]) + Cross(r[2], A[2]);
+		float denom = std::fabs(Dot(r[0], A[0]) + Dot(r[1], A[1]) + Dot(r[2], A[2])) + 1e-9f;
+		omega = omega * (1.0f / denom);
+		float angle = Length(omega);
+		if (angle < 1e-9f)break;
+		Vec3 axis = omega * (1.0f / angle);
+		float s = std::sin(0.5f*angle), c = std::cos(0.5f*angle);
+		//q = dq * q
+		Vec3 a(axis.x*s, axis.y*s, axis.z*s), b(q.x, q.y, q.z);
+		Vec3 v = b*c + a*q.w + Cross(a, b);
+		float w = c*q.w - Dot(a, b);
+		float l = std::sqrt(Dot(v, v) + w*w);
+		q = Quat(v.x / l, v.y / l, v.z / l, w / l);
+	}
+}
@@ -0,0 +1,246 @@
+#include "NvFlexHSoftBodyBuilder.h"
+
+#include <algorithm>
+#include <cmath>
+#include <map>
+#include <utility>
+
+#include "NvFlexHShapeMatching.h"
+
+
+static inline Vec3 toVec3(const UT_Vector3F& v) { return Vec3(v.x(), v.y(), v.z()); }
+
+
+NvFlexHSoftBodyBuilder::NvFlexHSoftBodyBuilder(const GU_Detail* gdp, const int* indices, int nactives) :_gdp(gdp), _indices(indices), _nactives(nactives),
+	_phnd(gdp->getP()),
+	_rhnd(gdp->findPointAttribute("restP")),
+	_mhnd(gdp->findPointAttribute("imass")),
+	_infhnd(gdp->findPrimitiveAttribute("inflatable")),
+	_prhnd(gdp->findPrimitiveAttribute("pressure")) {}
+
+
+bool NvFlexHSoftBodyBuilder::update(NvFlexHSoftBodyCache& cache, int64 restPId)const {
+	//gathering is a plain walk over primitives, what costs is edges and rest shapes, so those are kept when nothing differs
+	std::vector<int> tets;
+	std::vector<int> triangles;
+	std::vector<int> values;
+	std::vector<float> pressures;
+	for (GA_Iterator it(_gdp->getPrimitiveRange()); !it.atEnd(); ++it) {
+		const GA_Offset off = *it;
+		const GA_Size vtxcount = _gdp->getPrimitiveVertexCount(off);
+		const bool tet = vtxcount == 4 && _gdp->getPrimitiveTypeId(off) == GA_PRIMTETRAHEDRON;
+		const bool inflatable = vtxcount == 3 && _infhnd.isValid() && _infhnd.get(off) >= 0;
+		if (!tet && !inflatable)continue;
+
+		GA_OffsetListRef vtxs = _gdp->getPrimitiveVertexList(off);
+		int pts[4];
+		bool valid = true;
+		for (GA_Size vi = 0; vi < vtxcount; ++vi) {
+			GA_Index pt = _gdp->pointIndex(_gdp->vertexPoint(vtxs(vi)));
+			valid = valid && pt < _nactives; //point hit the particle limit
+			pts[vi] = int(pt);
+		}
+		if (!valid)continue;
+		if (tet) {
+			tets.insert(tets.end(), pts, pts + 4);
+		}
+		else {
+			triangles.insert(triangles.end(), pts, pts + 3);
+			values.push_back(_infhnd.get(off));
+			if (_prhnd.isValid())pressures.push_back(_prhnd.get(off));
+		}
+	}
+
+	//inflatable values can be anything, meshes go in value order. counting sort keeps primitive order inside a mesh
+	std::map<int, int> slots;
+	for (size_t i = 0; i < values.size(); ++i)slots[values[i]] = 0;
+	int nslots = 0;
+	for (std::map<int, int>::iterator it = slots.begin(); it != slots.end(); ++it)it->second = nslots++;
+	std::vector<int> start(nslots + 1, 0);
+	for (size_t i = 0; i < values.size(); ++i)++start[slots[values[i]] + 1];
+	for (int f = 0; f < nslots; ++f)start[f + 1] += start[f];
+	std::vector<int> sorted(triangles.size());
+	std::vector<float> meshpressures(_prhnd.isValid() ? nslots : 0, 0.0f);
+	std::vector<int> fill(start.begin(), start.end() - 1);
+	for (size_t i = 0; i < values.size(); ++i) {
+		const int f = slots[values[i]];
+		const int t = fill[f]++;
+		std::copy(&triangles[3 * i], &triangles[3 * i] + 3, &sorted[3 * t]);
+		if (!meshpressures.empty())meshpressures[f] += pressures[i];
+	}
+	for (size_t f = 0; f < meshpressures.size(); ++f)meshpressures[f] /= float(start[f + 1] - start[f]);
+	cache.pressures.swap(meshpressures);
+
+	const bool hadtets = !cache.tets.empty();
+	const bool restchanged = restPId != cache.restP;
+	const bool tetschanged = restchanged || tets != cache.tets;
+	const bool meshschanged = restchanged || sorted != cache.triangles || start != cache.inflatableStart;
+	cache.restP = restPId;
+
+	if (tetschanged) {
+		cache.tets.swap(tets);
+		const int ntets = cache.tetCount();
+		cache.tetRest.resize(3 * cache.tets.size());
+		for (size_t i = 0; i < cache.tets.size(); ++i) {
+			GA_Offset off = _gdp->pointOffset(cache.tets[i]);
+			UT_Vector3F r = _rhnd.isValid() ? _rhnd.get(off) : _phnd.get(off);
+			cache.tetRest[3 * i + 0] = r.x(); cache.tetRest[3 * i + 1] = r.y(); cache.tetRest[3 * i + 2] = r.z();
+		}
+
+		//neighbour tets share edges, springs go once per edge or dense parts of the mesh get stiffer
+		static const int tetEdges[6][2] = { { 0, 1 }, { 0, 2 }, { 0, 3 }, { 1, 2 }, { 1, 3 }, { 2, 3 } };
+		std::vector<std::pair<int, int> > edges;
+		edges.reserve(6 * size_t(ntets));
+		for (int t = 0; t < ntets; ++t) {
+			for (int e = 0; e < 6; ++e) {
+				int a = cache.tets[4 * t + tetEdges[e][0]], b = cache.tets[4 * t + tetEdges[e][1]];
+				if (a != b)edges.push_back(std::make_pair(std::min(a, b), std::max(a, b)));
+			}
+		}
+		std::sort(edges.begin(), edges.end());
+		edges.erase(std::unique(edges.begin(), edges.end()), edges.end());
+
+		cache.edges.resize(2 * edges.size());
+		cache.edgeLengths.resize(edges.size());
+		for (size_t e = 0; e < edges.size(); ++e) {
+			GA_Offset offa = _gdp->pointOffset(edges[e].first), offb = _gdp->pointOffset(edges[e].second);
+			UT_Vector3F a = _rhnd.isValid() ? _rhnd.get(offa) : _phnd.get(offa);
+			UT_Vector3F b = _rhnd.isValid() ? _rhnd.get(offb) : _phnd.get(offb);
+			cache.edges[2 * e + 0] = edges[e].first;
+			cache.edges[2 * e + 1] = edges[e].second;
+			cache.edgeLengths[e] = (a - b).length();
+		}
+	}
+
+	if (meshschanged) {
+		cache.triangles.swap(sorted);
+		cache.inflatableStart.swap(start);
+		const int nmeshes = cache.inflatableCount();
+		cache.restVolumes.assign(nmeshes, 0.0f);
+		for (int f = 0; f < nmeshes; ++f) {
+			float volume = 0.0f;
+			for (int t = cache.inflatableStart[f]; t < cache.inflatableStart[f + 1]; ++t) {
+				Vec3 p[3];
+				for (int k = 0; k < 3; ++k) {
+					GA_Offset off = _gdp->pointOffset(cache.triangles[3 * t + k]);
+					p[k] = toVec3(_rhnd.isValid() ? _rhnd.get(off) : _phnd.get(off));
+				}
+				volume += Dot(p[0], Cross(p[1], p[2]));
+			}
+			cache.restVolumes[f] = volume / 6.0f;
+		}
+	}
+
+	return tetschanged && (hadtets || !cache.tets.empty());
+}
+
+
+void NvFlexHSoftBodyBuilder::writeSprings(const NvFlexHSoftBodyCache& cache, float stiffness, int* springIds, float* springRls, float* springSts)const {
+	const int nsprings = cache.springCount();
+	for (int s = 0; s < nsprings; ++s) {
+		springIds[2 * s + 0] = _indices[cache.edges[2 * s + 0]];
+		springIds[2 * s + 1] = _indices[cache.edges[2 * s + 1]];
+		springRls[s] = cache.edgeLengths[s];
+		springSts[s] = stiffness;
+	}
+}
+
+
+void NvFlexHSoftBodyBuilder::writeTriangles(const NvFlexHSoftBodyCache& cache, int* triangleIds, float* triangleNms)const {
+	const int nmeshes = cache.inflatableCount();
+	for (int f = 0; f < nmeshes; ++f) {
+		//houdini winds polygons the other way round from what flex measures volume with, so most meshes get flipped here
+		const bool flip = cache.restVolumes[f] < 0.0f;
+		for (int t = cache.inflatableStart[f]; t < cache.inflatableStart[f + 1]; ++t) {
+			int pts[3] = { cache.triangles[3 * t + 0], cache.triangles[3 * t + 1], cache.triangles[3 * t + 2] };
+			if (flip)std::swap(pts[1], pts[2]);
+			Vec3 p[3];
+			for (int k = 0; k < 3; ++k) {
+				triangleIds[3 * t + k] = _indices[pts[k]];
+				p[k] = toVec3(_phnd.get(_gdp->pointOffset(pts[k])));
+			}
+			Vec3 n = Cross(p[1] - p[0], p[2] - p[0]);
+			float len = Length(n);
+			n = len > 1e-12f ? n * (1.0f / len) : Vec3(0.0f, 1.0f, 0.0f);
+			triangleNms[3 * t + 0] = n.x; triangleNms[3 * t + 1] = n.y; triangleNms[3 * t + 2] = n.z;
+		}
+	}
+}
+
+
+void NvFlexHSoftBodyBuilder::writeInflatables(const NvFlexHSoftBodyCache& cache, float pressure, float stiffness, int triangleOffset, NvFlexHInflatableData& idat, int inflatableOffset)const {
+	const int nmeshes = cache.inflatableCount();
+	for (int f = 0; f < nmeshes; ++f) {
+		const int i = inflatableOffset + f;
+		idat.startTris[i] = triangleOffset + cache.inflatableStart[f];
+		idat.numTris[i] = cache.inflatableStart[f + 1] - cache.inflatableStart[f];
+		idat.restVolumes[i] = std::fabs(cache.restVolumes[f]);
+		idat.overPressures[i] = cache.pressures.empty() ? pressure : cache.pressures[f];
+		idat.constraintScales[i] = stiffness;
+	}
+}
+
+
+void NvFlexHSoftBodyBuilder::writeClusters(const NvFlexHSoftBodyCache& cache, float stiffness, float threshold, float creep, NvFlexHRigidData& rdat, int rigidOffset, int indexOffset)const {
+	const int ntets = cache.tetCount();
+	for (int t = 0; t < ntets; ++t) {
+		const int r = rigidOffset + t;
+		const int first = indexOffset + 4 * t;
+
+		//mass weighted like the solver's center. imass is read here and not cached, so writing again picks up new masses
+		float weights[4];
+		float wsum = 0.0f;
+		Vec3 rest[4], p[4];
+		for (int k = 0; k < 4; ++k) {
+			GA_Offset off = _gdp->pointOffset(cache.tets[4 * t + k]);
+			float imass = _mhnd.isValid() ? _mhnd.get(off) : 1.0f;
+			weights[k] = imass > 0.0f ? 1.0f / imass : 0.0f;
+			wsum += weights[k];
+			rest[k] = Vec3(cache.tetRest[12 * t + 3 * k + 0], cache.tetRest[12 * t + 3 * k + 1], cache.tetRest[12 * t + 3 * k + 2]);
+			p[k] = toVec3(_phnd.get(off));
+		}
+		if (wsum == 0.0f) {
+			for (int k = 0; k < 4; ++k)weights[k] = 1.0f;
+			wsum = 4.0f;
+		}
+		Vec3 restcenter(0.0f), center(0.0f);
+		for (int k = 0; k < 4; ++k) {
+			restcenter += rest[k] * weights[k];
+			center += p[k] * weights[k];
+		}
+		restcenter = restcenter * (1.0f / wsum);
+		center = center * (1.0f / wsum);
+
+		//cache may be older than P, so the tet starts rotated to where it is now
+		Vec3 A[3] = { Vec3(0.0f), Vec3(0.0f), Vec3(0.0f) };
+		float maxr = 0.0f;
+		for (int k = 0; k < 4; ++k) {
+			Vec3 local = rest[k] - restcenter;
+			rest[k] = local;
+			maxr = std::max(maxr, Length(local));
+			Vec3 d = (p[k] - center) * weights[k];
+			A[0] += d * local.x;
+			A[1] += d * local.y;
+			A[2] += d * local.z;
+		}
+		Quat q;
+		nvFlexHExtractRotation(A, q);
+
+		for (int k = 0; k < 4; ++k) {
+			rdat.indices[first + k] = _indices[cache.tets[4 * t + k]];
+			float* rp = rdat.restPositions + 3 * (first + k);
+			rp[0] = rest[k].x; rp[1] = rest[k].y; rp[2] = rest[k].z;
+			float len = Length(rest[k]);
+			Vec3 dir = len > 1e-6f ? rest[k] * (1.0f / len) : Vec3(0.0f, 1.0f, 0.0f);
+			float* np = rdat.restNormals + 4 * (first + k);
+			np[0] = dir.x; np[1] = dir.y; np[2] = dir.z; np[3] = len - maxr;
+		}
+		rdat.offsets[r] = first;
+		rdat.stiffness[r] = stiffness;
+		rdat.thresholds[r] = threshold;
+		rdat.creeps[r] = creep;
+		rdat.rotations[4 * r + 0] = q.x; rdat.rotations[4 * r + 1] = q.y; rdat.rotations[4 * r + 2] = q.z; rdat.rotations[4 * r + 3] = q.w;
+		rdat.translations[3 * r + 0] = center.x; rdat.translations[3 * r + 1] = center.y; rdat.translations[3 * r + 2] = center.z;
+	}
+	if (ntets > 0)rdat.offsets[rigidOffset + ntets] = indexOffset + 4 * ntets;
+}
@@ -0,0 +1,72 @@
+#pragma once
+#include <GU/GU_Detail.h>
+#include <GA/GA_Handle.h>
+
+#include <vector>
+
+#include "NvFlexHBackend.h"
+
+
+/// Soft body constraints of one object by point GA_Index, kept between steps. Finding tet edges and measuring
+/// rest shapes is only done again when tets, inflatable triangles or restP are different from what the cache was
+/// made from, other topology changes just write what is here into the container again.
+struct NvFlexHSoftBodyCache {
+	std::vector<int> tets;             //4 points each
+	std::vector<float> tetRest;        //rest positions of tet corners, x, y, z
+	std::vector<int> edges;            //tet edges, 2 points each, every edge once
+	std::vector<float> edgeLengths;
+	std::vector<int> triangles;        //inflatable triangles, 3 points each, grouped by inflatable
+	std::vector<int> inflatableStart;  //inflatable i has triangles [inflatableStart[i], inflatableStart[i + 1])
+	std::vector<float> restVolumes;    //signed, negative for meshes wound inside out
+	std::vector<float> pressures;      //from primitive "pressure", empty without it
+	int64 restP;                       //restP data id rest shapes were read at
+	//solver params container data was written with, so changing them writes it again
+	float tetStiffness, inflatablePressure, inflatableStiffness;
+	bool tetClusters;
+
+	NvFlexHSoftBodyCache() :inflatableStart(1, 0), restP(-1), tetStiffness(-1.0f), inflatablePressure(-1.0f), inflatableStiffness(-1.0f), tetClusters(false) {}
+
+	int tetCount()const { return int(tets.size() / 4); }
+	int springCount()const { return int(edgeLengths.size()); }
+	int triangleCount()const { return int(triangles.size() / 3); }
+	int inflatableCount()const { return int(inflatableStart.size()) - 1; }
+};
+
+
+/// Makes soft body constraints of tetrahedron primitives and inflatable triangles.
+/// Tets become springs along their edges and, if asked, 4 particle shape matching clusters that keep them from
+/// collapsing or turning inside out. Triangles with primitive int "inflatable" >= 0 become one closed mesh per
+/// inflatable value, kept at "pressure" (averaged over the mesh, solver param without it) times their rest volume.
+/// NvFlexHTopologyBuilder leaves those triangles out, they are written after all plain triangles so every mesh
+/// is one range of dynamic triangles. Rest shape is restP if there is one, P otherwise.
+/// Prims referencing points that did not get a particle (GA_Index >= nactives) are skipped.
+class NvFlexHSoftBodyBuilder {
+public:
+	NvFlexHSoftBodyBuilder(const GU_Detail* gdp, const int* indices, int nactives);
+	NvFlexHSoftBodyBuilder(const NvFlexHSoftBodyBuilder&) = delete;
+	NvFlexHSoftBodyBuilder& operator=(const NvFlexHSoftBodyBuilder&) = delete;
+
+	/// brings cache up to date with the detail, restPId is the data id of restP. true if tets were made again,
+	/// clusters made of them need to be written again then
+	bool update(NvFlexHSoftBodyCache& cache, int64 restPId)const;
+
+	/// springIds - 2*springCount(), springRls and springSts - springCount()
+	void writeSprings(const NvFlexHSoftBodyCache& cache, float stiffness, int* springIds, float* springRls, float* springSts)const;
+	/// triangleIds and triangleNms - 3*triangleCount(), normals are faces of P pointing out of the mesh
+	void writeTriangles(const NvFlexHSoftBodyCache& cache, int* triangleIds, float* triangleNms)const;
+	/// inflatables [inflatableOffset, inflatableOffset + inflatableCount()) of idat, triangleOffset is where writeTriangles wrote to
+	void writeInflatables(const NvFlexHSoftBodyCache& cache, float pressure, float stiffness, int triangleOffset, NvFlexHInflatableData& idat, int inflatableOffset)const;
+	/// one cluster per tet, rigids [rigidOffset, rigidOffset + tetCount()) and indices [indexOffset, indexOffset + 4*tetCount()) of rdat
+	void writeClusters(const NvFlexHSoftBodyCache& cache, float stiffness, float threshold, float creep, NvFlexHRigidData& rdat, int rigidOffset, int indexOffset)const;
+
+private:
+	const GU_Detail* _gdp;
+	const int* _indices;
+	int _nactives;
+
+	GA_ROHandleV3 _phnd;
+	GA_ROHandleV3 _rhnd;
+	GA_ROHandleF _mhnd;
+	GA_ROHandleI _infhnd;
+	GA_ROHandleF _prhnd;
+};
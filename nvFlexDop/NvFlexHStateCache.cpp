@@ -0,0 +1,394 @@
+#include "NvFlexHStateCache.h"
+
+#include <algorithm>
+#include <climits>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <utility>
+
+
+namespace {
+	const char kMagic[8] = { 'N', 'V', 'F', 'H', 'S', 'T', 'A', 'T' };
+	const uint32_t kVersion = 1;
+	const uint64_t kAlign = 16;
+
+	enum Section {
+		eSecActive,
+		eSecParticles,
+		eSecRestParticles,
+		eSecVelocities,
+		eSecPhases,
+		eSecSpringIds,
+		eSecSpringRls,
+		eSecSpringSts,
+		eSecTriangleIds,
+		eSecTriangleNms,
+		eSecMembers,
+		eSecMemberIndices,
+		eSecShapes,
+		eSecCount
+	};
+
+	enum Flags {
+		eFlagTriangleNormals = 1 << 0
+	};
+
+	struct FileHeader {
+		char magic[8];
+		uint32_t version;
+		uint32_t sectionCount;
+		uint32_t flags;
+		uint32_t pad;
+	};
+
+	struct SectionEntry {
+		uint64_t offset;
+		uint64_t bytes;
+	};
+
+	struct MemberEntry {
+		int32_t objectid;
+		int32_t count;
+		uint64_t first; //into member indices section
+	};
+
+	const FileHeader* header(const NvFlexHMappedFile& file) {
+		return (const FileHeader*)file.data();
+	}
+
+	const SectionEntry* sections(const NvFlexHMappedFile& file) {
+		return (const SectionEntry*)(file.data() + sizeof(FileHeader));
+	}
+
+	/// file layout is built in memory as a list of sections, then written in one go
+	class Builder {
+	public:
+		Builder() :_entries(eSecCount) {
+			for (int i = 0; i < eSecCount; ++i) {
+				_entries[i].offset = 0;
+				_entries[i].bytes = 0;
+			}
+			_ptrs.resize(eSecCount, NULL);
+		}
+		void set(int sec, const void* data, size_t bytes) {
+			_ptrs[sec] = data;
+			_entries[sec].bytes = bytes;
+		}
+		bool write(const std::string& path, uint32_t flags) {
+			uint64_t offset = sizeof(FileHeader) + sizeof(SectionEntry) * eSecCount;
+			for (int i = 0; i < eSecCount; ++i) {
+				offset = (offset + kAlign - 1) / kAlign * kAlign;
+				_entries[i].offset = offset;
+				offset += _entries[i].bytes;
+			}
+
+			std::ofstream out(path.c_str(), std::ios::binary | std::ios::trunc);
+			if (!out)return false;
+			FileHeader hdr;
+			memcpy(hdr.magic, kMagic, sizeof(kMagic));
+			hdr.version = kVersion;
+			hdr.sectionCount = eSecCount;
+			hdr.flags = flags;
+			hdr.pad = 0;
+			out.write((const char*)&hdr, sizeof(hdr));
+			out.write((const char*)_entries.data(), sizeof(SectionEntry) * eSecCount);
+			uint64_t pos = sizeof(FileHeader) + sizeof(SectionEntry) * eSecCount;
+			const char zeros[kAlign] = { 0 };
+			for (int i = 0; i < eSecCount; ++i) {
+				out.write(zeros, std::streamsize(_entries[i].offset - pos));
+				if (_entries[i].bytes > 0)out.write((const char*)_ptrs[i], std::streamsize(_entries[i].bytes));
+				pos = _entries[i].offset + _entries[i].bytes;
+			}
+			return bool(out);
+		}
+	private:
+		std::vector<SectionEntry> _entries;
+		std::vector<const void*> _ptrs;
+	};
+}
+
+
+bool NvFlexHStateCache::write(const char* path, NvFlexHContainer* cont, const NvFlexHParticleData& pdat, const std::vector<Member>& members, bool triangleNormals, std::string& error) {
+	Builder builder;
+
+	//particles, compacted to active ones
+	std::vector<int> active(cont->capacity());
+	active.resize(cont->getActiveList(active.data()));
+	const size_t n = active.size();
+	std::vector<float> particles(4 * n), restParticles(4 * n), velocities(3 * n);
+	std::vector<int> phases(n);
+	for (size_t i = 0; i < n; ++i) {
+		const size_t idx = size_t(active[i]);
+		memcpy(&particles[4 * i], pdat.particles + 4 * idx, sizeof(float) * 4);
+		if (pdat.restParticles != NULL)memcpy(&restParticles[4 * i], pdat.restParticles + 4 * idx, sizeof(float) * 4);
+		memcpy(&velocities[3 * i], pdat.velocities + 3 * idx, sizeof(float) * 3);
+		phases[i] = pdat.phases[idx];
+	}
+	builder.set(eSecActive, active.data(), sizeof(int) * n);
+	builder.set(eSecParticles, particles.data(), sizeof(float) * particles.size());
+	builder.set(eSecRestParticles, restParticles.data(), sizeof(float) * restParticles.size());
+	builder.set(eSecVelocities, velocities.data(), sizeof(float) * velocities.size());
+	builder.set(eSecPhases, phases.data(), sizeof(int) * n);
+
+	//springs and triangles are copied out, so they are not kept mapped while writing
+	const int nsprings = cont->getSpringsCount();
+	std::vector<int> springIds(2 * size_t(nsprings));
+	std::vector<float> springRls(nsprings), springSts(nsprings);
+	if (nsprings > 0) {
+		NvFlexHSpringData sprdat = cont->mapSpringData();
+		memcpy(springIds.data(), sprdat.springIds, sizeof(int) * springIds.size());
+		memcpy(springRls.data(), sprdat.springRls, sizeof(float) * springRls.size());
+		memcpy(springSts.data(), sprdat.springSts, sizeof(float) * springSts.size());
+		cont->unmapSpringData();
+	}
+	builder.set(eSecSpringIds, springIds.data(), sizeof(int) * springIds.size());
+	builder.set(eSecSpringRls, springRls.data(), sizeof(float) * springRls.size());
+	builder.set(eSecSpringSts, springSts.data(), sizeof(float) * springSts.size());
+
+	const int ntriangles = cont->getTrianglesCount();
+	std::vector<int> triangleIds(3 * size_t(ntriangles));
+	std::vector<float> triangleNms(triangleNormals ? 3 * size_t(ntriangles) : 0);
+	if (ntriangles > 0) {
+		NvFlexHTriangleData tridat = cont->mapTriangleData();
+		memcpy(triangleIds.data(), tridat.triangleIds, sizeof(int) * triangleIds.size());
+		if (triangleNormals)memcpy(triangleNms.data(), tridat.triangleNms, sizeof(float) * triangleNms.size());
+		cont->unmapTriangleData();
+	}
+	builder.set(eSecTriangleIds, triangleIds.data(), sizeof(int) * triangleIds.size());
+	builder.set(eSecTriangleNms, triangleNms.data(), sizeof(float) * triangleNms.size());
+
+	//member index maps, one after another
+	std::vector<MemberEntry> memberEntries(members.size());
+	std::vector<int> memberIndices;
+	for (size_t m = 0; m < members.size(); ++m) {
+		memberEntries[m].objectid = members[m].objectid;
+		memberEntries[m].count = members[m].count;
+		memberEntries[m].first = memberIndices.size();
+		memberIndices.insert(memberIndices.end(), members[m].indices, members[m].indices + members[m].count);
+	}
+	builder.set(eSecMembers, memberEntries.data(), sizeof(MemberEntry) * memberEntries.size());
+	builder.set(eSecMemberIndices, memberIndices.data(), sizeof(int) * memberIndices.size());
+
+	//collider registry
+	const NvFlexHCollisionData* colldata = cont->collisionData();
+	std::vector<Shape> shapes(colldata->size());
+	for (int i = 0; i < colldata->size(); ++i) {
+		Shape& shp = shapes[i];
+		shp.key = colldata->keyAt(i);
+		shp.flags = colldata->flags()[i];
+		shp.pad = 0;
+		memcpy(shp.position, &colldata->positions()[i], sizeof(float) * 4);
+		memcpy(shp.rotation, &colldata->rotations()[i], sizeof(float) * 4);
+	}
+	builder.set(eSecShapes, shapes.data(), sizeof(Shape) * shapes.size());
+
+	const std::string tmppath = std::string(path) + ".tmp";
+	if (!builder.write(tmppath, triangleNormals ? eFlagTriangleNormals : 0)) {
+		std::remove(tmppath.c_str());
+		error = "can't write " + tmppath;
+		return false;
+	}
+	//rename does not replace existing files everywhere
+	std::remove(path);
+	if (std::rename(tmppath.c_str(), path) != 0) {
+		std::remove(tmppath.c_str());
+		error = std::string("can't rename cache file to ") + path;
+		return false;
+	}
+	return true;
+}
+
+
+NvFlexHStateCache::NvFlexHStateCache(const char* path) :_valid(false) {
+	if (!_file.open(path)) {
+		_error = std::string("can't open ") + path;
+		return;
+	}
+	const size_t tablesize = sizeof(FileHeader) + sizeof(SectionEntry) * eSecCount;
+	if (_file.size() < tablesize || memcmp(header(_file)->magic, kMagic, sizeof(kMagic)) != 0) {
+		_error = std::string(path) + " is not a nvflex state cache";
+		return;
+	}
+	if (header(_file)->version != kVersion || header(_file)->sectionCount != eSecCount) {
+		_error = std::string(path) + " was written by another version";
+		return;
+	}
+	for (int i = 0; i < eSecCount; ++i) {
+		const SectionEntry& sec = sections(_file)[i];
+		if (sec.offset < tablesize || sec.offset > _file.size() || sec.bytes > _file.size() - sec.offset || sec.offset % kAlign != 0) {
+			_error = std::string(path) + " is truncated or corrupt";
+			return;
+		}
+	}
+
+	//counts of related sections have to agree, so accessors can trust them
+	const size_t n = particleCount();
+	const size_t ns = springCount();
+	const size_t nt = triangleCount();
+	bool consistent = sectionBytes(eSecActive) % sizeof(int) == 0
+		&& sectionBytes(eSecParticles) == 4 * sizeof(float) * n && sectionBytes(eSecRestParticles) == 4 * sizeof(float) * n
+		&& sectionBytes(eSecVelocities) == 3 * sizeof(float) * n && sectionBytes(eSecPhases) == sizeof(int) * n
+		&& sectionBytes(eSecSpringIds) == 2 * sizeof(int) * ns && sectionBytes(eSecSpringSts) == sizeof(float) * ns
+		&& sectionBytes(eSecTriangleIds) == 3 * sizeof(int) * nt
+		&& (sectionBytes(eSecTriangleNms) == 0 || sectionBytes(eSecTriangleNms) == 3 * sizeof(float) * nt)
+		&& sectionBytes(eSecMembers) % sizeof(MemberEntry) == 0 && sectionBytes(eSecShapes) % sizeof(Shape) == 0;
+	const MemberEntry* mems = (const MemberEntry*)section(eSecMembers);
+	const size_t nindices = sectionBytes(eSecMemberIndices) / sizeof(int);
+	for (int m = 0; consistent && m < memberCount(); ++m)consistent = mems[m].count >= 0 && mems[m].first + uint64_t(mems[m].count) <= nindices;
+	if (!consistent) {
+		_error = std::string(path) + " is corrupt";
+		return;
+	}
+	_valid = true;
+}
+
+const void* NvFlexHStateCache::section(int sec)const {
+	return _file.data() + sections(_file)[sec].offset;
+}
+
+size_t NvFlexHStateCache::sectionBytes(int sec)const {
+	return size_t(sections(_file)[sec].bytes);
+}
+
+int NvFlexHStateCache::particleCount()const { return int(sectionBytes(eSecActive) / sizeof(int)); }
+const int* NvFlexHStateCache::activeIndices()const { return (const int*)section(eSecActive); }
+const float* NvFlexHStateCache::particles()const { return (const float*)section(eSecParticles); }
+const float* NvFlexHStateCache::restParticles()const { return (const float*)section(eSecRestParticles); }
+const float* NvFlexHStateCache::velocities()const { return (const float*)section(eSecVelocities); }
+const int* NvFlexHStateCache::phases()const { return (const int*)section(eSecPhases); }
+int NvFlexHStateCache::springCount()const { return int(sectionBytes(eSecSpringRls) / sizeof(float)); }
+const int* NvFlexHStateCache::springIndices()const { return (const int*)section(eSecSpringIds); }
+const float* NvFlexHStateCache::springRestLengths()const { return (const float*)section(eSecSpringRls); }
+const float* NvFlexHStateCache::springStrengths()const { return (const float*)section(eSecSpringSts); }
+int NvFlexHStateCache::triangleCount()const { return int(sectionBytes(eSecTriangleIds) / (3 * sizeof(int))); }
+const int* NvFlexHStateCache::triangleIndices()const { return (const int*)section(eSecTriangleIds); }
+const float* NvFlexHStateCache::triangleNormals()const { return sectionBytes(eSecTriangleNms) > 0 ? (const float*)section(eSecTriangleNms) : NULL; }
+int NvFlexHStateCache::memberCount()const { return int(sectionBytes(eSecMembers) / sizeof(MemberEntry)); }
+int NvFlexHStateCache::memberObjectId(int member)const { return ((const MemberEntry*)section(eSecMembers))[member].objectid; }
+int NvFlexHStateCache::memberPointCount(int member)const { return ((const MemberEntry*)section(eSecMembers))[member].count; }
+const int* NvFlexHStateCache::memberIndices(int member)const {
+	return (const int*)section(eSecMemberIndices) + ((const MemberEntry*)section(eSecMembers))[member].first;
+}
+int NvFlexHStateCache::shapeCount()const { return int(sectionBytes(eSecShapes) / sizeof(Shape)); }
+const NvFlexHStateCache::Shape* NvFlexHStateCache::shapes()const { return (const Shape*)section(eSecShapes); }
+
+
+bool NvFlexHStateCache::restore(NvFlexHContainer* cont, std::vector<RestoredMember>& members, std::string& error)const {
+	if (!_valid) {
+		error = _error;
+		return false;
+	}
+	const int n = particleCount();
+	if (n > cont->maxParticles()) {
+		error = "cache has more particles than the container can hold";
+		return false;
+	}
+
+	//cached indices are checked before the container is touched, two particles on one slot would share it.
+	//old index -> slot in the cache, sorted so lookups don't need a table as big as the largest (maybe corrupt) index
+	const int* active = activeIndices();
+	std::vector<std::pair<int, int> > remap(n);
+	for (int i = 0; i < n; ++i)remap[i] = std::make_pair(active[i], i);
+	std::sort(remap.begin(), remap.end());
+	if (n > 0 && remap[0].first < 0) {
+		error = "cache has a negative particle index";
+		return false;
+	}
+	for (int i = 1; i < n; ++i) {
+		if (remap[i].first == remap[i - 1].first) {
+			error = "cache has the same particle twice";
+			return false;
+		}
+	}
+	auto remapIndex = [&](int old) {
+		auto it = std::lower_bound(remap.begin(), remap.end(), std::make_pair(old, INT_MIN));
+		return it != remap.end() && it->first == old ? it->second : -1;
+	};
+
+	const int ns = springCount();
+	const int nt = triangleCount();
+	const int* springIds = springIndices();
+	const int* triangleIds = triangleIndices();
+	for (int i = 0; i < 2 * ns; ++i) {
+		if (remapIndex(springIds[i]) < 0) {
+			error = "cached spring refers to a particle that is not in the cache";
+			return false;
+		}
+	}
+	for (int i = 0; i < 3 * nt; ++i) {
+		if (remapIndex(triangleIds[i]) < 0) {
+			error = "cached triangle refers to a particle that is not in the cache";
+			return false;
+		}
+	}
+	for (int m = 0; m < memberCount(); ++m) {
+		const int* indices = memberIndices(m);
+		for (int i = 0; i < memberPointCount(m); ++i) {
+			if (remapIndex(indices[i]) < 0) {
+				error = "cached object refers to a particle that is not in the cache";
+				return false;
+			}
+		}
+	}
+
+	//container picks indices itself, so everything referring to particles goes through remap
+	std::vector<int> newindices(std::max(cont->capacity(), n));
+	int nactive = cont->getActiveList(newindices.data());
+	if (nactive > 0)cont->freeParticles(nactive, newindices.data());
+	if (!cont->reserve(n) || cont->allocParticles(n, newindices.data()) != n) {
+		error = "could not allocate particles for the cache";
+		return false;
+	}
+	for (size_t i = 0; i < remap.size(); ++i)remap[i].second = newindices[remap[i].second];
+
+	NvFlexHParticleData pdat = cont->mapParticleData();
+	for (int i = 0; i < n; ++i) {
+		const size_t idx = size_t(newindices[i]);
+		memcpy(pdat.particles + 4 * idx, particles() + 4 * size_t(i), sizeof(float) * 4);
+		memcpy(pdat.restParticles + 4 * idx, restParticles() + 4 * size_t(i), sizeof(float) * 4);
+		memcpy(pdat.velocities + 3 * idx, velocities() + 3 * size_t(i), sizeof(float) * 3);
+		pdat.phases[idx] = phases()[i];
+	}
+	cont->unmapParticleData();
+	cont->pushParticlesToDevice();
+
+	cont->resizeSpringData(ns);
+	if (ns > 0) {
+		NvFlexHSpringData sprdat = cont->mapSpringData();
+		for (int i = 0; i < 2 * ns; ++i)sprdat.springIds[i] = remapIndex(springIds[i]);
+		memcpy(sprdat.springRls, springRestLengths(), sizeof(float) * ns);
+		memcpy(sprdat.springSts, springStrengths(), sizeof(float) * ns);
+		cont->unmapSpringData();
+	}
+	cont->pushSpringsToDevice();
+
+	cont->resizeTriangleData(nt);
+	if (nt > 0) {
+		NvFlexHTriangleData tridat = cont->mapTriangleData();
+		for (int i = 0; i < 3 * nt; ++i)tridat.triangleIds[i] = remapIndex(triangleIds[i]);
+		if (triangleNormals() != NULL)memcpy(tridat.triangleNms, triangleNormals(), sizeof(float) * 3 * nt);
+		cont->unmapTriangleData();
+	}
+	cont->pushTrianglesToDevice(triangleNormals() != NULL);
+
+	members.resize(memberCount());
+	for (int m = 0; m < memberCount(); ++m) {
+		members[m].objectid = memberObjectId(m);
+		const int* indices = memberIndices(m);
+		members[m].indices.resize(memberPointCount(m));
+		for (int i = 0; i < memberPointCount(m); ++i)members[m].indices[i] = remapIndex(indices[i]);
+	}
+
+	//colliders come back with transforms, so first step after restore sweeps from where they were.
+	//shape parameters and meshes are filled by the solver, stored hashes don't match anything so meshes get rebuilt
+	NvFlexHCollisionData* colldata = cont->collisionData();
+	for (int i = 0; i < shapeCount(); ++i) {
+		const Shape& shp = shapes()[i];
+		bool isnew;
+		int hnd = colldata->acquire(shp.key, NvFlexCollisionShapeType(shp.flags & eNvFlexShapeFlagTypeMask), isnew);
+		colldata->setTransform(hnd, Vec4(shp.position[0], shp.position[1], shp.position[2], shp.position[3]), Quat(shp.rotation[0], shp.rotation[1], shp.rotation[2], shp.rotation[3]));
+	}
+	return true;
+}
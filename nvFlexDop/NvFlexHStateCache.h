@@ -0,0 +1,83 @@
+#pragma once
+#include <string>
+#include <vector>
+
+#include "NvFlexHBackend.h"
+#include "NvFlexHCollisionData.h"
+#include "NvFlexHMappedFile.h"
+
+
+/// Snapshot of a whole container in one file per frame: active list, particles, rest particles, velocities, phases,
+/// springs, triangles, particle index maps of member objects and collider keys with transforms.
+/// Only active particles are stored, in active list order. File is memory mapped when read, so streaming a frame out
+/// is just pointers into the mapping.
+/// Collision meshes are not stored - their ids only live as long as the process - colliders come back by key and
+/// transform and their shapes are rebuilt by the solver on the next step.
+class NvFlexHStateCache {
+public:
+	/// particles of one object: dop object id and container indices of its points, in point order
+	struct Member {
+		int objectid;
+		const int* indices;
+		int count;
+	};
+	struct RestoredMember {
+		int objectid;
+		std::vector<int> indices;
+	};
+	struct Shape {
+		long long key;
+		int flags;
+		int pad;
+		float position[4];
+		float rotation[4];
+	};
+
+	/// writes snapshot of cont to path. particles come from pdat, which caller maps (in pipelined mode that's staged data),
+	/// springs and triangles are mapped here, so caller must not have them mapped.
+	/// goes to a temp file first and is renamed, so readers never see half a file
+	static bool write(const char* path, NvFlexHContainer* cont, const NvFlexHParticleData& pdat, const std::vector<Member>& members, bool triangleNormals, std::string& error);
+
+	/// maps the file, isValid() tells if it's there and looks like a cache
+	explicit NvFlexHStateCache(const char* path);
+	NvFlexHStateCache(const NvFlexHStateCache&) = delete;
+	NvFlexHStateCache& operator=(const NvFlexHStateCache&) = delete;
+
+	bool isValid()const { return _valid; }
+	const std::string& error()const { return _error; }
+
+	//streaming, pointers are valid while this object lives
+	int particleCount()const;
+	const int* activeIndices()const;
+	const float* particles()const;		//x, y, z, inverse mass
+	const float* restParticles()const;	//x, y, z, 1
+	const float* velocities()const;		//x, y, z
+	const int* phases()const;
+	int springCount()const;
+	const int* springIndices()const;
+	const float* springRestLengths()const;
+	const float* springStrengths()const;
+	int triangleCount()const;
+	const int* triangleIndices()const;
+	/// NULL if triangles were written without normals
+	const float* triangleNormals()const;
+	int memberCount()const;
+	int memberObjectId(int member)const;
+	int memberPointCount(int member)const;
+	/// container indices as they were when written, restore gives the new ones
+	const int* memberIndices(int member)const;
+	int shapeCount()const;
+	const Shape* shapes()const;
+
+	/// puts the snapshot into cont. all particles of cont are freed first and get new indices,
+	/// springs, triangles and member index maps are remapped to them
+	bool restore(NvFlexHContainer* cont, std::vector<RestoredMember>& members, std::string& error)const;
+
+private:
+	const void* section(int sec)const;
+	size_t sectionBytes(int sec)const;
+
+	NvFlexHMappedFile _file;
+	bool _valid;
+	std::string _error;
+};
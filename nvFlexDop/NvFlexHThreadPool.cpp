@@ -0,0 +1,69 @@
+#include "NvFlexHThreadPool.h"
+
+#include <algorithm>
+
+
+NvFlexHThreadPool::NvFlexHThreadPool(int threads) :job(NULL), jobcount(0), jobgrain(1), jobchunks(0), nextchunk(0), busy(0), generation(0), quit(false) {
+	if (threads <= 0)threads = int(std::thread::hardware_concurrency());
+	for (int i = 1; i < threads; ++i) {
+		workers.push_back(std::thread(&NvFlexHThreadPool::workerLoop, this));
+	}
+}
+
+NvFlexHThreadPool::~NvFlexHThreadPool() {
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		quit = true;
+	}
+	startcv.notify_all();
+	for (size_t i = 0; i < workers.size(); ++i)workers[i].join();
+}
+
+void NvFlexHThreadPool::parallelFor(int count, int grain, const std::function<void(int, int)>& func) {
+	if (count <= 0)return;
+	if (grain < 1)grain = 1;
+	if (count <= grain || workers.empty()) {
+		func(0, count);
+		return;
+	}
+
+	std::lock_guard<std::mutex> dispatch(dispatchmutex);
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		job = &func;
+		jobcount = count;
+		jobgrain = grain;
+		jobchunks = (count + grain - 1) / grain;
+		nextchunk = 0;
+		busy = int(workers.size());
+		++generation;
+	}
+	startcv.notify_all();
+	runChunks();
+
+	std::unique_lock<std::mutex> lock(mutex);
+	donecv.wait(lock, [this] { return busy == 0; });
+	job = NULL;
+}
+
+void NvFlexHThreadPool::runChunks() {
+	for (int c = nextchunk.fetch_add(1); c < jobchunks; c = nextchunk.fetch_add(1)) {
+		int begin = c * jobgrain;
+		(*job)(begin, std::min(begin + jobgrain, jobcount));
+	}
+}
+
+void NvFlexHThreadPool::workerLoop() {
+	//starts from 0, not from current generation, so a job dispatched before this thread got here is not missed
+	unsigned seen = 0;
+	std::unique_lock<std::mutex> lock(mutex);
+	for (;;) {
+		startcv.wait(lock, [this, &seen] { return quit || generation != seen; });
+		if (quit)return;
+		seen = generation;
+		lock.unlock();
+		runChunks();
+		lock.lock();
+		if (--busy == 0)donecv.notify_one();
+	}
+}
@@ -0,0 +1,44 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+
+/// Fixed set of worker threads for code that cannot use UT_ParallelUtil (no HDK in there).
+/// One parallelFor runs at a time, callers from other threads wait for their turn.
+class NvFlexHThreadPool {
+public:
+	/// threads = 0 means one thread per hardware core, calling thread included
+	explicit NvFlexHThreadPool(int threads = 0);
+	NvFlexHThreadPool(const NvFlexHThreadPool&) = delete;
+	NvFlexHThreadPool& operator=(const NvFlexHThreadPool&) = delete;
+	~NvFlexHThreadPool();
+
+	int threadCount()const { return int(workers.size()) + 1; }
+
+	/// calls func(begin, end) for chunks of [0, count) with at most grain items, returns when all chunks are done.
+	/// calling thread takes chunks too, small ranges run right here
+	void parallelFor(int count, int grain, const std::function<void(int, int)>& func);
+
+private:
+	void workerLoop();
+	void runChunks();
+
+	std::vector<std::thread> workers;
+	std::mutex dispatchmutex;
+	std::mutex mutex;
+	std::condition_variable startcv;
+	std::condition_variable donecv;
+
+	const std::function<void(int, int)>* job;
+	int jobcount;
+	int jobgrain;
+	int jobchunks;
+	std::atomic<int> nextchunk;
+	int busy;
+	unsigned generation;
+	bool quit;
+};
@@ -0,0 +1,189 @@
+#include "NvFlexHTopologyBuilder.h"
+
+#include <GA/GA_PageIterator.h>
+#include <UT/UT_ParallelUtil.h>
+
+#include <climits>
+
+
+NvFlexHTopologyBuilder::NvFlexHTopologyBuilder(const GU_Detail* gdp, const int* indices, int nactives) :_gdp(gdp), _indices(indices), _nactives(nactives),
+	_rlhnd(gdp->findPrimitiveAttribute("restlength")),
+	_sthnd(gdp->findPrimitiveAttribute("strength")),
+	_nphnd(gdp->findPointAttribute("N")),
+	_nvhnd(gdp->findVertexAttribute("N")),
+	_nrhnd(gdp->findPrimitiveAttribute("N")),
+	_infhnd(gdp->findPrimitiveAttribute("inflatable")),
+	_springCount(0), _triangleCount(0) {
+	_normalType = _nrhnd.isValid() ? eNormalPrimitive : (_nvhnd.isValid() ? eNormalVertex : (_nphnd.isValid() ? eNormalPoint : eNormalNone));
+}
+
+inline int NvFlexHTopologyBuilder::classify(GA_Offset primoff)const {
+	GA_Size vtxcount = _gdp->getPrimitiveVertexCount(primoff);
+	if (vtxcount != 2 && vtxcount != 3)return 0;
+	if (vtxcount == 3 && _infhnd.isValid() && _infhnd.get(primoff) >= 0)return 0; //NvFlexHSoftBodyBuilder's
+	GA_OffsetListRef vtxs = _gdp->getPrimitiveVertexList(primoff);
+	for (GA_Size vi = 0; vi < vtxcount; ++vi) {
+		if (_gdp->pointIndex(_gdp->vertexPoint(vtxs(vi))) >= _nactives)return 0; //point hit the particle limit
+	}
+	return (int)vtxcount;
+}
+
+
+/// first pass, counts prims of every page
+class NvFlexHTopologyBuilder::PageCounter {
+public:
+	PageCounter(const NvFlexHTopologyBuilder& b, GA_Size* springs, GA_Size* triangles) :_b(b), _springs(springs), _triangles(triangles) {}
+
+	void operator()(const GA_SplittableRange& r)const {
+		for (GA_PageIterator pit = r.beginPages(); !pit.atEnd(); ++pit) {
+			GA_Size springs = 0;
+			GA_Size triangles = 0;
+			GA_PageNum page = -1;
+			GA_Offset bst, bed;
+			for (GA_Iterator it(pit.begin()); it.blockAdvance(bst, bed);) {
+				page = GAgetPageNum(bst);
+				for (GA_Offset off = bst; off < bed; ++off) {
+					int type = _b.classify(off);
+					if (type == 2)++springs;
+					else if (type == 3)++triangles;
+				}
+			}
+			if (page < 0)continue;
+			//one page is handled by one thread only
+			_springs[page] = springs;
+			_triangles[page] = triangles;
+		}
+	}
+
+private:
+	const NvFlexHTopologyBuilder& _b;
+	GA_Size* _springs;
+	GA_Size* _triangles;
+};
+
+
+void NvFlexHTopologyBuilder::count() {
+	_springCount = 0;
+	_triangleCount = 0;
+	const GA_Size npages = (GA_Size(_gdp->getNumPrimitiveOffsets()) + GA_PAGE_SIZE - 1) >> GA_PAGE_BITS;
+	//one extra entry, so start[npages] is the total
+	_springStart.assign(npages + 1, 0);
+	_triangleStart.assign(npages + 1, 0);
+	if (!isValid())return;
+
+	UTparallelFor(GA_SplittableRange(_gdp->getPrimitiveRange()), PageCounter(*this, _springStart.data(), _triangleStart.data()));
+
+	//exclusive prefix sum over pages. there's just nprims/1024 of them, serial is fine
+	GA_Size springsum = 0;
+	GA_Size trianglesum = 0;
+	for (GA_Size i = 0; i <= npages; ++i) {
+		GA_Size sc = _springStart[i];
+		GA_Size tc = _triangleStart[i];
+		_springStart[i] = springsum;
+		_triangleStart[i] = trianglesum;
+		springsum += sc;
+		trianglesum += tc;
+	}
+
+	//NvFlexVectors are int sized and spring indices take 2 ints per spring
+	_springCount = (int)std::min(springsum, GA_Size(INT_MAX / 2));
+	_triangleCount = (int)std::min(trianglesum, GA_Size(INT_MAX / 3));
+}
+
+
+/// second pass, every page writes into its own slots
+class NvFlexHTopologyBuilder::PageWriter {
+public:
+	PageWriter(const NvFlexHTopologyBuilder& b, int* springIds, float* springRls, float* springSts, int* triangleIds, float* triangleNms) :_b(b),
+		_springIds(springIds), _springRls(springRls), _springSts(springSts), _triangleIds(triangleIds), _triangleNms(triangleNms) {}
+
+	void operator()(const GA_SplittableRange& r)const {
+		const GU_Detail* gdp = _b._gdp;
+		const int* indices = _b._indices;
+		const NormalType normalType = _b._normalType;
+
+		for (GA_PageIterator pit = r.beginPages(); !pit.atEnd(); ++pit) {
+			GA_Size springcount = -1;
+			GA_Size trianglecount = -1;
+			GA_Offset bst, bed;
+			for (GA_Iterator it(pit.begin()); it.blockAdvance(bst, bed);) {
+				if (springcount < 0) {
+					GA_PageNum page = GAgetPageNum(bst);
+					springcount = _b._springStart[page];
+					trianglecount = _b._triangleStart[page];
+				}
+				for (GA_Offset off = bst; off < bed; ++off) {
+					int type = _b.classify(off);
+					if (type == 2) {
+						if (springcount >= _b._springCount)continue;
+						GA_OffsetListRef vtxs = gdp->getPrimitiveVertexList(off);
+						GA_Offset vt0 = vtxs(0);
+						GA_Offset vt1 = vtxs(1);
+
+						_springIds[springcount * 2 + 0] = indices[gdp->pointIndex(gdp->vertexPoint(vt0))];
+						_springIds[springcount * 2 + 1] = indices[gdp->pointIndex(gdp->vertexPoint(vt1))];
+						_springRls[springcount] = _b._rlhnd.get(off);
+						_springSts[springcount] = _b._sthnd.get(off);
+
+						++springcount;
+					}
+					else if (type == 3) {
+						if (trianglecount >= _b._triangleCount)continue;
+						GA_OffsetListRef vtxs = gdp->getPrimitiveVertexList(off);
+						GA_Offset vt0 = vtxs(0);
+						GA_Offset vt1 = vtxs(1);
+						GA_Offset vt2 = vtxs(2);
+
+						GA_Offset pt0 = gdp->vertexPoint(vt0);
+						GA_Offset pt1 = gdp->vertexPoint(vt1);
+						GA_Offset pt2 = gdp->vertexPoint(vt2);
+
+						GA_Size tricnt3 = trianglecount * 3;
+						_triangleIds[tricnt3 + 0] = indices[gdp->pointIndex(pt0)];
+						_triangleIds[tricnt3 + 1] = indices[gdp->pointIndex(pt1)];
+						_triangleIds[tricnt3 + 2] = indices[gdp->pointIndex(pt2)];
+
+						if (normalType != eNormalNone) {
+							UT_Vector3F n;
+							if (normalType == eNormalPoint) {
+								n = _b._nphnd.get(pt0);
+								n += _b._nphnd.get(pt1);
+								n += _b._nphnd.get(pt2);
+								n.normalize();
+							}
+							else if (normalType == eNormalVertex) {
+								n = _b._nvhnd.get(vt0);
+								n += _b._nvhnd.get(vt1);
+								n += _b._nvhnd.get(vt2);
+								n.normalize();
+							}
+							else {
+								n = _b._nrhnd.get(off);
+							}
+							_triangleNms[tricnt3 + 0] = n.x();
+							_triangleNms[tricnt3 + 1] = n.y();
+							_triangleNms[tricnt3 + 2] = n.z();
+						}
+
+						++trianglecount;
+					}
+				}
+			}
+		}
+	}
+
+private:
+	const NvFlexHTopologyBuilder& _b;
+	int* _springIds;
+	float* _springRls;
+	float* _springSts;
+	int* _triangleIds;
+	float* _triangleNms;
+};
+
+
+void NvFlexHTopologyBuilder::build(int* springIds, float* springRls, float* springSts, int* triangleIds, float* triangleNms)const {
+	if (!isValid())return;
+	if (_springCount == 0 && _triangleCount == 0)return;
+	UTparallelFor(GA_SplittableRange(_gdp->getPrimitiveRange()), PageWriter(*this, springIds, springRls, springSts, triangleIds, triangleNms));
+}
@@ -0,0 +1,65 @@
+#pragma once
+#include <GU/GU_Detail.h>
+#include <GA/GA_Handle.h>
+#include <GA/GA_SplittableRange.h>
+
+#include <vector>
+
+
+/// Turns detail's primitives into flex springs (2 vertex prims) and dynamic triangles (3 vertex prims).
+/// Prims referencing points that did not get a particle (GA_Index >= nactives) are skipped, so are triangles
+/// of inflatables, NvFlexHSoftBodyBuilder writes those.
+/// count() must be called before build(), so output buffers can be sized exactly.
+/// Both passes are threaded over primitive pages. count() stores per page prefix sums, so every page
+/// knows where its springs and triangles go and build() writes them in the same order as a serial loop would.
+class NvFlexHTopologyBuilder {
+public:
+	enum NormalType {
+		eNormalNone = 0,
+		eNormalPoint = 1,
+		eNormalVertex = 2,
+		eNormalPrimitive = 3
+	};
+
+	NvFlexHTopologyBuilder(const GU_Detail* gdp, const int* indices, int nactives);
+	NvFlexHTopologyBuilder(const NvFlexHTopologyBuilder&) = delete;
+	NvFlexHTopologyBuilder& operator=(const NvFlexHTopologyBuilder&) = delete;
+
+	/// restlength and strength are there
+	bool isValid()const { return _rlhnd.isValid() && _sthnd.isValid(); }
+	NormalType normalType()const { return _normalType; }
+
+	/// classification pass
+	void count();
+	int springCount()const { return _springCount; }
+	int triangleCount()const { return _triangleCount; }
+
+	/// springIds - 2*springCount, springRls and springSts - springCount, triangleIds and triangleNms - 3*triangleCount
+	/// triangleNms is not touched if normalType() is eNormalNone
+	void build(int* springIds, float* springRls, float* springSts, int* triangleIds, float* triangleNms)const;
+
+private:
+	class PageCounter;
+	class PageWriter;
+
+	/// returns 2 for spring, 3 for triangle, 0 for prims we ignore
+	int classify(GA_Offset primoff)const;
+
+	const GU_Detail* _gdp;
+	const int* _indices;
+	int _nactives;
+
+	GA_ROHandleF _rlhnd;
+	GA_ROHandleF _sthnd;
+	GA_ROHandleV3 _nphnd;
+	GA_ROHandleV3 _nvhnd;
+	GA_ROHandleV3 _nrhnd;
+	GA_ROHandleI _infhnd;
+	NormalType _normalType;
+
+	int _springCount;
+	int _triangleCount;
+	/// first output slot of every primitive page, filled by count()
+	std::vector<GA_Size> _springStart;
+	std::vector<GA_Size> _triangleStart;
+};
@@ -1,52 +1,59 @@
 #pragma once
 #include <NvFlex.h>
-#include <NvFlexExt.h>
 #include <../core/maths.h>
 
+#include "NvFlexHBackend.h"
 
+
+/// collision triangle mesh of a backend. data lives in backend's buffers only, it's written through NvFlexHTriangleMeshAutoMapper
 class NvFlexHTriangleMesh
 {
 public:
-	NvFlexHTriangleMesh(NvFlexLibrary* lib);
+	NvFlexHTriangleMesh(NvFlexHBackend* backend);
 	NvFlexHTriangleMesh(const NvFlexHTriangleMesh&) = delete;
 	NvFlexHTriangleMesh& operator=(const NvFlexHTriangleMesh&) = delete;
 	~NvFlexHTriangleMesh();
 
 	NvFlexTriangleMeshId getId()const;
-	void loadData(const Vec3* verts, const int* tris, int vertcount, int triscount);
-	
-	void mapall();
-	void unmapall();
-
-	void updateNvBuffers();
+	/// as of the last update, triangles can only be kept while this stays the same
+	int vertexCount()const { return vertcount; }
 
 private:
 	friend class NvFlexHTriangleMeshAutoMapper;
 
+	NvFlexHBackend* backend;
 	NvFlexTriangleMeshId id;
-	NvFlexVector<Vec3> vertvec;
-	NvFlexVector<int> trivec;
+	int vertcount;
 	float lower[3];
 	float upper[3];
 };
 
 
+/// maps mesh buffers for the lifetime of the object, mesh is updated when it goes out of scope
 class NvFlexHTriangleMeshAutoMapper {
 public:
-	NvFlexHTriangleMeshAutoMapper(NvFlexHTriangleMesh* m) :mesh(*m) { mesh.mapall(); }
-	NvFlexHTriangleMeshAutoMapper(NvFlexHTriangleMesh& m) :mesh(m) { mesh.mapall(); }
+	/// vertices and triangles are written anew
+	NvFlexHTriangleMeshAutoMapper(NvFlexHTriangleMesh* m, int vertcount, int tricount) :mesh(*m) {
+		mesh.vertcount = vertcount;
+		data = mesh.backend->mapTriangleMesh(mesh.id, vertcount, tricount, false);
+	}
+	/// vertices only, mesh keeps its triangles. vertcount must be mesh's vertexCount()
+	NvFlexHTriangleMeshAutoMapper(NvFlexHTriangleMesh* m, int vertcount) :mesh(*m) {
+		mesh.vertcount = vertcount;
+		data = mesh.backend->mapTriangleMesh(mesh.id, vertcount, 0, true);
+	}
 	NvFlexHTriangleMeshAutoMapper(const NvFlexHTriangleMeshAutoMapper&) = delete;
 	NvFlexHTriangleMeshAutoMapper& operator=(const NvFlexHTriangleMeshAutoMapper&) = delete;
-	~NvFlexHTriangleMeshAutoMapper() { mesh.unmapall(); mesh.updateNvBuffers(); }
+	~NvFlexHTriangleMeshAutoMapper() { mesh.backend->unmapTriangleMesh(mesh.id, mesh.lower, mesh.upper); }
 
-	inline void setVertexCount(int count) { mesh.vertvec.resize(count); }
-	inline void setTrianglesCount(int count) { mesh.trivec.resize(count * 3); }
-	inline Vec3* vertices()const { return mesh.vertvec.mappedPtr; }
-	inline int* triangles()const { return mesh.trivec.mappedPtr; }
+	inline Vec3* vertices()const { return data.vertices; }
+	/// NULL if triangles are kept
+	inline int* triangles()const { return data.triangles; }
 	inline float* lower()const { return mesh.lower; }
 	inline float* upper()const { return mesh.upper; }
 
 
 private:
 	NvFlexHTriangleMesh& mesh;
+	NvFlexHTriangleMeshData data;
 };
@@ -1,48 +1,64 @@
 #include "SIM_NvFlexData.h"
 #include <PRM/PRM_Template.h>
 #include <PRM/PRM_Default.h>
+#include <PRM/PRM_ChoiceList.h>
+#include <PRM/PRM_Range.h>
 
-NvFlexLibrary* SIM_NvFlexData::nvFlexLibrary = NULL;
+#include <stdexcept>
 
-static void CreateFluidParticleGrid(NvFlexExtParticleData& ptd, int* indices, Vec3 lower, int dimx, int dimy, int dimz, float radius, Vec3 velocity, float invMass, int phase, float jitter = 0.005f);
+#include "NvFlexHFlexBackend.h"
+#include "NvFlexHCpuBackend.h"
 
 
 void SIM_NvFlexData::initializeSubclass() {
 	SIM_Data::initializeSubclass();
-	_lastGdpPId = -1;
+	_lastGdpIds.invalidate();
+	_clusters = NvFlexHClusterLayout();
+	_softBodies.reset(new NvFlexHSoftBodyCache());
+	_fresh = true;
+	_error.clear();
 
 	int ptsmaxcount = getMaxPtsCount();
+	int diffusemaxcount = getMaxDiffuseCount();
+	if (diffusemaxcount < 0)diffusemaxcount = 0;
+	NvFlexHBackend* backend = NULL;
+	if (getBackend() == eBackendCpu)backend = NvFlexHCpuBackend::instance();
+	else backend = NvFlexHFlexBackend::instance(getDevice());
+	if (backend == NULL) {
+		_error = "nvflex library initialization failed";
+		if (getBackend() != eBackendCpu) {
+			const std::string liberror = NvFlexHFlexBackend::takeDeviceError(getDevice());
+			if (!liberror.empty())_error += ": " + liberror;
+		}
+		_valid = false;
+		nvdata.reset();
+		_indexMap.reset();
+		_members.reset();
+		return;
+	}
+
 	try {
-		nvdata.reset(new NvFlexContainerWrapper(SIM_NvFlexData::nvFlexLibrary, ptsmaxcount, 0));
-		_indices.reset(new int[ptsmaxcount]);
+		nvdata.reset(backend->createContainer(ptsmaxcount, diffusemaxcount));
+		_indexMap.reset(new NvFlexHIndexMap(ptsmaxcount));
+		_members.reset(new NvFlexHMemberMaps());
+	}
+	catch (const std::exception& e) {
+		_error = std::string("nvflex data initialization failed: ") + e.what();
+		_valid = false;
+		nvdata.reset();
+		_indexMap.reset();
+		_members.reset();
+		return;
 	}
 	catch (...) {
-		std::cout << "nvflex data initialization failed!" << std::endl;
+		_error = "nvflex data initialization failed";
 		_valid = false;
 		nvdata.reset();
-		_indices.reset();
+		_indexMap.reset();
+		_members.reset();
 		return;
 	}
-	std::cout << "nvflex data initialized" << std::endl;
-
-	//debug test
-	/*float sizex = 1.76f;
-	float sizey = 3.20f;
-	float sizez = 3.50f;
-
-	float restDistance = 0.055f;
-
-	int x = int(sizex / restDistance);
-	int y = int(sizey / restDistance);
-	int z = int(sizez / restDistance);
-
-	NvFlexExtParticleData ptd = NvFlexExtMapParticleData(nvdata->container());
-
-	NvFlexExtAllocParticles(nvdata->container(), x*y*z, _indices.get());
-	CreateFluidParticleGrid(ptd, _indices.get(), Vec3(0, restDistance, 0), x, y, z, restDistance, Vec3(0.0f), 1, eNvFlexPhaseSelfCollide | eNvFlexPhaseFluid);
-	*/
-
-	//NvFlexExtUnmapParticleData(nvdata->container());
+	_valid = true;
 }
 
 void SIM_NvFlexData::makeEqualSubclass(const SIM_Data* source) {
@@ -54,22 +70,53 @@ void SIM_NvFlexData::makeEqualSubclass(const SIM_Data* source) {
 		return;
 	}
 	nvdata = src->nvdata;
-	_indices = src->_indices;
-	_lastGdpPId = src->_lastGdpPId;
+	_indexMap = src->_indexMap;
+	_members = src->_members;
+	_lastGdpIds = src->_lastGdpIds;
+	_clusters = src->_clusters;
+	_softBodies = src->_softBodies;
+	_fresh = src->_fresh;
+	_error = src->_error;
 	_valid = _valid && src->_valid;
 	if (!_valid) {
 		nvdata.reset();
-		_indices.reset();
+		_indexMap.reset();
+		_members.reset();
 	}
 }
 
+void SIM_NvFlexData::joinContainer(const SIM_NvFlexData& other) {
+	nvdata = other.nvdata;
+	_indexMap.reset(new NvFlexHIndexMap(nvdata->maxParticles()));
+	_members = other._members;
+	_lastGdpIds.invalidate();
+	_clusters = NvFlexHClusterLayout();
+}
+
 const SIM_DopDescription* SIM_NvFlexData::getDescriptionForFucktory() {
 	static PRM_Name maxpts_name("maxpts", "Maximum Particles Count");
+	static PRM_Name maxdiffuse_name("maxdiffuse", "Maximum Diffuse Particles Count");
+	static PRM_Name backend_name("backend", "Compute Backend");
+	static PRM_Name device_name("device", "CUDA Device");
+
+	static PRM_Name backend_items[] = {
+		PRM_Name("nvflex", "NvFlex (CUDA)"),
+		PRM_Name("cpu", "CPU Reference"),
+		PRM_Name(0)
+	};
+	static PRM_ChoiceList backend_menu(PRM_CHOICELIST_SINGLE, backend_items);
 
 	static PRM_Default maxpts_default(1000000);
+	static PRM_Default maxdiffuse_default(0);
+	static PRM_Default backend_default(eBackendNvFlex);
+	static PRM_Default device_default(-1);
+	static PRM_Range device_range(PRM_RANGE_RESTRICTED, -1, PRM_RANGE_UI, 7);
 
 	static PRM_Template prms[]{
 		PRM_Template(PRM_INT_E, 1, &maxpts_name, &maxpts_default),
+		PRM_Template(PRM_INT_E, 1, &maxdiffuse_name, &maxdiffuse_default),
+		PRM_Template(PRM_ORD, 1, &backend_name, &backend_default, &backend_menu),
+		PRM_Template(PRM_INT, 1, &device_name, &device_default, 0, &device_range),
 		PRM_Template()
 	};
 
@@ -77,62 +124,7 @@ const SIM_DopDescription* SIM_NvFlexData::getDescriptionForFucktory() {
 	return &desc;
 }
 
-static void nvFlexErrorCallbackPrint(NvFlexErrorSeverity type, const char *msg, const char *file, int line) {
-	switch (type) {
-	case eNvFlexLogError:
-		std::cout << "NvF ERROR: "; break;
-	case eNvFlexLogWarning:
-		std::cout << "NvF WARNING: "; break;
-	case eNvFlexLogDebug:
-		std::cout << "NvF DEBUG: "; break;
-	case eNvFlexLogAll:
-		std::cout << "NvF ALL: "; break;
-	}
-	if (msg != NULL)std::cout << msg;
-	std::cout << " :: ";
-	if (file != NULL)std::cout << file;
-	std::cout << " :: ";
-	std::cout << line;
-	std::cout << std::endl;
-
-}
-
-
-SIM_NvFlexData::SIM_NvFlexData(const SIM_DataFactory*fack):SIM_Data(fack),SIM_OptionsUser(this), _indices(nullptr_t(), std::default_delete<int[]>()), _lastGdpPId(-1), _valid(false){
-	if (nvFlexLibrary == NULL) {
-		nvFlexLibrary = NvFlexInit(110, &nvFlexErrorCallbackPrint);
-	}
-	if (nvFlexLibrary != NULL)_valid = true;
-}
+SIM_NvFlexData::SIM_NvFlexData(const SIM_DataFactory*fack):SIM_Data(fack),SIM_OptionsUser(this), _valid(true), _fresh(true){}
 
 
 SIM_NvFlexData::~SIM_NvFlexData(){}
-
-
-
-// debug helpers
-static void CreateFluidParticleGrid(NvFlexExtParticleData& ptd, int* indices,  Vec3 lower, int dimx, int dimy, int dimz, float radius, Vec3 velocity, float invMass, int phase, float jitter)
-{
-	for (int x = 0; x < dimx; ++x)
-	{
-		for (int y = 0; y < dimy; ++y)
-		{
-			for (int z = 0; z < dimz; ++z)
-			{
-				
-				Vec3 position = lower + Vec3(float(x), float(y), float(z))*radius + RandomUnitVector()*jitter;
-				int ind = indices[z + dimz*(y + dimy*x)];
-				ptd.particles[ind * 4 + 0] = position.x;
-				ptd.particles[ind * 4 + 1] = position.y;
-				ptd.particles[ind * 4 + 2] = position.z;
-				ptd.particles[ind * 4 + 3] = invMass;
-
-				ptd.velocities[ind * 3 + 0] = velocity.x;
-				ptd.velocities[ind * 3 + 1] = velocity.y;
-				ptd.velocities[ind * 3 + 2] = velocity.z;
-				
-				ptd.phases[ind] = phase;
-			}
-		}
-	}
-}
\ No newline at end of file
@@ -5,11 +5,18 @@
 #include <SIM/SIM_DopDescription.h>
 
 #include <NvFlex.h>
-#include <NvFlexExt.h>
 #include <../core/types.h>
 #include <../core/maths.h>
 
+#include <memory>
+#include <string>
+
+#include "NvFlexHBackend.h"
+#include "NvFlexHClusterBuilder.h"
 #include "NvFlexHCollisionData.h"
+#include "NvFlexHIndexMap.h"
+#include "NvFlexHParticleTransfer.h"
+#include "NvFlexHSoftBodyBuilder.h"
 
 
 class SIM_NvFlexSolver; //fwd decl
@@ -18,122 +25,26 @@ class SIM_NvFlexData:public SIM_Data, public SIM_OptionsUser
 {
 	friend class SIM_NvFlexSolver;
 public:
-	class NvFlexContainerWrapper {
-	public:
-		typedef struct NvFlexHSpringData {
-			int* const springIds;
-			float* const springRls;
-			float* const springSts;
-
-			NvFlexHSpringData(int*sid, float*srl, float*sts):springIds(sid),springRls(srl),springSts(sts){}
-		} NvFlexHSpringData;
-
-		typedef struct NvFlexHTriangleData {
-			int* const triangleIds;
-			float* const triangleNms;
-
-			NvFlexHTriangleData(int*tid, float*tnm):triangleIds(tid),triangleNms(tnm){}
-		} NvFlexHTriangleData;
-
-		explicit NvFlexContainerWrapper(NvFlexLibrary*lib, int maxParticles, int MaxDiffuseParticles, int maxNeighbours = 96):_springIndices(lib),_springRestLengths(lib),_springStrenghts(lib), _triangleIndices(lib),_triangleNormals(lib){
-			_slv = NvFlexCreateSolver(lib, maxParticles, MaxDiffuseParticles, maxNeighbours);
-			if (_slv == NULL)throw std::runtime_error("NULL NVFLEX SOLVER!");
-			_cont = NvFlexExtCreateContainer(lib, _slv, maxParticles);
-			if (_cont == NULL)throw std::runtime_error("NULL NVFLEX CONTAINER!");
-			_colld = new NvFlexHCollisionData(lib);
-		}
-		NvFlexContainerWrapper(NvFlexContainerWrapper&) = delete;
-		~NvFlexContainerWrapper() {
-			NvFlexExtDestroyContainer(_cont);
-			NvFlexDestroySolver(_slv);
-			delete _colld;
-		}
-
-		NvFlexSolver* solver() { return _slv; }
-		NvFlexExtContainer * container() { return _cont; }
-		NvFlexHCollisionData* collisionData() { return _colld; }
-
-		//springs
-		int getSpringsCount()const { return _springRestLengths.size(); }
-		void resizeSpringData(int newSize) {
-			/// be sure data is NOT MAPPED before here
-			/// cuz all previous pointers will be invalidated
-			_springIndices.map();
-			_springRestLengths.map();
-			_springStrenghts.map();
-
-			_springIndices.resize(2*newSize);
-			_springRestLengths.resize(newSize);
-			_springStrenghts.resize(newSize);
-
-			_springIndices.unmap();
-			_springRestLengths.unmap();
-			_springStrenghts.unmap();
-		}
-		NvFlexHSpringData mapSpringData(){
-			_springIndices.map();
-			_springRestLengths.map();
-			_springStrenghts.map();
-			return NvFlexHSpringData(_springIndices.mappedPtr, _springRestLengths.mappedPtr, _springStrenghts.mappedPtr);
-		}
-		void unmapSpringData() {
-			_springIndices.unmap();
-			_springRestLengths.unmap();
-			_springStrenghts.unmap();
-		}
-		void pushSpringsToDevice() {
-			NvFlexSetSprings(_slv, _springIndices.buffer, _springRestLengths.buffer, _springStrenghts.buffer, _springRestLengths.size());
-		}
-
-		//triangles
-		int getTrianglesCount()const { return _triangleIndices.size() / 3; }
-		void resizeTriangleData(int newSize) {
-			/// be sure data is NOT MAPPED before here
-			/// cuz all previous pointers will be invalidated
-			_triangleIndices.map();
-			_triangleNormals.map();
-
-			_triangleIndices.resize(3*newSize);
-			_triangleNormals.resize(3*newSize);
-
-			_triangleIndices.unmap();
-			_triangleNormals.unmap();
-		}
-		NvFlexHTriangleData mapTriangleData() {
-			_triangleIndices.map();
-			_triangleNormals.map();
-			return NvFlexHTriangleData(_triangleIndices.mappedPtr, _triangleNormals.mappedPtr);
-		}
-		void unmapTriangleData() {
-			_triangleIndices.unmap();
-			_triangleNormals.unmap();
-		}
-		void pushTrianglesToDevice(bool pushNormals = true) {
-			NvFlexSetDynamicTriangles(_slv, _triangleIndices.buffer, pushNormals ? _triangleNormals.buffer : NULL, _triangleIndices.size() / 3);
-		}
-
-	private:
-		NvFlexHCollisionData* _colld;
-		NvFlexSolver* _slv;
-		NvFlexExtContainer* _cont;
-
-		//springs
-		NvFlexVector<int> _springIndices;
-		NvFlexVector<float> _springRestLengths;
-		NvFlexVector<float> _springStrenghts;
-		//triangles
-		NvFlexVector<int> _triangleIndices;
-		NvFlexVector<float> _triangleNormals;
+	enum Backend {
+		eBackendNvFlex = 0,
+		eBackendCpu = 1
 	};
 
-	
-	static NvFlexLibrary* nvFlexLibrary;
-
 	GETSET_DATA_FUNCS_I("maxpts", MaxPtsCount);
+	/// foam/spray/bubbles spawned by the solver, 0 turns them off. fixed for the life of the container
+	GETSET_DATA_FUNCS_I("maxdiffuse", MaxDiffuseCount);
+	GETSET_DATA_FUNCS_I("backend", Backend);
+	/// cuda device of the NvFlex backend, -1 for the one flex picks. sims on one device share its library
+	GETSET_DATA_FUNCS_I("device", Device);
 
-	std::shared_ptr<NvFlexContainerWrapper> nvdata;
+	std::shared_ptr<NvFlexHContainer> nvdata;
 public:
 	inline bool isNvValid() { return _valid; }
+	/// why the data is not valid, solver reports it on the object
+	inline const std::string& errorMessage()const { return _error; }
+	/// drops own container and shares the one of other. particles are allocated anew there on next ingest,
+	/// the ones of an earlier visit are freed then
+	void joinContainer(const SIM_NvFlexData& other);
 
 protected:
 	explicit SIM_NvFlexData(const SIM_DataFactory*fack);
@@ -144,9 +55,14 @@ protected:
 
 private:
 	bool _valid;
+	std::string _error;
 private: //for a friend
-	std::shared_ptr<int> _indices;
-	int64 _lastGdpPId;
+	std::shared_ptr<NvFlexHIndexMap> _indexMap;
+	std::shared_ptr<NvFlexHMemberMaps> _members; //of the container, shared by everyone in it
+	NvFlexHDataIds _lastGdpIds;
+	NvFlexHClusterLayout _clusters; //of the last cluster upload, for export
+	std::shared_ptr<NvFlexHSoftBodyCache> _softBodies; //depends on geometry only, so copies share it like the index map
+	bool _fresh; //container was not stepped yet, so it may be filled from a cache
 
 private:
 	static const SIM_DopDescription* getDescriptionForFucktory();
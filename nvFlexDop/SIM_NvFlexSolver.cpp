@@ -2,411 +2,764 @@
 
 #include "SIM_NvFlexSolver.h"
 
-#include "SIM_NvFlexData.h" //for static library
+#include "SIM_NvFlexData.h"
 
 #include <SIM/SIM_ObjectArray.h>
 #include <SIM/SIM_Object.h>
 #include <SIM/SIM_GeometryCopy.h>
 #include <SIM/SIM_ForceGravity.h>
+#include <SIM/SIM_EmptyData.h>
 #include <GU/GU_Detail.h>
 #include <PRM/PRM_Template.h>
 #include <PRM/PRM_Default.h>
 #include <PRM/PRM_Range.h>
+#include <UT/UT_FileUtil.h>
 
 #include <GA/GA_PageIterator.h>
 #include <GA/GA_PageHandle.h>
 #include <GA/GA_SplittableRange.h>
 
 #include <algorithm>
+#include <cctype>
+#include <memory>
+#include <string>
 
 #include "NvFlexHTriangleMesh.h"
+#include "NvFlexHParticleTransfer.h"
+#include "NvFlexHTopologyBuilder.h"
+#include "NvFlexHClusterBuilder.h"
+#include "NvFlexHSoftBodyBuilder.h"
+#include "NvFlexHCollisionMeshConverter.h"
+#include "NvFlexHColliderSource.h"
+#include "NvFlexHColliderShapes.h"
+#include "NvFlexHProfiler.h"
+#include "NvFlexHStateCache.h"
+
+
+/// writes new shape transform, previous one goes into prev* for swept collision. new shapes have no past, so prev is current
+template<class T>
+static void placeShape(NvFlexHCollisionGeometryWrapper<T>& geo, bool isnew, const Vec4& position, const Quat& rotation) {
+	*geo.prevposition = isnew ? position : *geo.position;
+	*geo.prevrotation = isnew ? rotation : *geo.rotation;
+	*geo.position = position;
+	*geo.rotation = rotation;
+}
+
+/// path of the cache file of a batch. several batches of one solver would overwrite each other,
+/// so then each gets _<object id of its first member> before the extension
+static std::string batchCachePath(const char* path, int objectid, bool suffix) {
+	std::string res(path);
+	if (!suffix)return res;
+	size_t dot = res.find_last_of('.');
+	size_t slash = res.find_last_of("/\\");
+	if (dot == std::string::npos || (slash != std::string::npos && dot < slash))dot = res.size();
+	return res.insert(dot, "_" + std::to_string(objectid));
+}
 
+/// device timer names come from the backend, make them usable as attribute names
+static std::string profileName(const char* prefix, const std::string& name) {
+	std::string res(prefix);
+	for (size_t i = 0; i < name.size(); ++i)res += isalnum((unsigned char)name[i]) ? name[i] : '_';
+	return res;
+}
+
+/// detail attributes nvf_time_<phase> and nvf_devtime_<timer> in milliseconds, so timings travel with the geometry
+static void writeProfileAttributes(GU_Detail* gdp, const NvFlexHProfiler& prof) {
+	for (int i = 0; i < NvFlexHProfiler::ePhaseCount; ++i) {
+		GA_RWHandleF hnd(gdp->addFloatTuple(GA_ATTRIB_DETAIL, profileName("nvf_time_", NvFlexHProfiler::phaseName(i)).c_str(), 1));
+		hnd.set(GA_Offset(0), float(prof.time(NvFlexHProfiler::Phase(i))));
+		hnd.bumpDataId();
+	}
+	GA_RWHandleF tothnd(gdp->addFloatTuple(GA_ATTRIB_DETAIL, "nvf_time_total", 1));
+	tothnd.set(GA_Offset(0), float(prof.total()));
+	tothnd.bumpDataId();
+
+	const std::vector<NvFlexHProfiler::DeviceTimer>& devtimers = prof.deviceTimers();
+	for (size_t i = 0; i < devtimers.size(); ++i) {
+		GA_RWHandleF hnd(gdp->addFloatTuple(GA_ATTRIB_DETAIL, profileName("nvf_devtime_", devtimers[i].name).c_str(), 1));
+		hnd.set(GA_Offset(0), devtimers[i].ms);
+		hnd.bumpDataId();
+	}
+}
 
+/// same timings as options of NvFlexProfile subdata, readable with dopoption() or in the details view
+static void writeProfileData(SIM_Object* obj, const NvFlexHProfiler& prof) {
+	SIM_EmptyData* data = SIM_DATA_CREATE(*obj, "NvFlexProfile", SIM_EmptyData, SIM_DATA_RETURN_EXISTING);
+	if (data == NULL)return;
+	SIM_Options& opts = data->getData();
+	for (int i = 0; i < NvFlexHProfiler::ePhaseCount; ++i)opts.setOptionF(NvFlexHProfiler::phaseName(i), prof.time(NvFlexHProfiler::Phase(i)));
+	opts.setOptionF("total", prof.total());
+	const std::vector<NvFlexHProfiler::DeviceTimer>& devtimers = prof.deviceTimers();
+	for (size_t i = 0; i < devtimers.size(); ++i)opts.setOptionF(profileName("device_", devtimers[i].name).c_str(), devtimers[i].ms);
+}
 
 
 SIM_NvFlexSolver::SIM_Result SIM_NvFlexSolver::solveObjectsSubclass(SIM_Engine & engine, SIM_ObjectArray & objs, SIM_ObjectArray & newobjs, SIM_ObjectArray & feedbackobjs, const SIM_Time & timestep)
 {
-	NvFlexHContextAutoGetter contextAutoGetAndRelease();
-
+	//objects sharing a container are solved together, with one tick.
+	//with batchObjects everyone joins the container of the first valid object, and stays there until reset
+	std::vector<std::vector<BatchMember> > batches;
 	for (exint obji = 0; obji < objs.entries(); ++obji) {
 		SIM_Object* obj = objs(obji);
 
 		SIM_NvFlexData* nvdata = SIM_DATA_GET(*obj, "NvFlexData", SIM_NvFlexData);
 		if (nvdata == NULL)continue;
 		if (!nvdata->isNvValid()) {
-			addError(obj, SIM_BADSUBDATA, "NvFlexData is in invalid state (maybe insufficient GPU resources). try resetting the simulation.", UT_ERROR_WARNING);
+			std::string msg = "NvFlexData is in invalid state (maybe insufficient GPU resources). try resetting the simulation.";
+			if (!nvdata->errorMessage().empty())msg += " " + nvdata->errorMessage();
+			addError(obj, SIM_BADSUBDATA, msg.c_str(), UT_ERROR_WARNING);
 			continue;
 		}
-		std::shared_ptr<SIM_NvFlexData::NvFlexContainerWrapper> consolv = nvdata->nvdata;
-
-
-		// Getting old geometry and shoving it into NvFlex buffers
-		const SIM_Geometry *geo=SIM_DATA_GETCONST(*obj, "Geometry", SIM_Geometry);
-		if (geo != NULL) {
-			GU_DetailHandleAutoReadLock lock(geo->getGeometry());
-			if (lock.isValid()) {
-				const GU_Detail *gdp = lock.getGdp();
-				int64 ndid = gdp->getP()->getDataId();
-				std::cout << "id = " << ndid << std::endl;
-				if (ndid != nvdata->_lastGdpPId) {
-					std::cout << "found geo, new id !! old id "<< nvdata->_lastGdpPId << std::endl;
-
-					GA_ROHandleV3 phnd(gdp->getP());
-					GA_ROHandleV3 vhnd(gdp->findPointAttribute("v"));
-					GA_ROHandleI ihnd(gdp->findPointAttribute("iid"));
-					GA_ROHandleI phshnd(gdp->findPointAttribute("phs"));
-					GA_ROHandleF mhnd(gdp->findPointAttribute("imass"));
-					GA_ROHandleV3 rhnd(gdp->findPointAttribute("restP"));
-					const bool hasRest = rhnd.isValid();
-
-					int* indices = nvdata->_indices.get();
-					int nactives = NvFlexExtGetActiveList(consolv->container(), indices);
-
-					if (phnd.isValid() && vhnd.isValid() && ihnd.isValid() && phshnd.isValid() && mhnd.isValid()) {
-						NvFlexExtParticleData pdat = NvFlexExtMapParticleData(consolv->container());
-
-						GA_Size ngdpoints = gdp->getNumPoints();
-						bool reget = false;
-						if (nactives < ngdpoints) {
-							int nptscount=NvFlexExtAllocParticles(consolv->container(), ngdpoints - nactives, indices); //whoa! carefull with that! your luck the mapped buffer is not reallocated during this operation!
-							/*for (int npi = 0; npi < nptscount; ++npi) {
-								pdat.phases[indices[npi]] = eNvFlexPhaseSelfCollide | eNvFlexPhaseFluid;
-							}*/
-							reget = true;
-						}
-						else if (nactives > ngdpoints) {
-							NvFlexExtFreeParticles(consolv->container(), nactives - ngdpoints, indices);
-							reget = true;
-						}
-						if (reget) nactives = NvFlexExtGetActiveList(consolv->container(), indices);
-
-						GA_Offset bst, bed;
-						bool stoploop = false;
-						for (GA_Iterator it(gdp->getPointRange()); it.blockAdvance(bst, bed);) { //TODO: make it threaded after debugged
-							for (GA_Offset off = bst; off < bed; ++off) {
-								UT_Vector3F p = phnd.get(off);
-								UT_Vector3F v = vhnd.get(off);
-
-								GA_Index idx = gdp->pointIndex(off);
-								if (idx >= nactives) {
-									stoploop = true;
-									break;
-								}
-								int iid = indices[idx];
-								int iid4 = iid * 4;
-								int iid3 = iid * 3;
-								pdat.particles[iid4 + 0] = p.x();
-								pdat.particles[iid4 + 1] = p.y();
-								pdat.particles[iid4 + 2] = p.z();
-								pdat.particles[iid4 + 3] = mhnd.get(off);
-								if (hasRest) {
-									UT_Vector3F rst = rhnd.get(off);
-									pdat.restParticles[iid4 + 0] = rst.x();
-									pdat.restParticles[iid4 + 1] = rst.y();
-									pdat.restParticles[iid4 + 2] = rst.z();
-									pdat.restParticles[iid4 + 3] = 1.0f; //cannot find in manual what it expects here
-								}
-
-								pdat.velocities[iid3 + 0] = v.x();
-								pdat.velocities[iid3 + 1] = v.y();
-								pdat.velocities[iid3 + 2] = v.z();
-
-								pdat.phases[iid] = phshnd.get(off);
-							}
-							if (stoploop)break;
-						}
-						
-						NvFlexExtUnmapParticleData(consolv->container());
-
-						//Push NvFlex data to GPU. since it's async - we need to do it as far from the solver tick as possible to use this time to do CPU work
-						NvFlexExtPushToDevice(consolv->container()); //This pushes all from particle data returned by map. so collisions, springs and triangles we can push separately.
-						//Also note that as long as we don't call anything with nvFlexExtAssets - we are free to rebind springs manually.
-
-						GA_Size nprims = gdp->getNumPrimitives();
-						if(nprims>0){//Create and Push SPRINGS and TRIANGLES
-							GA_ROHandleF rlhnd(gdp->findPrimitiveAttribute("restlength"));
-							GA_ROHandleF sthnd(gdp->findPrimitiveAttribute("strength"));
-							GA_ROHandleV3 nphnd(gdp->findPointAttribute("N"));
-							GA_ROHandleV3 nvhnd(gdp->findVertexAttribute("N"));
-							GA_ROHandleV3 nrhnd(gdp->findPrimitiveAttribute("N"));
-							const short triNormalType = nrhnd.isValid() ? 3 : (nvhnd.isValid() ? 2 : (nphnd.isValid() ? 1 : 0));
-
-
-							if (rlhnd.isValid() && sthnd.isValid()) {
-								//This would be super not cool and not optimal to do. But in NvFlexVector capacity is never lowered, so it's safe and fast to resize down later
-								// as a downside - we always will have that extra memory allocated untill solver is resetted
-								consolv->resizeSpringData(nprims);
-								consolv->resizeTriangleData(nprims); //TODO: count properly, dont waste memory like this!
-
-								auto sprdat = consolv->mapSpringData();
-								auto tridat = consolv->mapTriangleData();
-								GA_Size springcount = 0; //TODO: replace with SYS_AtomicCounter in threaded implementation
-								GA_Size trianglecount = 0;
-								for (GA_Iterator it(gdp->getPrimitiveRange()); !it.atEnd(); ++it) {
-									GA_Offset off = *it;
-									GA_Size vtxcount = gdp->getPrimitiveVertexCount(off);
-									if (vtxcount == 2) {
-										GA_OffsetListRef vtxs = gdp->getPrimitiveVertexList(off);
-										GA_Offset vt0 = vtxs(0);
-										GA_Offset vt1 = vtxs(1);
-
-										//TODO: check that if we hit pts limit - we dont write geo indices above the limit!!
-										//at this point indices should still be valid
-										sprdat.springIds[springcount * 2 + 0] = indices[gdp->pointIndex(gdp->vertexPoint(vt0))];
-										sprdat.springIds[springcount * 2 + 1] = indices[gdp->pointIndex(gdp->vertexPoint(vt1))];
-										sprdat.springRls[springcount] = rlhnd.get(off);
-										sprdat.springSts[springcount] = sthnd.get(off);
-
-										++springcount;
-									}
-									else if (vtxcount == 3) {
-										GA_OffsetListRef vtxs = gdp->getPrimitiveVertexList(off);
-										GA_Offset vt0 = vtxs(0);
-										GA_Offset vt1 = vtxs(1);
-										GA_Offset vt2 = vtxs(2);
-
-										GA_Offset pt0 = gdp->vertexPoint(vt0);
-										GA_Offset pt1 = gdp->vertexPoint(vt1);
-										GA_Offset pt2 = gdp->vertexPoint(vt2);
-
-										GA_Size tricnt3 = trianglecount * 3;
-										tridat.triangleIds[tricnt3 + 0] = indices[gdp->pointIndex(pt0)];
-										tridat.triangleIds[tricnt3 + 1] = indices[gdp->pointIndex(pt1)];
-										tridat.triangleIds[tricnt3 + 2] = indices[gdp->pointIndex(pt2)];
-
-										if (triNormalType > 0) {
-											UT_Vector3F n;
-											if (triNormalType == 1) {
-												n = nphnd.get(pt0);
-												n += nphnd.get(pt1);
-												n += nphnd.get(pt2);
-												n.normalize();
-											}
-											else if (triNormalType == 2) {
-												n = nvhnd.get(vt0);
-												n += nvhnd.get(vt1);
-												n += nvhnd.get(vt2);
-												n.normalize();
-											}
-											else if (triNormalType == 3) {
-												n = nrhnd.get(off);
-											}
-											tridat.triangleNms[tricnt3 + 0] = n.x();
-											tridat.triangleNms[tricnt3 + 1] = n.y();
-											tridat.triangleNms[tricnt3 + 2] = n.z();
-										}
-
-										++trianglecount;
-									}
-								}
-								consolv->unmapSpringData();
-								consolv->unmapTriangleData();
-								//TODO: check that springcount is in int bounds and clamp it if needed!!
-								consolv->resizeSpringData((int)springcount);
-								consolv->resizeTriangleData((int)trianglecount);
-
-
-							}
-							consolv->pushSpringsToDevice();//Note that we should do this only if change occured in springs. for now we do not detect those changes, so we push always.
-							consolv->pushTrianglesToDevice(triNormalType > 0);
-						}//END SPRINGS AND TRIANGLES
+		if (getBatchObjects() && !batches.empty() && nvdata->nvdata != batches[0][0].nvdata->nvdata)nvdata->joinContainer(*batches[0][0].nvdata);
+
+		BatchMember mem;
+		mem.obj = obj;
+		mem.nvdata = nvdata;
+		size_t bi = 0;
+		while (bi < batches.size() && batches[bi][0].nvdata->nvdata != nvdata->nvdata)++bi;
+		if (bi == batches.size())batches.push_back(std::vector<BatchMember>());
+		batches[bi].push_back(mem);
+	}
 
-					}
+	UT_String cacheFile, resumeFile;
+	getCacheFile(cacheFile);
+	getResumeFile(resumeFile);
+	for (size_t bi = 0; bi < batches.size(); ++bi) {
+		const int objid = batches[bi][0].obj->getObjectId();
+		solveBatch(batches[bi], timestep, batchCachePath(cacheFile, objid, batches.size() > 1), batchCachePath(resumeFile, objid, batches.size() > 1));
+		//library errors are only recorded by the backend, they show on the node like data errors do
+		const std::string liberror = batches[bi][0].nvdata->nvdata->backend()->takeError();
+		if (!liberror.empty())addError(batches[bi][0].obj, SIM_MESSAGE, liberror.c_str(), UT_ERROR_WARNING);
+	}
 
-				}
+	return SIM_SOLVER_SUCCESS;
+}
 
+void SIM_NvFlexSolver::solveBatch(const std::vector<BatchMember>& batch, const SIM_Time& timestep, const std::string& cachePath, const std::string& resumePath) {
+	std::shared_ptr<NvFlexHContainer> consolv = batch[0].nvdata->nvdata;
+	//whole step under one context, other networks using the same device wait for us
+	NvFlexHContextGuard contextGuard(consolv->backend());
+	NvFlexHProfiler prof;
+
+	//warm start: a container that was never stepped takes the cached state instead of starting from the input geometry
+	if (batch[0].nvdata->_fresh && getCacheResume()) {
+		NvFlexHProfiler::Scope scope(prof, NvFlexHProfiler::ePhaseIngest);
+		resumeBatch(batch, consolv.get(), resumePath);
+	}
+	for (size_t mi = 0; mi < batch.size(); ++mi)batch[mi].nvdata->_fresh = false;
+
+	//pipelined: last step already started this step's tick. it's only good while nothing changes,
+	//so any change throws it away before host buffers or the device are touched
+	const bool pipelined = getPipelined() && consolv->supportsPipelining();
+	bool speculating = consolv->hasSpeculativeTick();
+	auto dropSpeculation = [&]() {
+		if (!speculating)return;
+		consolv->discardSpeculativeTick();
+		speculating = false;
+	};
+	if (!pipelined)dropSpeculation();
+
+
+	// Getting old geometry and shoving it into NvFlex buffers
+	// read locks stay until topology is built, springs and triangles of all members go into the same buffers
+	std::vector<std::unique_ptr<GU_DetailHandleAutoReadLock> > locks(batch.size());
+	bool particleschanged = false;
+	bool topochanged = false;
+	bool clusterschanged = false;
+
+	//objects that left the container (deleted, or cache members nobody claimed) give their particles back.
+	//springs, triangles and clusters of everyone are built again, so none of them points at a freed particle
+	{
+		std::vector<int> ids(batch.size());
+		std::vector<std::shared_ptr<NvFlexHIndexMap> > maps(batch.size());
+		for (size_t mi = 0; mi < batch.size(); ++mi) {
+			ids[mi] = batch[mi].obj->getObjectId();
+			maps[mi] = batch[mi].nvdata->_indexMap;
+		}
+		std::vector<std::shared_ptr<NvFlexHIndexMap> > released;
+		batch[0].nvdata->_members->update(ids, maps, released);
+		if (!released.empty()) {
+			NvFlexHProfiler::Scope scope(prof, NvFlexHProfiler::ePhaseIngest);
+			dropSpeculation();
+			for (size_t ri = 0; ri < released.size(); ++ri)released[ri]->resize(consolv.get(), 0);
+			particleschanged = topochanged = clusterschanged = true;
+		}
+	}
+	//as floats, the way layouts keep them, or they would never compare equal
+	const float clusterStiffness = getClusterStiffness();
+	const float plasticThreshold = getPlasticThreshold();
+	const float plasticCreep = getPlasticCreep();
+	const float tetStiffness = getTetStiffness();
+	const bool tetClusters = getTetClusters();
+	const float inflatablePressure = getInflatablePressure();
+	const float inflatableStiffness = getInflatableStiffness();
+	for (size_t mi = 0; mi < batch.size(); ++mi) {
+		SIM_NvFlexData* nvdata = batch[mi].nvdata;
+		const SIM_Geometry *geo = SIM_DATA_GETCONST(*batch[mi].obj, "Geometry", SIM_Geometry);
+		if (geo == NULL)continue;
+		locks[mi].reset(new GU_DetailHandleAutoReadLock(geo->getGeometry()));
+		if (!locks[mi]->isValid()) {
+			locks[mi].reset();
+			continue;
+		}
+		const GU_Detail *gdp = locks[mi]->getGdp();
+		NvFlexHDataIds ids;
+		ids.read(gdp);
+		NvFlexHDataIds& lastids = nvdata->_lastGdpIds;
+
+		NvFlexHParticleIngest ingest(gdp);
+		if (!ingest.isValid()) {
+			locks[mi].reset();
+			continue;
+		}
+		NvFlexHIndexMap* indexmap = nvdata->_indexMap.get();
+
+		//new or freed particles need everything uploaded. points over the particle limit are compared to what was asked for last time,
+		//so a capped object is not uploaded again every step, only when it changes or the container got room for more
+		const int numpts = (int)gdp->getNumPoints();
+		const bool capped = indexmap->size() < indexmap->requested();
+		const bool sizechanged = numpts != indexmap->requested() || (capped && consolv->activeCount() < consolv->maxParticles());
+		int channels = NvFlexHParticleIngest::eChannelAll;
+		if (!sizechanged) {
+			channels = 0;
+			if (ids.P != lastids.P)channels |= NvFlexHParticleIngest::eChannelPosition;
+			if (ids.v != lastids.v)channels |= NvFlexHParticleIngest::eChannelVelocity;
+			if (ids.phs != lastids.phs)channels |= NvFlexHParticleIngest::eChannelPhase;
+			if (ids.imass != lastids.imass)channels |= NvFlexHParticleIngest::eChannelMass;
+			if (ids.restP != lastids.restP)channels |= NvFlexHParticleIngest::eChannelRest;
+		}
+		topochanged = topochanged || sizechanged || ids.topology != lastids.topology || ids.restlength != lastids.restlength || ids.strength != lastids.strength || ids.N != lastids.N;
+		//packed prims follow clusters by primitive index, so topology only matters when they have clusters
+		clusterschanged = clusterschanged || sizechanged || ids.cluster != lastids.cluster || ids.primcluster != lastids.primcluster || ids.clusterstiffness != lastids.clusterstiffness
+			|| (ids.primcluster >= 0 && ids.topology != lastids.topology);
+		const NvFlexHClusterLayout& layout = nvdata->_clusters;
+		clusterschanged = clusterschanged || layout.stiffness != clusterStiffness || layout.threshold != plasticThreshold || layout.creep != plasticCreep;
+		//restP is the rest shape of soft bodies, it only matters when there are any. their topology is in ids.topology already
+		const NvFlexHSoftBodyCache& softbodies = *nvdata->_softBodies;
+		const bool hassoftbodies = softbodies.tetCount() > 0 || softbodies.inflatableCount() > 0;
+		topochanged = topochanged || ids.inflatable != lastids.inflatable || ids.pressure != lastids.pressure || (hassoftbodies && ids.restP != lastids.restP)
+			|| softbodies.tetStiffness != tetStiffness || softbodies.inflatablePressure != inflatablePressure || softbodies.inflatableStiffness != inflatableStiffness;
+		clusterschanged = clusterschanged || softbodies.tetClusters != tetClusters;
+
+		if (channels != 0) {
+			NvFlexHProfiler::Scope scope(prof, NvFlexHProfiler::ePhaseIngest);
+			dropSpeculation();
+			//container grows before anything is mapped, growing reallocates all buffers
+			const int newpts = sizechanged ? numpts - indexmap->size() : 0;
+			if (newpts > 0 && !consolv->reserve(consolv->activeCount() + newpts)) {
+				addError(batch[mi].obj, SIM_MESSAGE, "not enough room in the container, some points are not simulated. raise Maximum Particles Count", UT_ERROR_WARNING);
+				consolv->reserve(consolv->maxParticles());
 			}
+			//host buffers still hold what we pulled last step, so only changed channels need to be written there.
+			NvFlexHParticleData pdat = consolv->mapParticleData();
+
+			//alloc or free particles at the tail of the index map. already existing points keep their particles
+			int nactives = sizechanged ? indexmap->resize(consolv.get(), numpts) : indexmap->size();
+
+			ingest.transfer(pdat, indexmap->indices(), nactives, channels, getThreadedIngest());
+
+			consolv->unmapParticleData();
+			particleschanged = true;
 		}
+		lastids = ids;
+	}
 
-		
-		
-		
-		// Updating collision Geometry.
-		// TODO: kill/deactivate meshes that are no longer in relationships
+	if (particleschanged) {
+		NvFlexHProfiler::Scope scope(prof, NvFlexHProfiler::ePhasePush);
+		//Push particle data to device. since it's async - we need to do it as far from the solver tick as possible to use this time to do CPU work
+		consolv->pushParticlesToDevice(); //all particle channels go at once. collisions, springs and triangles we can push separately.
+		//Also note that as long as we don't call anything with nvFlexExtAssets - we are free to rebind springs manually.
+	}
+
+	if (topochanged) {//Create and Push SPRINGS, TRIANGLES and INFLATABLES, only if they or point count changed. one member changing rebuilds all of them
+		bool pushNormals = true;
 		{
-			NvFlexHCollisionData* colldata = consolv->collisionData();
-			colldata->mapall();
-			/*
-			colldata->addSphere("test");
-			colldata->getSphere("test").collgeo->radius = 1.0f;
-			colldata->getSphere("test").position->y = 1.0f;
-			colldata->getSphere("test").prevposition->y = 1.0f;
-			*/
-
-			//find collision relationships and build collisions
-			SIM_ConstObjectArray affs;
-			obj->getConstAffectors(affs, "SIM_RelationshipCollide");
-			for (exint afi = 0; afi < affs.entries(); ++afi) {
-				const SIM_Object* aff = affs(afi);
-				if (aff == obj)continue;
-				std::cout << aff->getName() << " : " << aff->getObjectId() << std::endl;
-				const SIM_Geometry*affgeo = SIM_DATA_GETCONST(*aff, SIM_GEOMETRY_DATANAME, SIM_Geometry);
-				if (affgeo == NULL)continue;
-
-				GU_DetailHandleAutoReadLock hlk(affgeo->getGeometry());
-				const GU_Detail *gdp = hlk.getGdp();
-				int64 pDataId=gdp->getP()->getDataId();
-
-				std::string objidname = std::to_string(aff->getObjectId());
-
-				if(pDataId != colldata->getStoredHash(objidname)){
-					std::cout << "updating mesh " << objidname << std::endl;
-					colldata->setStoredHash(objidname, pDataId);
-					colldata->addTriangleMesh(objidname);
-					NvfTrimeshGeo trigeo=colldata->getTriangleMesh(objidname);
-
-					NvFlexHTriangleMeshAutoMapper tmeshlock(trigeo.collgeo);
-
-
-					GA_Offset off;
-					tmeshlock.setVertexCount(gdp->getNumPoints());
-					Vec3* trigeop = tmeshlock.vertices();
-					float* trigeolw = tmeshlock.lower();
-					float* trigeoup = tmeshlock.upper();
-					trigeoup[0] = trigeoup[1] = trigeoup[2] = -FLT_MAX;
-					trigeolw[0] = trigeolw[1] = trigeolw [2] = FLT_MAX;
-					GA_FOR_ALL_PTOFF(gdp, off) {
-						UT_Vector3 p=gdp->getPos3(off);
-						Vec3* currtgp = trigeop + gdp->pointIndex(off);
-						currtgp->x = p.x();
-						currtgp->y = p.y();
-						currtgp->z = p.z();
-						trigeolw[0] = std::min(p.x(), trigeolw[0]);
-						trigeolw[1] = std::min(p.y(), trigeolw[1]);
-						trigeolw[2] = std::min(p.z(), trigeolw[2]);
-						trigeoup[0] = std::max(p.x(), trigeoup[0]);
-						trigeoup[1] = std::max(p.y(), trigeoup[1]);
-						trigeoup[2] = std::max(p.z(), trigeoup[2]);
-					}
+			NvFlexHProfiler::Scope scope(prof, NvFlexHProfiler::ePhaseIngest);
+			dropSpeculation();
+			std::vector<std::unique_ptr<NvFlexHTopologyBuilder> > topos(batch.size());
+			std::vector<std::unique_ptr<NvFlexHSoftBodyBuilder> > softs(batch.size());
+
+			//count first, so buffers are sized exactly once. without restlength/strength counts are 0 and buffers get emptied
+			int springcount = 0;
+			int trianglecount = 0;
+			int inflatabletris = 0;
+			int inflatablecount = 0;
+			for (size_t mi = 0; mi < batch.size(); ++mi) {
+				if (!locks[mi])continue;
+				const NvFlexHIndexMap* indexmap = batch[mi].nvdata->_indexMap.get();
+				topos[mi].reset(new NvFlexHTopologyBuilder(locks[mi]->getGdp(), indexmap->indices(), indexmap->size()));
+				topos[mi]->count();
+				springcount += topos[mi]->springCount();
+				trianglecount += topos[mi]->triangleCount();
+				//normals go for all triangles or none, members without them would get garbage
+				if (topos[mi]->triangleCount() > 0 && topos[mi]->normalType() == NvFlexHTopologyBuilder::eNormalNone)pushNormals = false;
+
+				//tets made again means their clusters are too
+				softs[mi].reset(new NvFlexHSoftBodyBuilder(locks[mi]->getGdp(), indexmap->indices(), indexmap->size()));
+				NvFlexHSoftBodyCache& cache = *batch[mi].nvdata->_softBodies;
+				if (softs[mi]->update(cache, batch[mi].nvdata->_lastGdpIds.restP))clusterschanged = true;
+				springcount += cache.springCount();
+				inflatabletris += cache.triangleCount();
+				inflatablecount += cache.inflatableCount();
+			}
+			consolv->resizeSpringData(springcount);
+			consolv->resizeTriangleData(trianglecount + inflatabletris);
+			consolv->resizeInflatableData(inflatablecount);
+
+			auto sprdat = consolv->mapSpringData();
+			auto tridat = consolv->mapTriangleData();
+			NvFlexHInflatableData infdat = consolv->mapInflatableData();
+			int springoffset = 0;
+			int triangleoffset = 0;
+			for (size_t mi = 0; mi < batch.size(); ++mi) {
+				if (!topos[mi])continue;
+				topos[mi]->build(sprdat.springIds + 2 * springoffset, sprdat.springRls + springoffset, sprdat.springSts + springoffset,
+					tridat.triangleIds + 3 * triangleoffset, tridat.triangleNms + 3 * triangleoffset);
+				springoffset += topos[mi]->springCount();
+				triangleoffset += topos[mi]->triangleCount();
+
+				const NvFlexHSoftBodyCache& cache = *batch[mi].nvdata->_softBodies;
+				softs[mi]->writeSprings(cache, tetStiffness, sprdat.springIds + 2 * springoffset, sprdat.springRls + springoffset, sprdat.springSts + springoffset);
+				springoffset += cache.springCount();
+			}
+			//inflatables go after all plain triangles, each is one range of them
+			int inflatableoffset = 0;
+			for (size_t mi = 0; mi < batch.size(); ++mi) {
+				if (!softs[mi])continue;
+				NvFlexHSoftBodyCache& cache = *batch[mi].nvdata->_softBodies;
+				softs[mi]->writeTriangles(cache, tridat.triangleIds + 3 * triangleoffset, tridat.triangleNms + 3 * triangleoffset);
+				softs[mi]->writeInflatables(cache, inflatablePressure, inflatableStiffness, triangleoffset, infdat, inflatableoffset);
+				triangleoffset += cache.triangleCount();
+				inflatableoffset += cache.inflatableCount();
+				cache.tetStiffness = tetStiffness;
+				cache.inflatablePressure = inflatablePressure;
+				cache.inflatableStiffness = inflatableStiffness;
+			}
+			consolv->unmapSpringData();
+			consolv->unmapTriangleData();
+			consolv->unmapInflatableData();
+		}
 
-					//now we need to calculate triangles
-					GA_Size tricount = 0;
-					for (GA_Iterator it(gdp->getPrimitiveRange()); !it.atEnd(); ++it) {
-						tricount += std::max(gdp->getPrimitiveVertexCount(*it) - 2, GA_Size(0));
-					}
-					tmeshlock.setTrianglesCount(tricount);
-					//now set triangles!
-					size_t i = 0;
-					int* trigeot = tmeshlock.triangles();
-					for (GA_Iterator it(gdp->getPrimitiveRange()); !it.atEnd(); ++it) {
-						GA_OffsetListRef pvlr=gdp->getPrimitiveVertexList(*it);
-						GA_Index sttidx = -1;
-						GA_Index prvidx = -1;
-						for (int vi = 0; vi < pvlr.entries(); ++vi) {
-							GA_Index idx = gdp->pointIndex(gdp->vertexPoint(pvlr(vi)));//gdp->vertexIndex(pvlr(vi));//
-							if (vi == 0)sttidx = idx;
-							else if (vi > 1) {
-								//invert order cuz houdini goes clockwise
-								trigeot[i++] = sttidx;
-								trigeot[i++] = idx;
-								trigeot[i++] = prvidx;
-							}
-							prvidx = idx;
-						}
-					}
+		NvFlexHProfiler::Scope scope(prof, NvFlexHProfiler::ePhasePush);
+		consolv->pushSpringsToDevice();
+		consolv->pushTrianglesToDevice(pushNormals);
+		consolv->pushInflatablesToDevice();
+	}//END SPRINGS, TRIANGLES AND INFLATABLES
 
+	if (clusterschanged) {//Create and Push RIGIDS, same as springs: one member changing rebuilds all of them
+		{
+			NvFlexHProfiler::Scope scope(prof, NvFlexHProfiler::ePhaseIngest);
+			dropSpeculation();
+			std::vector<std::unique_ptr<NvFlexHClusterBuilder> > builders(batch.size());
+			int rigidcount = 0;
+			int indexcount = 0;
+			for (size_t mi = 0; mi < batch.size(); ++mi) {
+				if (!locks[mi]) {
+					batch[mi].nvdata->_clusters = NvFlexHClusterLayout();
+					continue;
+				}
+				const NvFlexHIndexMap* indexmap = batch[mi].nvdata->_indexMap.get();
+				builders[mi].reset(new NvFlexHClusterBuilder(locks[mi]->getGdp(), indexmap->indices(), indexmap->size()));
+				builders[mi]->count();
+				rigidcount += builders[mi]->rigidCount();
+				indexcount += builders[mi]->indexCount();
+				if (tetClusters) {
+					const NvFlexHSoftBodyCache& cache = *batch[mi].nvdata->_softBodies;
+					rigidcount += cache.tetCount();
+					indexcount += 4 * cache.tetCount();
 				}
 			}
-
-			colldata->unmapall();
-			colldata->setCollisionData(consolv->solver());
+			consolv->resizeRigidData(rigidcount, indexcount);
+
+			NvFlexHRigidData rigdat = consolv->mapRigidData();
+			int rigidoffset = 0;
+			int indexoffset = 0;
+			for (size_t mi = 0; mi < batch.size(); ++mi) {
+				if (!builders[mi])continue;
+				builders[mi]->build(rigdat, rigidoffset, indexoffset, clusterStiffness, plasticThreshold, plasticCreep, batch[mi].nvdata->_clusters);
+				rigidoffset += builders[mi]->rigidCount();
+				indexoffset += builders[mi]->indexCount();
+
+				//tet clusters are not exported, so they go after the ones the layout knows about
+				NvFlexHSoftBodyCache& cache = *batch[mi].nvdata->_softBodies;
+				cache.tetClusters = tetClusters;
+				if (!tetClusters)continue;
+				NvFlexHSoftBodyBuilder soft(locks[mi]->getGdp(), batch[mi].nvdata->_indexMap->indices(), batch[mi].nvdata->_indexMap->size());
+				soft.writeClusters(cache, clusterStiffness, plasticThreshold, plasticCreep, rigdat, rigidoffset, indexoffset);
+				rigidoffset += cache.tetCount();
+				indexoffset += 4 * cache.tetCount();
+			}
+			consolv->unmapRigidData();
 		}
 
+		NvFlexHProfiler::Scope scope(prof, NvFlexHProfiler::ePhasePush);
+		consolv->pushRigidsToDevice();
+	}//END RIGIDS
+	locks.clear();
+
+
+	// Updating collision Geometry.
+	// colliders not visited this step left collision relationships (or lost geometry) and get removed at the end
+	{
+		NvFlexHProfiler::Scope scope(prof, NvFlexHProfiler::ePhaseCollision);
+		NvFlexHCollisionData* colldata = consolv->collisionData();
+		colldata->markAllStale();
+		std::unordered_set<int> visited;
+		for (size_t mi = 0; mi < batch.size(); ++mi)updateColliders(batch[mi].obj, colldata, batch, visited);
+		colldata->removeStale();
+	}
 
-		nvparams.numIterations = getIterations();
-		int substeps = getSubsteps();
-		updateSolverParams();
-		//Find and apply gravity
-		{
-			SIM_ConstDataArray gravities;
-			obj->filterConstSubData(gravities, 0, SIM_DataFilterByType("SIM_ForceGravity"), SIM_FORCES_DATANAME, SIM_DataFilterNone());
-			for (exint i = 0; i < gravities.entries(); ++i) {
-				const SIM_ForceGravity* force = SIM_DATA_CASTCONST(gravities(i), SIM_ForceGravity);
-				if (force == NULL)continue;
-				UT_Vector3 outForce, outTorque;
-				force->getForce(*obj, UT_Vector3(), UT_Vector3(), UT_Vector3(), 1.0f, outForce,outTorque);
-
-				nvparams.gravity[0] += outForce.x();
-				nvparams.gravity[1] += outForce.y();
-				nvparams.gravity[2] += outForce.z();
-			}
+
+	SIM_Object* obj = batch[0].obj;
+	nvparams.numIterations = getIterations();
+	int substeps = getSubsteps();
+	updateSolverParams();
+	//Find and apply gravity. params are per solver, so a batch takes gravity of its first object
+	{
+		SIM_ConstDataArray gravities;
+		obj->filterConstSubData(gravities, 0, SIM_DataFilterByType("SIM_ForceGravity"), SIM_FORCES_DATANAME, SIM_DataFilterNone());
+		for (exint i = 0; i < gravities.entries(); ++i) {
+			const SIM_ForceGravity* force = SIM_DATA_CASTCONST(gravities(i), SIM_ForceGravity);
+			if (force == NULL)continue;
+			UT_Vector3 outForce, outTorque;
+			force->getForce(*obj, UT_Vector3(), UT_Vector3(), UT_Vector3(), 1.0f, outForce,outTorque);
+
+			nvparams.gravity[0] += outForce.x();
+			nvparams.gravity[1] += outForce.y();
+			nvparams.gravity[2] += outForce.z();
+		}
+	}
+	//a collider that moved this step will likely move on the next one too, the speculative tick would be thrown away
+	bool collidersmoved = false;
+	{
+		NvFlexHProfiler::Scope scope(prof, NvFlexHProfiler::ePhasePush);
+		//static colliders are not sent again every step
+		if (consolv->collisionData()->changedSincePush()) {
+			collidersmoved = true;
+			dropSpeculation();
+			consolv->pushShapesToDevice();
 		}
-		NvFlexSetParams(consolv->solver(), &nvparams);
+		if (speculating && !consolv->speculationMatches(timestep, substeps, nvparams))dropSpeculation();
+		if (!speculating)consolv->setParams(nvparams);
+	}
+
+	const bool ticked = !speculating;
+	{
+		NvFlexHProfiler::Scope scope(prof, NvFlexHProfiler::ePhaseTick);
+		if (speculating)consolv->acceptSpeculativeTick();
+		else consolv->tick(timestep, substeps, getProfileDevice());
+	}
+	//speculative ticks run without timers
+	if (getProfileDevice() && ticked)consolv->readTimers(prof);
+
+	const bool pullSmooth = nvparams.smoothing > 0.0f;
+	const bool pullAnisotropy = nvparams.anisotropyScale > 0.0f;
+	const bool pullDensities = getExportDensity();
+	const bool pullContacts = getExportContacts();
+	//clusters can't be speculated, their transforms only live on device. staging alone gives no overlap, plain pull is cheaper
+	const bool staged = pipelined && !collidersmoved && consolv->getRigidsCount() == 0;
+	NvFlexHParticleData pdat;	//mapping
+	{
+		NvFlexHProfiler::Scope scope(prof, NvFlexHProfiler::ePhasePull);
+		consolv->setSurfacePull(pullSmooth, pullAnisotropy);
+		consolv->setContactPull(pullDensities, pullContacts);
+		if (staged) {
+			//mapping host buffers for the cache would wait for the speculative tick, so the staged copy carries rest too
+			consolv->setStagedRestPull(getCacheWrite());
+			consolv->pullAndSpeculate(timestep, substeps);
+			//map waits for the staged copy, so pull time close to tick time means it waited for the speculative tick too
+			pdat = consolv->mapStagedParticleData();
+		}
+		else {
+			consolv->pullParticlesFromDevice();
+			pdat = consolv->mapParticleData();
+		}
+	}
 
-		NvFlexExtTickContainer(consolv->container(), timestep, substeps, false);
 
-		NvFlexExtPullFromDevice(consolv->container());
+	// write locks stay until profile attributes are written, export time of all members goes there too
+	std::vector<std::unique_ptr<GU_DetailHandleAutoWriteLock> > outlocks(batch.size());
+	{
+		NvFlexHProfiler::Scope scope(prof, NvFlexHProfiler::ePhaseExport);
+		exportBatch(batch, pdat, outlocks);
+		if (pullSmooth || pullAnisotropy) {
+			NvFlexHSurfaceData sdat = consolv->mapSurfaceData();
+			exportSurface(batch, sdat, outlocks);
+			consolv->unmapSurfaceData();
+		}
+		if (pullDensities || pullContacts) {
+			NvFlexHContactData cdat = consolv->mapContactData();
+			exportContacts(batch, cdat, outlocks);
+			consolv->unmapContactData();
+		}
+		if (consolv->getRigidsCount() > 0) {
+			NvFlexHRigidTransforms tdat = consolv->mapRigidTransforms();
+			exportClusters(batch, tdat, outlocks);
+			consolv->unmapRigidTransforms();
+		}
+		if (getCacheWrite()) {
+			writeCache(batch, consolv.get(), pdat, cachePath);
+		}
+		if (staged)consolv->unmapStagedParticleData();
+		else consolv->unmapParticleData();//unmapping
+		//container wide, so the first member carries them
+		if (consolv->maxDiffuseParticles() > 0)exportDiffuse(batch[0].obj, consolv.get());
+	}
 
+	for (size_t mi = 0; mi < batch.size(); ++mi) {
+		if (outlocks[mi])writeProfileAttributes(outlocks[mi]->getGdp(), prof);
+		if (getProfileData())writeProfileData(batch[mi].obj, prof);
+	}
+}
 
-		SIM_GeometryCopy *newgeo=SIM_DATA_CREATE(*obj, "Geometry", SIM_GeometryCopy, SIM_DATA_RETURN_EXISTING | SIM_DATA_ADOPT_EXISTING_ON_DELETE);
+void SIM_NvFlexSolver::exportBatch(const std::vector<BatchMember>& batch, const NvFlexHParticleData& pdat, std::vector<std::unique_ptr<GU_DetailHandleAutoWriteLock> >& outlocks) {
+	for (size_t mi = 0; mi < batch.size(); ++mi) {
+		SIM_NvFlexData* nvdata = batch[mi].nvdata;
+		SIM_GeometryCopy *newgeo = SIM_DATA_CREATE(*batch[mi].obj, "Geometry", SIM_GeometryCopy, SIM_DATA_RETURN_EXISTING | SIM_DATA_ADOPT_EXISTING_ON_DELETE);
 		if (newgeo == NULL)continue;//TODO: show error;
-		GU_DetailHandleAutoWriteLock lock(newgeo->getOwnGeometry());
-		if (lock.isValid()) {
-			GU_Detail *dgp = lock.getGdp();
-
-			int* iindex = nvdata->_indices.get(); //TODO: indices dont change - if we got them before solve - keep them!
-			int nactives = NvFlexExtGetActiveList(consolv->container(), iindex); //HERE I REEEEALLY HOPE nooe accesses it right now
-			
-			const bool recreateGeo = nactives != dgp->getNumPoints(); //This basically should never happen with current workflow
-
-			if(recreateGeo)dgp->stashAll();
-
-			//GA_RWAttributeRef vatt = dgp->findPointAttribute("v");//
-			GA_RWAttributeRef vatt = dgp->findFloatTuple(GA_ATTRIB_POINT, "v", 3, 3);
-			if (!vatt.isValid()) {
-				vatt = dgp->addFloatTuple(GA_ATTRIB_POINT, "v", 3, GA_Defaults(0));
-				vatt.setTypeInfo(GA_TYPE_VECTOR);
-			}
-			//GA_RWAttributeRef iidatt = dgp->findPointAttribute("iid");
-			GA_RWAttributeRef iidatt = dgp->findIntTuple(GA_ATTRIB_POINT, "iid", 1, 1);
-			if (!iidatt.isValid()) {
-				iidatt = dgp->addIntTuple(GA_ATTRIB_POINT, "iid", 1, GA_Defaults(-1));
-			}
-			//GA_RWAttributeRef phsatt = dgp->findPointAttribute("phs");
-			GA_RWAttributeRef phsatt = dgp->findIntTuple(GA_ATTRIB_POINT, "phs", 1, 1);
-			if (!phsatt.isValid()) {
-				phsatt = dgp->addIntTuple(GA_ATTRIB_POINT, "phs", 1, GA_Defaults(0));
-			}
-			GA_RWHandleV3 vhd(vatt);
-			GA_RWHandleI iidhd(iidatt);
-			GA_RWHandleI phshd(phsatt);
-
-			
-			NvFlexExtParticleData pdat = NvFlexExtMapParticleData(consolv->container());	//mapping
-			
-			// get indices and go through active indices!
-			if(recreateGeo)GA_Offset off = dgp->appendPointBlock(nactives);
-
-			GA_Offset ostt, oend;
-			for (GA_Iterator oit(dgp->getPointRange()); oit.blockAdvance(ostt, oend);) { //TODO: make it threaded after debugged
-				for (GA_Offset curroff = ostt; curroff < oend; ++curroff) {
-					UT_Vector3 pp;
-					int ii = iindex[dgp->pointIndex(curroff)];
-					pp.assign(pdat.particles[ii * 4 + 0], pdat.particles[ii * 4 + 1], pdat.particles[ii * 4 + 2]);
-					dgp->setPos3(curroff, pp);
-					pp.assign(pdat.velocities[ii * 3 + 0], pdat.velocities[ii * 3 + 1], pdat.velocities[ii * 3 + 2]);
-					vhd.set(curroff, pp);
-					iidhd.set(curroff, ii);
-					phshd.set(curroff, pdat.phases[ii]);
+		outlocks[mi].reset(new GU_DetailHandleAutoWriteLock(newgeo->getOwnGeometry()));
+		if (!outlocks[mi]->isValid()) {
+			outlocks[mi].reset();
+			continue;
+		}
+		GU_Detail *dgp = outlocks[mi]->getGdp();
+
+		//indices dont change during the tick, so the map is still valid here
+		const int* iindex = nvdata->_indexMap->indices();
+		int nactives = nvdata->_indexMap->size();
+
+		//a capped object has fewer particles than points. only the points past the cap go, so springs, triangles,
+		//packed and tet prims on the ones that stay are kept for the next ingest
+		NvFlexHParticleExport exporter(dgp);
+		const bool resized = exporter.fitPointCount(nactives);
+		exporter.transfer(pdat, iindex, nactives);
+
+		if (resized)dgp->getAttributes().bumpAllDataIds(GA_ATTRIB_POINT);
+		else exporter.bumpDataIds(); //only what we've written, so imass, restP etc. are not reuploaded next step
+		//detail attributes don't matter for ingest, so it's fine they come after the ids are read
+		nvdata->_lastGdpIds.read(dgp); //host buffers now match this geometry
+	}
+}
+
+void SIM_NvFlexSolver::exportSurface(const std::vector<BatchMember>& batch, const NvFlexHSurfaceData& sdat, std::vector<std::unique_ptr<GU_DetailHandleAutoWriteLock> >& outlocks) {
+	if (sdat.smoothParticles == NULL && sdat.anisotropy[0] == NULL)return; //backend has none
+	for (size_t mi = 0; mi < batch.size(); ++mi) {
+		if (!outlocks[mi])continue;
+		const NvFlexHIndexMap* indexmap = batch[mi].nvdata->_indexMap.get();
+		NvFlexHSurfaceExport exporter(outlocks[mi]->getGdp(), sdat);
+		exporter.transfer(indexmap->indices(), indexmap->size());
+		exporter.bumpDataIds();
+	}
+}
+
+void SIM_NvFlexSolver::exportContacts(const std::vector<BatchMember>& batch, const NvFlexHContactData& cdat, std::vector<std::unique_ptr<GU_DetailHandleAutoWriteLock> >& outlocks) {
+	if (cdat.densities == NULL && cdat.planes == NULL)return; //backend has none
+	for (size_t mi = 0; mi < batch.size(); ++mi) {
+		if (!outlocks[mi])continue;
+		const NvFlexHIndexMap* indexmap = batch[mi].nvdata->_indexMap.get();
+		NvFlexHContactExport exporter(outlocks[mi]->getGdp(), cdat);
+		exporter.transfer(indexmap->indices(), indexmap->size());
+		exporter.bumpDataIds();
+	}
+}
+
+void SIM_NvFlexSolver::exportClusters(const std::vector<BatchMember>& batch, const NvFlexHRigidTransforms& tdat, std::vector<std::unique_ptr<GU_DetailHandleAutoWriteLock> >& outlocks) {
+	if (tdat.count == 0)return;
+	for (size_t mi = 0; mi < batch.size(); ++mi) {
+		SIM_NvFlexData* nvdata = batch[mi].nvdata;
+		if (!outlocks[mi] || nvdata->_clusters.rigidCount == 0)continue;
+		GU_Detail* gdp = outlocks[mi]->getGdp();
+		NvFlexHClusterExport exporter(gdp, nvdata->_clusters, tdat);
+		exporter.transfer();
+		exporter.bumpDataIds();
+		//packed points and transforms follow the particles, that's not a change ingest has to upload next step
+		nvdata->_lastGdpIds.read(gdp);
+	}
+}
+
+void SIM_NvFlexSolver::exportDiffuse(SIM_Object* obj, NvFlexHContainer* cont) {
+	SIM_GeometryCopy *geo = SIM_DATA_CREATE(*obj, "DiffuseGeometry", SIM_GeometryCopy, SIM_DATA_RETURN_EXISTING | SIM_DATA_ADOPT_EXISTING_ON_DELETE);
+	if (geo == NULL)return;
+	GU_DetailHandleAutoWriteLock lock(geo->getOwnGeometry());
+	if (!lock.isValid())return;
+	NvFlexHDiffuseExport exporter(lock.getGdp());
+	NvFlexHDiffuseData ddat = cont->mapDiffuseData();
+	exporter.transfer(ddat);
+	cont->unmapDiffuseData();
+}
+
+void SIM_NvFlexSolver::writeCache(const std::vector<BatchMember>& batch, NvFlexHContainer* cont, const NvFlexHParticleData& pdat, const std::string& path) {
+	std::vector<NvFlexHStateCache::Member> members(batch.size());
+	for (size_t mi = 0; mi < batch.size(); ++mi) {
+		members[mi].objectid = batch[mi].obj->getObjectId();
+		members[mi].indices = batch[mi].nvdata->_indexMap->indices();
+		members[mi].count = batch[mi].nvdata->_indexMap->size();
+	}
+	//default path is in a folder of its own, nothing else makes it
+	UT_String dir, file;
+	UT_String(path.c_str()).splitPath(dir, file);
+	if (dir.isstring())UT_FileUtil::makeDirs(dir);
+	std::string error;
+	if (!NvFlexHStateCache::write(path.c_str(), cont, pdat, members, cont->hasTriangleNormals(), error))addError(batch[0].obj, SIM_MESSAGE, error.c_str(), UT_ERROR_WARNING);
+}
+
+bool SIM_NvFlexSolver::resumeBatch(const std::vector<BatchMember>& batch, NvFlexHContainer* cont, const std::string& path) {
+	NvFlexHStateCache cache(path.c_str());
+	std::vector<NvFlexHStateCache::RestoredMember> restored;
+	std::string error;
+	if (!cache.restore(cont, restored, error)) {
+		addError(batch[0].obj, SIM_MESSAGE, error.c_str(), UT_ERROR_WARNING);
+		return false;
+	}
+	//members find their particles by object id, objects not in the cache start empty
+	std::vector<bool> claimed(restored.size(), false);
+	for (size_t mi = 0; mi < batch.size(); ++mi) {
+		NvFlexHIndexMap* indexmap = batch[mi].nvdata->_indexMap.get();
+		indexmap->assign(NULL, 0);
+		for (size_t ri = 0; ri < restored.size(); ++ri) {
+			if (restored[ri].objectid != batch[mi].obj->getObjectId())continue;
+			indexmap->assign(restored[ri].indices.data(), int(restored[ri].indices.size()));
+			claimed[ri] = true;
+		}
+	}
+	//restore freed whatever members had before. cached objects that don't exist anymore become members
+	//of their own, so solveBatch frees their particles like those of any object that left
+	NvFlexHMemberMaps* containerMembers = batch[0].nvdata->_members.get();
+	containerMembers->clear();
+	for (size_t ri = 0; ri < restored.size(); ++ri) {
+		if (claimed[ri])continue;
+		std::shared_ptr<NvFlexHIndexMap> orphan(new NvFlexHIndexMap(cont->maxParticles()));
+		orphan->assign(restored[ri].indices.data(), int(restored[ri].indices.size()));
+		containerMembers->add(restored[ri].objectid, orphan);
+	}
+
+	//geometry gets the cached state right away, so ingest of this step sees nothing new and does not overwrite it
+	std::vector<std::unique_ptr<GU_DetailHandleAutoWriteLock> > locks(batch.size());
+	NvFlexHParticleData pdat = cont->mapParticleData();
+	exportBatch(batch, pdat, locks);
+	cont->unmapParticleData();
+	//clusters are not in the cache, they are built again from the resumed geometry
+	for (size_t mi = 0; mi < batch.size(); ++mi)batch[mi].nvdata->_clusters = NvFlexHClusterLayout();
+	return true;
+}
+
+void SIM_NvFlexSolver::updateColliders(const SIM_Object* obj, NvFlexHCollisionData* colldata, const std::vector<BatchMember>& batch, std::unordered_set<int>& visited) {
+	//find collision relationships and build collisions
+	SIM_ConstObjectArray affs;
+	obj->getConstAffectors(affs, "SIM_RelationshipCollide");
+	for (exint afi = 0; afi < affs.entries(); ++afi) {
+		const SIM_Object* aff = affs(afi);
+		//members of the batch meet as particles, not as colliders
+		bool member = false;
+		for (size_t mi = 0; mi < batch.size() && !member; ++mi)member = batch[mi].obj == aff;
+		if (member)continue;
+		//collider shared by several members is placed once, second placement would wipe its previous transform
+		if (!visited.insert(aff->getObjectId()).second)continue;
+		NvFlexHColliderSource collsrc(aff);
+		if (!collsrc.isValid())continue;
+		const GU_Detail *gdp = collsrc.detail();
+		int64 pDataId = collsrc.pointsDataId();
+		int64 topoDataId = collsrc.topologyDataId();
+
+		const int objid = aff->getObjectId();
+		NvFlexHColliderShapes::Type shapetype = NvFlexHColliderShapes::readType(gdp);
+
+		Vec4 position;
+		Quat rotation;
+		float scale[3];
+
+		if (shapetype != NvFlexHColliderShapes::eTypeMesh) {
+			//shape i of the object goes under key (objid, i), acquire replaces items of other type, like a mesh from before
+			NvFlexHColliderShapes shapes(gdp, shapetype);
+			const std::vector<NvFlexHColliderShapes::Shape>& locals = shapes.shapes();
+			colldata->removeIndexedItems(objid, int(locals.size()));
+
+			for (size_t si = 0; si < locals.size(); ++si) {
+				const NvFlexHColliderShapes::Shape& shp = locals[si];
+				bool isnew;
+				int hnd = colldata->acquire(NvFlexHCollisionData::makeKey(objid, int(si)), shapes.flexType(), isnew);
+				collsrc.shapeTransform(shp.center, shp.rotation, position, rotation, scale);
+
+				switch (shapetype) {
+				case NvFlexHColliderShapes::eTypeSphere: {
+					NvfSphereGeo geo = colldata->getSphere(hnd);
+					geo.collgeo->radius = shp.params[0] * std::max(scale[0], std::max(scale[1], scale[2]));
+					placeShape(geo, isnew, position, rotation);
+					break;
+				}
+				case NvFlexHColliderShapes::eTypeCapsule: {
+					NvfCapsuleGeo geo = colldata->getCapsule(hnd);
+					geo.collgeo->radius = shp.params[0] * std::max(scale[1], scale[2]);
+					geo.collgeo->halfHeight = shp.params[1] * scale[0];
+					placeShape(geo, isnew, position, rotation);
+					break;
+				}
+				case NvFlexHColliderShapes::eTypeBox: {
+					NvfBoxGeo geo = colldata->getBox(hnd);
+					for (int i = 0; i < 3; ++i)geo.collgeo->halfExtents[i] = shp.params[i] * scale[i];
+					placeShape(geo, isnew, position, rotation);
+					break;
+				}
+				case NvFlexHColliderShapes::eTypeConvex: {
+					NvfConvexGeo geo = colldata->getConvexMesh(hnd);
+					colldata->setMeshScale(hnd, scale);
+					placeShape(geo, isnew, position, rotation);
+					if (shapes.contentHash() != colldata->getStoredHash(hnd)) {
+						shapes.buildConvex(*geo.collgeo);
+						colldata->setStoredHash(hnd, shapes.contentHash());
+					}
+					break;
+				}
+				case NvFlexHColliderShapes::eTypeSDF: {
+					NvfSdfGeo geo = colldata->getSDF(hnd);
+					float sdfscale = shapes.sdfEdge() * scale[0];
+					colldata->setMeshScale(hnd, &sdfscale);
+					placeShape(geo, isnew, position, rotation);
+					if (shapes.contentHash() != colldata->getStoredHash(hnd)) {
+						shapes.buildSDF(*geo.collgeo);
+						colldata->setStoredHash(hnd, shapes.contentHash());
+					}
+					break;
+				}
+				default:
+					break;
 				}
 			}
-			NvFlexExtUnmapParticleData(consolv->container());//unmapping
-
-			if(recreateGeo)dgp->destroyStashed();
-			dgp->getAttributes().bumpAllDataIds(GA_ATTRIB_POINT);
-			nvdata->_lastGdpPId = dgp->getP()->getDataId(); //TODO: shit, we cannot save it on solver! save it on data!
+			continue;
 		}
 
-		
+		colldata->removeIndexedItems(objid, 1);
+		bool isnew;
+		int hnd = colldata->acquire(NvFlexHCollisionData::makeKey(objid, 0), eNvFlexShapeTriangleMesh, isnew);
+		NvfTrimeshGeo trigeo = colldata->getTriangleMesh(hnd);
+
+		//mesh stays in local space, rigid motion only updates shape transform
+		collsrc.shapeTransform(position, rotation, scale);
+		placeShape(trigeo, isnew, position, rotation);
+		colldata->setMeshScale(hnd, scale);
+
+		const int64 storedTopoDataId = colldata->getStoredTopologyHash(hnd);
+		if(pDataId != colldata->getStoredHash(hnd) || topoDataId != storedTopoDataId){
+			NvFlexHCollisionMeshConverter converter(gdp);
+
+			//triangles only depend on topology and point count, deforming colliders keep the ones already in the backend
+			const int vertcount = int(gdp->getNumPoints());
+			const bool rebuildTriangles = isnew || topoDataId != storedTopoDataId || trigeo.collgeo->vertexCount() != vertcount;
+			std::unique_ptr<NvFlexHTriangleMeshAutoMapper> tmeshlock(rebuildTriangles
+				? new NvFlexHTriangleMeshAutoMapper(trigeo.collgeo, vertcount, int(converter.countTriangles()))
+				: new NvFlexHTriangleMeshAutoMapper(trigeo.collgeo, vertcount));
+			converter.convertPoints(tmeshlock->vertices(), tmeshlock->lower(), tmeshlock->upper());
+			if (rebuildTriangles)converter.convertTriangles(tmeshlock->triangles());
+
+			colldata->setStoredHash(hnd, pDataId);
+			colldata->setStoredTopologyHash(hnd, topoDataId);
+		}
 	}
-
-	return SIM_SOLVER_SUCCESS;
 }
 
 void SIM_NvFlexSolver::initializeSubclass()
 {
 	SIM_Solver::initializeSubclass();
-	//if(SIM_NvFlexData::nvFlexLibrary == NULL)SIM_NvFlexData::nvFlexLibrary=NvFlexInit();
 	
 	//if(!nvparams)nvparams.reset(new NvFlexParams); //we don't need to reset it every every time i guess
 	
@@ -445,10 +798,10 @@ void SIM_NvFlexSolver::updateSolverParams() {
 	(Vec4&)nvparams.planes[4] = Vec4(0.0f, 0.0f, -1.0f, 4);
 	//(Vec4&)nvparams->planes[5] = Vec4(0.0f, -1.0f, 0.0f, g_sceneUpper.y);
 
-	nvparams.anisotropyScale = 0.0f;
-	nvparams.anisotropyMin = 0.1f;
-	nvparams.anisotropyMax = 2.0f;
-	nvparams.smoothing = 0.0f;
+	nvparams.anisotropyScale = getAnisotropyScale();
+	nvparams.anisotropyMin = getAnisotropyMin();
+	nvparams.anisotropyMax = getAnisotropyMax();
+	nvparams.smoothing = getSmoothing();
 
 	nvparams.shapeCollisionMargin = getShapeCollisionMargin();
 	nvparams.particleCollisionMargin = getParticleCollisionMargin();
@@ -462,6 +815,12 @@ void SIM_NvFlexSolver::updateSolverParams() {
 	nvparams.surfaceTension = getSurfaceTension();
 	nvparams.vorticityConfinement = getVorticityConfinement();// 0.0f;
 	nvparams.buoyancy = getBuoyancy();// 1.0f;
+
+	nvparams.diffuseThreshold = getDiffuseThreshold();
+	nvparams.diffuseBuoyancy = getDiffuseBuoyancy();
+	nvparams.diffuseDrag = getDiffuseDrag();
+	nvparams.diffuseBallistic = getDiffuseBallistic();
+	nvparams.diffuseLifetime = getDiffuseLifetime();
 }
 
 void SIM_NvFlexSolver::makeEqualSubclass(const SIM_Data * source)
@@ -506,6 +865,38 @@ const SIM_DopDescription* SIM_NvFlexSolver::getDescriptionForFucktory() {
 	static PRM_Name shapeCollisionMargin_name("shapeCollisionMargin", "Shape Collision Margin");
 	static PRM_Name particleCollisionMargin_name("particleCollisionMargin", "Particle Collision Margin");
 	static PRM_Name collisionDistance_name("collisionDistance", "Collision Distance");
+
+	static PRM_Name smoothing_name("smoothing", "Smoothing");
+	static PRM_Name anisotropyScale_name("anisotropyScale", "Anisotropy Scale");
+	static PRM_Name anisotropyMin_name("anisotropyMin", "Anisotropy Min");
+	static PRM_Name anisotropyMax_name("anisotropyMax", "Anisotropy Max");
+
+	static PRM_Name clusterStiffness_name("clusterStiffness", "Cluster Stiffness");
+	static PRM_Name plasticThreshold_name("plasticThreshold", "Plastic Threshold");
+	static PRM_Name plasticCreep_name("plasticCreep", "Plastic Creep");
+	static PRM_Name tetStiffness_name("tetStiffness", "Tet Stiffness");
+	static PRM_Name tetClusters_name("tetClusters", "Tet Clusters");
+	static PRM_Name inflatablePressure_name("inflatablePressure", "Inflatable Pressure");
+	static PRM_Name inflatableStiffness_name("inflatableStiffness", "Inflatable Stiffness");
+
+	static PRM_Name exportDensity_name("exportDensity", "Export Density");
+	static PRM_Name exportContacts_name("exportContacts", "Export Contacts");
+
+	static PRM_Name diffuseThreshold_name("diffuseThreshold", "Diffuse Threshold");
+	static PRM_Name diffuseBuoyancy_name("diffuseBuoyancy", "Diffuse Buoyancy");
+	static PRM_Name diffuseDrag_name("diffuseDrag", "Diffuse Drag");
+	static PRM_Name diffuseBallistic_name("diffuseBallistic", "Diffuse Ballistic Neighbours");
+	static PRM_Name diffuseLifetime_name("diffuseLifetime", "Diffuse Lifetime");
+
+	static PRM_Name threadedIngest_name("threadedIngest", "Threaded Particle Ingest");
+	static PRM_Name pipelined_name("pipelined", "Pipelined");
+	static PRM_Name batchObjects_name("batchObjects", "Batch Objects");
+	static PRM_Name cacheWrite_name("cacheWrite", "Write State Cache");
+	static PRM_Name cacheFile_name("cacheFile", "State Cache File");
+	static PRM_Name cacheResume_name("cacheResume", "Resume From State Cache");
+	static PRM_Name resumeFile_name("resumeFile", "Resume File");
+	static PRM_Name profileDevice_name("profileDevice", "Device Timers");
+	static PRM_Name profileData_name("profileData", "Profile Data");
 	
 
 	static PRM_Default radius_default(0.1f);
@@ -531,7 +922,23 @@ const SIM_DopDescription* SIM_NvFlexSolver::getDescriptionForFucktory() {
 	static PRM_Default particleCollisionMargin_defaults(0.0f);
 	static PRM_Default collisionDistance_defaults(0.0275f);
 
+	static PRM_Default clusterStiffness_default(1.0f);
+	static PRM_Default tetStiffness_default(1.0f);
+	static PRM_Default inflatablePressure_default(1.0f);
+	static PRM_Default inflatableStiffness_default(1.0f);
+
+	static PRM_Default anisotropyMin_default(0.1f);
+	static PRM_Default anisotropyMax_default(2.0f);
+
+	static PRM_Default diffuseThreshold_default(100.0f);
+	static PRM_Default diffuseBuoyancy_default(1.0f);
+	static PRM_Default diffuseDrag_default(0.8f);
+	static PRM_Default diffuseBallistic_default(16);
+	static PRM_Default diffuseLifetime_default(2.0f);
+
 	static PRM_Default zero_defaults(0.0f);
+	static PRM_Default true_defaults(1);
+	static PRM_Default cacheFile_default(0, "$HIP/nvflex/$OS.$SF4.nvfstate");
 
 	static PRM_Range iterations_range(PRM_RANGE_RESTRICTED, 1, PRM_RANGE_UI, 16);
 	static PRM_Range substeps_range(PRM_RANGE_RESTRICTED, 1, PRM_RANGE_UI, 16);
@@ -547,6 +954,11 @@ const SIM_DopDescription* SIM_NvFlexSolver::getDescriptionForFucktory() {
 	static PRM_Name sep1("sep1", "sep1");
 	static PRM_Name sep2("sep2", "sep2");
 	static PRM_Name sep3("sep3", "sep3");
+	static PRM_Name sep4("sep4", "sep4");
+	static PRM_Name sep5("sep5", "sep5");
+	static PRM_Name sep6("sep6", "sep6");
+	static PRM_Name sep7("sep7", "sep7");
+	static PRM_Name sep8("sep8", "sep8");
 	//endseps
 
 	static PRM_Template prms[] = {
@@ -577,6 +989,38 @@ const SIM_DopDescription* SIM_NvFlexSolver::getDescriptionForFucktory() {
 		PRM_Template(PRM_FLT, 1, &shapeCollisionMargin_name, &shapeCollisionMargin_defaults),
 		PRM_Template(PRM_FLT, 1, &particleCollisionMargin_name, &particleCollisionMargin_defaults),
 		PRM_Template(PRM_FLT, 1, &collisionDistance_name, &collisionDistance_defaults),
+		PRM_Template(PRM_SEPARATOR, 1, &sep8),
+		PRM_Template(PRM_FLT, 1, &clusterStiffness_name, &clusterStiffness_default, 0, &zeroOne_range),
+		PRM_Template(PRM_FLT, 1, &plasticThreshold_name, &zero_defaults),
+		PRM_Template(PRM_FLT, 1, &plasticCreep_name, &zero_defaults, 0, &zeroOne_range),
+		PRM_Template(PRM_FLT, 1, &tetStiffness_name, &tetStiffness_default, 0, &zeroOne_range),
+		PRM_Template(PRM_TOGGLE, 1, &tetClusters_name, &true_defaults),
+		PRM_Template(PRM_FLT, 1, &inflatablePressure_name, &inflatablePressure_default),
+		PRM_Template(PRM_FLT, 1, &inflatableStiffness_name, &inflatableStiffness_default, 0, &zeroOne_range),
+		PRM_Template(PRM_SEPARATOR, 1, &sep7),
+		PRM_Template(PRM_FLT, 1, &smoothing_name, &zero_defaults, 0, &zeroOne_range),
+		PRM_Template(PRM_FLT, 1, &anisotropyScale_name, &zero_defaults),
+		PRM_Template(PRM_FLT, 1, &anisotropyMin_name, &anisotropyMin_default),
+		PRM_Template(PRM_FLT, 1, &anisotropyMax_name, &anisotropyMax_default),
+		PRM_Template(PRM_TOGGLE, 1, &exportDensity_name, &zero_defaults),
+		PRM_Template(PRM_TOGGLE, 1, &exportContacts_name, &zero_defaults),
+		PRM_Template(PRM_SEPARATOR, 1, &sep6),
+		PRM_Template(PRM_FLT, 1, &diffuseThreshold_name, &diffuseThreshold_default),
+		PRM_Template(PRM_FLT, 1, &diffuseBuoyancy_name, &diffuseBuoyancy_default),
+		PRM_Template(PRM_FLT, 1, &diffuseDrag_name, &diffuseDrag_default, 0, &zeroOne_range),
+		PRM_Template(PRM_INT, 1, &diffuseBallistic_name, &diffuseBallistic_default),
+		PRM_Template(PRM_FLT, 1, &diffuseLifetime_name, &diffuseLifetime_default),
+		PRM_Template(PRM_SEPARATOR, 1, &sep4),
+		PRM_Template(PRM_TOGGLE, 1, &threadedIngest_name, &true_defaults),
+		PRM_Template(PRM_TOGGLE, 1, &pipelined_name, &zero_defaults),
+		PRM_Template(PRM_TOGGLE, 1, &batchObjects_name, &zero_defaults),
+		PRM_Template(PRM_SEPARATOR, 1, &sep5),
+		PRM_Template(PRM_TOGGLE, 1, &cacheWrite_name, &zero_defaults),
+		PRM_Template(PRM_FILE, 1, &cacheFile_name, &cacheFile_default),
+		PRM_Template(PRM_TOGGLE, 1, &cacheResume_name, &zero_defaults),
+		PRM_Template(PRM_FILE, 1, &resumeFile_name, &cacheFile_default),
+		PRM_Template(PRM_TOGGLE, 1, &profileDevice_name, &zero_defaults),
+		PRM_Template(PRM_TOGGLE, 1, &profileData_name, &zero_defaults),
 		PRM_Template()
 	};
 
@@ -6,6 +6,17 @@
 #include <NvFlex.h>
 #include <NvFlexExt.h>
 
+#include <memory>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+#include "NvFlexHBackend.h"
+
+class SIM_NvFlexData; //fwd decl
+class NvFlexHCollisionData; //fwd decl
+class GU_DetailHandleAutoWriteLock; //fwd decl
+
 class SIM_NvFlexSolver:public SIM_Solver,public SIM_OptionsUser
 {
 public:
@@ -42,6 +53,52 @@ public:
 	GETSET_DATA_FUNCS_F("particleCollisionMargin", ParticleCollisionMargin);
 	GETSET_DATA_FUNCS_F("collisionDistance", CollisionDistance);
 
+	/// surfacing: smoothP and aniso1..3 point attributes for meshing, each computed and exported only when above 0
+	GETSET_DATA_FUNCS_F("smoothing", Smoothing);
+	GETSET_DATA_FUNCS_F("anisotropyScale", AnisotropyScale);
+	GETSET_DATA_FUNCS_F("anisotropyMin", AnisotropyMin);
+	GETSET_DATA_FUNCS_F("anisotropyMax", AnisotropyMax);
+
+	/// shape matching clusters from "cluster" point/packed primitive attributes, see NvFlexHClusterBuilder.
+	/// stiffness is for clusters without clusterstiffness, plastic threshold 0 keeps them from deforming for good
+	GETSET_DATA_FUNCS_F("clusterStiffness", ClusterStiffness);
+	GETSET_DATA_FUNCS_F("plasticThreshold", PlasticThreshold);
+	GETSET_DATA_FUNCS_F("plasticCreep", PlasticCreep);
+	/// soft bodies, see NvFlexHSoftBodyBuilder. tet clusters are shape matched with cluster stiffness and plasticity above
+	GETSET_DATA_FUNCS_F("tetStiffness", TetStiffness);
+	GETSET_DATA_FUNCS_B("tetClusters", TetClusters);
+	GETSET_DATA_FUNCS_F("inflatablePressure", InflatablePressure);
+	GETSET_DATA_FUNCS_F("inflatableStiffness", InflatableStiffness);
+
+	/// density and first contact of every particle as point attributes, pulled from the solver only when on
+	GETSET_DATA_FUNCS_B("exportDensity", ExportDensity);
+	GETSET_DATA_FUNCS_B("exportContacts", ExportContacts);
+
+	/// diffuse particles, only with maxdiffuse on NvFlexData. they go to DiffuseGeometry of the (first) object
+	GETSET_DATA_FUNCS_F("diffuseThreshold", DiffuseThreshold);
+	GETSET_DATA_FUNCS_F("diffuseBuoyancy", DiffuseBuoyancy);
+	GETSET_DATA_FUNCS_F("diffuseDrag", DiffuseDrag);
+	GETSET_DATA_FUNCS_I("diffuseBallistic", DiffuseBallistic);
+	GETSET_DATA_FUNCS_F("diffuseLifetime", DiffuseLifetime);
+
+	GETSET_DATA_FUNCS_B("threadedIngest", ThreadedIngest);
+	/// next tick starts on device while this step exports, gains only while inputs don't change (sim-forward playback).
+	/// steps where colliders moved don't start one, it would be thrown away next step anyway, and neither do containers with
+	/// clusters. so scenes with animated colliders get nothing from it. pull phase time is the wait for staged results
+	GETSET_DATA_FUNCS_B("pipelined", Pipelined);
+	/// all objects of this solver share one container and one tick, so their particles interact
+	GETSET_DATA_FUNCS_B("batchObjects", BatchObjects);
+	/// container state of every step goes to cacheFile (NvFlexHStateCache), so a long sim can be resumed mid-way
+	GETSET_DATA_FUNCS_B("cacheWrite", CacheWrite);
+	GETSET_DATA_FUNCS_S("cacheFile", CacheFile);
+	/// on the first step after reset the container is filled from resumeFile instead of the input geometry
+	GETSET_DATA_FUNCS_B("cacheResume", CacheResume);
+	GETSET_DATA_FUNCS_S("resumeFile", ResumeFile);
+	/// backend timers for every tick, costs a sync on gpu
+	GETSET_DATA_FUNCS_B("profileDevice", ProfileDevice);
+	/// phase timings also go to NvFlexProfile subdata, not only to detail attributes of the geometry
+	GETSET_DATA_FUNCS_B("profileData", ProfileData);
+
 protected:
 	explicit SIM_NvFlexSolver(const SIM_DataFactory*fack);
 	virtual ~SIM_NvFlexSolver();
@@ -53,6 +110,28 @@ protected:
 
 	NvFlexParams nvparams;
 
+	struct BatchMember {
+		SIM_Object* obj;
+		SIM_NvFlexData* nvdata;
+	};
+	/// one step of objects sharing a container
+	void solveBatch(const std::vector<BatchMember>& batch, const SIM_Time& timestep, const std::string& cachePath, const std::string& resumePath);
+	/// particles of pdat into geometry of every member, write locks are kept in outlocks
+	void exportBatch(const std::vector<BatchMember>& batch, const NvFlexHParticleData& pdat, std::vector<std::unique_ptr<GU_DetailHandleAutoWriteLock> >& outlocks);
+	/// smoothed positions and anisotropy into geometry locked by exportBatch
+	void exportSurface(const std::vector<BatchMember>& batch, const NvFlexHSurfaceData& sdat, std::vector<std::unique_ptr<GU_DetailHandleAutoWriteLock> >& outlocks);
+	/// densities and contacts into geometry locked by exportBatch
+	void exportContacts(const std::vector<BatchMember>& batch, const NvFlexHContactData& cdat, std::vector<std::unique_ptr<GU_DetailHandleAutoWriteLock> >& outlocks);
+	/// cluster transforms into geometry locked by exportBatch, packed primitives following clusters are moved by them
+	void exportClusters(const std::vector<BatchMember>& batch, const NvFlexHRigidTransforms& tdat, std::vector<std::unique_ptr<GU_DetailHandleAutoWriteLock> >& outlocks);
+	/// diffuse particles of the container into DiffuseGeometry subdata of obj
+	void exportDiffuse(SIM_Object* obj, NvFlexHContainer* cont);
+	void writeCache(const std::vector<BatchMember>& batch, NvFlexHContainer* cont, const NvFlexHParticleData& pdat, const std::string& path);
+	/// container and member geometry take the state from the cache file. false with a warning if it can't be read
+	bool resumeBatch(const std::vector<BatchMember>& batch, NvFlexHContainer* cont, const std::string& path);
+	/// collision relationships of obj into colldata. visited collects collider object ids, each is placed once per step
+	void updateColliders(const SIM_Object* obj, NvFlexHCollisionData* colldata, const std::vector<BatchMember>& batch, std::unordered_set<int>& visited);
+
 
 private:
 	static const SIM_DopDescription* getDescriptionForFucktory();
@@ -60,11 +139,3 @@ private:
 	DECLARE_STANDARD_GETCASTTOTYPE();
 	DECLARE_DATAFACTORY(SIM_NvFlexSolver, SIM_Solver, "solver for nvflex sim", getDescriptionForFucktory());
 };
-
-class NvFlexHContextAutoGetter {
-public:
-	NvFlexHContextAutoGetter(NvFlexLibrary*lib):_lib(lib) { NvFlexAcquireContext(lib); }
-	~NvFlexHContextAutoGetter() { NvFlexRestoreContext(_lib); }
-private:
-	NvFlexLibrary* _lib;
-};
\ No newline at end of file
@@ -0,0 +1,53 @@
+#pragma once
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+
+/// Tiny timing harness shared by the benchmarks. Every case runs reps times, the best time is reported
+/// as items per second, so numbers are comparable between runs and machines with noisy neighbours.
+class NvFlexHBench {
+public:
+	/// scales are given as arguments, like: bench 10000 1000000 10000000. default is 10k and 1M
+	static std::vector<int> scales(int argc, char** argv) {
+		std::vector<int> s;
+		for (int i = 1; i < argc; ++i) {
+			int v = atoi(argv[i]);
+			if (v > 0)s.push_back(v);
+		}
+		if (s.empty()) {
+			s.push_back(10000);
+			s.push_back(1000000);
+		}
+		return s;
+	}
+
+	/// fewer reps for big inputs, so 10M runs do not take forever
+	static int reps(int scale) { return std::max(1, std::min(20, 20000000 / std::max(scale, 1))); }
+
+	static void header() {
+		printf("%-36s %10s %12s %14s\n", "case", "items", "best ms", "Mitems/s");
+	}
+
+	/// setup runs before every rep and is not timed
+	template<class Setup, class Func>
+	static void run(const char* name, long long items, int reps, Setup setup, Func func) {
+		double best = 1e30;
+		for (int r = 0; r < reps; ++r) {
+			setup();
+			auto t0 = std::chrono::steady_clock::now();
+			func();
+			auto t1 = std::chrono::steady_clock::now();
+			best = std::min(best, std::chrono::duration<double>(t1 - t0).count());
+		}
+		printf("%-36s %10lld %12.3f %14.2f\n", name, items, best * 1e3, best > 0 ? items / best * 1e-6 : 0.0);
+		fflush(stdout);
+	}
+
+	template<class Func>
+	static void run(const char* name, long long items, int reps, Func func) {
+		run(name, items, reps, [] {}, func);
+	}
+};
@@ -0,0 +1,51 @@
+// HDK-free benchmarks: collision registry bookkeeping. Builds and runs anywhere nvFlexHCore does.
+#include <memory>
+
+#include "NvFlexHBench.h"
+#include "NvFlexHCollisionData.h"
+#include "NvFlexHCpuBackend.h"
+
+
+static void fillRegistry(NvFlexHCollisionData& cd, int n) {
+	bool isnew;
+	for (int i = 0; i < n; ++i)cd.acquire(NvFlexHCollisionData::makeKey(i, 0), eNvFlexShapeSphere, isnew);
+}
+
+int main(int argc, char** argv) {
+	std::vector<int> scales = NvFlexHBench::scales(argc, argv);
+	NvFlexHBackend* backend = NvFlexHCpuBackend::instance();
+
+	NvFlexHBench::header();
+	for (size_t si = 0; si < scales.size(); ++si) {
+		const int n = scales[si];
+		const int reps = NvFlexHBench::reps(n);
+		std::unique_ptr<NvFlexHCollisionData> cd;
+		auto fresh = [&] { cd.reset(new NvFlexHCollisionData(backend)); };
+		auto filled = [&] { fresh(); fillRegistry(*cd, n); };
+
+		NvFlexHBench::run("registry acquire new", n, reps, fresh, [&] { fillRegistry(*cd, n); });
+
+		NvFlexHBench::run("registry acquire existing", n, reps, filled, [&] { fillRegistry(*cd, n); });
+
+		volatile int sink = 0;
+		NvFlexHBench::run("registry find", n, reps, filled, [&] {
+			int acc = 0;
+			for (int i = 0; i < n; ++i)acc += cd->find(NvFlexHCollisionData::makeKey(i, 0));
+			sink = acc;
+		});
+
+		NvFlexHBench::run("registry remove by key", n, reps, filled, [&] {
+			for (int i = 0; i < n; ++i)cd->removeItem(NvFlexHCollisionData::makeKey(i, 0));
+		});
+
+		//a step where every other collider left its relationship
+		NvFlexHBench::run("registry stale sweep (half)", n, reps, filled, [&] {
+			cd->markAllStale();
+			bool isnew;
+			for (int i = 0; i < n; i += 2)cd->acquire(NvFlexHCollisionData::makeKey(i, 0), eNvFlexShapeSphere, isnew);
+			cd->removeStale();
+		});
+		(void)sink;
+	}
+	return 0;
+}
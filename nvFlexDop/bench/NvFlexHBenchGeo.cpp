@@ -0,0 +1,245 @@
+// HDK benchmarks: particle ingest/export, spring and triangle extraction, collision mesh conversion.
+// Inputs are synthetic: a cloth-like grid of points, every row chained with springs and every quad split in two triangles.
+// Before timing, threaded particle ingest is checked byte for byte against the serial one, bench fails if they differ.
+// Export of a capped object is checked to keep the primitives on points under the cap.
+#include <GU/GU_Detail.h>
+#include <GEO/GEO_PrimPoly.h>
+#include <GEO/GEO_PolyCounts.h>
+#include <GA/GA_Handle.h>
+
+#include <cmath>
+#include <cstring>
+#include <memory>
+
+#include "NvFlexHBench.h"
+#include "NvFlexHParticleTransfer.h"
+#include "NvFlexHTopologyBuilder.h"
+#include "NvFlexHCollisionMeshConverter.h"
+
+
+/// width*rows points on a grid with all attributes ingest reads
+static void buildParticles(GU_Detail& gdp, int width, int rows) {
+	GA_Offset start = gdp.appendPointBlock(GA_Size(width) * rows);
+	GA_RWHandleV3 vhnd(gdp.addFloatTuple(GA_ATTRIB_POINT, "v", 3));
+	GA_RWHandleI iidhnd(gdp.addIntTuple(GA_ATTRIB_POINT, "iid", 1));
+	GA_RWHandleI phshnd(gdp.addIntTuple(GA_ATTRIB_POINT, "phs", 1));
+	GA_RWHandleF mhnd(gdp.addFloatTuple(GA_ATTRIB_POINT, "imass", 1));
+	for (int r = 0; r < rows; ++r) {
+		for (int c = 0; c < width; ++c) {
+			GA_Offset off = start + GA_Offset(GA_Size(r) * width + c);
+			gdp.setPos3(off, UT_Vector3F(c * 0.01f, std::sin(c * 0.1f) * 0.05f, r * 0.01f));
+			vhnd.set(off, UT_Vector3F(0.0f, -1.0f, 0.0f));
+			iidhnd.set(off, int(off));
+			phshnd.set(off, 1);
+			mhnd.set(off, 1.0f);
+		}
+	}
+}
+
+/// springs along rows (open 2 point polys) and two triangles per quad (closed 3 point polys)
+static void buildCloth(GU_Detail& gdp, int width, int rows, bool springs, bool triangles) {
+	if (springs) {
+		UT_IntArray pts;
+		for (int r = 0; r < rows; ++r) {
+			for (int c = 0; c + 1 < width; ++c) {
+				pts.append(r * width + c);
+				pts.append(r * width + c + 1);
+			}
+		}
+		GEO_PolyCounts counts;
+		counts.append(2, pts.entries() / 2);
+		GEO_PrimPoly::buildBlock(&gdp, GA_Offset(0), gdp.getNumPoints(), counts, pts.array(), false);
+	}
+	if (triangles) {
+		UT_IntArray pts;
+		for (int r = 0; r + 1 < rows; ++r) {
+			for (int c = 0; c + 1 < width; ++c) {
+				int p00 = r * width + c, p01 = p00 + 1, p10 = p00 + width, p11 = p10 + 1;
+				pts.append(p00); pts.append(p10); pts.append(p11);
+				pts.append(p00); pts.append(p11); pts.append(p01);
+			}
+		}
+		GEO_PolyCounts counts;
+		counts.append(3, pts.entries() / 3);
+		GEO_PrimPoly::buildBlock(&gdp, GA_Offset(0), gdp.getNumPoints(), counts, pts.array(), true);
+	}
+	GA_RWHandleF rlhnd(gdp.addFloatTuple(GA_ATTRIB_PRIMITIVE, "restlength", 1));
+	GA_RWHandleF sthnd(gdp.addFloatTuple(GA_ATTRIB_PRIMITIVE, "strength", 1));
+	GA_Offset off;
+	GA_FOR_ALL_PRIMOFF(&gdp, off) {
+		rlhnd.set(off, 0.01f);
+		sthnd.set(off, 1.0f);
+	}
+}
+
+/// host buffers shaped like mapped container data
+struct HostParticles {
+	std::vector<float> particles, restParticles, velocities, normals;
+	std::vector<int> phases, indices;
+	NvFlexHParticleData pdat;
+
+	explicit HostParticles(int n) :particles(4 * size_t(n)), restParticles(4 * size_t(n)), velocities(3 * size_t(n)), normals(4 * size_t(n)), phases(n), indices(n) {
+		for (int i = 0; i < n; ++i)indices[i] = i;
+		pdat.particles = particles.data();
+		pdat.restParticles = restParticles.data();
+		pdat.velocities = velocities.data();
+		pdat.phases = phases.data();
+		pdat.normals = normals.data();
+	}
+};
+
+/// threaded and serial ingest must write the same bytes. detail has holes in point offsets, restP,
+/// points past nactives and a scattered index map, buffers start filled with garbage so skipped slots count too
+static bool checkIngestIdentical(int width, int rows) {
+	GU_Detail gdp;
+	buildParticles(gdp, width, rows);
+	GA_RWHandleV3 rhnd(gdp.addFloatTuple(GA_ATTRIB_POINT, "restP", 3));
+	GA_Offset off;
+	GA_FOR_ALL_PTOFF(&gdp, off) {
+		rhnd.set(off, gdp.getPos3(off) * 2.0f);
+	}
+	const GA_Offset end = GA_Offset(GA_Size(width) * rows); //fresh detail, points are offsets [0, end)
+	for (off = GA_Offset(3); off < end; off += 7)gdp.destroyPointOffset(off);
+
+	const int n = int(gdp.getNumPoints());
+	const int nactives = n - n / 10;
+	HostParticles serial(n), threaded(n);
+	//stride coprime with n walks every slot once, far from monotonic
+	auto gcd = [](int a, int b) { while (b) { int t = a % b; a = b; b = t; } return a; };
+	int stride = 7919 % n;
+	while (n > 1 && (stride == 0 || gcd(stride, n) != 1))stride = (stride + 1) % n;
+	for (int i = 0; i < n; ++i)serial.indices[i] = threaded.indices[i] = int((long long)i * stride % n);
+
+	HostParticles* bufs[2] = { &serial, &threaded };
+	for (HostParticles* b : bufs) {
+		memset(b->particles.data(), 0xab, b->particles.size() * sizeof(float));
+		memset(b->restParticles.data(), 0xab, b->restParticles.size() * sizeof(float));
+		memset(b->velocities.data(), 0xab, b->velocities.size() * sizeof(float));
+		memset(b->phases.data(), 0xab, b->phases.size() * sizeof(int));
+	}
+	NvFlexHParticleIngest ingest(&gdp);
+	ingest.transfer(serial.pdat, serial.indices.data(), nactives, NvFlexHParticleIngest::eChannelAll, false);
+	ingest.transfer(threaded.pdat, threaded.indices.data(), nactives, NvFlexHParticleIngest::eChannelAll, true);
+
+	bool same = true;
+	auto cmp = [&](const char* name, const void* a, const void* b, size_t bytes) {
+		if (memcmp(a, b, bytes) == 0)return;
+		fprintf(stderr, "ingest mismatch: threaded and serial %s differ (%d points)\n", name, n);
+		same = false;
+	};
+	cmp("particles", serial.particles.data(), threaded.particles.data(), serial.particles.size() * sizeof(float));
+	cmp("restParticles", serial.restParticles.data(), threaded.restParticles.data(), serial.restParticles.size() * sizeof(float));
+	cmp("velocities", serial.velocities.data(), threaded.velocities.data(), serial.velocities.size() * sizeof(float));
+	cmp("phases", serial.phases.data(), threaded.phases.data(), serial.phases.size() * sizeof(int));
+	return same;
+}
+
+/// last row is over the cap. its points go with the springs and triangles on them, every other prim must stay whole
+static bool checkCappedExportKeepsPrims(int width, int rows) {
+	GU_Detail gdp;
+	buildParticles(gdp, width, rows);
+	buildCloth(gdp, width, rows, true, true);
+	const int nactives = width * (rows - 1);
+	HostParticles host(nactives);
+
+	NvFlexHParticleExport exporter(&gdp);
+	exporter.fitPointCount(nactives);
+	exporter.transfer(host.pdat, host.indices.data(), nactives);
+
+	GA_Size whole = 0;
+	const GA_Primitive* prim;
+	GA_FOR_ALL_PRIMITIVES(&gdp, prim) {
+		const GA_Size nv = prim->getVertexCount();
+		if (nv == 2 || nv == 3)++whole;
+	}
+	const GA_Size expected = GA_Size(rows - 1) * (width - 1) + 2 * GA_Size(rows - 2) * (width - 1);
+	if (gdp.getNumPoints() == nactives && whole == expected)return true;
+	fprintf(stderr, "capped export: %d points and %d whole prims, expected %d and %d\n", int(gdp.getNumPoints()), int(whole), nactives, int(expected));
+	return false;
+}
+
+
+int main(int argc, char** argv) {
+	std::vector<int> scales = NvFlexHBench::scales(argc, argv);
+
+	NvFlexHBench::header();
+	for (size_t si = 0; si < scales.size(); ++si) {
+		const int width = std::max(2, int(std::sqrt(double(scales[si]))));
+		const int rows = std::max(2, scales[si] / width);
+		const int n = width * rows;
+		const int reps = NvFlexHBench::reps(n);
+
+		//timings mean nothing if the paths disagree
+		if (!checkIngestIdentical(width, rows))return 1;
+		if (!checkCappedExportKeepsPrims(width, rows))return 1;
+
+		//particles
+		{
+			std::unique_ptr<GU_Detail> gdp(new GU_Detail);
+			buildParticles(*gdp, width, rows);
+			HostParticles host(n);
+			NvFlexHParticleIngest ingest(gdp.get());
+
+			NvFlexHBench::run("ingest all channels, threaded", n, reps, [&] {
+				ingest.transfer(host.pdat, host.indices.data(), n, NvFlexHParticleIngest::eChannelAll, true);
+			});
+			NvFlexHBench::run("ingest all channels, serial", n, reps, [&] {
+				ingest.transfer(host.pdat, host.indices.data(), n, NvFlexHParticleIngest::eChannelAll, false);
+			});
+			NvFlexHBench::run("ingest P only, threaded", n, reps, [&] {
+				ingest.transfer(host.pdat, host.indices.data(), n, NvFlexHParticleIngest::eChannelPosition, true);
+			});
+
+			NvFlexHParticleExport exporter(gdp.get());
+			NvFlexHBench::run("export P v iid phs", n, reps, [&] {
+				exporter.transfer(host.pdat, host.indices.data(), n);
+				exporter.bumpDataIds();
+			});
+		}
+
+		//springs and triangles
+		{
+			std::unique_ptr<GU_Detail> gdp(new GU_Detail);
+			buildParticles(*gdp, width, rows);
+			buildCloth(*gdp, width, rows, true, true);
+			HostParticles host(n);
+			const int nprims = int(gdp->getNumPrimitives());
+
+			std::vector<int> springIds, triangleIds;
+			std::vector<float> springRls, springSts, triangleNms;
+			NvFlexHBench::run("topology count + build (prims)", nprims, reps, [&] {
+				NvFlexHTopologyBuilder topo(gdp.get(), host.indices.data(), n);
+				topo.count();
+				springIds.resize(2 * size_t(topo.springCount()));
+				springRls.resize(topo.springCount());
+				springSts.resize(topo.springCount());
+				triangleIds.resize(3 * size_t(topo.triangleCount()));
+				triangleNms.resize(3 * size_t(topo.triangleCount()));
+				topo.build(springIds.data(), springRls.data(), springSts.data(), triangleIds.data(), triangleNms.data());
+			});
+		}
+
+		//collision mesh
+		{
+			std::unique_ptr<GU_Detail> gdp(new GU_Detail);
+			buildParticles(*gdp, width, rows);
+			buildCloth(*gdp, width, rows, false, true);
+			const int nprims = int(gdp->getNumPrimitives());
+
+			std::vector<Vec3> vertices(n);
+			float lower[3], upper[3];
+			NvFlexHBench::run("collision mesh points + bounds", n, reps, [&] {
+				NvFlexHCollisionMeshConverter converter(gdp.get());
+				converter.convertPoints(vertices.data(), lower, upper);
+			});
+
+			std::vector<int> triangles;
+			NvFlexHBench::run("collision mesh triangulation (prims)", nprims, reps, [&] {
+				NvFlexHCollisionMeshConverter converter(gdp.get());
+				triangles.resize(3 * size_t(converter.countTriangles()));
+				converter.convertTriangles(triangles.data());
+			});
+		}
+	}
+	return 0;
+}
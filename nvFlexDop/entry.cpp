@@ -1,10 +1,18 @@
 #include <UT/UT_DSOVersion.h>
+#include <UT/UT_Exit.h>
 
 #include "SIM_NvFlexData.h"
 #include "SIM_NvFlexSolver.h"
+#include "NvFlexHFlexBackend.h"
 
 
+static void shutdownNvFlex(void*) {
+	//cuda may be gone by the time static destructors run, so libraries go down with houdini's exit callbacks
+	NvFlexHFlexBackend::shutdown();
+}
+
 void initializeSIM(void*) {
 	IMPLEMENT_DATAFACTORY(SIM_NvFlexData);
 	IMPLEMENT_DATAFACTORY(SIM_NvFlexSolver);
+	UT_Exit::addExitCallback(shutdownNvFlex);
 }
\ No newline at end of file
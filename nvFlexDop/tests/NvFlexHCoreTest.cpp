@@ -0,0 +1,512 @@
+// HDK-free checks of nvFlexHCore: flat map, collision registry, index map, member maps, state cache, a cpu backend tick
+// and cpu backend meshes used from several threads.
+// Runs anywhere nvFlexHCore builds, no gpu. Exits with 1 if any check failed, ctest runs it as nvFlexHCoreTest.
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "NvFlexHFlatMap.h"
+#include "NvFlexHCollisionData.h"
+#include "NvFlexHIndexMap.h"
+#include "NvFlexHStateCache.h"
+#include "NvFlexHTriangleMesh.h"
+#include "NvFlexHCpuBackend.h"
+
+
+static int failures = 0;
+
+#define CHECK(cond) do { if (!(cond)) { fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); ++failures; } } while (0)
+
+
+static void testFlatMap() {
+	NvFlexHFlatMap map;
+	CHECK(map.find(1) == -1);
+	CHECK(!map.erase(1));
+
+	//enough keys to grow a few times and to have long probe clusters
+	const int n = 5000;
+	for (int i = 0; i < n; ++i)map.insert((long long)i << 32, i);
+	CHECK(map.size() == size_t(n));
+	map.insert(0, 7);
+	CHECK(map.find(0) == 7);
+	CHECK(map.size() == size_t(n));
+
+	//erasing every third key shifts the ones behind back, all others must still be found
+	for (int i = 0; i < n; i += 3)CHECK(map.erase((long long)i << 32));
+	for (int i = 0; i < n; ++i) {
+		const int want = i % 3 == 0 ? -1 : i;
+		CHECK(map.find((long long)i << 32) == want);
+	}
+	CHECK(map.size() == size_t(n - (n + 2) / 3));
+
+	//erased keys can come back
+	for (int i = 0; i < n; i += 3)map.insert((long long)i << 32, i + 1);
+	for (int i = 0; i < n; ++i)CHECK(map.find((long long)i << 32) == (i % 3 == 0 ? i + 1 : i));
+	CHECK(map.size() == size_t(n));
+}
+
+
+/// every offset's key leads to a handle whose wrapper points at that offset
+static bool registryConsistent(NvFlexHCollisionData& cd) {
+	for (int i = 0; i < cd.size(); ++i) {
+		const int h = cd.find(cd.keyAt(i));
+		if (h < 0)return false;
+		if (cd.getSphere(h).position != cd.positions() + i)return false;
+	}
+	return true;
+}
+
+static void testCollisionData() {
+	NvFlexHCollisionData cd(NvFlexHCpuBackend::instance());
+	bool isnew;
+	const int n = 8;
+	std::vector<int> handles(n);
+	for (int i = 0; i < n; ++i) {
+		handles[i] = cd.acquire(NvFlexHCollisionData::makeKey(i, 0), eNvFlexShapeSphere, isnew);
+		CHECK(isnew);
+		NvfSphereGeo sph = cd.getSphere(handles[i]);
+		*sph.position = Vec4(float(i), 0.0f, 0.0f, 0.0f);
+		sph.collgeo->radius = float(i + 1);
+	}
+	CHECK(cd.size() == n);
+	CHECK(cd.acquire(NvFlexHCollisionData::makeKey(3, 0), eNvFlexShapeSphere, isnew) == handles[3]);
+	CHECK(!isnew);
+	CHECK(registryConsistent(cd));
+
+	//removing from the front swaps the last one in, handles of the others don't move
+	CHECK(cd.removeItem(NvFlexHCollisionData::makeKey(0, 0)));
+	CHECK(!cd.removeItem(NvFlexHCollisionData::makeKey(0, 0)));
+	CHECK(cd.size() == n - 1);
+	CHECK(cd.find(NvFlexHCollisionData::makeKey(0, 0)) == -1);
+	for (int i = 1; i < n; ++i) {
+		CHECK(cd.find(NvFlexHCollisionData::makeKey(i, 0)) == handles[i]);
+		NvfSphereGeo sph = cd.getSphere(handles[i]);
+		CHECK(sph.position->x == float(i));
+		CHECK(sph.collgeo->radius == float(i + 1));
+	}
+	CHECK(registryConsistent(cd));
+
+	//stale sweep drops everything not acquired since markAllStale
+	cd.markAllStale();
+	for (int i = 1; i < n; i += 2)cd.acquire(NvFlexHCollisionData::makeKey(i, 0), eNvFlexShapeSphere, isnew);
+	CHECK(cd.removeStale() == 3);
+	CHECK(cd.size() == 4);
+	for (int i = 1; i < n; ++i) {
+		const int h = cd.find(NvFlexHCollisionData::makeKey(i, 0));
+		CHECK(i % 2 == 1 ? h == handles[i] : h == -1);
+		if (h >= 0)CHECK(cd.getSphere(h).position->x == float(i));
+	}
+	CHECK(registryConsistent(cd));
+
+	//same key with another type replaces the shape
+	const NvFlexHCollisionKey key = NvFlexHCollisionData::makeKey(3, 0);
+	const int bh = cd.acquire(key, eNvFlexShapeBox, isnew);
+	CHECK(isnew);
+	CHECK(cd.size() == 4);
+	CHECK(cd.find(key) == bh);
+	CHECK(cd.getShapeType(bh) == eNvFlexShapeBox);
+	CHECK(registryConsistent(cd));
+	for (int i = 1; i < n; i += 2) {
+		if (i == 3)continue;
+		const int h = cd.find(NvFlexHCollisionData::makeKey(i, 0));
+		CHECK(h >= 0 && cd.getShapeType(h) == eNvFlexShapeSphere && cd.getSphere(h).position->x == float(i));
+	}
+
+	//freed handles are reused, indexed removal stops at the first missing subindex
+	for (int s = 0; s < 4; ++s)cd.acquire(NvFlexHCollisionData::makeKey(100, s), eNvFlexShapeSphere, isnew);
+	CHECK(cd.removeIndexedItems(100, 1) == 3);
+	CHECK(cd.find(NvFlexHCollisionData::makeKey(100, 0)) >= 0);
+	CHECK(cd.size() == 5);
+	CHECK(registryConsistent(cd));
+
+	cd.markPushed();
+	CHECK(!cd.changedSincePush());
+	cd.getSphere(cd.find(NvFlexHCollisionData::makeKey(100, 0))).position->y = 1.0f;
+	CHECK(cd.changedSincePush());
+}
+
+
+/// deforming collider: vertices move, triangles written once stay in the backend
+static void testTriangleMeshUpdate() {
+	NvFlexHCpuBackend* backend = NvFlexHCpuBackend::instance();
+	NvFlexHTriangleMesh mesh(backend);
+	const int tris[6] = { 0, 1, 2, 0, 2, 3 };
+	{
+		NvFlexHTriangleMeshAutoMapper lock(&mesh, 4, 2);
+		CHECK(lock.triangles() != NULL);
+		for (int i = 0; i < 4; ++i)lock.vertices()[i] = Vec3(float(i & 1), 0.0f, float(i >> 1));
+		memcpy(lock.triangles(), tris, sizeof(tris));
+		lock.lower()[0] = lock.lower()[1] = lock.lower()[2] = 0.0f;
+		lock.upper()[0] = lock.upper()[2] = 1.0f;
+		lock.upper()[1] = 0.0f;
+	}
+	CHECK(mesh.vertexCount() == 4);
+	{
+		NvFlexHTriangleMeshAutoMapper lock(&mesh, 4);
+		CHECK(lock.triangles() == NULL);
+		for (int i = 0; i < 4; ++i)lock.vertices()[i] = Vec3(float(i & 1), 2.0f, float(i >> 1));
+		lock.lower()[1] = lock.upper()[1] = 2.0f;
+	}
+	const NvFlexHCpuBackend::TriangleMesh* tm = backend->triangleMesh(mesh.getId());
+	CHECK(tm != NULL);
+	if (tm == NULL)return;
+	CHECK(tm->triangles.size() == 6 && memcmp(tm->triangles.data(), tris, sizeof(tris)) == 0);
+	CHECK(tm->vertices.size() == 4 && tm->vertices[3].y == 2.0f && tm->vertices[3].x == 1.0f);
+	CHECK(tm->lower.y == 2.0f);
+	//grid was rebuilt for the moved vertices, every triangle is in some cell
+	CHECK(tm->cellstart.back() >= 2);
+}
+
+
+static void testIndexMap() {
+	std::unique_ptr<NvFlexHContainer> cont(NvFlexHCpuBackend::instance()->createContainer(8, 0));
+	NvFlexHIndexMap map(cont->maxParticles());
+	CHECK(map.resize(cont.get(), 5) == 5);
+	CHECK(cont->activeCount() == 5);
+	std::vector<int> first(map.indices(), map.indices() + 5);
+
+	//growing past the container stops at what is there, but remembers what was asked
+	CHECK(map.resize(cont.get(), 12) == 8);
+	CHECK(map.size() == 8);
+	CHECK(map.requested() == 12);
+	CHECK(cont->activeCount() == 8);
+	for (int i = 0; i < 5; ++i)CHECK(map[i] == first[i]);
+
+	//shrinking frees the tail, head keeps its particles
+	const int freed = map[3];
+	CHECK(map.resize(cont.get(), 3) == 3);
+	CHECK(map.requested() == 3);
+	CHECK(cont->activeCount() == 3);
+	for (int i = 0; i < 3; ++i)CHECK(map[i] == first[i]);
+	std::vector<int> active(cont->capacity());
+	active.resize(cont->getActiveList(active.data()));
+	CHECK(active.size() == 3);
+	for (size_t i = 0; i < active.size(); ++i)CHECK(active[i] != freed);
+
+	CHECK(map.resize(cont.get(), 0) == 0);
+	CHECK(cont->activeCount() == 0);
+}
+
+static void testMemberMaps() {
+	std::unique_ptr<NvFlexHContainer> cont(NvFlexHCpuBackend::instance()->createContainer(16, 0));
+	std::vector<std::shared_ptr<NvFlexHIndexMap> > maps;
+	for (int i = 0; i < 3; ++i) {
+		maps.push_back(std::shared_ptr<NvFlexHIndexMap>(new NvFlexHIndexMap(cont->maxParticles())));
+		maps.back()->resize(cont.get(), 4);
+	}
+	NvFlexHMemberMaps members;
+	std::vector<std::shared_ptr<NvFlexHIndexMap> > released;
+	members.update({ 10, 11, 12 }, maps, released);
+	CHECK(released.empty());
+	CHECK(members.size() == 3);
+
+	//object 11 is gone: its map comes back to be freed, the others stay
+	members.update({ 10, 12 }, { maps[0], maps[2] }, released);
+	CHECK(released.size() == 1 && released[0] == maps[1]);
+	for (size_t i = 0; i < released.size(); ++i)released[i]->resize(cont.get(), 0);
+	CHECK(cont->activeCount() == 8);
+
+	//object 10 came back with a new map, the old one still holds particles
+	released.clear();
+	std::shared_ptr<NvFlexHIndexMap> rejoined(new NvFlexHIndexMap(cont->maxParticles()));
+	members.update({ 10, 12 }, { rejoined, maps[2] }, released);
+	CHECK(released.size() == 1 && released[0] == maps[0]);
+
+	//added members are released by the next update that doesn't name them
+	released.clear();
+	members.clear();
+	members.add(99, maps[2]);
+	members.update({ 10 }, { rejoined }, released);
+	CHECK(released.size() == 1 && released[0] == maps[2]);
+	CHECK(members.size() == 1);
+}
+
+
+static std::string readFile(const std::string& path) {
+	std::ifstream in(path.c_str(), std::ios::binary);
+	return std::string(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+}
+
+static void writeFile(const std::string& path, const std::string& data) {
+	std::ofstream out(path.c_str(), std::ios::binary | std::ios::trunc);
+	out.write(data.data(), std::streamsize(data.size()));
+}
+
+/// offset of section sec in a cache file, header is 24 bytes followed by offset, bytes pairs
+static size_t sectionOffset(const std::string& file, int sec) {
+	unsigned long long off;
+	memcpy(&off, file.data() + 24 + 16 * sec, sizeof(off));
+	return size_t(off);
+}
+
+static void testStateCache() {
+	NvFlexHBackend* backend = NvFlexHCpuBackend::instance();
+	std::unique_ptr<NvFlexHContainer> cont(backend->createContainer(64, 0));
+	const int n = 10;
+	std::vector<int> idx(n);
+	CHECK(cont->allocParticles(n, idx.data()) == n);
+	//free a few so active indices are not just 0..n-1
+	cont->freeParticles(1, &idx[2]);
+	cont->freeParticles(1, &idx[7]);
+	int more[2];
+	CHECK(cont->allocParticles(2, more) == 2);
+	idx[2] = more[0];
+	idx[7] = more[1];
+
+	NvFlexHParticleData pdat = cont->mapParticleData();
+	for (int i = 0; i < n; ++i) {
+		const int p = idx[i];
+		for (int c = 0; c < 4; ++c)pdat.particles[4 * p + c] = float(10 * i + c);
+		for (int c = 0; c < 4; ++c)pdat.restParticles[4 * p + c] = float(-10 * i - c);
+		for (int c = 0; c < 3; ++c)pdat.velocities[3 * p + c] = float(i) * 0.5f + c;
+		pdat.phases[p] = i;
+	}
+	cont->unmapParticleData();
+	cont->resizeSpringData(2);
+	NvFlexHSpringData sdat = cont->mapSpringData();
+	sdat.springIds[0] = idx[0]; sdat.springIds[1] = idx[1];
+	sdat.springIds[2] = idx[8]; sdat.springIds[3] = idx[9];
+	sdat.springRls[0] = 1.0f; sdat.springRls[1] = 2.0f;
+	sdat.springSts[0] = 0.5f; sdat.springSts[1] = 0.25f;
+	cont->unmapSpringData();
+	bool isnew;
+	const int sh = cont->collisionData()->acquire(NvFlexHCollisionData::makeKey(42, 1), eNvFlexShapeSphere, isnew);
+	*cont->collisionData()->getSphere(sh).position = Vec4(1.0f, 2.0f, 3.0f, 0.0f);
+
+	//one member with every other particle, in reverse
+	std::vector<int> memberIndices;
+	for (int i = n - 1; i >= 0; i -= 2)memberIndices.push_back(idx[i]);
+	std::vector<NvFlexHStateCache::Member> members(1);
+	members[0].objectid = 5;
+	members[0].indices = memberIndices.data();
+	members[0].count = int(memberIndices.size());
+
+	const std::string path = "nvFlexHCoreTest.nvfstate";
+	std::string error;
+	pdat = cont->mapParticleData();
+	CHECK(NvFlexHStateCache::write(path.c_str(), cont.get(), pdat, members, false, error));
+	cont->unmapParticleData();
+
+	//restore into another container, particles get new indices there
+	std::unique_ptr<NvFlexHContainer> other(backend->createContainer(64, 0));
+	int junk[3];
+	other->allocParticles(3, junk);
+	{
+		NvFlexHStateCache cache(path.c_str());
+		CHECK(cache.isValid());
+		CHECK(cache.particleCount() == n);
+		CHECK(cache.springCount() == 2);
+		CHECK(cache.memberCount() == 1);
+		CHECK(cache.shapeCount() == 1);
+		CHECK(cache.shapeCount() == 1 && cache.shapes()[0].key == NvFlexHCollisionData::makeKey(42, 1) && cache.shapes()[0].position[2] == 3.0f);
+		std::vector<NvFlexHStateCache::RestoredMember> restored;
+		CHECK(cache.restore(other.get(), restored, error));
+		CHECK(other->activeCount() == n);
+		CHECK(restored.size() == 1);
+		if (restored.size() == 1) {
+			const NvFlexHStateCache::RestoredMember& rm = restored[0];
+			CHECK(rm.objectid == 5);
+			CHECK(rm.indices.size() == memberIndices.size());
+			NvFlexHParticleData rdat = other->mapParticleData();
+			for (size_t k = 0; k < rm.indices.size() && k < memberIndices.size(); ++k) {
+				const int i = n - 1 - 2 * int(k);
+				const int p = rm.indices[k];
+				CHECK(p >= 0 && p < other->capacity());
+				if (p < 0 || p >= other->capacity())continue;
+				CHECK(rdat.particles[4 * p + 0] == float(10 * i) && rdat.particles[4 * p + 3] == float(10 * i + 3));
+				CHECK(rdat.restParticles[4 * p + 1] == float(-10 * i - 1));
+				CHECK(rdat.velocities[3 * p + 2] == float(i) * 0.5f + 2);
+				CHECK(rdat.phases[p] == i);
+			}
+			other->unmapParticleData();
+		}
+		CHECK(other->getSpringsCount() == 2);
+		if (other->getSpringsCount() == 2) {
+			//spring between original particles 8 and 9: 9 is member slot 0, particle 8 has phase 8
+			NvFlexHSpringData odat = other->mapSpringData();
+			NvFlexHParticleData rdat = other->mapParticleData();
+			CHECK(odat.springIds[3] == restored[0].indices[0]);
+			CHECK(rdat.phases[odat.springIds[2]] == 8);
+			CHECK(odat.springRls[1] == 2.0f && odat.springSts[1] == 0.25f);
+			other->unmapParticleData();
+			other->unmapSpringData();
+		}
+	}
+
+	//broken files are refused before the container is touched
+	const std::string good = readFile(path);
+	const std::string badpath = "nvFlexHCoreTestBad.nvfstate";
+	auto refused = [&](const std::string& data) {
+		writeFile(badpath, data);
+		NvFlexHStateCache cache(badpath.c_str());
+		std::vector<NvFlexHStateCache::RestoredMember> restored;
+		std::string err;
+		const int before = other->activeCount();
+		const bool ok = cache.restore(other.get(), restored, err);
+		return !ok && !err.empty() && other->activeCount() == before;
+	};
+	CHECK(!good.empty());
+	CHECK(refused(good.substr(0, good.size() / 2)));
+	CHECK(refused(good.substr(0, 20)));
+	CHECK(refused(std::string(good.size(), 'x')));
+
+	std::string dup = good;
+	memcpy(&dup[sectionOffset(good, 0) + sizeof(int)], good.data() + sectionOffset(good, 0), sizeof(int));
+	CHECK(refused(dup));
+
+	std::string negative = good;
+	const int minusone = -1;
+	memcpy(&negative[sectionOffset(good, 0)], &minusone, sizeof(int));
+	CHECK(refused(negative));
+
+	//member pointing at a particle that is not cached, member indices are section 11
+	std::string stray = good;
+	const int missing = 63;
+	for (int i = 0; i < n; ++i)CHECK(idx[i] != missing);
+	memcpy(&stray[sectionOffset(good, 11)], &missing, sizeof(int));
+	CHECK(refused(stray));
+
+	//spring ids are section 5
+	std::string badspring = good;
+	memcpy(&badspring[sectionOffset(good, 5)], &missing, sizeof(int));
+	CHECK(refused(badspring));
+
+	std::remove(path.c_str());
+	std::remove(badpath.c_str());
+}
+
+
+/// particles dropped on a ground plane with a sphere collider in the way come to rest above both
+static void testCpuTick() {
+	NvFlexHBackend* backend = NvFlexHCpuBackend::instance();
+	std::unique_ptr<NvFlexHContainer> cont(backend->createContainer(256, 0));
+	const int side = 4;
+	const int n = side * side * side;
+	std::vector<int> idx(n);
+	CHECK(cont->allocParticles(n, idx.data()) == n);
+	const float radius = 0.1f;
+	NvFlexHParticleData pdat = cont->mapParticleData();
+	for (int i = 0; i < n; ++i) {
+		const int p = idx[i];
+		pdat.particles[4 * p + 0] = (i % side) * radius;
+		pdat.particles[4 * p + 1] = 1.0f + (i / side % side) * radius;
+		pdat.particles[4 * p + 2] = (i / (side * side)) * radius;
+		pdat.particles[4 * p + 3] = 1.0f;
+		pdat.velocities[3 * p + 0] = pdat.velocities[3 * p + 1] = pdat.velocities[3 * p + 2] = 0.0f;
+		pdat.phases[p] = NvFlexMakePhase(0, eNvFlexPhaseSelfCollide);
+	}
+	cont->unmapParticleData();
+	cont->pushParticlesToDevice();
+
+	bool isnew;
+	const int sh = cont->collisionData()->acquire(NvFlexHCollisionData::makeKey(1, 0), eNvFlexShapeSphere, isnew);
+	NvfSphereGeo sph = cont->collisionData()->getSphere(sh);
+	*sph.position = *sph.prevposition = Vec4(0.15f, 0.3f, 0.15f, 0.0f);
+	sph.collgeo->radius = 0.3f;
+	cont->pushShapesToDevice();
+
+	NvFlexParams params;
+	memset(&params, 0, sizeof(params));
+	params.gravity[1] = -9.8f;
+	params.radius = radius;
+	params.solidRestDistance = radius * 0.9f;
+	params.fluidRestDistance = radius * 0.5f;
+	params.collisionDistance = radius * 0.5f;
+	params.numIterations = 3;
+	params.relaxationFactor = 1.0f;
+	params.maxSpeed = 1e9f;
+	params.maxAcceleration = 1e9f;
+	params.numPlanes = 1;
+	params.planes[0][1] = 1.0f;
+	cont->setParams(params);
+
+	for (int s = 0; s < 60; ++s)cont->tick(1.0f / 30.0f, 2);
+	cont->pullParticlesFromDevice();
+
+	pdat = cont->mapParticleData();
+	float lowest = 1e30f, highest = -1e30f;
+	bool finite = true, inside = false;
+	for (int i = 0; i < n; ++i) {
+		const float* p = pdat.particles + 4 * idx[i];
+		for (int c = 0; c < 3; ++c)finite = finite && std::isfinite(p[c]);
+		lowest = std::min(lowest, p[1]);
+		highest = std::max(highest, p[1]);
+		const float dx = p[0] - 0.15f, dy = p[1] - 0.3f, dz = p[2] - 0.15f;
+		inside = inside || std::sqrt(dx * dx + dy * dy + dz * dz) < 0.3f - radius;
+	}
+	cont->unmapParticleData();
+	CHECK(finite);
+	//fell from y >= 1 onto the sphere and the plane, none went through either
+	CHECK(highest < 1.0f);
+	CHECK(lowest > -radius);
+	CHECK(!inside);
+	CHECK(cont->activeCount() == n);
+}
+
+/// two "networks" make and drop meshes on the shared cpu backend while a third destroys a container, all under the guard
+static void testCpuBackendThreads() {
+	NvFlexHCpuBackend* backend = NvFlexHCpuBackend::instance();
+	std::unique_ptr<NvFlexHContainer> doomed(backend->createContainer(64, 0));
+	const float lower[3] = { 0.0f, 0.0f, 0.0f }, upper[3] = { 1.0f, 1.0f, 1.0f };
+	const int rounds = 500;
+	std::vector<NvFlexTriangleMeshId> ids[2];
+	auto network = [&](std::vector<NvFlexTriangleMeshId>& made) {
+		for (int r = 0; r < rounds; ++r) {
+			NvFlexHContextGuard guard(backend);
+			NvFlexTriangleMeshId id = backend->createTriangleMesh();
+			NvFlexHTriangleMeshData mdat = backend->mapTriangleMesh(id, 3, 1, false);
+			for (int i = 0; i < 3; ++i) {
+				mdat.vertices[i] = Vec3(float(i == 1), float(i == 2), 0.0f);
+				mdat.triangles[i] = i;
+			}
+			backend->unmapTriangleMesh(id, lower, upper);
+			if (r & 1)backend->destroyTriangleMesh(id);
+			else made.push_back(id);
+		}
+	};
+	std::thread a(network, std::ref(ids[0])), b(network, std::ref(ids[1]));
+	std::thread c([&doomed] { doomed.reset(); });
+	a.join();
+	b.join();
+	c.join();
+
+	NvFlexHContextGuard guard(backend);
+	for (int t = 0; t < 2; ++t) {
+		CHECK(ids[t].size() == size_t(rounds / 2));
+		for (size_t i = 0; i < ids[t].size(); ++i) {
+			const NvFlexHCpuBackend::TriangleMesh* mesh = backend->triangleMesh(ids[t][i]);
+			CHECK(mesh != NULL && mesh->triangles.size() == 3);
+			backend->destroyTriangleMesh(ids[t][i]);
+		}
+	}
+	//ids are unique across threads
+	std::vector<NvFlexTriangleMeshId> all(ids[0]);
+	all.insert(all.end(), ids[1].begin(), ids[1].end());
+	std::sort(all.begin(), all.end());
+	CHECK(std::adjacent_find(all.begin(), all.end()) == all.end());
+}
+
+
+int main() {
+	testFlatMap();
+	testCollisionData();
+	testTriangleMeshUpdate();
+	testIndexMap();
+	testMemberMaps();
+	testStateCache();
+	testCpuTick();
+	testCpuBackendThreads();
+	if (failures > 0) {
+		fprintf(stderr, "%d checks failed\n", failures);
+		return 1;
+	}
+	printf("all checks passed\n");
+	return 0;
+}
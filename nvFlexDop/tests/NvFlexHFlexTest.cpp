@@ -0,0 +1,141 @@
+// Checks of the NvFlex backend that need a cuda device: pipelining keeps host particle buffers in step with the device.
+// Built when the FleX libraries are found, exits with 77 (skipped for ctest) if flex can't start on this machine.
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <vector>
+
+#include "NvFlexHFlexBackend.h"
+
+
+static int failures = 0;
+
+#define CHECK(cond) do { if (!(cond)) { fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); ++failures; } } while (0)
+
+
+/// a falling cube of 8 particles, one shape matching cluster over all of them if clusters is set
+static void setupCube(NvFlexHContainer* cont, std::vector<int>& idx, bool clusters) {
+	const int n = 8;
+	idx.resize(n);
+	CHECK(cont->allocParticles(n, idx.data()) == n);
+	NvFlexHParticleData pdat = cont->mapParticleData();
+	for (int i = 0; i < n; ++i) {
+		const int p = idx[i];
+		pdat.particles[4 * p + 0] = (i & 1) * 0.1f;
+		pdat.particles[4 * p + 1] = 1.0f + (i >> 1 & 1) * 0.1f;
+		pdat.particles[4 * p + 2] = (i >> 2 & 1) * 0.1f;
+		pdat.particles[4 * p + 3] = 1.0f;
+		for (int c = 0; c < 4; ++c)pdat.restParticles[4 * p + c] = c < 3 ? pdat.particles[4 * p + c] : 1.0f;
+		pdat.velocities[3 * p + 0] = pdat.velocities[3 * p + 1] = pdat.velocities[3 * p + 2] = 0.0f;
+		pdat.phases[p] = NvFlexMakePhase(0, 0);
+	}
+	cont->unmapParticleData();
+	cont->pushParticlesToDevice();
+
+	if (clusters) {
+		cont->resizeRigidData(1, n);
+		NvFlexHRigidData rdat = cont->mapRigidData();
+		rdat.offsets[0] = 0;
+		rdat.offsets[1] = n;
+		for (int i = 0; i < n; ++i) {
+			rdat.indices[i] = idx[i];
+			rdat.restPositions[3 * i + 0] = (i & 1) * 0.1f - 0.05f;
+			rdat.restPositions[3 * i + 1] = (i >> 1 & 1) * 0.1f - 0.05f;
+			rdat.restPositions[3 * i + 2] = (i >> 2 & 1) * 0.1f - 0.05f;
+			for (int c = 0; c < 4; ++c)rdat.restNormals[4 * i + c] = 0.0f;
+		}
+		rdat.stiffness[0] = 1.0f;
+		rdat.thresholds[0] = 0.0f;
+		rdat.creeps[0] = 0.0f;
+		rdat.rotations[0] = rdat.rotations[1] = rdat.rotations[2] = 0.0f;
+		rdat.rotations[3] = 1.0f;
+		rdat.translations[0] = rdat.translations[2] = 0.05f;
+		rdat.translations[1] = 1.05f;
+		cont->unmapRigidData();
+		cont->pushRigidsToDevice();
+	}
+
+	NvFlexParams params;
+	memset(&params, 0, sizeof(params));
+	params.gravity[1] = -9.8f;
+	params.radius = 0.1f;
+	params.solidRestDistance = 0.09f;
+	params.fluidRestDistance = 0.05f;
+	params.numIterations = 3;
+	params.relaxationFactor = 1.0f;
+	params.maxSpeed = 1e9f;
+	params.maxAcceleration = 1e9f;
+	params.shapeCollisionMargin = 0.01f;
+	params.particleCollisionMargin = 0.01f;
+	cont->setParams(params);
+}
+
+/// steps the way SIM_NvFlexSolver does in pipelined mode when nothing changes, then changes v only:
+/// positions in host buffers must be the ones last exported, not whatever a pull left there long ago
+static void testPipelinedIngest(NvFlexHBackend* backend, bool clusters) {
+	NvFlexHContextGuard guard(backend);
+	std::unique_ptr<NvFlexHContainer> cont(backend->createContainer(64, 0));
+	CHECK(cont->supportsPipelining());
+	std::vector<int> idx;
+	setupCube(cont.get(), idx, clusters);
+	const float dt = 1.0f / 24.0f;
+	const int substeps = 2;
+
+	//one plain step, so host buffers hold a pulled state that gets old while pipelining
+	cont->tick(dt, substeps);
+	cont->pullParticlesFromDevice();
+
+	std::vector<float> exported(4 * idx.size());
+	cont->setStagedRestPull(true);
+	for (int step = 0; step < 10; ++step) {
+		if (cont->hasSpeculativeTick())cont->acceptSpeculativeTick();
+		else cont->tick(dt, substeps);
+		cont->pullAndSpeculate(dt, substeps);
+		CHECK(cont->hasSpeculativeTick() == !clusters);
+		NvFlexHParticleData staged = cont->mapStagedParticleData();
+		for (size_t i = 0; i < idx.size(); ++i)memcpy(&exported[4 * i], staged.particles + 4 * idx[i], sizeof(float) * 4);
+		//rest is staged for the cache, it's what setupCube wrote
+		CHECK(staged.restParticles != NULL);
+		for (size_t i = 0; i < idx.size(); ++i)CHECK(staged.restParticles[4 * idx[i] + 1] == 1.0f + (i >> 1 & 1) * 0.1f);
+		cont->unmapStagedParticleData();
+	}
+
+	//v changed: speculation goes, then only velocities are written and everything is pushed
+	if (cont->hasSpeculativeTick())cont->discardSpeculativeTick();
+	NvFlexHParticleData pdat = cont->mapParticleData();
+	for (size_t i = 0; i < idx.size(); ++i) {
+		CHECK(memcmp(pdat.particles + 4 * idx[i], &exported[4 * i], sizeof(float) * 4) == 0);
+		pdat.velocities[3 * idx[i] + 0] = 1.0f;
+	}
+	cont->unmapParticleData();
+	cont->pushParticlesToDevice();
+	cont->tick(dt, substeps);
+	cont->pullParticlesFromDevice();
+
+	//one tick on from the exported state: moved along x and kept falling
+	pdat = cont->mapParticleData();
+	for (size_t i = 0; i < idx.size(); ++i) {
+		const float* p = pdat.particles + 4 * idx[i];
+		CHECK(p[0] > exported[4 * i + 0]);
+		CHECK(p[1] < exported[4 * i + 1]);
+	}
+	cont->unmapParticleData();
+}
+
+
+int main() {
+	NvFlexHBackend* backend = NvFlexHFlexBackend::instance();
+	if (backend == NULL) {
+		printf("no flex device, skipped\n");
+		return 77;
+	}
+	testPipelinedIngest(backend, false);
+	testPipelinedIngest(backend, true);
+	NvFlexHFlexBackend::shutdown();
+	if (failures > 0) {
+		fprintf(stderr, "%d checks failed\n", failures);
+		return 1;
+	}
+	printf("all checks passed\n");
+	return 0;
+}